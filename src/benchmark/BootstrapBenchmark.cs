@@ -0,0 +1,117 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="BootstrapBenchmark.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using System.Threading;
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation.Benchmarks
+{
+    /// <summary>
+    /// Time from process start to Main and to the first request that would be traced, without the profiler
+    /// and with the profiler in the eager and the deferred bootstrap mode. The profiler calls the agent at the
+    /// top of the child's Main, as it does in any application. A request is traceable once the agent has
+    /// subscribed to the "Microsoft.AspNetCore" listener, the check ASP.NET Core hosting makes for every request.
+    /// </summary>
+    internal static class BootstrapBenchmark
+    {
+        private const int Runs = 20;
+
+        private const string HostingListenerName = "Microsoft.AspNetCore";
+
+        private const string RequestActivityName = "Microsoft.AspNetCore.Hosting.HttpRequestIn";
+
+        private const int TraceableTimeoutMilliseconds = 30000;
+
+        public static void Run()
+        {
+#if NET45
+            Console.WriteLine("the bootstrap modes apply to .NET Core, run this benchmark on netcoreapp2.0");
+#else
+            var eager = ProfiledProcess.GetProfilerEnvironment();
+            var deferred = ProfiledProcess.GetProfilerEnvironment();
+            deferred["AWS_XRAY_PROFILER_DEFERRED_BOOTSTRAP"] = "true";
+
+            Report("no profiler", new Dictionary<string, string>());
+            Report("profiler, eager bootstrap", eager);
+            Report("profiler, deferred bootstrap", deferred);
+#endif
+        }
+
+        /// <summary>
+        /// Reports when Main starts, then when a request arriving at that moment would be traced, or -1.
+        /// </summary>
+        public static void RunChild()
+        {
+            ProfiledProcess.ReportSinceStart();
+
+            var hosting = new DiagnosticListener(HostingListenerName);
+            var waiting = Stopwatch.StartNew();
+
+            while (!hosting.IsEnabled(RequestActivityName))
+            {
+                if (waiting.ElapsedMilliseconds > TraceableTimeoutMilliseconds)
+                {
+                    Console.WriteLine((-1.0).ToString("F3", CultureInfo.InvariantCulture));
+                    return;
+                }
+
+                Thread.Sleep(1);
+            }
+
+            ProfiledProcess.ReportSinceStart();
+        }
+
+        private static void Report(string name, IDictionary<string, string> environment)
+        {
+            bool profiled = environment.Count > 0;
+            var timesToMain = new List<double>();
+            var timesToTraceable = new List<double>();
+
+            // The first run warms the file cache of the runtime's own assemblies and is left out
+            ProfiledProcess.Run(profiled ? "bootstrap" : "startup", environment);
+
+            for (int i = 0; i < Runs; i++)
+            {
+                // Without the profiler nothing subscribes, so only the time to Main is measured
+                double[] values = ProfiledProcess.Run(profiled ? "bootstrap" : "startup", environment);
+                timesToMain.Add(values[0]);
+
+                if (profiled && values[1] >= 0)
+                {
+                    timesToTraceable.Add(values[1]);
+                }
+            }
+
+            if (!profiled)
+            {
+                Console.WriteLine("{0,-40} time to Main {1,8:F1} ms median of {2}", name, ProfiledProcess.Median(timesToMain), Runs);
+            }
+            else if (timesToTraceable.Count == 0)
+            {
+                Console.WriteLine("{0,-40} time to Main {1,8:F1} ms, no request became traceable", name, ProfiledProcess.Median(timesToMain));
+            }
+            else
+            {
+                Console.WriteLine("{0,-40} time to Main {1,8:F1} ms, to first traced request {2,8:F1} ms, median of {3}",
+                    name, ProfiledProcess.Median(timesToMain), ProfiledProcess.Median(timesToTraceable), timesToTraceable.Count);
+            }
+        }
+    }
+}
@@ -0,0 +1,112 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="ClockBenchmark.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+using System;
+using System.Diagnostics;
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation.Benchmarks
+{
+    /// <summary>
+    /// Cost per call and observed resolution of the profiler's clock against DateTime.UtcNow and Stopwatch,
+    /// and how far the profiler's clock drifts from DateTime.UtcNow over the run.
+    /// </summary>
+    internal static class ClockBenchmark
+    {
+        private const int Iterations = 10000000;
+
+        private const int ResolutionSamples = 1000000;
+
+        public static void Run()
+        {
+            double driftBefore = GetOffsetMicroseconds();
+
+            long sink = 0;
+            var stopwatch = Stopwatch.StartNew();
+            for (int i = 0; i < Iterations; i++)
+            {
+                sink += DateTime.UtcNow.Ticks;
+            }
+
+            stopwatch.Stop();
+            Program.Report("DateTime.UtcNow", Iterations, stopwatch);
+
+            stopwatch.Restart();
+            for (int i = 0; i < Iterations; i++)
+            {
+                sink += Stopwatch.GetTimestamp();
+            }
+
+            stopwatch.Stop();
+            Program.Report("Stopwatch.GetTimestamp", Iterations, stopwatch);
+
+            double seconds = 0;
+            stopwatch.Restart();
+            for (int i = 0; i < Iterations; i++)
+            {
+                seconds += ProfilerExports.GetXRayTimestamp();
+            }
+
+            stopwatch.Stop();
+            Program.Report("GetXRayTimestamp", Iterations, stopwatch);
+
+            stopwatch.Restart();
+            for (int i = 0; i < Iterations; i++)
+            {
+                sink += ProfilerExports.GetXRayTimestampMicroseconds();
+            }
+
+            stopwatch.Stop();
+            Program.Report("GetXRayTimestampMicroseconds", Iterations, stopwatch);
+
+            Console.WriteLine("resolution DateTime.UtcNow {0:F3} us, Stopwatch {1:F3} us, GetXRayTimestampMicroseconds {2:F3} us",
+                GetResolution(() => DateTime.UtcNow.Ticks) / 10.0,
+                GetResolution(Stopwatch.GetTimestamp) * 1000000.0 / Stopwatch.Frequency,
+                GetResolution(ProfilerExports.GetXRayTimestampMicroseconds));
+
+            double driftAfter = GetOffsetMicroseconds();
+            Console.WriteLine("offset from DateTime.UtcNow {0:F0} us before, {1:F0} us after ({2} {3})", driftBefore, driftAfter, sink != 0, seconds != 0);
+        }
+
+        /// <summary>
+        /// Smallest step between successive reads of a clock, in its own units.
+        /// </summary>
+        private static long GetResolution(Func<long> read)
+        {
+            long smallest = long.MaxValue;
+            long last = read();
+
+            for (int i = 0; i < ResolutionSamples; i++)
+            {
+                long now = read();
+                if (now != last && now - last < smallest)
+                {
+                    smallest = now - last;
+                }
+
+                last = now;
+            }
+
+            return smallest;
+        }
+
+        private static double GetOffsetMicroseconds()
+        {
+            long utcNow = (DateTime.UtcNow - new DateTime(1970, 1, 1, 0, 0, 0, DateTimeKind.Utc)).Ticks / 10;
+            return ProfilerExports.GetXRayTimestampMicroseconds() - utcNow;
+        }
+    }
+}
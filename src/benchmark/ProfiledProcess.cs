@@ -0,0 +1,125 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="ProfiledProcess.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using System.Reflection;
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation.Benchmarks
+{
+    /// <summary>
+    /// Starts this program again as a child process, with or without the profiler attached, and reads the
+    /// milliseconds the child reports from the moment it was started. The child is run through the same host as the parent.
+    /// </summary>
+    internal static class ProfiledProcess
+    {
+        internal const string ChildArgument = "--child";
+
+        private const string ProfilerGuid = "{AE47A175-390A-4F13-84CB-7169CEBF064A}";
+
+        private const string ProfilerFileName = "ClrProfiler.dll";
+
+        private const string StartedVariable = "AWS_XRAY_BENCHMARK_STARTED";
+
+        /// <summary>
+        /// Environment that attaches the profiler copied next to the benchmarks, on .NET Framework and .NET Core.
+        /// </summary>
+        internal static Dictionary<string, string> GetProfilerEnvironment()
+        {
+            string profilerPath = Path.Combine(AppDomain.CurrentDomain.BaseDirectory, ProfilerFileName);
+            if (!File.Exists(profilerPath))
+            {
+                throw new FileNotFoundException("Build the profiler before running this benchmark", profilerPath);
+            }
+
+            return new Dictionary<string, string>
+            {
+                { "COR_ENABLE_PROFILING", "1" },
+                { "COR_PROFILER", ProfilerGuid },
+                { "COR_PROFILER_PATH", profilerPath },
+                { "CORECLR_ENABLE_PROFILING", "1" },
+                { "CORECLR_PROFILER", ProfilerGuid },
+                { "CORECLR_PROFILER_PATH", profilerPath },
+            };
+        }
+
+        /// <summary>
+        /// Runs the child scenario once and returns the milliseconds it printed, one value per line.
+        /// </summary>
+        internal static double[] Run(string scenario, IDictionary<string, string> environment)
+        {
+            string entryAssembly = Assembly.GetEntryAssembly().Location;
+            string host = Process.GetCurrentProcess().MainModule.FileName;
+            bool hosted = !string.Equals(Path.GetFileName(host), Path.GetFileName(entryAssembly), StringComparison.OrdinalIgnoreCase);
+
+            var startInfo = new ProcessStartInfo
+            {
+                FileName = hosted ? host : entryAssembly,
+                Arguments = (hosted ? "\"" + entryAssembly + "\" " : string.Empty) + ChildArgument + " " + scenario,
+                UseShellExecute = false,
+                RedirectStandardOutput = true,
+            };
+
+            foreach (var variable in environment)
+            {
+                startInfo.EnvironmentVariables[variable.Key] = variable.Value;
+            }
+
+            // Stopwatch timestamps are machine wide, so the child measures from this one
+            startInfo.EnvironmentVariables[StartedVariable] = Stopwatch.GetTimestamp().ToString(CultureInfo.InvariantCulture);
+
+            using (var process = Process.Start(startInfo))
+            {
+                var values = new List<double>();
+                string line;
+
+                while ((line = process.StandardOutput.ReadLine()) != null)
+                {
+                    values.Add(double.Parse(line, CultureInfo.InvariantCulture));
+                }
+
+                process.WaitForExit();
+                if (process.ExitCode != 0)
+                {
+                    throw new InvalidOperationException("Child scenario " + scenario + " exited with " + process.ExitCode);
+                }
+
+                return values.ToArray();
+            }
+        }
+
+        /// <summary>
+        /// Prints the elapsed milliseconds since the parent started this process, for the parent to read.
+        /// </summary>
+        internal static void ReportSinceStart()
+        {
+            long started = long.Parse(Environment.GetEnvironmentVariable(StartedVariable), CultureInfo.InvariantCulture);
+            double elapsed = (Stopwatch.GetTimestamp() - started) * 1000.0 / Stopwatch.Frequency;
+            Console.WriteLine(elapsed.ToString("F3", CultureInfo.InvariantCulture));
+        }
+
+        internal static double Median(List<double> values)
+        {
+            values.Sort();
+            int middle = values.Count / 2;
+            return values.Count % 2 == 1 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+        }
+    }
+}
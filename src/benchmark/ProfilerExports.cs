@@ -0,0 +1,63 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="ProfilerExports.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+using System.Runtime.InteropServices;
+using System.Security;
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation.Benchmarks
+{
+    /// <summary>
+    /// Exports of the profiler library that the benchmarks compare against their managed counterparts.
+    /// </summary>
+    [SuppressUnmanagedCodeSecurity]
+    internal static class ProfilerExports
+    {
+        private const string Library = "ClrProfiler";
+
+        [DllImport(Library, CallingConvention = CallingConvention.StdCall)]
+        internal static extern double GetXRayTimestamp();
+
+        [DllImport(Library, CallingConvention = CallingConvention.StdCall)]
+        internal static extern long GetXRayTimestampMicroseconds();
+
+        [DllImport(Library, CallingConvention = CallingConvention.StdCall)]
+        [return: MarshalAs(UnmanagedType.Bool)]
+        internal static extern bool IsXRayThreadPoolStarving();
+
+        [DllImport(Library, CallingConvention = CallingConvention.StdCall)]
+        internal static extern int GetXRayThreadPoolStatus(out ThreadPoolStatus status);
+    }
+
+    /// <summary>
+    /// The profiler's ThreadPoolStatus, field for field.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct ThreadPoolStatus
+    {
+        public uint LiveThreads;
+        public uint PoolThreads;
+        public uint BlockedThreads;
+        public uint Starving;
+        public ulong CreatedThreads;
+        public ulong DestroyedThreads;
+        public double InjectionRate;
+        public ulong LongestBlockedMilliseconds;
+        public ulong StarvationEpisodes;
+        public double StarvingSince;
+        public ulong LongestBlockedSegment;
+    }
+}
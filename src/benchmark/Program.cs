@@ -0,0 +1,82 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="Program.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation.Benchmarks
+{
+    /// <summary>
+    /// Runs the benchmarks named on the command line, or all of them. Exports of the profiler are called
+    /// from ClrProfiler.dll, which the build copies next to the benchmarks once the profiler has been built.
+    /// </summary>
+    public static class Program
+    {
+        private static readonly Dictionary<string, Action> Benchmarks = new Dictionary<string, Action>(StringComparer.OrdinalIgnoreCase)
+        {
+            { "bootstrap", BootstrapBenchmark.Run },
+            { "clock", ClockBenchmark.Run },
+            { "sql", SqlCommandBenchmark.Run },
+            { "startup", StartupBenchmark.Run },
+            { "starvation", StarvationBenchmark.Run },
+        };
+
+        // Scenarios that benchmarks run in a child process, see ProfiledProcess
+        private static readonly Dictionary<string, Action> Children = new Dictionary<string, Action>(StringComparer.OrdinalIgnoreCase)
+        {
+            { "bootstrap", BootstrapBenchmark.RunChild },
+            { "sql", SqlCommandBenchmark.RunChild },
+            { "startup", StartupBenchmark.RunChild },
+            { "starvation", StarvationBenchmark.RunChild },
+        };
+
+        public static int Main(string[] args)
+        {
+            if (args.Length == 2 && args[0] == ProfiledProcess.ChildArgument)
+            {
+                Children[args[1]]();
+                return 0;
+            }
+
+            var names = args.Length > 0 ? args : new List<string>(Benchmarks.Keys).ToArray();
+
+            foreach (var name in names)
+            {
+                if (!Benchmarks.TryGetValue(name, out var benchmark))
+                {
+                    Console.Error.WriteLine("Unknown benchmark {0}, expected one of: {1}", name, string.Join(", ", Benchmarks.Keys));
+                    return 1;
+                }
+
+                Console.WriteLine("== {0}", name);
+                benchmark();
+            }
+
+            return 0;
+        }
+
+        /// <summary>
+        /// Prints the cost per call of a loop that ran the given number of iterations.
+        /// </summary>
+        internal static void Report(string name, long iterations, Stopwatch stopwatch)
+        {
+            double nanoseconds = stopwatch.Elapsed.TotalMilliseconds * 1000000.0 / iterations;
+            Console.WriteLine("{0,-40} {1,10:F1} ns/call {2,14:N0} calls/s", name, nanoseconds, iterations / stopwatch.Elapsed.TotalSeconds);
+        }
+    }
+}
@@ -0,0 +1,183 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="SqlCommandBenchmark.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+using System;
+#if NET45
+using Amazon.XRay.Recorder.Core;
+using Amazon.XRay.Recorder.Core.Internal.Entities;
+using System.Collections.Generic;
+using System.Data.SqlClient;
+using System.Diagnostics;
+using System.Globalization;
+#endif
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation.Benchmarks
+{
+    /// <summary>
+    /// Throughput of SqlCommand calls traced by the SqlEventListener and by the hooks the profiler redirects
+    /// them to, next to the same calls untraced. The commands run against a local SQL Server stand-in, LocalDB
+    /// unless AWS_XRAY_BENCHMARK_SQL_CONNECTION names another, so the round trip stays short next to the cost
+    /// of tracing. The hooks are called directly, the way a rewritten call site calls them, in a child process
+    /// run under the profiler with AWS_XRAY_PROFILER_SQL_COMMANDS on, so that they get the profiler's records.
+    /// </summary>
+    internal static class SqlCommandBenchmark
+    {
+        private const string ConnectionVariable = "AWS_XRAY_BENCHMARK_SQL_CONNECTION";
+
+        private const string SqlCommandsVariable = "AWS_XRAY_PROFILER_SQL_COMMANDS";
+
+        private const string LocalDbConnection = @"Data Source=(localdb)\MSSQLLocalDB;Integrated Security=true";
+
+        private const int Rounds = 5;
+
+        private const int CommandsPerRound = 20000;
+
+        private const int CommandsPerSegment = 50;
+
+        public static void Run()
+        {
+#if !NET45
+            Console.WriteLine("the SqlCommand hooks apply to .NET Framework, run this benchmark on net452");
+#else
+            string connectionString = Environment.GetEnvironmentVariable(ConnectionVariable) ?? LocalDbConnection;
+
+            using (var connection = new SqlConnection(connectionString))
+            {
+                try
+                {
+                    connection.Open();
+                }
+                catch (Exception e) when (e is SqlException || e is InvalidOperationException)
+                {
+                    Console.WriteLine("no SQL Server at {0}, set {1}: {2}", connection.DataSource, ConnectionVariable, e.Message);
+                    return;
+                }
+            }
+
+            var environment = ProfiledProcess.GetProfilerEnvironment();
+            environment[SqlCommandsVariable] = "true";
+            environment[ConnectionVariable] = connectionString;
+
+            double[] nanoseconds = ProfiledProcess.Run("sql", environment);
+
+            Report("untraced", nanoseconds[0]);
+            Report("SqlEventListener", nanoseconds[1]);
+
+            if (nanoseconds[2] < 0)
+            {
+                Console.WriteLine("the profiler handed out no SqlCommand records, check that it runs on .NET Framework");
+                return;
+            }
+
+            Report("SqlCommandHooks", nanoseconds[2]);
+#endif
+        }
+
+        /// <summary>
+        /// Prints the median nanoseconds per command of each setup, -1 for the hooks when they went untraced.
+        /// </summary>
+        public static void RunChild()
+        {
+#if NET45
+            string connectionString = Environment.GetEnvironmentVariable(ConnectionVariable);
+
+            using (var connection = new SqlConnection(connectionString))
+            {
+                connection.Open();
+
+                var command = new SqlCommand("SELECT 1", connection);
+                var untraced = new List<double>();
+                var listened = new List<double>();
+                var hooked = new List<double>();
+
+                // Only calls that go through the hooks are traced by them
+                SqlCommandHooks.Enable();
+                bool timed = IsTimedByProfiler();
+
+                // The setups take turns, so a server that speeds up or slows down weighs on all of them
+                for (int round = 0; round < Rounds; round++)
+                {
+                    untraced.Add(Measure(() => command.ExecuteScalar()));
+
+                    using (new SqlEventListener())
+                    {
+                        listened.Add(Measure(() => command.ExecuteScalar()));
+                    }
+
+                    hooked.Add(Measure(() => SqlCommandHooks.ExecuteScalar(command)));
+                }
+
+                Print(ProfiledProcess.Median(untraced));
+                Print(ProfiledProcess.Median(listened));
+                Print(timed ? ProfiledProcess.Median(hooked) : -1);
+            }
+#endif
+        }
+
+#if NET45
+        /// <summary>
+        /// True when the profiler hands out records, which it only does with the redirected calls in place.
+        /// </summary>
+        private static bool IsTimedByProfiler()
+        {
+            uint record = Utils.ProfilerExports.BeginXRaySqlCommand();
+            if (record == 0)
+            {
+                return false;
+            }
+
+            Utils.ProfilerExports.EndXRaySqlCommand(record, false, out _);
+            return true;
+        }
+
+        /// <summary>
+        /// Nanoseconds per command, run in sampled segments as a traced request would run them.
+        /// </summary>
+        private static double Measure(Func<object> execute)
+        {
+            var recorder = AWSXRayRecorder.Instance;
+            var stopwatch = Stopwatch.StartNew();
+
+            for (int i = 0; i < CommandsPerRound; i += CommandsPerSegment)
+            {
+                recorder.BeginSegment("SqlCommandBenchmark", TraceId.NewId());
+
+                for (int j = 0; j < CommandsPerSegment; j++)
+                {
+                    execute();
+                }
+
+                recorder.EndSegment();
+            }
+
+            stopwatch.Stop();
+
+            return stopwatch.Elapsed.TotalMilliseconds * 1000000.0 / CommandsPerRound;
+        }
+
+        private static void Print(double nanoseconds)
+        {
+            Console.WriteLine(nanoseconds.ToString("F3", CultureInfo.InvariantCulture));
+        }
+
+        private static void Report(string name, double nanoseconds)
+        {
+            Console.WriteLine("{0,-40} {1,10:F1} ns/call {2,14:N0} calls/s", name, nanoseconds, 1000000000.0 / nanoseconds);
+        }
+#endif
+    }
+}
@@ -0,0 +1,86 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="StartupBenchmark.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation.Benchmarks
+{
+    /// <summary>
+    /// Time from process start to Main without the profiler, and with the profiler on a cold and on a warm
+    /// rewrite cache. A cold run deletes the cache file first, so the entry point is found by name and the
+    /// rewrite is built and saved; a warm run replays the saved body.
+    /// </summary>
+    internal static class StartupBenchmark
+    {
+        private const int Runs = 20;
+
+        public static void Run()
+        {
+            string cachePath = Path.Combine(Path.GetTempPath(), "xray-benchmark-" + Guid.NewGuid().ToString("N") + ".cache");
+
+            var withoutProfiler = new Dictionary<string, string>();
+            var withProfiler = ProfiledProcess.GetProfilerEnvironment();
+            var withCache = ProfiledProcess.GetProfilerEnvironment();
+            withCache["AWS_XRAY_PROFILER_CACHE_PATH"] = cachePath;
+
+            try
+            {
+                Report("no profiler", () => { }, withoutProfiler);
+                Report("profiler, no cache", () => { }, withProfiler);
+                Report("profiler, cold cache", () => File.Delete(cachePath), withCache);
+
+                if (!File.Exists(cachePath))
+                {
+                    Console.WriteLine("the profiler saved no cache file, the warm run would repeat the cold one");
+                    return;
+                }
+
+                Report("profiler, warm cache", () => { }, withCache);
+            }
+            finally
+            {
+                File.Delete(cachePath);
+            }
+        }
+
+        /// <summary>
+        /// Runs the child, which reports when Main starts.
+        /// </summary>
+        public static void RunChild()
+        {
+            ProfiledProcess.ReportSinceStart();
+        }
+
+        private static void Report(string name, Action beforeRun, IDictionary<string, string> environment)
+        {
+            var timesToMain = new List<double>();
+
+            // The first run warms the file cache of the runtime's own assemblies and is left out
+            ProfiledProcess.Run("startup", environment);
+
+            for (int i = 0; i < Runs; i++)
+            {
+                beforeRun();
+                timesToMain.Add(ProfiledProcess.Run("startup", environment)[0]);
+            }
+
+            Console.WriteLine("{0,-40} time to Main {1,8:F1} ms median of {2}", name, ProfiledProcess.Median(timesToMain), Runs);
+        }
+    }
+}
@@ -0,0 +1,159 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="StarvationBenchmark.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using System.Threading;
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation.Benchmarks
+{
+    /// <summary>
+    /// A synthetic app that starves its own thread pool, run with the profiler's starvation detector on.
+    /// The child first keeps every pool thread busy on CPU work, which must not be flagged, then queues far
+    /// more work items than the pool has threads, each blocking on an event, which must be flagged once the
+    /// threshold has passed, and finally releases them, which must clear the signal.
+    /// </summary>
+    internal static class StarvationBenchmark
+    {
+        private const int Runs = 5;
+
+        private const int ThresholdMilliseconds = 500;
+
+        private const int BusyMilliseconds = 3000;
+
+        private const int DetectionTimeoutMilliseconds = 30000;
+
+        private const int PollMilliseconds = 5;
+
+        private const int BlockedItemsPerProcessor = 16;
+
+        public static void Run()
+        {
+            var environment = ProfiledProcess.GetProfilerEnvironment();
+            environment["AWS_XRAY_PROFILER_STARVATION_THRESHOLD"] = ThresholdMilliseconds.ToString();
+
+            var flagged = new List<double>();
+            var detected = new List<double>();
+            var cleared = new List<double>();
+            int missed = 0;
+
+            for (int i = 0; i < Runs; i++)
+            {
+                double[] values = ProfiledProcess.Run("starvation", environment);
+                flagged.Add(values[0]);
+
+                if (values[1] < 0 || values[2] < 0)
+                {
+                    missed++;
+                    continue;
+                }
+
+                detected.Add(values[1]);
+                cleared.Add(values[2]);
+            }
+
+            Console.WriteLine("threshold {0} ms, {1} processors, {2} blocked work items", ThresholdMilliseconds, Environment.ProcessorCount,
+                Environment.ProcessorCount * BlockedItemsPerProcessor);
+            Console.WriteLine("{0,-40} {1,8:F1} ms median of {2}", "flagged while busy, not starving", ProfiledProcess.Median(flagged), Runs);
+
+            if (detected.Count > 0)
+            {
+                Console.WriteLine("{0,-40} {1,8:F1} ms median of {2}", "starvation to detection", ProfiledProcess.Median(detected), detected.Count);
+                Console.WriteLine("{0,-40} {1,8:F1} ms median of {2}", "release to clear", ProfiledProcess.Median(cleared), cleared.Count);
+            }
+
+            if (missed > 0)
+            {
+                Console.WriteLine("{0} of {1} runs were not flagged or not cleared within {2} ms", missed, Runs, DetectionTimeoutMilliseconds);
+            }
+        }
+
+        /// <summary>
+        /// Prints the milliseconds flagged while busy, from starvation to detection and from release to
+        /// clear, -1 for a signal that never came.
+        /// </summary>
+        public static void RunChild()
+        {
+            int processors = Environment.ProcessorCount;
+
+            // Busy: one CPU-bound item per pool thread, every one of them progressing
+            long busyUntil = Stopwatch.GetTimestamp() + BusyMilliseconds * Stopwatch.Frequency / 1000;
+            var busyDone = new CountdownEvent(processors);
+            for (int i = 0; i < processors; i++)
+            {
+                ThreadPool.QueueUserWorkItem(_ =>
+                {
+                    double sink = 0;
+                    while (Stopwatch.GetTimestamp() < busyUntil)
+                    {
+                        sink += Math.Sqrt(sink + 1);
+                    }
+
+                    busyDone.Signal();
+                });
+            }
+
+            double flagged = 0;
+            var busy = Stopwatch.StartNew();
+            while (!busyDone.IsSet)
+            {
+                long before = busy.ElapsedTicks;
+                bool starving = ProfilerExports.IsXRayThreadPoolStarving();
+                Thread.Sleep(PollMilliseconds);
+                flagged += starving ? (busy.ElapsedTicks - before) * 1000.0 / Stopwatch.Frequency : 0;
+            }
+
+            // Starved: every pool thread blocks, and the queue holds many more items than threads
+            var release = new ManualResetEventSlim(false);
+            var starved = Stopwatch.StartNew();
+            for (int i = 0; i < processors * BlockedItemsPerProcessor; i++)
+            {
+                ThreadPool.QueueUserWorkItem(_ => release.Wait());
+            }
+
+            double detection = WaitFor(true, starved);
+
+            var released = Stopwatch.StartNew();
+            release.Set();
+            double clear = detection < 0 ? -1 : WaitFor(false, released);
+
+            ProfilerExports.GetXRayThreadPoolStatus(out var status);
+
+            Console.WriteLine(flagged.ToString("F3", CultureInfo.InvariantCulture));
+            Console.WriteLine(detection.ToString("F3", CultureInfo.InvariantCulture));
+            Console.WriteLine(clear.ToString("F3", CultureInfo.InvariantCulture));
+            Console.Error.WriteLine("pool {0} threads, {1} created, {2} starvation episodes", status.PoolThreads, status.CreatedThreads, status.StarvationEpisodes);
+        }
+
+        private static double WaitFor(bool starving, Stopwatch stopwatch)
+        {
+            while (ProfilerExports.IsXRayThreadPoolStarving() != starving)
+            {
+                if (stopwatch.ElapsedMilliseconds > DetectionTimeoutMilliseconds)
+                {
+                    return -1;
+                }
+
+                Thread.Sleep(PollMilliseconds);
+            }
+
+            return stopwatch.Elapsed.TotalMilliseconds;
+        }
+    }
+}
@@ -0,0 +1,845 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <algorithm>
+#include "stdafx.h"
+#include "CallSites.h"
+#include "Environment.h"
+#include "ILWriter.h"
+#include "Journal.h"
+#include "Recorder.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#define OperandNone 0
+#define OperandSwitch 0xFE
+#define OperandInvalid 0xFF
+#define OpcodeSwitch 0x45
+#define OpcodePrefix 0xFE
+#define OpcodeConstrained 0x16
+#define TableByteMemberRef 0x0A // high byte of a MemberRef token
+
+// Operand sizes of the one-byte CIL opcodes (ECMA-335 III), indexed by opcode
+static const BYTE OneByteOperands[] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1,                                 // 0x00 nop .. ldarga.s
+    1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,                                 // 0x10 starg.s .. ldc.i4.s
+    4, 8, 4, 8, 0xFF, 0, 0, 4, 4, 4, 0, 1, 1, 1, 1, 1,                              // 0x20 ldc.i4 .. brtrue.s
+    1, 1, 1, 1, 1, 1, 1, 1, 4, 4, 4, 4, 4, 4, 4, 4,                                 // 0x30 beq.s .. bge
+    4, 4, 4, 4, 4, 0xFE, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,                              // 0x40 bgt .. ldind.r4
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,                                 // 0x50 ldind.r8 .. and
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4,                                 // 0x60 or .. callvirt
+    4, 4, 4, 4, 4, 4, 0, 0xFF, 0xFF, 4, 0, 4, 4, 4, 4, 4,                           // 0x70 cpobj .. ldsflda
+    4, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 4, 0, 4,                                 // 0x80 stsfld .. ldelema
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,                                 // 0x90 ldelem.i1 .. stelem.i8
+    0, 0, 0, 4, 4, 4, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,   // 0xA0 stelem.r4 .. unbox.any
+    0xFF, 0xFF, 0xFF, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,         // 0xB0 conv.ovf.i1 .. conv.ovf.u8
+    0xFF, 0xFF, 4, 0, 0xFF, 0xFF, 4, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // 0xC0 refanyval .. mkrefany
+    4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 1, 0,                                 // 0xD0 ldtoken .. stind.i
+    0,                                                                              // 0xE0 conv.u
+};
+
+// Operand sizes of the two-byte opcodes, indexed by the byte after the 0xFE prefix
+static const BYTE TwoByteOperands[] =
+{
+    0, 0, 0, 0, 0, 0, 4, 4, 0xFF, 2, 2, 2, 2, 2, 2, 0,                              // 0xFE00 arglist .. localloc
+    0xFF, 0, 1, 0, 0, 4, 4, 0, 0, 1, 0, 0xFF, 4, 0, 0,                              // 0xFE10 endfilter .. readonly.
+};
+
+CallSiteTarget CallSites::targets[CallSitesMaximumTargets];
+ULONG CallSites::targetCount = 0;
+std::shared_mutex CallSites::modulesLock;
+std::unordered_map<ModuleID, std::shared_ptr<CallSites::CallSiteModule>> CallSites::modules;
+
+void CallSites::Initialize()
+{
+    WCHAR* value = new WCHAR[CallSitesValueLength];
+
+    if (targetCount == 0 && Environment::GetValue(CallSitesVariable, value, CallSitesValueLength))
+    {
+        WCHAR* context = NULL;
+        for (WCHAR* entry = wcstok_s(value, L";", &context); entry != NULL; entry = wcstok_s(NULL, L";", &context))
+        {
+            AddTarget(entry);
+        }
+    }
+
+    delete[] value;
+}
+
+// Overrides are called through the class that first declared them, DbCommand for most Execute methods,
+// so both classes are listed; the hooks only trace the calls made on a SqlCommand
+static const LPCWSTR SqlCommandClassNames[] = { L"System.Data.SqlClient.SqlCommand", L"System.Data.Common.DbCommand" };
+static const LPCWSTR SqlCommandMethodNames[] =
+{
+    L"ExecuteReader", L"ExecuteReaderAsync", L"ExecuteNonQuery", L"ExecuteNonQueryAsync", L"ExecuteScalar", L"ExecuteScalarAsync",
+};
+
+bool CallSites::AddSqlCommands(ICorProfilerInfo3* profilerInfo)
+{
+    if (!Environment::IsEnabled(SqlCommandsVariable))
+    {
+        return false;
+    }
+
+    // The hooks are built for .NET Framework only, where System.Data holds SqlCommand; elsewhere every
+    // redirected call would fail to bind
+    USHORT clrInstanceId = 0;
+    COR_PRF_RUNTIME_TYPE runtimeType;
+    USHORT majorVersion = 0;
+    USHORT minorVersion = 0;
+    USHORT buildNumber = 0;
+    USHORT qfeVersion = 0;
+
+    HRESULT hr = profilerInfo->GetRuntimeInformation(&clrInstanceId, &runtimeType, &majorVersion, &minorVersion, &buildNumber, &qfeVersion, 0, NULL, NULL);
+    if (FAILED(hr) || runtimeType != COR_PRF_DESKTOP_CLR)
+    {
+        return false;
+    }
+
+    for (LPCWSTR className : SqlCommandClassNames)
+    {
+        for (LPCWSTR methodName : SqlCommandMethodNames)
+        {
+            // The methods listed so far are still redirected, and their hooks still time them
+            if (targetCount >= CallSitesMaximumTargets)
+            {
+                return true;
+            }
+
+            CallSiteTarget* target = &targets[targetCount++];
+            wcscpy_s(target->className, CallSiteNameLength, className);
+            wcscpy_s(target->methodName, CallSiteNameLength, methodName);
+            wcscpy_s(target->hookClassName, CallSiteNameLength, SqlCommandsHookClassName);
+            wcscpy_s(target->hookMethodName, CallSiteNameLength, methodName);
+        }
+    }
+
+    return true;
+}
+
+static bool SplitName(LPCWSTR name, size_t length, WCHAR* className, WCHAR* methodName)
+{
+    // The method follows the last '.', which for a constructor is the one in front of "ctor"
+    LPCWSTR separator = NULL;
+    for (LPCWSTR cursor = name; cursor < name + length; cursor++)
+    {
+        if (*cursor == L'.')
+        {
+            separator = cursor;
+        }
+    }
+
+    if (separator != NULL && separator > name && separator[-1] == L'.')
+    {
+        separator--;
+    }
+
+    if (separator == NULL || separator == name || separator + 1 == name + length)
+    {
+        return false;
+    }
+
+    size_t classNameLength = separator - name;
+    size_t methodNameLength = name + length - separator - 1;
+    if (classNameLength >= CallSiteNameLength || methodNameLength >= CallSiteNameLength)
+    {
+        return false;
+    }
+
+    wcsncpy_s(className, CallSiteNameLength, name, classNameLength);
+    wcsncpy_s(methodName, CallSiteNameLength, separator + 1, methodNameLength);
+
+    return true;
+}
+
+void CallSites::AddTarget(LPWSTR value)
+{
+    LPWSTR hook = wcschr(value, L'=');
+    if (hook == NULL || targetCount >= CallSitesMaximumTargets)
+    {
+        return;
+    }
+
+    CallSiteTarget* target = &targets[targetCount];
+    if (SplitName(value, hook - value, target->className, target->methodName) &&
+        SplitName(hook + 1, wcslen(hook + 1), target->hookClassName, target->hookMethodName))
+    {
+        targetCount++;
+    }
+}
+
+bool CallSites::IsApplicationAssembly(LPCWSTR assemblyName)
+{
+    // Hooks live in the agent assembly, so redirecting inside it would turn a hook into a call to itself
+    const LPCWSTR excludedNames[] = { L"mscorlib", L"netstandard", L"System" };
+    const LPCWSTR excludedPrefixes[] = { L"System.", L"Microsoft.", L"AWSXRayRecorder" };
+
+    for (LPCWSTR name : excludedNames)
+    {
+        if (wcscmp(assemblyName, name) == 0)
+        {
+            return false;
+        }
+    }
+
+    for (LPCWSTR prefix : excludedPrefixes)
+    {
+        if (wcsncmp(assemblyName, prefix, wcslen(prefix)) == 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::shared_ptr<CallSites::CallSiteModule> CallSites::GetModule(ICorProfilerInfo3* profilerInfo, ModuleID moduleID, MetadataReader* metadataReader)
+{
+    {
+        std::shared_lock<std::shared_mutex> guard(modulesLock);
+
+        auto found = modules.find(moduleID);
+        if (found != modules.end())
+        {
+            return found->second;
+        }
+    }
+
+    LPCBYTE baseAddress = NULL;
+    AssemblyID assemblyID = 0;
+    DWORD moduleFlags = 0;
+    HRESULT hr = profilerInfo->GetModuleInfo2(moduleID, &baseAddress, 0, NULL, NULL, &assemblyID, &moduleFlags);
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteGetModuleInfo, hr);
+        return nullptr;
+    }
+
+    WCHAR assemblyName[CallSiteNameLength];
+    ULONG assemblyNameLength = 0;
+    AppDomainID appDomainID = 0;
+    ModuleID manifestModuleID = 0;
+    hr = profilerInfo->GetAssemblyInfo(assemblyID, CallSiteNameLength, &assemblyNameLength, assemblyName, &appDomainID, &manifestModuleID);
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteGetAssemblyInfo, hr);
+        return nullptr;
+    }
+
+    std::shared_ptr<CallSiteModule> module = std::make_shared<CallSiteModule>();
+    module->application = IsApplicationAssembly(assemblyName);
+
+    // Dynamic modules have no image to read, nothing in them is redirected
+    MetadataReader imageReader;
+    if (metadataReader == NULL && (moduleFlags & COR_PRF_MODULE_DYNAMIC) == 0 && imageReader.Open(baseAddress, (moduleFlags & COR_PRF_MODULE_FLAT_LAYOUT) != 0))
+    {
+        metadataReader = &imageReader;
+    }
+
+    if (module->application && metadataReader != NULL)
+    {
+        FindReferences(*metadataReader, module.get());
+    }
+
+    // A module built twice by racing threads keeps whichever table was published first
+    std::unique_lock<std::shared_mutex> guard(modulesLock);
+    return modules.emplace(moduleID, module).first->second;
+}
+
+void CallSites::FindReferences(MetadataReader& metadataReader, CallSiteModule* module)
+{
+    WCHAR className[CallSiteNameLength];
+    WCHAR methodName[CallSiteNameLength];
+    ULONG memberRefCount = metadataReader.GetRowCount(MetadataTableMemberRef);
+
+    // Rows are visited in token order, so the table comes out sorted for the binary search in Find
+    for (ULONG rid = 1; rid <= memberRefCount; rid++)
+    {
+        MetadataMemberRef memberRef;
+        if (!metadataReader.GetMemberRef(TokenFromRid(rid, mdtMemberRef), &memberRef) ||
+            TypeFromToken(memberRef.parent) != mdtTypeRef ||
+            memberRef.signatureLength == 0 ||
+            !MetadataReader::GetName(memberRef.name, methodName, CallSiteNameLength))
+        {
+            continue;
+        }
+
+        // Field references, varargs and generic method definitions are never plain call sites
+        BYTE callingConvention = memberRef.signature[0];
+        if ((callingConvention & IMAGE_CEE_CS_CALLCONV_MASK) != IMAGE_CEE_CS_CALLCONV_DEFAULT || (callingConvention & IMAGE_CEE_CS_CALLCONV_GENERIC) != 0)
+        {
+            continue;
+        }
+
+        bool hasClassName = false;
+        for (ULONG i = 0; i < targetCount; i++)
+        {
+            if (wcscmp(targets[i].methodName, methodName) != 0)
+            {
+                continue;
+            }
+
+            MetadataTypeRef typeRef;
+            if (!hasClassName && (!metadataReader.GetTypeRef(memberRef.parent, &typeRef) || !MetadataReader::GetTypeName(typeRef.nameSpace, typeRef.name, className, CallSiteNameLength)))
+            {
+                break;
+            }
+
+            hasClassName = true;
+            if (wcscmp(targets[i].className, className) != 0)
+            {
+                continue;
+            }
+
+            CallSiteReference reference;
+            reference.token = TokenFromRid(rid, mdtMemberRef);
+            reference.target = i;
+            reference.parent = memberRef.parent;
+            reference.signature = memberRef.signature;
+            reference.signatureLength = memberRef.signatureLength;
+            reference.hook = mdTokenNil;
+
+            // Instance methods are only redirected from callvirt: a call is either a base call or
+            // a value type receiver, and a hook that calls the target virtually would break both
+            if ((callingConvention & IMAGE_CEE_CS_CALLCONV_HASTHIS) == 0)
+            {
+                reference.opcode = CallSiteOpcodeCall;
+            }
+            else
+            {
+                reference.opcode = wcscmp(methodName, L".ctor") == 0 ? CallSiteOpcodeNewobj : CallSiteOpcodeCallvirt;
+            }
+
+            module->references.push_back(reference);
+            break;
+        }
+    }
+}
+
+static inline const CallSiteReference* FindReference(LPCBYTE instruction, const std::vector<CallSiteReference>& references)
+{
+    mdToken token;
+    memcpy(&token, instruction + 1, sizeof(token));
+
+    auto found = std::lower_bound(references.begin(), references.end(), token, [](const CallSiteReference& reference, mdToken token)
+    {
+        return reference.token < token;
+    });
+
+    return found != references.end() && found->token == token && found->opcode == instruction[0] ? &*found : NULL;
+}
+
+static inline bool IsCandidate(LPCBYTE instruction)
+{
+    return (instruction[0] == CallSiteOpcodeCall || instruction[0] == CallSiteOpcodeCallvirt || instruction[0] == CallSiteOpcodeNewobj) && instruction[4] == TableByteMemberRef;
+}
+
+bool CallSites::HasCandidate(LPCBYTE code, ULONG codeSize, const std::vector<CallSiteReference>& references)
+{
+    if (codeSize < CallSiteInstructionSize)
+    {
+        return false;
+    }
+
+    // Any byte may start a candidate here, the decoder in Find sorts out operand bytes that only look like one
+    ULONG lastOffset = codeSize - CallSiteInstructionSize;
+    ULONG offset = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+    const __m128i call = _mm_set1_epi8((char)CallSiteOpcodeCall);
+    const __m128i callvirt = _mm_set1_epi8((char)CallSiteOpcodeCallvirt);
+    const __m128i newobj = _mm_set1_epi8((char)CallSiteOpcodeNewobj);
+    const __m128i memberRef = _mm_set1_epi8((char)TableByteMemberRef);
+
+    // Compares 16 opcode positions against the three call opcodes and the token table bytes four bytes later
+    for (; offset + 16 <= lastOffset + 1; offset += 16)
+    {
+        __m128i opcodes = _mm_loadu_si128((const __m128i*)(code + offset));
+        __m128i tables = _mm_loadu_si128((const __m128i*)(code + offset + 4));
+        __m128i calls = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(opcodes, call), _mm_cmpeq_epi8(opcodes, callvirt)), _mm_cmpeq_epi8(opcodes, newobj));
+        int mask = _mm_movemask_epi8(_mm_and_si128(calls, _mm_cmpeq_epi8(tables, memberRef)));
+
+        while (mask != 0)
+        {
+            unsigned long bit = 0;
+            _BitScanForward(&bit, (unsigned long)mask);
+
+            if (FindReference(code + offset + bit, references) != NULL)
+            {
+                return true;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; offset <= lastOffset; offset++)
+    {
+        if (IsCandidate(code + offset) && FindReference(code + offset, references) != NULL)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+ULONG CallSites::Find(LPCBYTE code, ULONG codeSize, const std::vector<CallSiteReference>& references, std::vector<CallSite>* sites)
+{
+    if (references.empty() || !HasCandidate(code, codeSize, references))
+    {
+        return 0;
+    }
+
+    size_t firstSite = sites != NULL ? sites->size() : 0;
+    ULONG found = 0;
+    ULONG offset = 0;
+    bool constrained = false;
+
+    while (offset < codeSize)
+    {
+        BYTE opcode = code[offset];
+        ULONG operandSize = OperandInvalid;
+        bool isConstrained = false;
+
+        if (opcode == OpcodePrefix)
+        {
+            BYTE suffix = offset + 1 < codeSize ? code[offset + 1] : OperandInvalid;
+            operandSize = suffix < sizeof(TwoByteOperands) ? TwoByteOperands[suffix] : OperandInvalid;
+            isConstrained = suffix == OpcodeConstrained;
+            offset += 2;
+        }
+        else if (opcode < sizeof(OneByteOperands))
+        {
+            operandSize = OneByteOperands[opcode];
+
+            if (operandSize == OperandSwitch && offset + 5 <= codeSize)
+            {
+                ULONG targetCount;
+                memcpy(&targetCount, code + offset + 1, sizeof(targetCount));
+                operandSize = targetCount <= codeSize / 4 ? 4 + targetCount * 4 : OperandInvalid;
+            }
+
+            // A constrained callvirt must stay virtual, the prefix only applies to that form
+            const CallSiteReference* reference = NULL;
+            if (offset + CallSiteInstructionSize <= codeSize && !constrained && (reference = FindReference(code + offset, references)) != NULL)
+            {
+                if (sites != NULL)
+                {
+                    sites->push_back({ offset, (ULONG)(reference - references.data()) });
+                }
+
+                found++;
+            }
+
+            offset += 1;
+        }
+
+        // A body the decoder cannot walk to its end is left untouched
+        if (operandSize == OperandInvalid || operandSize == OperandSwitch || offset + operandSize > codeSize)
+        {
+            if (sites != NULL)
+            {
+                sites->resize(firstSite);
+            }
+
+            return 0;
+        }
+
+        offset += operandSize;
+        constrained = isConstrained;
+    }
+
+    return found;
+}
+
+bool CallSites::GetCode(LPCBYTE methodHeader, LPCBYTE* code, ULONG* codeSize)
+{
+    if (methodHeader == NULL)
+    {
+        return false;
+    }
+
+    if (((COR_ILMETHOD_TINY*)methodHeader)->IsTiny())
+    {
+        *code = ((COR_ILMETHOD_TINY*)methodHeader)->GetCode();
+        *codeSize = ((COR_ILMETHOD_TINY*)methodHeader)->GetCodeSize();
+    }
+    else
+    {
+        *code = ((COR_ILMETHOD_FAT*)methodHeader)->GetCode();
+        *codeSize = ((COR_ILMETHOD_FAT*)methodHeader)->GetCodeSize();
+    }
+
+    return true;
+}
+
+bool CallSites::IndexModule(ICorProfilerInfo3* profilerInfo, ModuleID moduleID, MetadataReader& metadataReader, std::vector<mdMethodDef>* callers)
+{
+    std::shared_ptr<CallSiteModule> module = GetModule(profilerInfo, moduleID, &metadataReader);
+    if (module == nullptr)
+    {
+        return false;
+    }
+
+    if (!module->application || module->references.empty())
+    {
+        return true;
+    }
+
+    ULONG methodDefCount = metadataReader.GetRowCount(MetadataTableMethodDef);
+    for (ULONG rid = 1; rid <= methodDefCount; rid++)
+    {
+        MetadataMethodDef methodDef;
+        LPCBYTE code = NULL;
+        ULONG codeSize = 0;
+
+        if (metadataReader.GetMethodDef(TokenFromRid(rid, mdtMethodDef), &methodDef) &&
+            GetCode(metadataReader.GetMethodBody(methodDef), &code, &codeSize) &&
+            Find(code, codeSize, module->references, NULL) > 0)
+        {
+            callers->push_back(TokenFromRid(rid, mdtMethodDef));
+        }
+    }
+
+    return true;
+}
+
+static HRESULT SkipType(PCCOR_SIGNATURE* cursor, PCCOR_SIGNATURE end);
+
+static HRESULT SkipCompressed(PCCOR_SIGNATURE* cursor, PCCOR_SIGNATURE end, ULONG* value)
+{
+    ULONG size = 0;
+    HRESULT hr = *cursor < end ? CorSigUncompressData(*cursor, (DWORD)(end - *cursor), value, &size) : META_E_BAD_SIGNATURE;
+    if (SUCCEEDED(hr))
+    {
+        *cursor += size;
+    }
+
+    return hr;
+}
+
+static HRESULT SkipMethodSignature(PCCOR_SIGNATURE* cursor, PCCOR_SIGNATURE end)
+{
+    ULONG value = 0;
+    if (*cursor >= end)
+    {
+        return META_E_BAD_SIGNATURE;
+    }
+
+    BYTE callingConvention = *(*cursor)++;
+    if ((callingConvention & IMAGE_CEE_CS_CALLCONV_GENERIC) != 0 && FAILED(SkipCompressed(cursor, end, &value)))
+    {
+        return META_E_BAD_SIGNATURE;
+    }
+
+    ULONG parameterCount = 0;
+    if (FAILED(SkipCompressed(cursor, end, &parameterCount)) || FAILED(SkipType(cursor, end)))
+    {
+        return META_E_BAD_SIGNATURE;
+    }
+
+    for (ULONG i = 0; i < parameterCount; i++)
+    {
+        if (FAILED(SkipType(cursor, end)))
+        {
+            return META_E_BAD_SIGNATURE;
+        }
+    }
+
+    return S_OK;
+}
+
+// Steps over one Type blob (ECMA-335 II.23.2.12) including its custom modifiers
+static HRESULT SkipType(PCCOR_SIGNATURE* cursor, PCCOR_SIGNATURE end)
+{
+    ULONG value = 0;
+
+    while (*cursor < end)
+    {
+        BYTE elementType = *(*cursor)++;
+
+        switch (elementType)
+        {
+        case ELEMENT_TYPE_CMOD_REQD:
+        case ELEMENT_TYPE_CMOD_OPT:
+            if (FAILED(SkipCompressed(cursor, end, &value)))
+            {
+                return META_E_BAD_SIGNATURE;
+            }
+            continue;
+        case ELEMENT_TYPE_SENTINEL:
+        case ELEMENT_TYPE_PINNED:
+        case ELEMENT_TYPE_BYREF:
+        case ELEMENT_TYPE_PTR:
+        case ELEMENT_TYPE_SZARRAY:
+            continue;
+        case ELEMENT_TYPE_VALUETYPE:
+        case ELEMENT_TYPE_CLASS:
+        case ELEMENT_TYPE_VAR:
+        case ELEMENT_TYPE_MVAR:
+            return SkipCompressed(cursor, end, &value);
+        case ELEMENT_TYPE_GENERICINST:
+        {
+            ULONG argumentCount = 0;
+            if (FAILED(SkipType(cursor, end)) || FAILED(SkipCompressed(cursor, end, &argumentCount)))
+            {
+                return META_E_BAD_SIGNATURE;
+            }
+
+            for (ULONG i = 0; i < argumentCount; i++)
+            {
+                if (FAILED(SkipType(cursor, end)))
+                {
+                    return META_E_BAD_SIGNATURE;
+                }
+            }
+
+            return S_OK;
+        }
+        case ELEMENT_TYPE_ARRAY:
+        {
+            ULONG rank = 0;
+            ULONG sizeCount = 0;
+            ULONG lowerBoundCount = 0;
+            if (FAILED(SkipType(cursor, end)) || FAILED(SkipCompressed(cursor, end, &rank)) || FAILED(SkipCompressed(cursor, end, &sizeCount)))
+            {
+                return META_E_BAD_SIGNATURE;
+            }
+
+            for (ULONG i = 0; i < sizeCount; i++)
+            {
+                if (FAILED(SkipCompressed(cursor, end, &value)))
+                {
+                    return META_E_BAD_SIGNATURE;
+                }
+            }
+
+            if (FAILED(SkipCompressed(cursor, end, &lowerBoundCount)))
+            {
+                return META_E_BAD_SIGNATURE;
+            }
+
+            for (ULONG i = 0; i < lowerBoundCount; i++)
+            {
+                if (FAILED(SkipCompressed(cursor, end, &value)))
+                {
+                    return META_E_BAD_SIGNATURE;
+                }
+            }
+
+            return S_OK;
+        }
+        case ELEMENT_TYPE_FNPTR:
+            return SkipMethodSignature(cursor, end);
+        default:
+            return (elementType >= ELEMENT_TYPE_VOID && elementType <= ELEMENT_TYPE_STRING) || elementType == ELEMENT_TYPE_TYPEDBYREF ||
+                   elementType == ELEMENT_TYPE_I || elementType == ELEMENT_TYPE_U || elementType == ELEMENT_TYPE_OBJECT ? S_OK : META_E_BAD_SIGNATURE;
+        }
+    }
+
+    return META_E_BAD_SIGNATURE;
+}
+
+HRESULT CallSites::BuildHookSignature(PCCOR_SIGNATURE signature, ULONG signatureLength, BYTE opcode, mdTypeRef parent, BYTE* hookSignature, ULONG* hookSignatureLength)
+{
+    // Room for a longer parameter count and the receiver's CLASS <TypeRef>
+    if (signatureLength < 3 || signatureLength + 8 > CallSiteSignatureLength)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (opcode == CallSiteOpcodeCall)
+    {
+        memcpy(hookSignature, signature, signatureLength);
+        *hookSignatureLength = signatureLength;
+        return S_OK;
+    }
+
+    PCCOR_SIGNATURE end = signature + signatureLength;
+    PCCOR_SIGNATURE cursor = signature + 1;
+    ULONG parameterCount = 0;
+    if (FAILED(SkipCompressed(&cursor, end, &parameterCount)))
+    {
+        return META_E_BAD_SIGNATURE;
+    }
+
+    PCCOR_SIGNATURE returnType = cursor;
+    if (FAILED(SkipType(&cursor, end)))
+    {
+        return META_E_BAD_SIGNATURE;
+    }
+
+    PCCOR_SIGNATURE parameters = cursor;
+    ULONG length = 0;
+
+    hookSignature[length++] = (BYTE)(signature[0] & ~(IMAGE_CEE_CS_CALLCONV_HASTHIS | IMAGE_CEE_CS_CALLCONV_EXPLICITTHIS));
+
+    if (opcode == CallSiteOpcodeCallvirt)
+    {
+        // The receiver becomes the first parameter
+        length += CorSigCompressData(parameterCount + 1, hookSignature + length);
+        memcpy(hookSignature + length, returnType, parameters - returnType);
+        length += (ULONG)(parameters - returnType);
+        hookSignature[length++] = ELEMENT_TYPE_CLASS;
+        length += CorSigCompressToken(parent, hookSignature + length);
+    }
+    else
+    {
+        // The constructed object becomes the return value
+        if (*returnType != ELEMENT_TYPE_VOID)
+        {
+            return META_E_BAD_SIGNATURE;
+        }
+
+        length += CorSigCompressData(parameterCount, hookSignature + length);
+        hookSignature[length++] = ELEMENT_TYPE_CLASS;
+        length += CorSigCompressToken(parent, hookSignature + length);
+    }
+
+    memcpy(hookSignature + length, parameters, end - parameters);
+    *hookSignatureLength = length + (ULONG)(end - parameters);
+
+    return S_OK;
+}
+
+HRESULT CallSites::DefineHook(ICorProfilerInfo3* profilerInfo, ModuleID moduleID, CallSiteModule* module, ULONG reference, mdMemberRef* hook)
+{
+    std::lock_guard<std::mutex> guard(module->hookLock);
+
+    CallSiteReference* callSiteReference = &module->references[reference];
+    if (callSiteReference->hook != mdTokenNil)
+    {
+        *hook = callSiteReference->hook;
+        return S_OK;
+    }
+
+    BYTE hookSignature[CallSiteSignatureLength];
+    ULONG hookSignatureLength = 0;
+    HRESULT hr = BuildHookSignature(callSiteReference->signature, callSiteReference->signatureLength, callSiteReference->opcode, callSiteReference->parent, hookSignature, &hookSignatureLength);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    IMetaDataEmit* iMetaDataEmit = NULL;
+    hr = profilerInfo->GetModuleMetaData(moduleID, ofRead | ofWrite, IID_IMetaDataEmit, (IUnknown**)&iMetaDataEmit);
+    if (FAILED(hr) || iMetaDataEmit == NULL)
+    {
+        Journal::WriteFailure(JournalSiteGetModuleMetaData, hr);
+        return FAILED(hr) ? hr : E_FAIL;
+    }
+
+    IMetaDataAssemblyEmit* iMetaDataAssemblyEmit = NULL;
+    hr = iMetaDataEmit->QueryInterface(IID_IMetaDataAssemblyEmit, (void**)&iMetaDataAssemblyEmit);
+    if (FAILED(hr) || iMetaDataAssemblyEmit == NULL)
+    {
+        Journal::WriteFailure(JournalSiteQueryAssemblyEmit, hr);
+        iMetaDataEmit->Release();
+        return FAILED(hr) ? hr : E_FAIL;
+    }
+
+    const BYTE publicKeyToken[] = { 0xd4, 0x27, 0x00, 0x1f, 0x96, 0xb0, 0xd0, 0xb6 }; // d427001f96b0d0b6
+    ASSEMBLYMETADATA autoInstrumentationMetaData = { 0 };
+    mdAssemblyRef autoInstrumentationToken;
+    hr = iMetaDataAssemblyEmit->DefineAssemblyRef(publicKeyToken, sizeof(publicKeyToken), AutoInstrumentationAssemblyName, &autoInstrumentationMetaData, NULL, 0, 0, &autoInstrumentationToken);
+    Recorder::RecordDefinition(moduleID, RecordingDefineAssemblyRef, mdTokenNil, hr, autoInstrumentationToken, AutoInstrumentationAssemblyName, publicKeyToken, sizeof(publicKeyToken));
+    iMetaDataAssemblyEmit->Release();
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteDefineAssemblyRef, hr);
+        iMetaDataEmit->Release();
+        return hr;
+    }
+
+    const CallSiteTarget* target = &targets[callSiteReference->target];
+    mdTypeRef hookClassToken;
+    hr = iMetaDataEmit->DefineTypeRefByName(autoInstrumentationToken, target->hookClassName, &hookClassToken);
+    Recorder::RecordDefinition(moduleID, RecordingDefineTypeRef, autoInstrumentationToken, hr, hookClassToken, target->hookClassName, NULL, 0);
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteDefineTypeRefByName, hr);
+        iMetaDataEmit->Release();
+        return hr;
+    }
+
+    hr = iMetaDataEmit->DefineMemberRef(hookClassToken, target->hookMethodName, hookSignature, hookSignatureLength, &callSiteReference->hook);
+    Recorder::RecordDefinition(moduleID, RecordingDefineMemberRef, hookClassToken, hr, callSiteReference->hook, target->hookMethodName, hookSignature, hookSignatureLength);
+    iMetaDataEmit->Release();
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteDefineMemberRef, hr);
+        return hr;
+    }
+
+    *hook = callSiteReference->hook;
+
+    return S_OK;
+}
+
+HRESULT CallSites::Redirect(ICorProfilerInfo3* profilerInfo, ModuleID moduleID, mdMethodDef token, ULONG* redirected)
+{
+    *redirected = 0;
+
+    std::shared_ptr<CallSiteModule> module = GetModule(profilerInfo, moduleID, NULL);
+    if (module == nullptr || !module->application || module->references.empty())
+    {
+        return S_FALSE;
+    }
+
+    LPCBYTE methodHeader = NULL;
+    ULONG methodSize = 0;
+    HRESULT hr = profilerInfo->GetILFunctionBody(moduleID, token, &methodHeader, &methodSize);
+    Recorder::RecordILFunctionBody(moduleID, token, hr, methodHeader, methodSize);
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteGetILFunctionBody, hr);
+        return hr;
+    }
+
+    LPCBYTE code = NULL;
+    ULONG codeSize = 0;
+    std::vector<CallSite> sites;
+    if (!GetCode(methodHeader, &code, &codeSize) || (ULONG64)(code - methodHeader) + codeSize > methodSize ||
+        Find(code, codeSize, module->references, &sites) == 0)
+    {
+        return S_FALSE;
+    }
+
+    // Same length, same stack effect: the copy only differs in the redirected instructions
+    std::vector<BYTE> methodBody(methodHeader, methodHeader + methodSize);
+    ULONG codeOffset = (ULONG)(code - methodHeader);
+
+    for (const CallSite& site : sites)
+    {
+        mdMemberRef hook = mdTokenNil;
+        hr = DefineHook(profilerInfo, moduleID, module.get(), site.reference, &hook);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        BYTE* instruction = methodBody.data() + codeOffset + site.offset;
+        instruction[0] = CallSiteOpcodeCall;
+        memcpy(instruction + 1, &hook, sizeof(hook));
+    }
+
+    if (!ILWriter::WriteILHeader(profilerInfo, moduleID, token, methodBody.data(), methodSize))
+    {
+        return E_FAIL;
+    }
+
+    *redirected = (ULONG)sites.size();
+
+    return S_OK;
+}
+
+void CallSites::Remove(ModuleID moduleID)
+{
+    std::unique_lock<std::shared_mutex> guard(modulesLock);
+    modules.erase(moduleID);
+}
@@ -0,0 +1,105 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+#include "cor.h"
+#include "corprof.h"
+#include "MetadataReader.h"
+
+#define CallSitesVariable L"AWS_XRAY_PROFILER_REDIRECTED_CALLS"
+#define SqlCommandsVariable L"AWS_XRAY_PROFILER_SQL_COMMANDS"
+#define SqlCommandsHookClassName L"Amazon.XRay.Recorder.AutoInstrumentation.SqlCommandHooks"
+#define CallSitesValueLength 8192
+#define CallSitesMaximumTargets 64
+#define CallSiteNameLength 256
+#define CallSiteSignatureLength 256
+
+#define CallSiteOpcodeCall 0x28
+#define CallSiteOpcodeCallvirt 0x6F
+#define CallSiteOpcodeNewobj 0x73
+#define CallSiteInstructionSize 5
+
+typedef struct
+{
+    WCHAR className[CallSiteNameLength];
+    WCHAR methodName[CallSiteNameLength];
+    WCHAR hookClassName[CallSiteNameLength];
+    WCHAR hookMethodName[CallSiteNameLength];
+} CallSiteTarget;
+
+typedef struct
+{
+    mdMemberRef token;
+    BYTE opcode;
+    ULONG target;
+    mdTypeRef parent;
+    PCCOR_SIGNATURE signature;
+    ULONG signatureLength;
+    mdMemberRef hook;
+} CallSiteReference;
+
+typedef struct
+{
+    ULONG offset;
+    ULONG reference;
+} CallSite;
+
+// Redirects the calls listed in AWS_XRAY_PROFILER_REDIRECTED_CALLS
+// ("Namespace.Type.Method=Namespace.HookType.HookMethod;...") to static hooks in the agent assembly.
+// Each application module gets a table of the MemberRefs that name a target, and method bodies are
+// screened 16 bytes at a time for call, callvirt or newobj followed by a MemberRef token before a
+// full CIL decode confirms the hits on instruction boundaries. A confirmed site keeps its length and
+// stack effect, only the opcode becomes call and the token the hook's:
+//     call T::M(a, b)                  -> call H::M(a, b)
+//     callvirt instance T::M(a, b)     -> call H::M(T, a, b)
+//     newobj instance T::.ctor(a, b)   -> call T H::.ctor(a, b)
+// so branches and exception clauses stay valid. Targets are methods of reference types; framework
+// and agent assemblies are never rewritten. AWS_XRAY_PROFILER_SQL_COMMANDS adds a built-in list that
+// sends the Execute methods of SqlCommand to the agent's SqlCommandHooks on .NET Framework;
+// AddSqlCommands tells whether it did, so that SqlCommands hands the hooks records to time them in.
+class CallSites
+{
+public:
+    static void Initialize();
+    static bool AddSqlCommands(ICorProfilerInfo3* profilerInfo);
+
+    static inline bool IsEnabled()
+    {
+        return targetCount > 0;
+    }
+
+    static bool IndexModule(ICorProfilerInfo3* profilerInfo, ModuleID moduleID, MetadataReader& metadataReader, std::vector<mdMethodDef>* callers);
+    static HRESULT Redirect(ICorProfilerInfo3* profilerInfo, ModuleID moduleID, mdMethodDef token, ULONG* redirected);
+    static void Remove(ModuleID moduleID);
+
+    // The body scan and the hook signature work on bytes alone, references sorted by token
+    static ULONG Find(LPCBYTE code, ULONG codeSize, const std::vector<CallSiteReference>& references, std::vector<CallSite>* sites);
+    static HRESULT BuildHookSignature(PCCOR_SIGNATURE signature, ULONG signatureLength, BYTE opcode, mdTypeRef parent, BYTE* hookSignature, ULONG* hookSignatureLength);
+
+private:
+    struct CallSiteModule
+    {
+        bool application;
+        std::vector<CallSiteReference> references;
+        std::mutex hookLock;
+    };
+
+    static void AddTarget(LPWSTR value);
+    static std::shared_ptr<CallSiteModule> GetModule(ICorProfilerInfo3* profilerInfo, ModuleID moduleID, MetadataReader* metadataReader);
+    static bool IsApplicationAssembly(LPCWSTR assemblyName);
+    static void FindReferences(MetadataReader& metadataReader, CallSiteModule* module);
+    static bool HasCandidate(LPCBYTE code, ULONG codeSize, const std::vector<CallSiteReference>& references);
+    static bool GetCode(LPCBYTE methodHeader, LPCBYTE* code, ULONG* codeSize);
+    static HRESULT DefineHook(ICorProfilerInfo3* profilerInfo, ModuleID moduleID, CallSiteModule* module, ULONG reference, mdMemberRef* hook);
+
+    static CallSiteTarget targets[CallSitesMaximumTargets];
+    static ULONG targetCount;
+    static std::shared_mutex modulesLock;
+    static std::unordered_map<ModuleID, std::shared_ptr<CallSiteModule>> modules;
+};
@@ -51,13 +51,16 @@ HRESULT STDMETHODCALLTYPE ClassFactory::CreateInstance(IUnknown *pUnkOuter, REFI
         return CLASS_E_NOAGGREGATION;
     }
 
-    CorProfiler* profiler = new CorProfiler();
+    // The feature set is fixed for the process, so the specialization is chosen once, here
+    ICorProfilerCallback10* profiler = CreateCorProfiler();
     if (profiler == nullptr)
     {
         return E_FAIL;
     }
 
-    assert(riid == __uuidof(ICorProfilerCallback8) ||
+    assert(riid == __uuidof(ICorProfilerCallback10) ||
+           riid == __uuidof(ICorProfilerCallback9) ||
+           riid == __uuidof(ICorProfilerCallback8) ||
            riid == __uuidof(ICorProfilerCallback7) ||
            riid == __uuidof(ICorProfilerCallback6) ||
            riid == __uuidof(ICorProfilerCallback5) ||
@@ -0,0 +1,180 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "Clock.h"
+
+std::once_flag Clock::calibrated;
+std::atomic<LONG64> Clock::frequency(0);
+LONG64 Clock::resyncInterval = 0;
+std::atomic<ULONG> Clock::sequence(0);
+std::atomic<LONG64> Clock::anchorCounter(0);
+std::atomic<LONG64> Clock::anchorEpochMicroseconds(0);
+std::atomic<LONG64> Clock::anchorSlewTicks(0);
+std::atomic<bool> Clock::resyncing(false);
+
+void Clock::Calibrate()
+{
+    std::call_once(calibrated, []()
+    {
+        LARGE_INTEGER counterFrequency;
+        QueryPerformanceFrequency(&counterFrequency);
+
+        resyncInterval = counterFrequency.QuadPart * ClockResyncIntervalMilliseconds / 1000;
+        Resync(counterFrequency.QuadPart);
+
+        // Published last: a reader that sees the frequency also sees the interval and the first anchor
+        frequency.store(counterFrequency.QuadPart, std::memory_order_release);
+    });
+}
+
+void Clock::ReadWallClock(LONG64* counter, LONG64* epochMicroseconds)
+{
+    // Bracket the wall clock read between two counter reads and keep the tightest pair,
+    // so a preemption during calibration does not skew every later timestamp.
+    LONG64 bestWindow = MAXLONGLONG;
+
+    for (int i = 0; i < ClockCalibrationAttempts; i++)
+    {
+        LARGE_INTEGER before;
+        LARGE_INTEGER after;
+        FILETIME wallClock;
+
+        QueryPerformanceCounter(&before);
+        GetSystemTimePreciseAsFileTime(&wallClock);
+        QueryPerformanceCounter(&after);
+
+        LONG64 window = after.QuadPart - before.QuadPart;
+        if (window < bestWindow)
+        {
+            ULONG64 fileTime = ((ULONG64)wallClock.dwHighDateTime << 32) | wallClock.dwLowDateTime;
+
+            bestWindow = window;
+            *counter = before.QuadPart + window / 2;
+            *epochMicroseconds = (LONG64)((fileTime - FileTimeUnixEpochOffset) / FileTimeTicksPerMicrosecond);
+        }
+    }
+}
+
+LONG64 Clock::ToEpochMicroseconds(const ClockAnchor& anchor, LONG64 counter, LONG64 ticksPerSecond, LONG64 interval)
+{
+    // A counter from before the anchor can only come from another core's skew, it maps to the anchor
+    LONG64 elapsed = counter > anchor.counter ? counter - anchor.counter : 0;
+
+    // The slew is less than the interval, so the slewed elapsed time never decreases
+    LONG64 slewed = elapsed < interval ? elapsed : interval;
+    elapsed += anchor.slewTicks * slewed / interval;
+
+    return anchor.epochMicroseconds + (elapsed / ticksPerSecond) * MicrosecondsPerSecond + ((elapsed % ticksPerSecond) * MicrosecondsPerSecond) / ticksPerSecond;
+}
+
+ClockAnchor Clock::Reanchor(const ClockAnchor& anchor, LONG64 counter, LONG64 wallCounter, LONG64 wallEpochMicroseconds, LONG64 ticksPerSecond, LONG64 interval)
+{
+    ClockAnchor wallAnchor = { wallCounter, wallEpochMicroseconds, 0 };
+    LONG64 wall = ToEpochMicroseconds(wallAnchor, counter, ticksPerSecond, interval);
+
+    ClockAnchor next = { counter, wall, 0 };
+    if (anchor.counter == 0)
+    {
+        return next;
+    }
+
+    LONG64 current = ToEpochMicroseconds(anchor, counter, ticksPerSecond, interval);
+    LONG64 offset = wall - current;
+    LONG64 limit = interval * MicrosecondsPerSecond / ticksPerSecond / ClockMaximumSlewDivisor;
+
+    // Far behind the wall clock, a step forward keeps timestamps monotonic and avoids a long catch-up
+    if (offset > limit)
+    {
+        return next;
+    }
+
+    // Otherwise continue from the current time and correct over the next interval; what is left
+    // of a larger step back is corrected by the resyncs that follow
+    next.epochMicroseconds = current;
+    next.slewTicks = (offset < -limit ? -limit : offset) * ticksPerSecond / MicrosecondsPerSecond;
+
+    return next;
+}
+
+void Clock::Resync(LONG64 ticksPerSecond)
+{
+    LONG64 wallCounter = 0;
+    LONG64 wallEpochMicroseconds = 0;
+    ReadWallClock(&wallCounter, &wallEpochMicroseconds);
+
+    // Only one thread resyncs at a time, so the current anchor can be read without the seqlock
+    ClockAnchor anchor;
+    anchor.counter = anchorCounter.load(std::memory_order_relaxed);
+    anchor.epochMicroseconds = anchorEpochMicroseconds.load(std::memory_order_relaxed);
+    anchor.slewTicks = anchorSlewTicks.load(std::memory_order_relaxed);
+
+    // Seqlock write: readers retry while the sequence is odd or has moved underneath them.
+    sequence.fetch_add(1, std::memory_order_acq_rel);
+
+    // The new anchor's counter is read inside the write, so every reader still on the previous anchor
+    // read its counter before it and the two anchors agree at the switch
+    ClockAnchor next = Reanchor(anchor, GetCounter(), wallCounter, wallEpochMicroseconds, ticksPerSecond, resyncInterval);
+
+    anchorCounter.store(next.counter, std::memory_order_relaxed);
+    anchorEpochMicroseconds.store(next.epochMicroseconds, std::memory_order_relaxed);
+    anchorSlewTicks.store(next.slewTicks, std::memory_order_relaxed);
+    sequence.fetch_add(1, std::memory_order_release);
+}
+
+LONG64 Clock::GetEpochMicroseconds()
+{
+    LONG64 ticksPerSecond = GetFrequency();
+    LONG64 now;
+    ClockAnchor anchor;
+    ULONG begin;
+
+    do
+    {
+        begin = sequence.load(std::memory_order_acquire);
+        now = GetCounter();
+        anchor.counter = anchorCounter.load(std::memory_order_relaxed);
+        anchor.epochMicroseconds = anchorEpochMicroseconds.load(std::memory_order_relaxed);
+        anchor.slewTicks = anchorSlewTicks.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((begin & 1) != 0 || sequence.load(std::memory_order_relaxed) != begin);
+
+    LONG64 epochMicroseconds = ToEpochMicroseconds(anchor, now, ticksPerSecond, resyncInterval);
+
+    // Only one caller pays for the resync; everyone else keeps using the previous anchor,
+    // which is at most one interval's worth of drift behind.
+    if (now - anchor.counter > resyncInterval && !resyncing.exchange(true, std::memory_order_acquire))
+    {
+        Resync(ticksPerSecond);
+        resyncing.store(false, std::memory_order_release);
+    }
+
+    return epochMicroseconds;
+}
+
+LONG64 Clock::GetFrequency()
+{
+    LONG64 ticksPerSecond = frequency.load(std::memory_order_acquire);
+    if (ticksPerSecond == 0)
+    {
+        Calibrate();
+        ticksPerSecond = frequency.load(std::memory_order_acquire);
+    }
+
+    return ticksPerSecond;
+}
+
+double Clock::GetEpochSeconds()
+{
+    return (double)GetEpochMicroseconds() / MicrosecondsPerSecond;
+}
+
+extern "C" double STDMETHODCALLTYPE GetXRayTimestamp()
+{
+    return Clock::GetEpochSeconds();
+}
+
+extern "C" LONG64 STDMETHODCALLTYPE GetXRayTimestampMicroseconds()
+{
+    return Clock::GetEpochMicroseconds();
+}
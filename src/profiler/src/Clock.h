@@ -0,0 +1,63 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include "cor.h"
+
+#define ClockResyncIntervalMilliseconds 1000
+#define ClockCalibrationAttempts 5
+#define ClockMaximumSlewDivisor 2 // a resync corrects at most half an interval, so the clock runs at 0.5x to 1.5x
+#define MicrosecondsPerSecond 1000000LL
+#define FileTimeTicksPerMicrosecond 10ULL
+#define FileTimeUnixEpochOffset 116444736000000000ULL // 100ns ticks between 1601-01-01 and 1970-01-01
+
+typedef struct
+{
+    LONG64 counter;
+    LONG64 epochMicroseconds;
+    LONG64 slewTicks; // spread over the interval that follows the anchor
+} ClockAnchor;
+
+// Monotonic high-resolution clock for segment timestamps.
+// QueryPerformanceCounter is read on every call and anchored to the system wall clock at Initialize.
+// The anchor is refreshed once per resync interval so the result tracks NTP adjustments, but it never
+// steps backwards: each new anchor starts where the previous one left off, and the difference to the
+// wall clock is slewed in over the next interval. Only a clock that fell far behind steps forward.
+class Clock
+{
+public:
+    static void Calibrate();
+    static LONG64 GetEpochMicroseconds();
+    static double GetEpochSeconds();
+    static LONG64 GetFrequency();
+
+    static inline LONG64 GetCounter()
+    {
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return counter.QuadPart;
+    }
+
+    // The anchor arithmetic, free of global state so that any wall clock can be replayed through it
+    static LONG64 ToEpochMicroseconds(const ClockAnchor& anchor, LONG64 counter, LONG64 ticksPerSecond, LONG64 interval);
+    static ClockAnchor Reanchor(const ClockAnchor& anchor, LONG64 counter, LONG64 wallCounter, LONG64 wallEpochMicroseconds, LONG64 ticksPerSecond, LONG64 interval);
+
+private:
+    static void Resync(LONG64 ticksPerSecond);
+    static void ReadWallClock(LONG64* counter, LONG64* epochMicroseconds);
+
+    static std::once_flag calibrated;
+    static std::atomic<LONG64> frequency;
+    static LONG64 resyncInterval;
+    static std::atomic<ULONG> sequence;
+    static std::atomic<LONG64> anchorCounter;
+    static std::atomic<LONG64> anchorEpochMicroseconds;
+    static std::atomic<LONG64> anchorSlewTicks;
+    static std::atomic<bool> resyncing;
+};
+
+extern "C" double STDMETHODCALLTYPE GetXRayTimestamp();
+extern "C" LONG64 STDMETHODCALLTYPE GetXRayTimestampMicroseconds();
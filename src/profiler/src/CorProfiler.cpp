@@ -3,21 +3,46 @@
 
 #include "CorProfiler.h"
 
-CorProfiler::CorProfiler() : refCount(0), corProfilerInfo(nullptr)
+template <ULONG Features>
+CorProfiler<Features>::CorProfiler(ULONG requestedFeatures) : refCount(0), corProfilerInfo(nullptr), requestedFeatures(requestedFeatures), rewriteCache(nullptr), cachedEntryModuleID(0), cachedEntry(nullptr)
 {
 }
 
-CorProfiler::~CorProfiler()
+template <ULONG Features>
+CorProfiler<Features>::~CorProfiler()
 {
     if (this->corProfilerInfo != nullptr)
     {
         this->corProfilerInfo->Release();
         this->corProfilerInfo = nullptr;
     }
+
+    if (this->rewriteCache != nullptr)
+    {
+        delete this->rewriteCache;
+        this->rewriteCache = nullptr;
+    }
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::Initialize(IUnknown *pICorProfilerInfoUnk)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::Initialize(IUnknown *pICorProfilerInfoUnk)
 {
+    Clock::Calibrate();
+    Journal::Initialize();
+
+    if (HasInstrumentation)
+    {
+        MethodCounters::Initialize();
+        CallSites::Initialize();
+    }
+
+    if (HasDiagnostics)
+    {
+        Overhead::Initialize();
+        Governor::Initialize();
+        Recorder::Initialize();
+    }
+
     HRESULT queryInterfaceResult = pICorProfilerInfoUnk->QueryInterface(__uuidof(ICorProfilerInfo8), reinterpret_cast<void **>(&this->corProfilerInfo));
 
     if (FAILED(queryInterfaceResult))
@@ -25,19 +50,116 @@ HRESULT STDMETHODCALLTYPE CorProfiler::Initialize(IUnknown *pICorProfilerInfoUnk
         return E_FAIL;
     }
 
+    if (IsRequested(ProfilerFeatureSampling))
+    {
+        Sampler::Initialize();
+    }
+
+    if (IsRequested(ProfilerFeatureHardwareCounters))
+    {
+        HardwareCounters::Initialize();
+    }
+
+    if (HasInstrumentation && CallSites::AddSqlCommands(this->corProfilerInfo))
+    {
+        SqlCommands::Enable();
+    }
+
     DWORD eventMask = COR_PRF_MONITOR_JIT_COMPILATION                      |
-                      COR_PRF_DISABLE_TRANSPARENCY_CHECKS_UNDER_FULL_TRUST | /* helps the case where this profiler is used on Full CLR */
-                      COR_PRF_DISABLE_INLINING                             ;
+                      COR_PRF_DISABLE_TRANSPARENCY_CHECKS_UNDER_FULL_TRUST ; /* helps the case where this profiler is used on Full CLR */
+
+    // Main alone is never inlined nor unloaded; counted and redirected methods may be both
+    if (IsInstrumenting())
+    {
+        eventMask |= COR_PRF_MONITOR_FUNCTION_UNLOADS | /* evicts unloaded methods from the method table */
+                     COR_PRF_DISABLE_INLINING         ; /* an inlined copy would miss its counter or redirection */
+    }
+
+    if (IsRequested(ProfilerFeatureModuleIndex))
+    {
+        ModuleIndex::Initialize(this->corProfilerInfo);
+    }
+
+    if (ModuleIndex::IsEnabled() || (HasDiagnostics && Recorder::IsEnabled()) || (HasInstrumentation && CallSites::IsEnabled()))
+    {
+        eventMask |= COR_PRF_MONITOR_MODULE_LOADS;
+    }
+
+    WCHAR rewriteCachePath[MAX_PATH];
+    if (IsRequested(ProfilerFeatureRewriteCache) && Environment::GetValue(RewriteCachePathVariable, rewriteCachePath, MAX_PATH))
+    {
+        this->rewriteCache = new RewriteCache(rewriteCachePath);
+
+        // Module loads are only needed to spot the cached entry module on a warm start
+        if (this->rewriteCache->Load() && !this->rewriteCache->IsEmpty())
+        {
+            eventMask |= COR_PRF_MONITOR_MODULE_LOADS;
+        }
+    }
+
+    if (HasThreads)
+    {
+        eventMask |= ThreadMonitor::Initialize();
+    }
+
+    if (HasDiagnostics)
+    {
+        eventMask |= StartupTimeline::Initialize(this->corProfilerInfo, eventMask);
+    }
+
+    // Newer interfaces are negotiated per feature, the profiler itself still runs on ICorProfilerInfo8
+    DWORD highEventMask = 0;
+    if (HasRuntimeEvents)
+    {
+        highEventMask |= RuntimeEvents::Initialize(pICorProfilerInfoUnk);
+    }
+
+    if (HasHeap)
+    {
+        eventMask |= HeapSnapshots::Initialize(this->corProfilerInfo, &highEventMask);
+    }
+
+    eventMask &= AllowedEventMask;
+    highEventMask &= AllowedHighEventMask;
 
-    auto hr = this->corProfilerInfo->SetEventMask(eventMask);
+    auto hr = this->corProfilerInfo->SetEventMask2(eventMask, highEventMask);
+
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteSetEventMask, hr);
+    }
+    else
+    {
+        Journal::Write(JournalEventMaskChanged, JournalSiteSetEventMask, ((ULONG64)highEventMask << 32) | eventMask);
+    }
+
+    // Contexts are only indexed by ThreadID when ThreadDestroyed is there to take them out again
+    TraceContext::Initialize(this->corProfilerInfo, HasThreads && SUCCEEDED(hr) && (eventMask & COR_PRF_MONITOR_THREADS) != 0);
 
     hasInserted = false;
 
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::Shutdown()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::Shutdown()
 {
+    Governor::Shutdown();
+    ThreadMonitor::Shutdown();
+    RuntimeEvents::Shutdown();
+    HeapSnapshots::Shutdown();
+    ModuleIndex::Shutdown();
+    Recorder::Shutdown();
+    StartupTimeline::Shutdown();
+    TraceContext::Shutdown();
+    Journal::Shutdown();
+    Overhead::Shutdown();
+
+    if (this->rewriteCache != nullptr)
+    {
+        this->rewriteCache->Flush();
+    }
+
     if (this->corProfilerInfo != nullptr)
     {
         this->corProfilerInfo->Release();
@@ -47,146 +169,511 @@ HRESULT STDMETHODCALLTYPE CorProfiler::Shutdown()
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::AppDomainCreationStarted(AppDomainID appDomainId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::AppDomainCreationStarted(AppDomainID appDomainId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::AppDomainCreationFinished(AppDomainID appDomainId, HRESULT hrStatus)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::AppDomainCreationFinished(AppDomainID appDomainId, HRESULT hrStatus)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::AppDomainShutdownStarted(AppDomainID appDomainId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::AppDomainShutdownStarted(AppDomainID appDomainId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::AppDomainShutdownFinished(AppDomainID appDomainId, HRESULT hrStatus)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::AppDomainShutdownFinished(AppDomainID appDomainId, HRESULT hrStatus)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::AssemblyLoadStarted(AssemblyID assemblyId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::AssemblyLoadStarted(AssemblyID assemblyId)
 {
+    OverheadTimer timer(OverheadAssemblyLoadStarted, HasDiagnostics);
+
+    if (HasDiagnostics && StartupTimeline::IsActive())
+    {
+        StartupTimeline::Begin(StartupPhaseAssembly);
+        StartupTimeline::AssemblyStarted(assemblyId);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::AssemblyLoadFinished(AssemblyID assemblyId, HRESULT hrStatus)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::AssemblyLoadFinished(AssemblyID assemblyId, HRESULT hrStatus)
 {
+    OverheadTimer timer(OverheadAssemblyLoadFinished, HasDiagnostics);
+
+    if (HasDiagnostics && StartupTimeline::IsActive())
+    {
+        StartupTimeline::AssemblyFinished(assemblyId);
+        StartupTimeline::End(StartupPhaseAssembly);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::AssemblyUnloadStarted(AssemblyID assemblyId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::AssemblyUnloadStarted(AssemblyID assemblyId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::AssemblyUnloadFinished(AssemblyID assemblyId, HRESULT hrStatus)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::AssemblyUnloadFinished(AssemblyID assemblyId, HRESULT hrStatus)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ModuleLoadStarted(ModuleID moduleId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ModuleLoadStarted(ModuleID moduleId)
 {
+    OverheadTimer timer(OverheadModuleLoadStarted, HasDiagnostics);
+
+    if (HasDiagnostics && StartupTimeline::IsActive())
+    {
+        StartupTimeline::Begin(StartupPhaseModule);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ModuleLoadFinished(ModuleID moduleId, HRESULT hrStatus)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ModuleLoadFinished(ModuleID moduleId, HRESULT hrStatus)
 {
+    OverheadTimer timer(OverheadModuleLoadFinished, HasDiagnostics);
+    StartupTimer startupTimer(HasDiagnostics);
+
+    if (HasDiagnostics && StartupTimeline::IsActive())
+    {
+        StartupTimeline::End(StartupPhaseModule);
+    }
+
+    if (HasDiagnostics)
+    {
+        Recorder::RecordModule(RecordingModuleLoadFinished, moduleId, hrStatus);
+    }
+
+    if (ModuleIndex::IsEnabled() && SUCCEEDED(hrStatus))
+    {
+        ModuleIndex::Enqueue(moduleId);
+    }
+
+    if (hasInserted || this->rewriteCache == nullptr || this->cachedEntry != nullptr || FAILED(hrStatus))
+    {
+        return S_OK;
+    }
+
+    GUID moduleVersionId;
+    if (FAILED(GetModuleVersionId(moduleId, &moduleVersionId)))
+    {
+        return S_OK;
+    }
+
+    const RewriteCacheEntry* entry = this->rewriteCache->Find(moduleVersionId);
+    if (entry != nullptr)
+    {
+        this->cachedEntryModuleID = moduleId;
+        this->cachedEntry = entry;
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ModuleUnloadStarted(ModuleID moduleId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ModuleUnloadStarted(ModuleID moduleId)
 {
+    if (HasDiagnostics)
+    {
+        Recorder::RecordModule(RecordingModuleUnloadStarted, moduleId, S_OK);
+    }
+
+    if (ModuleIndex::IsEnabled())
+    {
+        ModuleIndex::Remove(moduleId);
+    }
+
+    if (HasInstrumentation && CallSites::IsEnabled())
+    {
+        CallSites::Remove(moduleId);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ModuleUnloadFinished(ModuleID moduleId, HRESULT hrStatus)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ModuleUnloadFinished(ModuleID moduleId, HRESULT hrStatus)
 {
+    MethodTable::RemoveModule(moduleId);
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ModuleAttachedToAssembly(ModuleID moduleId, AssemblyID AssemblyId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ModuleAttachedToAssembly(ModuleID moduleId, AssemblyID AssemblyId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ClassLoadStarted(ClassID classId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ClassLoadStarted(ClassID classId)
 {
+    OverheadTimer timer(OverheadClassLoadStarted, HasDiagnostics);
+
+    if (HasDiagnostics && StartupTimeline::IsActive())
+    {
+        StartupTimeline::Begin(StartupPhaseClass);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ClassLoadFinished(ClassID classId, HRESULT hrStatus)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ClassLoadFinished(ClassID classId, HRESULT hrStatus)
 {
+    OverheadTimer timer(OverheadClassLoadFinished, HasDiagnostics);
+
+    if (HasDiagnostics && StartupTimeline::IsActive())
+    {
+        StartupTimeline::End(StartupPhaseClass);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ClassUnloadStarted(ClassID classId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ClassUnloadStarted(ClassID classId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ClassUnloadFinished(ClassID classId, HRESULT hrStatus)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ClassUnloadFinished(ClassID classId, HRESULT hrStatus)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::FunctionUnloadStarted(FunctionID functionId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::FunctionUnloadStarted(FunctionID functionId)
 {
+    MethodTable::Remove(functionId);
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::JITCompilationStarted(FunctionID functionId, BOOL fIsSafeToBlock)
-{    
-    // Insert only once at the beginning of application
-    if (hasInserted)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::JITCompilationStarted(FunctionID functionId, BOOL fIsSafeToBlock)
+{
+    // The JIT phase starts here, the profiler's own share of it is timed separately
+    if (HasDiagnostics && StartupTimeline::IsActive())
+    {
+        StartupTimeline::Begin(StartupPhaseJit);
+    }
+
+    OverheadTimer timer(OverheadJITCompilationStarted, HasDiagnostics);
+    StartupTimer startupTimer(HasDiagnostics);
+
+    if (HasDiagnostics)
+    {
+        Recorder::RecordJITCompilationStarted(functionId, fIsSafeToBlock);
+    }
+
+    // Insert only once at the beginning of application, counted methods and call sites are rewritten for the whole run
+    if (hasInserted && !IsInstrumenting())
+    {
+        return S_OK;
+    }
+
+    // Tiered compilation reports rewritten methods again, their body already carries the injected code
+    MethodDescriptor descriptor;
+    if (MethodTable::Find(functionId, &descriptor) && (descriptor.flags & MethodFlagRewritten))
+    {
+        return S_OK;
+    }
+
+    Journal::Write(JournalMethodConsidered, JournalSiteNone, functionId);
+
+    ClassID classID = 0;
+    ModuleID moduleID = 0;
+    mdToken functionToken = 0;
+    HRESULT hr = this->corProfilerInfo->GetFunctionInfo(functionId, &classID, &moduleID, &functionToken);
+
+    if (HasDiagnostics)
     {
+        Recorder::RecordFunctionInfo(functionId, classID, moduleID, functionToken, hr);
+    }
+
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteGetFunctionInfo, hr);
         return S_OK;
     }
 
-    FunctionInfo* functionInfo = GetFunctionInfoFromId(this->corProfilerInfo, functionId);
+    // Warm start: the entry point is already known, so every other method is skipped without resolving its name
+    if (!hasInserted && this->cachedEntry != nullptr)
+    {
+        if (moduleID == this->cachedEntryModuleID && functionToken == this->cachedEntry->entryPointToken)
+        {
+            LONG64 rewriteStarted = Clock::GetCounter();
+            Journal::Write(JournalRewriteStarted, JournalSiteNone, functionId);
+
+            if (WriteCachedRewrite(moduleID, functionToken))
+            {
+                Journal::Write(JournalRewriteFinished, JournalSiteNone, Clock::GetCounter() - rewriteStarted);
+                RecordMethod(functionId, moduleID, functionToken, NULL, MethodFlagEntryPoint | MethodFlagRewritten, 0);
+                hasInserted = true;
+                return S_OK;
+            }
+
+            Journal::Write(JournalRewriteFailed, JournalSiteNone, Clock::GetCounter() - rewriteStarted);
+        }
+        else if (!IsInstrumenting())
+        {
+            return S_OK;
+        }
+    }
+
+    // Indexed modules answer with one bit, methods of modules still being indexed are matched by name below
+    if (ModuleIndex::IsEnabled() && ModuleIndex::Lookup(moduleID, functionToken) == ModuleIndexNotTarget)
+    {
+        return S_OK;
+    }
+
+    // Call sites go first, a prologue inserted below is then written on top of the redirected body
+    if (HasInstrumentation && CallSites::IsEnabled())
+    {
+        RedirectCallSites(functionId, moduleID, functionToken);
+
+        if (hasInserted && !MethodCounters::IsEnabled())
+        {
+            return S_OK;
+        }
+    }
+
+    FunctionInfo* functionInfo = GetFunctionInfoFromId(this->corProfilerInfo, functionId, classID, moduleID, functionToken);
 
     if (functionInfo == NULL)
     {
         return S_OK;
     }
 
+    if (hasInserted || wcscmp(functionInfo->GetFunctionName(), L"Main") != 0)
+    {
+        if (HasInstrumentation)
+        {
+            InsertCallCounter(functionInfo);
+        }
+
+        delete functionInfo;
+        return S_OK;
+    }
+
     ILWriter* ilWriter = new ILWriter(this->corProfilerInfo, functionInfo);
 
     if (ilWriter == nullptr)
     {
+        delete functionInfo;
         return E_FAIL;
     }
 
-    if (ilWriter->Write())
+    LONG64 rewriteStarted = Clock::GetCounter();
+    Journal::Write(JournalRewriteStarted, JournalSiteNone, functionId);
+
+    BOOL written = FALSE;
+    {
+        OverheadTimer timer(OverheadILWriterWrite, HasDiagnostics);
+        written = ilWriter->Write();
+    }
+
+    if (written)
     {
+        Journal::Write(JournalRewriteFinished, JournalSiteNone, Clock::GetCounter() - rewriteStarted);
+        RecordMethod(functionId, functionInfo->GetModuleID(), functionInfo->GetToken(), functionInfo, MethodFlagEntryPoint | MethodFlagRewritten, 0);
         hasInserted = true;
+
+        // Hook references are defined anew by every process, so a body with redirected call sites is not cached
+        if (this->rewriteCache != nullptr && !(MethodTable::Find(functionId, &descriptor) && (descriptor.flags & MethodFlagRedirected)))
+        {
+            SaveRewrite(functionInfo, ilWriter);
+        }
+    }
+    else
+    {
+        Journal::Write(JournalRewriteFailed, JournalSiteNone, Clock::GetCounter() - rewriteStarted);
     }
 
+    // The method table keeps what later callbacks need to know about the method
+    delete ilWriter;
+    delete functionInfo;
+
     return S_OK;
 }
 
-FunctionInfo* CorProfiler::GetFunctionInfoFromId(ICorProfilerInfo* corProfilerInfo, FunctionID functionID)
+template <ULONG Features>
+HRESULT CorProfiler<Features>::GetModuleVersionId(ModuleID moduleID, GUID* moduleVersionId)
 {
-    ClassID classID = 0;
-    ModuleID moduleID = 0;
-    mdToken functionToken = 0;
-    HRESULT hr = corProfilerInfo->GetFunctionInfo(functionID, &classID, &moduleID, &functionToken);
+    IMetaDataImport* metaDataImport = NULL;
+    HRESULT hr = this->corProfilerInfo->GetModuleMetaData(moduleID, ofRead, IID_IMetaDataImport, (IUnknown**)&metaDataImport);
 
-    if (FAILED(hr))
+    if (FAILED(hr) || metaDataImport == NULL)
     {
-        return NULL;
+        return E_FAIL;
+    }
+
+    hr = metaDataImport->GetScopeProps(NULL, 0, NULL, moduleVersionId);
+    metaDataImport->Release();
+
+    return hr;
+}
+
+template <ULONG Features>
+BOOL CorProfiler<Features>::WriteCachedRewrite(ModuleID moduleID, mdToken functionToken)
+{
+    // Metadata emitted by the previous process is not persisted, so the reference to AddXRay is defined again.
+    // The stored body is only valid when the module hands back the same token it embeds.
+    mdMemberRef injectedMethodToken = mdTokenNil;
+    HRESULT hr = ILWriter::DefineInjectedMethod(this->corProfilerInfo, moduleID, &injectedMethodToken);
+
+    if (FAILED(hr) || injectedMethodToken != this->cachedEntry->injectedMethodToken)
+    {
+        return FALSE;
+    }
+
+    return ILWriter::WriteILHeader(this->corProfilerInfo, moduleID, functionToken, this->rewriteCache->GetILHeader(this->cachedEntry), this->cachedEntry->ilSize);
+}
+
+template <ULONG Features>
+void CorProfiler<Features>::SaveRewrite(FunctionInfo* functionInfo, ILWriter* ilWriter)
+{
+    GUID moduleVersionId;
+    if (FAILED(GetModuleVersionId(functionInfo->GetModuleID(), &moduleVersionId)))
+    {
+        return;
+    }
+
+    // Saving releases the mapped view, so the cached entry can no longer be used
+    this->cachedEntry = nullptr;
+
+    this->rewriteCache->Save(moduleVersionId, functionInfo->GetToken(), ilWriter->GetInjectedMethodToken(), ilWriter->GetWrittenILHeader(), ilWriter->GetNewMethodTotalSize());
+}
+
+template <ULONG Features>
+bool CorProfiler<Features>::IsCandidate(LPCWSTR functionName)
+{
+    return (!hasInserted && wcscmp(functionName, L"Main") == 0) || (HasInstrumentation && MethodCounters::IsCountedName(functionName));
+}
+
+template <ULONG Features>
+void CorProfiler<Features>::InsertCallCounter(FunctionInfo* functionInfo)
+{
+    // The core library implements Interlocked itself, so it is never counted
+    if (wcscmp(functionInfo->GetAssemblyName(), L"System.Private.CoreLib") == 0 || wcscmp(functionInfo->GetAssemblyName(), L"mscorlib") == 0)
+    {
+        return;
+    }
+
+    LONG slot = MethodCounters::FindSlot(functionInfo->GetClassName(), functionInfo->GetFunctionName());
+    if (slot < 0 || !MethodCounters::Claim(functionInfo->GetModuleID(), functionInfo->GetToken()))
+    {
+        return;
+    }
+
+    BYTE prologue[MethodCounterPrologueSize];
+    if (FAILED(MethodCounters::BuildPrologue(this->corProfilerInfo, functionInfo, slot, prologue, MethodCounterPrologueSize)))
+    {
+        return;
+    }
+
+    ILWriter ilWriter(this->corProfilerInfo, functionInfo, prologue, MethodCounterPrologueSize, MethodCounterPrologueMaxStack);
+
+    LONG64 rewriteStarted = Clock::GetCounter();
+    Journal::Write(JournalRewriteStarted, JournalSiteNone, functionInfo->GetFunctionID());
+
+    if (ilWriter.Write())
+    {
+        Journal::Write(JournalRewriteFinished, JournalSiteNone, Clock::GetCounter() - rewriteStarted);
+        RecordMethod(functionInfo->GetFunctionID(), functionInfo->GetModuleID(), functionInfo->GetToken(), functionInfo, MethodFlagCounted | MethodFlagRewritten, slot);
+    }
+    else
+    {
+        Journal::Write(JournalRewriteFailed, JournalSiteNone, Clock::GetCounter() - rewriteStarted);
+    }
+}
+
+template <ULONG Features>
+void CorProfiler<Features>::RedirectCallSites(FunctionID functionId, ModuleID moduleId, mdToken token)
+{
+    LONG64 rewriteStarted = Clock::GetCounter();
+    ULONG redirected = 0;
+    HRESULT hr = CallSites::Redirect(this->corProfilerInfo, moduleId, token, &redirected);
+
+    if (hr == S_OK)
+    {
+        Journal::Write(JournalCallSitesRedirected, JournalSiteNone, redirected);
+        RecordMethod(functionId, moduleId, token, NULL, MethodFlagRedirected | MethodFlagRewritten, 0);
+    }
+    else if (FAILED(hr))
+    {
+        Journal::Write(JournalRewriteFailed, JournalSiteNone, Clock::GetCounter() - rewriteStarted);
     }
+}
+
+template <ULONG Features>
+void CorProfiler<Features>::RecordMethod(FunctionID functionId, ModuleID moduleId, mdToken token, FunctionInfo* functionInfo, ULONG flags, ULONG counterSlot)
+{
+    MethodDescriptor descriptor = { 0 };
+    descriptor.functionId = functionId;
+    descriptor.moduleId = moduleId;
+    descriptor.token = token;
+    descriptor.flags = flags;
+    descriptor.counterSlot = counterSlot;
 
+    // A method can be redirected and then counted or rewritten as the entry point in the same callback
+    MethodDescriptor existing;
+    if (MethodTable::Find(functionId, &existing))
+    {
+        descriptor.flags |= existing.flags;
+    }
+
+    if (functionInfo != NULL)
+    {
+        descriptor.assemblyNameId = MethodTable::InternName(functionInfo->GetAssemblyName());
+        descriptor.classNameId = MethodTable::InternName(functionInfo->GetClassName());
+        descriptor.methodNameId = MethodTable::InternName(functionInfo->GetFunctionName());
+    }
+
+    MethodTable::Insert(descriptor);
+}
+
+template <ULONG Features>
+FunctionInfo* CorProfiler<Features>::GetFunctionInfoFromId(ICorProfilerInfo* corProfilerInfo, FunctionID functionID, ClassID classID, ModuleID moduleID, mdToken functionToken)
+{
+    OverheadTimer timer(OverheadGetFunctionInfoFromId, HasDiagnostics);
+
+    // The caller already asked GetFunctionInfo, and recorded its answer, for the ids passed in
     wchar_t moduleName[DefaultLength];
     LPCBYTE baseAddress = NULL;
     ULONG modulePathLength = 0;
     AssemblyID assemblyID;
-    hr = corProfilerInfo->GetModuleInfo(moduleID, &baseAddress, DefaultLength, &modulePathLength, moduleName, &assemblyID);
+    DWORD moduleFlags = 0;
+    HRESULT hr = this->corProfilerInfo->GetModuleInfo2(moduleID, &baseAddress, DefaultLength, &modulePathLength, moduleName, &assemblyID, &moduleFlags);
+
+    if (HasDiagnostics)
+    {
+        Recorder::RecordModuleInfo(moduleID, assemblyID, hr, moduleName);
+    }
 
     if (FAILED(hr))
     {
+        Journal::WriteFailure(JournalSiteGetModuleInfo, hr);
         return NULL;
     }
 
@@ -197,11 +684,41 @@ FunctionInfo* CorProfiler::GetFunctionInfoFromId(ICorProfilerInfo* corProfilerIn
     ModuleID module;
     hr = corProfilerInfo->GetAssemblyInfo(assemblyID, assemblyNameSize, &assemblyNameLength, assemblyName, &appDomainID, &module);
 
+    if (HasDiagnostics)
+    {
+        Recorder::RecordAssemblyInfo(assemblyID, appDomainID, module, hr, assemblyName);
+    }
+
     if (FAILED(hr))
     {
+        Journal::WriteFailure(JournalSiteGetAssemblyInfo, hr);
         return NULL;
     }
 
+    // Loaded images are read in place; IMetaDataImport remains for dynamic modules, images the reader
+    // rejects, and recordings, which have to capture its answers
+    MetadataReader metadataReader;
+    if (!(HasDiagnostics && Recorder::IsEnabled()) && (moduleFlags & COR_PRF_MODULE_DYNAMIC) == 0 && metadataReader.Open(baseAddress, (moduleFlags & COR_PRF_MODULE_FLAT_LAYOUT) != 0))
+    {
+        MetadataMethodDef methodDef;
+        MetadataTypeDef typeDef;
+        WCHAR functionName[DefaultLength];
+        WCHAR className[DefaultLength];
+
+        if (metadataReader.GetMethodDef(functionToken, &methodDef) && MetadataReader::GetName(methodDef.name, functionName, DefaultLength))
+        {
+            if (!IsCandidate(functionName))
+            {
+                return NULL;
+            }
+
+            if (metadataReader.GetTypeDef(metadataReader.GetMethodOwner(functionToken), &typeDef) && MetadataReader::GetTypeName(typeDef.nameSpace, typeDef.name, className, DefaultLength))
+            {
+                return new FunctionInfo(functionID, classID, moduleID, functionToken, functionName, className, assemblyName);
+            }
+        }
+    }
+
     IMetaDataImport* metaDataImport = NULL;
     mdToken mdtoken = NULL;
     IID iidMetaDataImport = IID_IMetaDataImport;
@@ -209,6 +726,7 @@ FunctionInfo* CorProfiler::GetFunctionInfoFromId(ICorProfilerInfo* corProfilerIn
 
     if (FAILED(hr) || metaDataImport == NULL)
     {
+        Journal::WriteFailure(JournalSiteGetTokenAndMetaDataFromFunction, hr);
         return NULL;
     }
 
@@ -223,13 +741,21 @@ FunctionInfo* CorProfiler::GetFunctionInfoFromId(ICorProfilerInfo* corProfilerIn
     DWORD functionFlags = NULL;
     hr = metaDataImport->GetMethodProps(mdtoken, &classTypeDef, functionName, functionSize, &functionSizePath, &functionAttributes, &functionSignature, &functionSignatureLength, &functionAddress, &functionFlags);
 
+    if (HasDiagnostics)
+    {
+        Recorder::RecordMethodProps(moduleID, mdtoken, classTypeDef, functionAttributes, functionFlags, hr, functionName, functionSignature, functionSignatureLength);
+    }
+
     if (FAILED(hr))
     {
+        Journal::WriteFailure(JournalSiteGetMethodProps, hr);
+        metaDataImport->Release();
         return NULL;
     }
 
-    if (wcscmp(functionName, L"Main") != 0)
+    if (!IsCandidate(functionName))
     {
+        metaDataImport->Release();
         return NULL;
     }
 
@@ -240,8 +766,15 @@ FunctionInfo* CorProfiler::GetFunctionInfoFromId(ICorProfilerInfo* corProfilerIn
     mdToken classMdToken = NULL;
     hr = metaDataImport->GetTypeDefProps(classTypeDef, className, classNameSize, &numberOfChar, &classFlag, &classMdToken);
 
+    if (HasDiagnostics)
+    {
+        Recorder::RecordTypeDefProps(moduleID, classTypeDef, classFlag, classMdToken, hr, className);
+    }
+
     if (FAILED(hr))
     {
+        Journal::WriteFailure(JournalSiteGetTypeDefProps, hr);
+        metaDataImport->Release();
         return NULL;
     }
 
@@ -252,352 +785,594 @@ FunctionInfo* CorProfiler::GetFunctionInfoFromId(ICorProfilerInfo* corProfilerIn
 }
 
 
-HRESULT STDMETHODCALLTYPE CorProfiler::JITCompilationFinished(FunctionID functionId, HRESULT hrStatus, BOOL fIsSafeToBlock)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::JITCompilationFinished(FunctionID functionId, HRESULT hrStatus, BOOL fIsSafeToBlock)
+{
+    OverheadTimer timer(OverheadJITCompilationFinished, HasDiagnostics);
+
+    if (HasDiagnostics && StartupTimeline::IsActive())
+    {
+        StartupTimeline::End(StartupPhaseJit);
+    }
+
+    return S_OK;
+}
+
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::JITCachedFunctionSearchStarted(FunctionID functionId, BOOL *pbUseCachedFunction)
+{
+    return S_OK;
+}
+
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::JITCachedFunctionSearchFinished(FunctionID functionId, COR_PRF_JIT_CACHE result)
+{
+    return S_OK;
+}
+
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::JITFunctionPitched(FunctionID functionId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::JITCachedFunctionSearchStarted(FunctionID functionId, BOOL *pbUseCachedFunction)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::JITInlining(FunctionID callerId, FunctionID calleeId, BOOL *pfShouldInline)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::JITCachedFunctionSearchFinished(FunctionID functionId, COR_PRF_JIT_CACHE result)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ThreadCreated(ThreadID threadId)
 {
+    OverheadTimer timer(OverheadThreadCreated, HasDiagnostics);
+
+    if (HasThreads && ThreadMonitor::IsEnabled())
+    {
+        ThreadMonitor::Add(threadId);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::JITFunctionPitched(FunctionID functionId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ThreadDestroyed(ThreadID threadId)
 {
+    OverheadTimer timer(OverheadThreadDestroyed, HasDiagnostics);
+
+    if (HasThreads && ThreadMonitor::IsEnabled())
+    {
+        ThreadMonitor::Remove(threadId);
+    }
+
+    if (HasThreads)
+    {
+        TraceContext::Unbind(threadId);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::JITInlining(FunctionID callerId, FunctionID calleeId, BOOL *pfShouldInline)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ThreadAssignedToOSThread(ThreadID managedThreadId, DWORD osThreadId)
 {
+    OverheadTimer timer(OverheadThreadAssignedToOSThread, HasDiagnostics);
+
+    if (HasThreads && ThreadMonitor::IsEnabled())
+    {
+        ThreadMonitor::Assign(managedThreadId, osThreadId);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ThreadCreated(ThreadID threadId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RemotingClientInvocationStarted()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ThreadDestroyed(ThreadID threadId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RemotingClientSendingMessage(GUID *pCookie, BOOL fIsAsync)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ThreadAssignedToOSThread(ThreadID managedThreadId, DWORD osThreadId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RemotingClientReceivingReply(GUID *pCookie, BOOL fIsAsync)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RemotingClientInvocationStarted()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RemotingClientInvocationFinished()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RemotingClientSendingMessage(GUID *pCookie, BOOL fIsAsync)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RemotingServerReceivingMessage(GUID *pCookie, BOOL fIsAsync)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RemotingClientReceivingReply(GUID *pCookie, BOOL fIsAsync)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RemotingServerInvocationStarted()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RemotingClientInvocationFinished()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RemotingServerInvocationReturned()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RemotingServerReceivingMessage(GUID *pCookie, BOOL fIsAsync)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RemotingServerSendingReply(GUID *pCookie, BOOL fIsAsync)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RemotingServerInvocationStarted()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::UnmanagedToManagedTransition(FunctionID functionId, COR_PRF_TRANSITION_REASON reason)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RemotingServerInvocationReturned()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ManagedToUnmanagedTransition(FunctionID functionId, COR_PRF_TRANSITION_REASON reason)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RemotingServerSendingReply(GUID *pCookie, BOOL fIsAsync)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RuntimeSuspendStarted(COR_PRF_SUSPEND_REASON suspendReason)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::UnmanagedToManagedTransition(FunctionID functionId, COR_PRF_TRANSITION_REASON reason)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RuntimeSuspendFinished()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ManagedToUnmanagedTransition(FunctionID functionId, COR_PRF_TRANSITION_REASON reason)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RuntimeSuspendAborted()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RuntimeSuspendStarted(COR_PRF_SUSPEND_REASON suspendReason)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RuntimeResumeStarted()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RuntimeSuspendFinished()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RuntimeResumeFinished()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RuntimeSuspendAborted()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RuntimeThreadSuspended(ThreadID threadId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RuntimeResumeStarted()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RuntimeThreadResumed(ThreadID threadId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RuntimeResumeFinished()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::MovedReferences(ULONG cMovedObjectIDRanges, ObjectID oldObjectIDRangeStart[], ObjectID newObjectIDRangeStart[], ULONG cObjectIDRangeLength[])
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RuntimeThreadSuspended(ThreadID threadId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ObjectAllocated(ObjectID objectId, ClassID classId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RuntimeThreadResumed(ThreadID threadId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ObjectsAllocatedByClass(ULONG cClassCount, ClassID classIds[], ULONG cObjects[])
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::MovedReferences(ULONG cMovedObjectIDRanges, ObjectID oldObjectIDRangeStart[], ObjectID newObjectIDRangeStart[], ULONG cObjectIDRangeLength[])
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ObjectReferences(ObjectID objectId, ClassID classId, ULONG cObjectRefs, ObjectID objectRefIds[])
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ObjectAllocated(ObjectID objectId, ClassID classId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RootReferences(ULONG cRootRefs, ObjectID rootRefIds[])
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ObjectsAllocatedByClass(ULONG cClassCount, ClassID classIds[], ULONG cObjects[])
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionThrown(ObjectID thrownObjectId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ObjectReferences(ObjectID objectId, ClassID classId, ULONG cObjectRefs, ObjectID objectRefIds[])
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionSearchFunctionEnter(FunctionID functionId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RootReferences(ULONG cRootRefs, ObjectID rootRefIds[])
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionSearchFunctionLeave()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionThrown(ObjectID thrownObjectId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionSearchFilterEnter(FunctionID functionId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionSearchFunctionEnter(FunctionID functionId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionSearchFilterLeave()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionSearchFunctionLeave()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionSearchCatcherFound(FunctionID functionId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionSearchFilterEnter(FunctionID functionId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionOSHandlerEnter(UINT_PTR __unused)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionSearchFilterLeave()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionOSHandlerLeave(UINT_PTR __unused)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionSearchCatcherFound(FunctionID functionId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionUnwindFunctionEnter(FunctionID functionId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionOSHandlerEnter(UINT_PTR __unused)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionUnwindFunctionLeave()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionOSHandlerLeave(UINT_PTR __unused)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionUnwindFinallyEnter(FunctionID functionId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionUnwindFunctionEnter(FunctionID functionId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionUnwindFinallyLeave()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionUnwindFunctionLeave()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionCatcherEnter(FunctionID functionId, ObjectID objectId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionUnwindFinallyEnter(FunctionID functionId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionCatcherLeave()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionUnwindFinallyLeave()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::COMClassicVTableCreated(ClassID wrappedClassId, REFGUID implementedIID, void *pVTable, ULONG cSlots)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionCatcherEnter(FunctionID functionId, ObjectID objectId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::COMClassicVTableDestroyed(ClassID wrappedClassId, REFGUID implementedIID, void *pVTable)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionCatcherLeave()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionCLRCatcherFound()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::COMClassicVTableCreated(ClassID wrappedClassId, REFGUID implementedIID, void *pVTable, ULONG cSlots)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ExceptionCLRCatcherExecute()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::COMClassicVTableDestroyed(ClassID wrappedClassId, REFGUID implementedIID, void *pVTable)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ThreadNameChanged(ThreadID threadId, ULONG cchName, WCHAR name[])
 {
+    OverheadTimer timer(OverheadThreadNameChanged, HasDiagnostics);
+
+    if (HasThreads && ThreadMonitor::IsEnabled())
+    {
+        ThreadMonitor::SetName(threadId, cchName, name);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionCLRCatcherFound()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::GarbageCollectionStarted(int cGenerations, BOOL generationCollected[], COR_PRF_GC_REASON reason)
 {
+    OverheadTimer timer(OverheadGarbageCollectionStarted, HasDiagnostics);
+
+    if (HasHeap && HeapSnapshots::IsEnabled())
+    {
+        HeapSnapshots::Started(cGenerations, generationCollected, reason);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ExceptionCLRCatcherExecute()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::SurvivingReferences(ULONG cSurvivingObjectIDRanges, ObjectID objectIDRangeStart[], ULONG cObjectIDRangeLength[])
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ThreadNameChanged(ThreadID threadId, ULONG cchName, WCHAR name[])
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::GarbageCollectionFinished()
 {
+    OverheadTimer timer(OverheadGarbageCollectionFinished, HasDiagnostics);
+
+    if (HasHeap && HeapSnapshots::IsEnabled())
+    {
+        HeapSnapshots::Finished();
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::GarbageCollectionStarted(int cGenerations, BOOL generationCollected[], COR_PRF_GC_REASON reason)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::FinalizeableObjectQueued(DWORD finalizerFlags, ObjectID objectID)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::SurvivingReferences(ULONG cSurvivingObjectIDRanges, ObjectID objectIDRangeStart[], ULONG cObjectIDRangeLength[])
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::RootReferences2(ULONG cRootRefs, ObjectID rootRefIds[], COR_PRF_GC_ROOT_KIND rootKinds[], COR_PRF_GC_ROOT_FLAGS rootFlags[], UINT_PTR rootIds[])
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::GarbageCollectionFinished()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::HandleCreated(GCHandleID handleId, ObjectID initialObjectId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::FinalizeableObjectQueued(DWORD finalizerFlags, ObjectID objectID)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::HandleDestroyed(GCHandleID handleId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::RootReferences2(ULONG cRootRefs, ObjectID rootRefIds[], COR_PRF_GC_ROOT_KIND rootKinds[], COR_PRF_GC_ROOT_FLAGS rootFlags[], UINT_PTR rootIds[])
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::InitializeForAttach(IUnknown *pCorProfilerInfoUnk, void *pvClientData, UINT cbClientData)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::HandleCreated(GCHandleID handleId, ObjectID initialObjectId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ProfilerAttachComplete()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::HandleDestroyed(GCHandleID handleId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ProfilerDetachSucceeded()
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::InitializeForAttach(IUnknown *pCorProfilerInfoUnk, void *pvClientData, UINT cbClientData)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ReJITCompilationStarted(FunctionID functionId, ReJITID rejitId, BOOL fIsSafeToBlock)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ProfilerAttachComplete()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::GetReJITParameters(ModuleID moduleId, mdMethodDef methodId, ICorProfilerFunctionControl *pFunctionControl)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ProfilerDetachSucceeded()
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ReJITCompilationFinished(FunctionID functionId, ReJITID rejitId, HRESULT hrStatus, BOOL fIsSafeToBlock)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ReJITCompilationStarted(FunctionID functionId, ReJITID rejitId, BOOL fIsSafeToBlock)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ReJITError(ModuleID moduleId, mdMethodDef methodId, FunctionID functionId, HRESULT hrStatus)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::GetReJITParameters(ModuleID moduleId, mdMethodDef methodId, ICorProfilerFunctionControl *pFunctionControl)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::MovedReferences2(ULONG cMovedObjectIDRanges, ObjectID oldObjectIDRangeStart[], ObjectID newObjectIDRangeStart[], SIZE_T cObjectIDRangeLength[])
 {
+    OverheadTimer timer(OverheadSurvivingReferences, HasDiagnostics);
+
+    // Compacting collections report their survivors here, the others through SurvivingReferences2
+    if (HasHeap && HeapSnapshots::IsEnabled())
+    {
+        HeapSnapshots::Survived(cMovedObjectIDRanges, cObjectIDRangeLength);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ReJITCompilationFinished(FunctionID functionId, ReJITID rejitId, HRESULT hrStatus, BOOL fIsSafeToBlock)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::SurvivingReferences2(ULONG cSurvivingObjectIDRanges, ObjectID objectIDRangeStart[], SIZE_T cObjectIDRangeLength[])
 {
+    OverheadTimer timer(OverheadSurvivingReferences, HasDiagnostics);
+
+    if (HasHeap && HeapSnapshots::IsEnabled())
+    {
+        HeapSnapshots::Survived(cSurvivingObjectIDRanges, cObjectIDRangeLength);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ReJITError(ModuleID moduleId, mdMethodDef methodId, FunctionID functionId, HRESULT hrStatus)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ConditionalWeakTableElementReferences(ULONG cRootRefs, ObjectID keyRefIds[], ObjectID valueRefIds[], GCHandleID rootIds[])
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::MovedReferences2(ULONG cMovedObjectIDRanges, ObjectID oldObjectIDRangeStart[], ObjectID newObjectIDRangeStart[], SIZE_T cObjectIDRangeLength[])
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::GetAssemblyReferences(const WCHAR *wszAssemblyPath, ICorProfilerAssemblyReferenceProvider *pAsmRefProvider)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::SurvivingReferences2(ULONG cSurvivingObjectIDRanges, ObjectID objectIDRangeStart[], SIZE_T cObjectIDRangeLength[])
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::ModuleInMemorySymbolsUpdated(ModuleID moduleId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ConditionalWeakTableElementReferences(ULONG cRootRefs, ObjectID keyRefIds[], ObjectID valueRefIds[], GCHandleID rootIds[])
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::DynamicMethodJITCompilationStarted(FunctionID functionId, BOOL fIsSafeToBlock, LPCBYTE ilHeader, ULONG cbILHeader)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::GetAssemblyReferences(const WCHAR *wszAssemblyPath, ICorProfilerAssemblyReferenceProvider *pAsmRefProvider)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::DynamicMethodJITCompilationFinished(FunctionID functionId, HRESULT hrStatus, BOOL fIsSafeToBlock)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::ModuleInMemorySymbolsUpdated(ModuleID moduleId)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::DynamicMethodUnloaded(FunctionID functionId)
 {
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::DynamicMethodJITCompilationStarted(FunctionID functionId, BOOL fIsSafeToBlock, LPCBYTE ilHeader, ULONG cbILHeader)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::EventPipeEventDelivered(EVENTPIPE_PROVIDER provider, DWORD eventId, DWORD eventVersion, ULONG cbMetadataBlob, LPCBYTE metadataBlob, ULONG cbEventData, LPCBYTE eventData, LPCGUID pActivityId, LPCGUID pRelatedActivityId, ThreadID eventThread, ULONG numStackFrames, UINT_PTR stackFrames[])
 {
+    OverheadTimer timer(OverheadEventPipeEventDelivered, HasDiagnostics);
+
+    // The session enables a single provider, so the event id alone identifies the event
+    if (HasRuntimeEvents)
+    {
+        RuntimeEvents::Deliver(eventId, cbEventData, eventData, eventThread);
+    }
+
     return S_OK;
 }
 
-HRESULT STDMETHODCALLTYPE CorProfiler::DynamicMethodJITCompilationFinished(FunctionID functionId, HRESULT hrStatus, BOOL fIsSafeToBlock)
+template <ULONG Features>
+HRESULT STDMETHODCALLTYPE CorProfiler<Features>::EventPipeProviderCreated(EVENTPIPE_PROVIDER provider)
 {
     return S_OK;
 }
+
+template class CorProfiler<ProfilerFeaturesDefault>;
+template class CorProfiler<ProfilerFeaturesInstrumented>;
+template class CorProfiler<ProfilerFeaturesAll>;
+
+static ULONG GetRequestedFeatures()
+{
+    ULONG features = ProfilerFeatureInjection;
+
+    if (Environment::IsSet(MethodCountersVariable) || Environment::IsSet(CallSitesVariable) || Environment::IsEnabled(SqlCommandsVariable))
+    {
+        features |= ProfilerFeatureInstrumentation;
+    }
+
+    if (Environment::IsSet(RecorderPathVariable) ||
+        Environment::IsEnabled(OverheadEnabledVariable) ||
+        Environment::GetULong(GovernorBudgetVariable, 0) != 0 ||
+        Environment::IsEnabled(StartupTimelineVariable))
+    {
+        features |= ProfilerFeatureDiagnostics;
+    }
+
+    if (Environment::GetULong(ThreadMonitorThresholdVariable, 0) != 0)
+    {
+        features |= ProfilerFeatureThreads;
+    }
+
+    if (Environment::IsEnabled(RuntimeEventsVariable))
+    {
+        features |= ProfilerFeatureRuntimeEvents;
+    }
+
+    if (Environment::IsEnabled(HeapSnapshotsVariable))
+    {
+        features |= ProfilerFeatureHeap;
+    }
+
+    if (Environment::IsSet(SamplerRulesVariable))
+    {
+        features |= ProfilerFeatureSampling;
+    }
+
+    if (Environment::IsEnabled(HardwareCountersVariable))
+    {
+        features |= ProfilerFeatureHardwareCounters;
+    }
+
+    if (Environment::GetULong(ModuleIndexThreadsVariable, ModuleIndexDefaultThreads) != 0)
+    {
+        features |= ProfilerFeatureModuleIndex;
+    }
+
+    if (Environment::IsSet(RewriteCachePathVariable))
+    {
+        features |= ProfilerFeatureRewriteCache;
+    }
+
+    return features;
+}
+
+ICorProfilerCallback10* CreateCorProfiler()
+{
+    ULONG features = GetRequestedFeatures();
+    ULONG specialized = features & ProfilerFeaturesAll;
+
+    if ((specialized & ~ProfilerFeaturesDefault) == 0)
+    {
+        return new CorProfiler<ProfilerFeaturesDefault>(features);
+    }
+
+    if ((specialized & ~ProfilerFeaturesInstrumented) == 0)
+    {
+        return new CorProfiler<ProfilerFeaturesInstrumented>(features);
+    }
+
+    return new CorProfiler<ProfilerFeaturesAll>(features);
+}
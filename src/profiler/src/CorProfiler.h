@@ -7,21 +7,103 @@
 #include "cor.h"
 #include "corhdr.h"
 #include "corprof.h"
+#include "CallSites.h"
+#include "Clock.h"
+#include "CpuTime.h"
+#include "Environment.h"
 #include "FunctionInfo.h"
+#include "Governor.h"
+#include "HardwareCounters.h"
+#include "HeapSnapshots.h"
 #include "ILWriter.h"
+#include "Journal.h"
+#include "MetadataReader.h"
+#include "MethodCounters.h"
+#include "MethodTable.h"
+#include "ModuleIndex.h"
+#include "Recorder.h"
+#include "Overhead.h"
+#include "RewriteCache.h"
+#include "RuntimeEvents.h"
+#include "Sampler.h"
+#include "SqlCommands.h"
+#include "StartupTimeline.h"
+#include "ThreadMonitor.h"
+#include "TraceContext.h"
 
 #define DefaultLength 1024
 
-class CorProfiler : public ICorProfilerCallback8
+#define ProfilerFeatureInjection 0x01       // entry point rewrite
+#define ProfilerFeatureInstrumentation 0x02 // counted methods, redirected call sites
+#define ProfilerFeatureDiagnostics 0x04     // recorder, overhead histograms and governor, startup timeline
+#define ProfilerFeatureThreads 0x08         // thread-pool starvation detector
+#define ProfilerFeatureRuntimeEvents 0x10   // EventPipe session on the runtime provider
+#define ProfilerFeatureHeap 0x20            // heap snapshots at the end of each collection
+
+// Switched at run time, these never pick a specialization
+#define ProfilerFeatureSampling 0x100         // sampling rules loaded at startup
+#define ProfilerFeatureHardwareCounters 0x200 // per-thread hardware counters
+#define ProfilerFeatureModuleIndex 0x400      // background module indexing
+#define ProfilerFeatureRewriteCache 0x800     // cached entry point rewrite
+
+#define ProfilerFeaturesDefault ProfilerFeatureInjection
+#define ProfilerFeaturesInstrumented (ProfilerFeatureInjection | ProfilerFeatureInstrumentation)
+#define ProfilerFeaturesAll (ProfilerFeatureInjection | ProfilerFeatureInstrumentation | ProfilerFeatureDiagnostics | ProfilerFeatureThreads | ProfilerFeatureRuntimeEvents | ProfilerFeatureHeap)
+
+// The profiler is compiled once per feature set. Callbacks test the Has* constants before any runtime
+// switch, so the code of features left out of a specialization, their timers included, is dropped by
+// the compiler and their event mask bits can never be requested. CreateCorProfiler picks the smallest
+// specialization that covers the features the environment turns on, and hands it all the requested
+// features, so that Initialize only starts what was asked for and requests only the events it needs.
+template <ULONG Features>
+class CorProfiler : public ICorProfilerCallback10
 {
 private:
+    static constexpr bool HasInstrumentation = (Features & ProfilerFeatureInstrumentation) != 0;
+    static constexpr bool HasDiagnostics = (Features & ProfilerFeatureDiagnostics) != 0;
+    static constexpr bool HasThreads = (Features & ProfilerFeatureThreads) != 0;
+    static constexpr bool HasRuntimeEvents = (Features & ProfilerFeatureRuntimeEvents) != 0;
+    static constexpr bool HasHeap = (Features & ProfilerFeatureHeap) != 0;
+
+    static constexpr DWORD AllowedEventMask = COR_PRF_MONITOR_JIT_COMPILATION                      |
+                                              COR_PRF_MONITOR_FUNCTION_UNLOADS                     |
+                                              COR_PRF_DISABLE_TRANSPARENCY_CHECKS_UNDER_FULL_TRUST |
+                                              COR_PRF_DISABLE_INLINING                             |
+                                              COR_PRF_MONITOR_MODULE_LOADS                         |
+                                              (HasDiagnostics ? COR_PRF_MONITOR_ASSEMBLY_LOADS | COR_PRF_MONITOR_CLASS_LOADS : 0) |
+                                              (HasThreads ? COR_PRF_MONITOR_THREADS : 0)                 |
+                                              (HasHeap ? COR_PRF_MONITOR_GC : 0);
+    static constexpr DWORD AllowedHighEventMask = (HasRuntimeEvents ? COR_PRF_HIGH_MONITOR_EVENT_PIPE : 0) |
+                                                  (HasHeap ? COR_PRF_HIGH_BASIC_GC : 0);
+
+    static inline bool IsInstrumenting()
+    {
+        return HasInstrumentation && (MethodCounters::IsEnabled() || CallSites::IsEnabled());
+    }
+
+    inline bool IsRequested(ULONG feature) const
+    {
+        return (requestedFeatures & feature) != 0;
+    }
+
     std::atomic<int> refCount;
     ICorProfilerInfo8* corProfilerInfo;
     bool hasInserted;
+    ULONG requestedFeatures;
+    RewriteCache* rewriteCache;
+    ModuleID cachedEntryModuleID;
+    const RewriteCacheEntry* cachedEntry;
+    HRESULT GetModuleVersionId(ModuleID moduleID, GUID* moduleVersionId);
+    BOOL WriteCachedRewrite(ModuleID moduleID, mdToken functionToken);
+    void SaveRewrite(FunctionInfo* functionInfo, ILWriter* ilWriter);
+    bool IsCandidate(LPCWSTR functionName);
+    void InsertCallCounter(FunctionInfo* functionInfo);
+    void RedirectCallSites(FunctionID functionId, ModuleID moduleId, mdToken token);
+    void RecordMethod(FunctionID functionId, ModuleID moduleId, mdToken token, FunctionInfo* functionInfo, ULONG flags, ULONG counterSlot);
 public:
-    CorProfiler();
+    CorProfiler(ULONG requestedFeatures);
     virtual ~CorProfiler();
-    FunctionInfo* GetFunctionInfoFromId(ICorProfilerInfo* corProfilerInfo, FunctionID functionID);
+    FunctionInfo* GetFunctionInfoFromId(ICorProfilerInfo* corProfilerInfo, FunctionID functionID, ClassID classID, ModuleID moduleID, mdToken functionToken);
     HRESULT STDMETHODCALLTYPE Initialize(IUnknown* pICorProfilerInfoUnk) override;
     HRESULT STDMETHODCALLTYPE Shutdown() override;
     HRESULT STDMETHODCALLTYPE AppDomainCreationStarted(AppDomainID appDomainId) override;
@@ -114,10 +196,18 @@ public:
 
     HRESULT STDMETHODCALLTYPE DynamicMethodJITCompilationStarted(FunctionID functionId, BOOL fIsSafeToBlock, LPCBYTE ilHeader, ULONG cbILHeader) override;
     HRESULT STDMETHODCALLTYPE DynamicMethodJITCompilationFinished(FunctionID functionId, HRESULT hrStatus, BOOL fIsSafeToBlock) override;
+
+    HRESULT STDMETHODCALLTYPE DynamicMethodUnloaded(FunctionID functionId) override;
+
+    HRESULT STDMETHODCALLTYPE EventPipeEventDelivered(EVENTPIPE_PROVIDER provider, DWORD eventId, DWORD eventVersion, ULONG cbMetadataBlob, LPCBYTE metadataBlob, ULONG cbEventData, LPCBYTE eventData, LPCGUID pActivityId, LPCGUID pRelatedActivityId, ThreadID eventThread, ULONG numStackFrames, UINT_PTR stackFrames[]) override;
+    HRESULT STDMETHODCALLTYPE EventPipeProviderCreated(EVENTPIPE_PROVIDER provider) override;
+
     
     HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **ppvObject) override
     {
-        if (riid == __uuidof(ICorProfilerCallback8) ||
+        if (riid == __uuidof(ICorProfilerCallback10) ||
+            riid == __uuidof(ICorProfilerCallback9) ||
+            riid == __uuidof(ICorProfilerCallback8) ||
             riid == __uuidof(ICorProfilerCallback7) ||
             riid == __uuidof(ICorProfilerCallback6) ||
             riid == __uuidof(ICorProfilerCallback5) ||
@@ -153,3 +243,6 @@ public:
         return count;
     }
 };
+
+// Profiler specialization covering the features requested by the environment
+ICorProfilerCallback10* CreateCorProfiler();
@@ -0,0 +1,62 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#if defined(__linux__)
+#include <time.h>
+#endif
+#include "stdafx.h"
+#include "CpuTime.h"
+
+ULONG64 CpuTime::GetThreadCounter()
+{
+#if defined(__linux__)
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0)
+    {
+        return 0;
+    }
+
+    return (ULONG64)now.tv_sec * 1000000000ULL + (ULONG64)now.tv_nsec;
+#else
+    FILETIME creation;
+    FILETIME exit;
+    FILETIME kernel;
+    FILETIME user;
+
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+    {
+        return 0;
+    }
+
+    ULONG64 kernelTicks = ((ULONG64)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    ULONG64 userTicks = ((ULONG64)user.dwHighDateTime << 32) | user.dwLowDateTime;
+
+    return kernelTicks + userTicks;
+#endif
+}
+
+ULONG64 CpuTime::ToNanoseconds(ULONG64 counter)
+{
+#if defined(__linux__)
+    return counter;
+#else
+    return counter * FileTimeNanosecondsPerTick;
+#endif
+}
+
+ULONG64 CpuTime::GetThreadNanoseconds()
+{
+    return ToNanoseconds(GetThreadCounter());
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayThreadCpuTime(ULONG64* nanoseconds)
+{
+    if (nanoseconds == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    *nanoseconds = CpuTime::GetThreadNanoseconds();
+
+    return S_OK;
+}
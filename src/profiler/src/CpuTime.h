@@ -0,0 +1,22 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "cor.h"
+
+#define FileTimeNanosecondsPerTick 100ULL
+
+// CPU time consumed by the calling thread. Linux reads CLOCK_THREAD_CPUTIME_ID, in nanoseconds. Windows
+// reads the kernel and user times of GetThreadTimes, in 100 ns units. The thread's cycle count would be
+// finer, but cycles are not time: their rate follows the core's frequency, which Windows does not report,
+// so they are not converted. Callers keep the raw counter and convert the difference.
+class CpuTime
+{
+public:
+    static ULONG64 GetThreadCounter();
+    static ULONG64 ToNanoseconds(ULONG64 counter);
+    static ULONG64 GetThreadNanoseconds();
+};
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayThreadCpuTime(ULONG64* nanoseconds);
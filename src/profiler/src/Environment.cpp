@@ -0,0 +1,50 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "Environment.h"
+
+bool Environment::GetValue(LPCWSTR name, WCHAR* buffer, DWORD bufferLength)
+{
+    DWORD length = GetEnvironmentVariableW(name, buffer, bufferLength);
+
+    return length > 0 && length < bufferLength;
+}
+
+bool Environment::IsSet(LPCWSTR name)
+{
+    // With no buffer the call answers the size the value needs, terminator included, or zero when it is missing
+    return GetEnvironmentVariableW(name, NULL, 0) > 1;
+}
+
+bool Environment::IsEnabled(LPCWSTR name)
+{
+    WCHAR value[EnvironmentValueLength];
+
+    if (!GetValue(name, value, EnvironmentValueLength))
+    {
+        return false;
+    }
+
+    return wcscmp(value, L"1") == 0 || _wcsicmp(value, L"true") == 0;
+}
+
+ULONG Environment::GetULong(LPCWSTR name, ULONG defaultValue)
+{
+    WCHAR value[EnvironmentValueLength];
+
+    if (!GetValue(name, value, EnvironmentValueLength))
+    {
+        return defaultValue;
+    }
+
+    WCHAR* end = NULL;
+    ULONG result = wcstoul(value, &end, 10);
+
+    if (end == value || *end != L'\0')
+    {
+        return defaultValue;
+    }
+
+    return result;
+}
@@ -0,0 +1,19 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "cor.h"
+
+#define EnvironmentValueLength 260
+
+// Profiler settings are read from AWS_XRAY_PROFILER_* environment variables,
+// next to the CORECLR_PROFILER variables that load the profiler in the first place.
+class Environment
+{
+public:
+    static bool GetValue(LPCWSTR name, WCHAR* buffer, DWORD bufferLength);
+    static bool IsSet(LPCWSTR name);
+    static bool IsEnabled(LPCWSTR name);
+    static ULONG GetULong(LPCWSTR name, ULONG defaultValue);
+};
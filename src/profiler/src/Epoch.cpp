@@ -0,0 +1,117 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "Epoch.h"
+
+std::atomic<ULONG64> Epoch::global(1);
+std::atomic<Epoch::ThreadEpoch*> Epoch::threads(nullptr);
+std::mutex Epoch::retiredLock;
+std::vector<Epoch::Retired> Epoch::retired;
+thread_local Epoch::ThreadEpoch* Epoch::threadEpoch = nullptr;
+
+Epoch::ThreadEpoch* Epoch::GetThreadEpoch()
+{
+    if (threadEpoch != nullptr)
+    {
+        return threadEpoch;
+    }
+
+    ThreadEpoch* created = new ThreadEpoch();
+    created->epoch.store(EpochQuiescent, std::memory_order_relaxed);
+    created->depth = 0;
+
+    ThreadEpoch* head = threads.load(std::memory_order_relaxed);
+    do
+    {
+        created->next = head;
+    } while (!threads.compare_exchange_weak(head, created, std::memory_order_release, std::memory_order_relaxed));
+
+    threadEpoch = created;
+    return created;
+}
+
+void Epoch::Enter()
+{
+    ThreadEpoch* current = GetThreadEpoch();
+    if (current->depth++ > 0)
+    {
+        return;
+    }
+
+    // The store must be visible before the table pointer is read, which takes a full fence
+    current->epoch.store(global.load(std::memory_order_acquire), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void Epoch::Leave()
+{
+    ThreadEpoch* current = threadEpoch;
+    if (--current->depth > 0)
+    {
+        return;
+    }
+
+    current->epoch.store(EpochQuiescent, std::memory_order_release);
+}
+
+ULONG64 Epoch::GetOldestActive()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    ULONG64 oldest = global.load(std::memory_order_relaxed);
+    for (ThreadEpoch* thread = threads.load(std::memory_order_acquire); thread != nullptr; thread = thread->next)
+    {
+        ULONG64 epoch = thread->epoch.load(std::memory_order_acquire);
+        if (epoch != EpochQuiescent && epoch < oldest)
+        {
+            oldest = epoch;
+        }
+    }
+
+    return oldest;
+}
+
+void Epoch::Retire(void* object, void (*release)(void*))
+{
+    // Readers that see the advanced epoch entered after the object was unlinked
+    ULONG64 epoch = global.fetch_add(1, std::memory_order_seq_cst);
+
+    {
+        std::lock_guard<std::mutex> guard(retiredLock);
+        retired.push_back({ epoch, object, release });
+    }
+
+    Reclaim();
+}
+
+void Epoch::Reclaim()
+{
+    std::vector<Retired> expired;
+
+    {
+        std::lock_guard<std::mutex> guard(retiredLock);
+
+        ULONG64 oldest = GetOldestActive();
+        size_t kept = 0;
+
+        for (size_t i = 0; i < retired.size(); i++)
+        {
+            if (retired[i].epoch < oldest)
+            {
+                expired.push_back(retired[i]);
+            }
+            else
+            {
+                retired[kept++] = retired[i];
+            }
+        }
+
+        retired.resize(kept);
+    }
+
+    for (const Retired& object : expired)
+    {
+        object.release(object.object);
+    }
+}
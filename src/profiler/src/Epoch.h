@@ -0,0 +1,70 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "cor.h"
+
+#define EpochCacheLine 64
+#define EpochQuiescent 0
+
+// Epoch-based reclamation for the lock-free tables read by the callbacks.
+// A reader publishes the global epoch in its own thread's block for as long as it holds pointers
+// read from a table, so entering and leaving touch no shared cache line. A writer that unlinks an
+// object retires it under the epoch it advanced to; the object is freed once every reader still
+// inside a read section entered after that, so none of them can have seen it. Thread blocks are
+// linked into a list and never unlinked; a thread that exits leaves its block quiescent.
+class Epoch
+{
+public:
+    static void Enter();
+    static void Leave();
+
+    // Frees the object with the given function once no reader can still hold it
+    static void Retire(void* object, void (*release)(void*));
+
+    // Frees what can be freed now; called by Retire, and by writers that want memory back sooner
+    static void Reclaim();
+
+private:
+    struct alignas(EpochCacheLine) ThreadEpoch
+    {
+        std::atomic<ULONG64> epoch;
+        ULONG depth;
+        ThreadEpoch* next;
+    };
+
+    struct Retired
+    {
+        ULONG64 epoch;
+        void* object;
+        void (*release)(void*);
+    };
+
+    static ThreadEpoch* GetThreadEpoch();
+    static ULONG64 GetOldestActive();
+
+    static std::atomic<ULONG64> global;
+    static std::atomic<ThreadEpoch*> threads;
+    static std::mutex retiredLock;
+    static std::vector<Retired> retired;
+    static thread_local ThreadEpoch* threadEpoch;
+};
+
+// Keeps the objects read from a table alive until the end of the scope
+class EpochGuard
+{
+public:
+    EpochGuard()
+    {
+        Epoch::Enter();
+    }
+
+    ~EpochGuard()
+    {
+        Epoch::Leave();
+    }
+};
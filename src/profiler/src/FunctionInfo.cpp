@@ -1,6 +1,7 @@
 // Copyright (c) .NET Foundation and contributors. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
+#include <stdlib.h>
 #include "stdafx.h"
 #include "FunctionInfo.h"
 
@@ -10,13 +11,17 @@ FunctionInfo::FunctionInfo(FunctionID functionID, ClassID classID, ModuleID modu
     this->classID = classID;
     this->moduleID = moduleID;
     this->token = token;
-    this->assemblyName = assemblyName;
-    this->functionName = functionName;
-    this->className = className;
+    // The names usually live in the caller's stack buffers, so keep copies
+    this->assemblyName = _wcsdup(assemblyName);
+    this->functionName = _wcsdup(functionName);
+    this->className = _wcsdup(className);
 }
 
 FunctionInfo::~FunctionInfo()
 {
+    free(assemblyName);
+    free(functionName);
+    free(className);
 }
 
 FunctionID FunctionInfo::GetFunctionID()
@@ -0,0 +1,276 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "Clock.h"
+#include "Environment.h"
+#include "Governor.h"
+#include "Journal.h"
+#include "Overhead.h"
+
+ULONG64 Governor::budget = 0;
+DWORD Governor::interval = GovernorDefaultIntervalMilliseconds;
+double Governor::probeCostNanoseconds = 0;
+HANDLE Governor::stopEvent = NULL;
+ULONG64 Governor::lastCallbackNanoseconds = 0;
+ULONG64 Governor::lastCounts[MethodCountersMaximumSlots] = { 0 };
+GovernedProbe Governor::probes[MethodCountersMaximumSlots] = { 0 };
+std::atomic<ULONG64> Governor::measured(0);
+std::atomic<ULONG64> Governor::transitions(0);
+std::atomic<ULONG> Governor::shed(0);
+
+void Governor::Initialize()
+{
+    budget = Environment::GetULong(GovernorBudgetVariable, 0);
+    if (budget == 0 || stopEvent != NULL)
+    {
+        return;
+    }
+
+    interval = Environment::GetULong(GovernorIntervalVariable, GovernorDefaultIntervalMilliseconds);
+    if (interval == 0)
+    {
+        interval = GovernorDefaultIntervalMilliseconds;
+    }
+
+    // The callback share of the budget comes from the overhead histograms
+    Overhead::Enable();
+
+    stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (stopEvent == NULL)
+    {
+        return;
+    }
+
+    HANDLE thread = CreateThread(NULL, 0, GovernorThread, NULL, 0, NULL);
+    if (thread != NULL)
+    {
+        CloseHandle(thread);
+    }
+}
+
+void Governor::CalibrateProbeCost()
+{
+    // An uncontended locked add is the floor of what a probe costs; contention only makes shedding kick in earlier
+    volatile LONG64 target = 0;
+    LONG64 started = Clock::GetCounter();
+
+    for (ULONG i = 0; i < GovernorCalibrationIterations; i++)
+    {
+        InterlockedAdd64(&target, 1);
+    }
+
+    LONG64 elapsed = Clock::GetCounter() - started;
+    probeCostNanoseconds = elapsed * (1000000000.0 / Clock::GetFrequency()) / GovernorCalibrationIterations;
+}
+
+DWORD WINAPI Governor::GovernorThread(LPVOID parameter)
+{
+    CalibrateProbeCost();
+
+    lastCallbackNanoseconds = Overhead::GetCallbackNanoseconds();
+    LONG64 lastCounter = Clock::GetCounter();
+
+    while (WaitForSingleObject(stopEvent, interval) == WAIT_TIMEOUT)
+    {
+        LONG64 counter = Clock::GetCounter();
+        double elapsedSeconds = (double)(counter - lastCounter) / Clock::GetFrequency();
+        lastCounter = counter;
+
+        if (elapsedSeconds > 0)
+        {
+            Evaluate(elapsedSeconds);
+        }
+    }
+
+    return 0;
+}
+
+void Governor::Evaluate(double elapsedSeconds)
+{
+    ULONG64 callbackNanoseconds = Overhead::GetCallbackNanoseconds();
+    double callbackMicroseconds = (callbackNanoseconds - lastCallbackNanoseconds) / elapsedSeconds / 1000.0;
+    lastCallbackNanoseconds = callbackNanoseconds;
+
+    ULONG slotCount = MethodCounters::GetSlotCount();
+
+    for (ULONG i = 0; i < slotCount; i++)
+    {
+        ULONG64 count = MethodCounters::GetCount(i);
+        ULONG64 hits = count - lastCounts[i];
+        lastCounts[i] = count;
+
+        // A shed probe keeps the cost it was shed at, decayed below, as the guess of what restoring it would cost
+        probes[i].enabled = MethodCounters::IsSlotEnabled(i);
+        probes[i].changed = false;
+        if (probes[i].enabled)
+        {
+            probes[i].microseconds = hits / elapsedSeconds * probeCostNanoseconds / 1000.0;
+        }
+    }
+
+    Age(probes, slotCount);
+
+    double current = Balance(callbackMicroseconds, probes, slotCount, (double)budget);
+    measured.store((ULONG64)current, std::memory_order_relaxed);
+
+    for (ULONG i = 0; i < slotCount; i++)
+    {
+        if (!probes[i].changed)
+        {
+            continue;
+        }
+
+        MethodCounters::SetSlotEnabled(i, probes[i].enabled);
+        if (probes[i].enabled)
+        {
+            shed.fetch_sub(1, std::memory_order_relaxed);
+            Report(JournalProbeRestored, i, (ULONG64)current);
+        }
+        else
+        {
+            shed.fetch_add(1, std::memory_order_relaxed);
+            Report(JournalProbeShed, i, (ULONG64)current);
+        }
+    }
+}
+
+void Governor::Age(GovernedProbe* probes, ULONG probeCount)
+{
+    for (ULONG i = 0; i < probeCount; i++)
+    {
+        if (!probes[i].enabled && ++probes[i].shedIntervals >= probes[i].decayIntervals)
+        {
+            probes[i].microseconds = probes[i].microseconds * GovernorDecayPercent / 100;
+            probes[i].shedIntervals = 0;
+        }
+    }
+}
+
+double Governor::Balance(double callbackMicroseconds, GovernedProbe* probes, ULONG probeCount, double budgetMicroseconds)
+{
+    double current = callbackMicroseconds;
+    for (ULONG i = 0; i < probeCount; i++)
+    {
+        if (probes[i].enabled)
+        {
+            current += probes[i].microseconds;
+        }
+    }
+
+    // Probes only add to the callbacks, so with no room left for any probe there is nothing to decide
+    if (callbackMicroseconds >= budgetMicroseconds)
+    {
+        return current;
+    }
+
+    // Over budget: shed the busiest probe left, until the estimate fits
+    while (current > budgetMicroseconds)
+    {
+        LONG busiest = -1;
+        for (ULONG i = 0; i < probeCount; i++)
+        {
+            if (probes[i].enabled && (busiest < 0 || probes[i].microseconds > probes[busiest].microseconds))
+            {
+                busiest = (LONG)i;
+            }
+        }
+
+        if (busiest < 0)
+        {
+            break;
+        }
+
+        // A trial that failed at once waits twice as long before the next one
+        ULONG decayIntervals = probes[busiest].decayIntervals > 0 ? probes[busiest].decayIntervals : 1;
+        if (probes[busiest].restored && decayIntervals < GovernorMaximumDecayIntervals)
+        {
+            decayIntervals *= 2;
+        }
+
+        probes[busiest].decayIntervals = decayIntervals;
+        probes[busiest].shedIntervals = 0;
+        probes[busiest].restored = false;
+        probes[busiest].enabled = false;
+        probes[busiest].changed = !probes[busiest].changed;
+        current -= probes[busiest].microseconds;
+    }
+
+    // Under budget: restore the quietest shed probe while the estimate stays within the restore threshold
+    while (current <= budgetMicroseconds)
+    {
+        LONG quietest = -1;
+        for (ULONG i = 0; i < probeCount; i++)
+        {
+            if (!probes[i].enabled && (quietest < 0 || probes[i].microseconds < probes[quietest].microseconds))
+            {
+                quietest = (LONG)i;
+            }
+        }
+
+        if (quietest < 0)
+        {
+            break;
+        }
+
+        double restored = current + probes[quietest].microseconds;
+        if (restored > budgetMicroseconds * GovernorRestorePercent / 100)
+        {
+            break;
+        }
+
+        probes[quietest].enabled = true;
+        probes[quietest].changed = !probes[quietest].changed;
+        probes[quietest].restored = true;
+        current = restored;
+    }
+
+    // A probe restored by the last balance that still fits has passed its trial
+    for (ULONG i = 0; i < probeCount; i++)
+    {
+        if (probes[i].enabled && !probes[i].changed && probes[i].restored)
+        {
+            probes[i].restored = false;
+            probes[i].decayIntervals = 1;
+        }
+    }
+
+    return current;
+}
+
+void Governor::Report(uint16_t eventType, ULONG slot, ULONG64 measuredMicroseconds)
+{
+    transitions.fetch_add(1, std::memory_order_relaxed);
+
+    ULONG64 clamped = measuredMicroseconds > 0xFFFFFFFF ? 0xFFFFFFFF : measuredMicroseconds;
+    Journal::Write(eventType, JournalSiteNone, ((ULONG64)slot << 32) | clamped);
+}
+
+HRESULT Governor::GetStatus(GovernorStatus* status)
+{
+    if (status == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    status->budgetMicroseconds = budget;
+    status->measuredMicroseconds = measured.load(std::memory_order_relaxed);
+    status->transitions = transitions.load(std::memory_order_relaxed);
+    status->shedProbes = shed.load(std::memory_order_relaxed);
+    status->reserved = 0;
+
+    return budget == 0 ? S_FALSE : S_OK;
+}
+
+void Governor::Shutdown()
+{
+    if (stopEvent != NULL)
+    {
+        SetEvent(stopEvent);
+    }
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayProfilerGovernor(GovernorStatus* status)
+{
+    return Governor::GetStatus(status);
+}
@@ -0,0 +1,75 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include "cor.h"
+#include "MethodCounters.h"
+
+#define GovernorBudgetVariable L"AWS_XRAY_PROFILER_OVERHEAD_BUDGET"
+#define GovernorIntervalVariable L"AWS_XRAY_PROFILER_GOVERNOR_INTERVAL"
+#define GovernorDefaultIntervalMilliseconds 1000
+#define GovernorRestorePercent 75
+#define GovernorCalibrationIterations 100000
+#define GovernorDecayPercent 50
+#define GovernorMaximumDecayIntervals 64
+
+typedef struct
+{
+    double microseconds; // cost per second of wall time while enabled, for a shed probe the decayed cost it was shed at
+    ULONG decayIntervals; // intervals between decays of a shed probe, doubled each time a restored probe is shed again
+    ULONG shedIntervals; // intervals since a shed probe last decayed
+    bool restored; // restored by the last balance and not measured yet
+    bool enabled;
+    bool changed;
+} GovernedProbe;
+
+typedef struct
+{
+    ULONG64 budgetMicroseconds;
+    ULONG64 measuredMicroseconds;
+    ULONG64 transitions;
+    ULONG shedProbes;
+    ULONG reserved;
+} GovernorStatus;
+
+// Keeps the profiler's own cost under AWS_XRAY_PROFILER_OVERHEAD_BUDGET, in microseconds of profiler
+// time per second of wall time. Every interval the governor adds the time spent in the runtime's
+// callbacks to the estimated cost of the call counter probes, sheds the busiest probes while the total
+// is over budget and restores the quietest ones once they fit in GovernorRestorePercent of it again.
+// A shed probe counts nothing, so its cost decays by GovernorDecayPercent every few intervals until it
+// is restored and measured again; a restored probe that has to be shed at once waits twice as long for
+// its next trial. Shedding cannot make callbacks cheaper, so while they alone exceed the budget the
+// probes are left as they are. Each transition is written to the journal.
+class Governor
+{
+public:
+    static void Initialize();
+    static void Shutdown();
+    static HRESULT GetStatus(GovernorStatus* status);
+
+    // Decays the cost of shed probes by one interval
+    static void Age(GovernedProbe* probes, ULONG probeCount);
+    // Sheds and restores probes against the budget, marking each one it changes; returns the new estimate
+    static double Balance(double callbackMicroseconds, GovernedProbe* probes, ULONG probeCount, double budgetMicroseconds);
+
+private:
+    static DWORD WINAPI GovernorThread(LPVOID parameter);
+    static void CalibrateProbeCost();
+    static void Evaluate(double elapsedSeconds);
+    static void Report(uint16_t eventType, ULONG slot, ULONG64 measuredMicroseconds);
+
+    static ULONG64 budget;
+    static DWORD interval;
+    static double probeCostNanoseconds;
+    static HANDLE stopEvent;
+    static ULONG64 lastCallbackNanoseconds;
+    static ULONG64 lastCounts[MethodCountersMaximumSlots];
+    static GovernedProbe probes[MethodCountersMaximumSlots];
+    static std::atomic<ULONG64> measured;
+    static std::atomic<ULONG64> transitions;
+    static std::atomic<ULONG> shed;
+};
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayProfilerGovernor(GovernorStatus* status);
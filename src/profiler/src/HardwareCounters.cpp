@@ -0,0 +1,245 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#if defined(__linux__)
+#include <errno.h>
+#include <string.h>
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "stdafx.h"
+#include "Environment.h"
+#include "HardwareCounters.h"
+
+std::atomic<bool> HardwareCounters::enabled(false);
+std::atomic<bool> HardwareCounters::refused(false);
+thread_local HardwareCounters::ThreadCounters HardwareCounters::threadCounters;
+
+HardwareCounters::ThreadCounters::ThreadCounters() : available(0), attempted(false)
+{
+    for (ULONG i = 0; i < HardwareCounterCount; i++)
+    {
+        descriptors[i] = -1;
+        pages[i] = NULL;
+    }
+}
+
+HardwareCounters::ThreadCounters::~ThreadCounters()
+{
+#if defined(__linux__)
+    for (ULONG i = 0; i < HardwareCounterCount; i++)
+    {
+        if (pages[i] != NULL)
+        {
+            munmap(pages[i], (size_t)sysconf(_SC_PAGESIZE));
+        }
+
+        if (descriptors[i] >= 0)
+        {
+            close(descriptors[i]);
+        }
+    }
+#endif
+}
+
+void HardwareCounters::Initialize()
+{
+#if defined(__linux__)
+    enabled.store(Environment::IsEnabled(HardwareCountersVariable), std::memory_order_relaxed);
+#endif
+}
+
+HardwareCounters::ThreadCounters* HardwareCounters::GetThreadCounters()
+{
+    ThreadCounters* counters = &threadCounters;
+    if (!counters->attempted)
+    {
+        counters->attempted = true;
+        Open(counters);
+    }
+
+    return counters;
+}
+
+void HardwareCounters::Open(ThreadCounters* counters)
+{
+#if defined(__linux__)
+    static const struct
+    {
+        __u32 type;
+        __u64 config;
+    } events[HardwareCounterCount] =
+    {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    };
+
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    int leader = -1;
+
+    for (ULONG i = 0; i < HardwareCounterCount && !refused.load(std::memory_order_relaxed); i++)
+    {
+        perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = events[i].type;
+        attributes.config = events[i].config;
+        attributes.exclude_hv = 1;
+
+        // Switches happen in the kernel, the other counters count this thread's own code
+        attributes.exclude_kernel = i == HardwareCounterContextSwitches ? 0 : 1;
+
+        int group = i == HardwareCounterContextSwitches ? -1 : leader;
+        int descriptor = (int)syscall(SYS_perf_event_open, &attributes, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+
+        if (descriptor < 0)
+        {
+            // No perf access at all, which will not change for the next thread
+            if (i == HardwareCounterCycles && (errno == EACCES || errno == EPERM || errno == ENOSYS || errno == ENOENT || errno == ENODEV || errno == EOPNOTSUPP))
+            {
+                refused.store(true, std::memory_order_relaxed);
+            }
+
+            continue;
+        }
+
+        if (i == HardwareCounterCycles)
+        {
+            leader = descriptor;
+        }
+
+        counters->descriptors[i] = descriptor;
+        counters->available |= 1 << i;
+
+        void* page = mmap(NULL, pageSize, PROT_READ, MAP_SHARED, descriptor, 0);
+        counters->pages[i] = page != MAP_FAILED ? page : NULL;
+    }
+
+    // getrusage counts the thread's switches without any perf access
+    counters->available |= 1 << HardwareCounterContextSwitches;
+#endif
+}
+
+ULONG64 HardwareCounters::ReadCounter(ThreadCounters* counters, ULONG counter)
+{
+#if defined(__linux__)
+    int descriptor = counters->descriptors[counter];
+
+    if (descriptor < 0)
+    {
+        rusage usage;
+        return getrusage(RUSAGE_THREAD, &usage) == 0 ? (ULONG64)(usage.ru_nvcsw + usage.ru_nivcsw) : 0;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    volatile perf_event_mmap_page* page = (volatile perf_event_mmap_page*)counters->pages[counter];
+    if (page != NULL)
+    {
+        // The kernel bumps the lock around every update of the page, the same protocol as a seqlock
+        __u32 sequence;
+        __u32 index;
+        ULONG64 count;
+
+        do
+        {
+            sequence = page->lock;
+            std::atomic_signal_fence(std::memory_order_acquire);
+
+            index = page->cap_user_rdpmc ? page->index : 0;
+            count = page->offset;
+
+            if (index != 0)
+            {
+                ULONG width = page->pmc_width;
+                ULONG64 raw = __builtin_ia32_rdpmc((int)(index - 1)) << (64 - width);
+                count += (ULONG64)((LONG64)raw >> (64 - width));
+            }
+
+            std::atomic_signal_fence(std::memory_order_acquire);
+        } while (page->lock != sequence);
+
+        // An index of zero means the counter is not on the core right now, or user reads are not allowed
+        if (index != 0)
+        {
+            return count;
+        }
+    }
+#endif
+
+    ULONG64 value = 0;
+    return read(descriptor, &value, sizeof(value)) == sizeof(value) ? value : 0;
+#else
+    return 0;
+#endif
+}
+
+HRESULT HardwareCounters::Read(HardwareCounterSnapshot* snapshot)
+{
+    memset(snapshot, 0, sizeof(HardwareCounterSnapshot));
+
+    if (!enabled.load(std::memory_order_relaxed))
+    {
+        return S_FALSE;
+    }
+
+    ThreadCounters* counters = GetThreadCounters();
+
+    for (ULONG i = 0; i < HardwareCounterCount; i++)
+    {
+        if ((counters->available & (1 << i)) != 0)
+        {
+            snapshot->values[i] = ReadCounter(counters, i);
+        }
+    }
+
+    snapshot->owner = (ULONG64)counters;
+    snapshot->available = counters->available;
+
+    return counters->available != 0 ? S_OK : S_FALSE;
+}
+
+HRESULT HardwareCounters::Begin(HardwareCounterSnapshot* snapshot)
+{
+    if (snapshot == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    return Read(snapshot);
+}
+
+HRESULT HardwareCounters::End(const HardwareCounterSnapshot* begin, HardwareCounterSnapshot* delta)
+{
+    if (begin == NULL || delta == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    HardwareCounterSnapshot current;
+    Read(&current);
+
+    delta->owner = current.owner;
+    delta->available = current.owner == begin->owner ? current.available & begin->available : 0;
+
+    for (ULONG i = 0; i < HardwareCounterCount; i++)
+    {
+        delta->values[i] = (delta->available & (1 << i)) != 0 ? current.values[i] - begin->values[i] : 0;
+    }
+
+    return delta->available != 0 ? S_OK : S_FALSE;
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE BeginXRayHardwareCounters(HardwareCounterSnapshot* snapshot)
+{
+    return HardwareCounters::Begin(snapshot);
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE EndXRayHardwareCounters(const HardwareCounterSnapshot* begin, HardwareCounterSnapshot* delta)
+{
+    return HardwareCounters::End(begin, delta);
+}
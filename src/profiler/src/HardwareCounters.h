@@ -0,0 +1,66 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include "cor.h"
+#include "corprof.h"
+
+#define HardwareCountersVariable L"AWS_XRAY_PROFILER_HARDWARE_COUNTERS"
+
+#define HardwareCounterCycles 0
+#define HardwareCounterInstructions 1
+#define HardwareCounterCacheMisses 2
+#define HardwareCounterContextSwitches 3
+#define HardwareCounterCount 4
+
+typedef struct
+{
+    ULONG64 values[HardwareCounterCount];
+    ULONG64 owner; // thread that took the snapshot, a difference across threads means nothing
+    ULONG available; // bit per counter that could be opened on that thread
+} HardwareCounterSnapshot;
+
+// Opt-in hardware counters of the calling thread, enabled by AWS_XRAY_PROFILER_HARDWARE_COUNTERS on
+// Linux. The first snapshot on a thread opens perf_event_open counters for its user-mode cycles,
+// instructions and last-level cache misses, as one group so that they are scheduled together, and for
+// its context switches. Counters are read with rdpmc from their mapped page while the kernel allows it
+// and the counter is live on the core, otherwise with a read of the descriptor. The SDK takes a
+// snapshot when a segment begins on a thread and the difference when it ends there; a segment that
+// ended on another thread gets an empty difference. Counters that cannot be opened, in containers
+// without perf access, are left out of the available mask, and once the first thread is refused the
+// others do not ask again; context switches then come from getrusage. On other platforms snapshots
+// are empty and return S_FALSE.
+class HardwareCounters
+{
+public:
+    static void Initialize();
+
+    static HRESULT Begin(HardwareCounterSnapshot* snapshot);
+    static HRESULT End(const HardwareCounterSnapshot* begin, HardwareCounterSnapshot* delta);
+
+private:
+    struct ThreadCounters
+    {
+        int descriptors[HardwareCounterCount];
+        void* pages[HardwareCounterCount];
+        ULONG available;
+        bool attempted;
+
+        ThreadCounters();
+        ~ThreadCounters();
+    };
+
+    static ThreadCounters* GetThreadCounters();
+    static void Open(ThreadCounters* threadCounters);
+    static ULONG64 ReadCounter(ThreadCounters* threadCounters, ULONG counter);
+    static HRESULT Read(HardwareCounterSnapshot* snapshot);
+
+    static std::atomic<bool> enabled;
+    static std::atomic<bool> refused;
+    static thread_local ThreadCounters threadCounters;
+};
+
+extern "C" HRESULT STDMETHODCALLTYPE BeginXRayHardwareCounters(HardwareCounterSnapshot* snapshot);
+extern "C" HRESULT STDMETHODCALLTYPE EndXRayHardwareCounters(const HardwareCounterSnapshot* begin, HardwareCounterSnapshot* delta);
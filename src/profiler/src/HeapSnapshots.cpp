@@ -0,0 +1,202 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "Clock.h"
+#include "Environment.h"
+#include "HeapSnapshots.h"
+#include "Journal.h"
+
+ICorProfilerInfo8* HeapSnapshots::profilerInfo = NULL;
+bool HeapSnapshots::survivalMeasured = false;
+COR_PRF_GC_GENERATION_RANGE HeapSnapshots::ranges[HeapMaximumRanges];
+HeapSnapshot HeapSnapshots::current = { 0 };
+LONG64 HeapSnapshots::startedCounter = 0;
+std::mutex HeapSnapshots::snapshotsLock;
+HeapSnapshot HeapSnapshots::snapshots[HeapSnapshotCount];
+ULONG64 HeapSnapshots::snapshotCount = 0;
+
+DWORD HeapSnapshots::Initialize(ICorProfilerInfo8* profilerInfo, DWORD* highEventMask)
+{
+    if (!Environment::IsEnabled(HeapSnapshotsVariable) || HeapSnapshots::profilerInfo != NULL)
+    {
+        return 0;
+    }
+
+    DWORD eventMask = 0;
+    survivalMeasured = Environment::IsEnabled(HeapSurvivalVariable);
+
+    if (survivalMeasured)
+    {
+        // The surviving and moved ranges are only reported under full GC monitoring
+        eventMask = COR_PRF_MONITOR_GC;
+    }
+    else
+    {
+        // ICorProfilerInfo10 arrived with .NET Core 3.0, which has the lightweight notifications
+        ICorProfilerInfo10* profilerInfo10 = NULL;
+        if (FAILED(profilerInfo->QueryInterface(__uuidof(ICorProfilerInfo10), reinterpret_cast<void**>(&profilerInfo10))))
+        {
+            return 0;
+        }
+
+        profilerInfo10->Release();
+        *highEventMask |= COR_PRF_HIGH_BASIC_GC;
+    }
+
+    profilerInfo->AddRef();
+    HeapSnapshots::profilerInfo = profilerInfo;
+
+    return eventMask;
+}
+
+void HeapSnapshots::Shutdown()
+{
+    if (profilerInfo != NULL)
+    {
+        profilerInfo->Release();
+        profilerInfo = NULL;
+    }
+}
+
+bool HeapSnapshots::ReadSizes(ULONG64* sizes)
+{
+    memset(sizes, 0, sizeof(ULONG64) * HeapGenerationCount);
+
+    // Server GC reports ranges per heap; past the buffer the sizes come out short rather than not at all
+    ULONG rangeCount = 0;
+    HRESULT hr = profilerInfo->GetGenerationBounds(HeapMaximumRanges, &rangeCount, ranges);
+
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteGetGenerationBounds, hr);
+        return false;
+    }
+
+    if (rangeCount > HeapMaximumRanges)
+    {
+        rangeCount = HeapMaximumRanges;
+    }
+
+    for (ULONG i = 0; i < rangeCount; i++)
+    {
+        ULONG generation = (ULONG)ranges[i].generation;
+        if (generation < HeapGenerationCount)
+        {
+            sizes[generation] += ranges[i].rangeLength;
+        }
+    }
+
+    return true;
+}
+
+void HeapSnapshots::Started(int generationCount, BOOL generationCollected[], COR_PRF_GC_REASON reason)
+{
+    // Collections never overlap, so the snapshot under way needs no lock
+    memset(&current, 0, sizeof(HeapSnapshot));
+
+    for (int i = 0; i < generationCount && i <= HeapGeneration2; i++)
+    {
+        if (generationCollected[i])
+        {
+            current.collectedGeneration = i;
+        }
+    }
+
+    current.reason = (ULONG)reason;
+    ReadSizes(current.sizesBefore);
+    startedCounter = Clock::GetCounter();
+}
+
+void HeapSnapshots::Survived(ULONG rangeCount, SIZE_T rangeLengths[])
+{
+    for (ULONG i = 0; i < rangeCount; i++)
+    {
+        current.promotedBytes += rangeLengths[i];
+    }
+}
+
+void HeapSnapshots::Finished()
+{
+    if (startedCounter == 0)
+    {
+        return;
+    }
+
+    current.pauseMicroseconds = (ULONG64)((Clock::GetCounter() - startedCounter) * 1000000.0 / Clock::GetFrequency());
+    current.timestamp = (double)Clock::GetEpochMicroseconds() / MicrosecondsPerSecond;
+    startedCounter = 0;
+
+    ReadSizes(current.sizesAfter);
+
+    ULONG collected = current.collectedGeneration;
+    ULONG64 collectedBefore = 0;
+    ULONG64 survived = 0;
+
+    for (ULONG generation = HeapGeneration0; generation <= collected; generation++)
+    {
+        collectedBefore += current.sizesBefore[generation];
+        survived += current.sizesAfter[generation];
+    }
+
+    if (collected == HeapGeneration2)
+    {
+        // Full collections also sweep the large and pinned object heaps
+        collectedBefore += current.sizesBefore[HeapLargeObjects] + current.sizesBefore[HeapPinnedObjects];
+        survived += current.sizesAfter[HeapLargeObjects] + current.sizesAfter[HeapPinnedObjects];
+    }
+    else if (current.sizesAfter[collected + 1] > current.sizesBefore[collected + 1])
+    {
+        // Survivors of the oldest collected generation move up into the next one
+        survived += current.sizesAfter[collected + 1] - current.sizesBefore[collected + 1];
+    }
+
+    if (survivalMeasured)
+    {
+        survived = current.promotedBytes;
+        current.survivalMeasured = TRUE;
+    }
+
+    current.promotedBytes = survived;
+    current.survivalRate = collectedBefore != 0 ? (double)survived / collectedBefore : 0;
+    current.survivalRate = current.survivalRate > 1 ? 1 : current.survivalRate;
+
+    std::lock_guard<std::mutex> guard(snapshotsLock);
+
+    // The growth of the first snapshot is measured from the start of its own collection
+    const ULONG64* previous = snapshotCount != 0 ? snapshots[(snapshotCount - 1) % HeapSnapshotCount].sizesAfter : current.sizesBefore;
+    for (ULONG generation = 0; generation < HeapGenerationCount; generation++)
+    {
+        current.growth[generation] = (LONG64)(current.sizesAfter[generation] - previous[generation]);
+    }
+
+    current.index = ++snapshotCount;
+    snapshots[(current.index - 1) % HeapSnapshotCount] = current;
+}
+
+HRESULT HeapSnapshots::Get(ULONG age, HeapSnapshot* snapshot)
+{
+    if (snapshot == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    memset(snapshot, 0, sizeof(HeapSnapshot));
+
+    std::lock_guard<std::mutex> guard(snapshotsLock);
+
+    // Age zero is the latest collection, older ones are kept until the ring wraps
+    if (age >= HeapSnapshotCount || age >= snapshotCount)
+    {
+        return S_FALSE;
+    }
+
+    *snapshot = snapshots[(snapshotCount - 1 - age) % HeapSnapshotCount];
+
+    return S_OK;
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayHeapSnapshot(ULONG age, HeapSnapshot* snapshot)
+{
+    return HeapSnapshots::Get(age, snapshot);
+}
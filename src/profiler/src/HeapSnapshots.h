@@ -0,0 +1,74 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <mutex>
+#include "cor.h"
+#include "corprof.h"
+
+#define HeapSnapshotsVariable L"AWS_XRAY_PROFILER_HEAP_SNAPSHOTS"
+#define HeapSurvivalVariable L"AWS_XRAY_PROFILER_HEAP_SURVIVAL"
+#define HeapSnapshotCount 64
+#define HeapMaximumRanges 512
+
+#define HeapGeneration0 0
+#define HeapGeneration1 1
+#define HeapGeneration2 2
+#define HeapLargeObjects 3
+#define HeapPinnedObjects 4
+#define HeapGenerationCount 5
+
+typedef struct
+{
+    ULONG64 index;
+    double timestamp;
+    ULONG64 pauseMicroseconds;
+    ULONG collectedGeneration;
+    ULONG reason;
+    ULONG64 sizesBefore[HeapGenerationCount];
+    ULONG64 sizesAfter[HeapGenerationCount];
+    LONG64 growth[HeapGenerationCount];
+    ULONG64 promotedBytes;
+    double survivalRate;
+    ULONG survivalMeasured;
+} HeapSnapshot;
+
+// Heap shape after each garbage collection, enabled by AWS_XRAY_PROFILER_HEAP_SNAPSHOTS. The bounds of
+// every generation are read when a collection starts and again when it finishes, and the snapshot is
+// kept in a ring, together with how much each generation grew since the previous collection. Bytes
+// promoted and the survival rate of the collected generations are estimated from the sizes, or summed
+// from the surviving and moved object ranges when AWS_XRAY_PROFILER_HEAP_SURVIVAL is also set. The
+// lightweight GC notifications of .NET Core 3.0 and later are used; the survival ranges, and runtimes
+// without them, need full GC monitoring, which turns off concurrent collections, so on those runtimes
+// snapshots are only taken when survival is asked for.
+class HeapSnapshots
+{
+public:
+    static DWORD Initialize(ICorProfilerInfo8* profilerInfo, DWORD* highEventMask);
+    static void Shutdown();
+
+    static inline bool IsEnabled()
+    {
+        return profilerInfo != NULL;
+    }
+
+    static void Started(int generationCount, BOOL generationCollected[], COR_PRF_GC_REASON reason);
+    static void Survived(ULONG rangeCount, SIZE_T rangeLengths[]);
+    static void Finished();
+    static HRESULT Get(ULONG age, HeapSnapshot* snapshot);
+
+private:
+    static bool ReadSizes(ULONG64* sizes);
+
+    static ICorProfilerInfo8* profilerInfo;
+    static bool survivalMeasured;
+    static COR_PRF_GC_GENERATION_RANGE ranges[HeapMaximumRanges];
+    static HeapSnapshot current;
+    static LONG64 startedCounter;
+    static std::mutex snapshotsLock;
+    static HeapSnapshot snapshots[HeapSnapshotCount];
+    static ULONG64 snapshotCount;
+};
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayHeapSnapshot(ULONG age, HeapSnapshot* snapshot);
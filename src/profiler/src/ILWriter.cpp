@@ -2,10 +2,33 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include "stdafx.h"
+#include "Environment.h"
 #include "ILWriter.h"
+#include "Journal.h"
+#include "Recorder.h"
 #include <corhlpr.cpp>
 
 ILWriter::ILWriter(ICorProfilerInfo* profilerInfo, FunctionInfo* functionInfo)
+{
+    Load(profilerInfo, functionInfo);
+}
+
+ILWriter::ILWriter(ICorProfilerInfo* profilerInfo, FunctionInfo* functionInfo, LPCBYTE prologue, ULONG prologueSize, WORD prologueMaxStack)
+{
+    if (prologueSize > MaximumPrologueSize)
+    {
+        return;
+    }
+
+    memcpy_s(this->prologue, MaximumPrologueSize, prologue, prologueSize);
+    this->prologueSize = prologueSize;
+    this->prologueMaxStack = prologueMaxStack;
+    this->injectsAddXRay = FALSE;
+
+    Load(profilerInfo, functionInfo);
+}
+
+void ILWriter::Load(ICorProfilerInfo* profilerInfo, FunctionInfo* functionInfo)
 {
     ModuleID moduleID = functionInfo->GetModuleID();
     mdToken mdtoken = functionInfo->GetToken();
@@ -13,9 +36,11 @@ ILWriter::ILWriter(ICorProfilerInfo* profilerInfo, FunctionInfo* functionInfo)
     ULONG methodSize;
 
     HRESULT hr = profilerInfo->GetILFunctionBody(moduleID, mdtoken, &methodHeader, &methodSize);
+    Recorder::RecordILFunctionBody(moduleID, mdtoken, hr, methodHeader, methodSize);
 
     if (FAILED(hr))
     {
+        Journal::WriteFailure(JournalSiteGetILFunctionBody, hr);
         return;
     }
 
@@ -25,7 +50,7 @@ ILWriter::ILWriter(ICorProfilerInfo* profilerInfo, FunctionInfo* functionInfo)
     }
     else
     {
-        if (methodSize <= (MaximumSize - InjectedCodeSize))
+        if (methodSize <= (MaximumSize - prologueSize))
         {
             this->identifier = TinyMethod;
         }
@@ -47,14 +72,71 @@ ILWriter::~ILWriter()
 
 BOOL ILWriter::Write()
 {
+    if (functionInfo == NULL)
+    {
+        return FALSE;
+    }
+
     ModuleID moduleID = functionInfo->GetModuleID();
     mdToken functionToken = functionInfo->GetToken();
     LPCBYTE newILHeader = (LPCBYTE)GetNewILHeader();
 
+    if (newILHeader == NULL)
+    {
+        return FALSE;
+    }
+
     HRESULT hr = profilerInfo->SetILFunctionBody(moduleID, functionToken, newILHeader);
+    Recorder::RecordSetILFunctionBody(moduleID, functionToken, hr, newILHeader, GetNewMethodTotalSize());
+
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteSetILFunctionBody, hr);
+        return FALSE;
+    }
+
+    this->newILHeader = newILHeader;
+
+    return TRUE;
+}
+
+LPCBYTE ILWriter::GetWrittenILHeader()
+{
+    return newILHeader;
+}
+
+mdMemberRef ILWriter::GetInjectedMethodToken()
+{
+    return injectedMethodToken;
+}
+
+BOOL ILWriter::WriteILHeader(ICorProfilerInfo* profilerInfo, ModuleID moduleID, mdToken functionToken, LPCBYTE ilHeader, ULONG ilSize)
+{
+    IMethodMalloc* allocator = NULL;
+    HRESULT hr = profilerInfo->GetILFunctionBodyAllocator(moduleID, &allocator);
+    if (FAILED(hr) || allocator == NULL)
+    {
+        Journal::WriteFailure(JournalSiteGetILFunctionBodyAllocator, hr);
+        return FALSE;
+    }
+
+    BYTE* codeBuffer = (BYTE*)allocator->Alloc(ilSize);
+    allocator->Release();
+
+    if (codeBuffer == NULL)
+    {
+        Journal::WriteFailure(JournalSiteAllocILFunctionBody, E_OUTOFMEMORY);
+        return FALSE;
+    }
+
+    memcpy_s(codeBuffer, ilSize, ilHeader, ilSize);
+
+    hr = profilerInfo->SetILFunctionBody(moduleID, functionToken, codeBuffer);
+    Recorder::RecordSetILFunctionBody(moduleID, functionToken, hr, codeBuffer, ilSize);
 
     if (FAILED(hr))
     {
+        Journal::WriteFailure(JournalSiteSetILFunctionBody, hr);
         return FALSE;
     }
 
@@ -65,11 +147,16 @@ ULONG ILWriter::GetNewMethodTotalSize()
 {
     if (identifier == FatMethod)
     {
-        return methodSize + InjectedCodeSize + GetOffset();
+        return methodSize + prologueSize + GetOffset();
+    }
+    else if (identifier == OtherMethod)
+    {
+        // A tiny body that outgrows the tiny format is rewritten behind a fat header, not its one-byte tiny header
+        return FatMethodHeader + ((COR_ILMETHOD_TINY*)methodHeader)->GetCodeSize() + prologueSize;
     }
     else
     {
-        return methodSize + InjectedCodeSize;
+        return methodSize + prologueSize;
     }
 }
 
@@ -82,7 +169,7 @@ ULONG ILWriter::GetOffset()
     else
     {
         ULONG oldMethodSize = FatMethodHeader + ((COR_ILMETHOD_FAT*)methodHeader)->GetCodeSize();
-        ULONG newMethodSize = FatMethodHeader + ((COR_ILMETHOD_FAT*)methodHeader)->GetCodeSize() + InjectedCodeSize;
+        ULONG newMethodSize = FatMethodHeader + ((COR_ILMETHOD_FAT*)methodHeader)->GetCodeSize() + prologueSize;
         ULONG oldOffset = (int)((BYTE*)((COR_ILMETHOD_FAT*)methodHeader)->GetSect() - (BYTE*)((BYTE*)methodHeader + oldMethodSize));
         ULONG mod = sizeof(DWORD);
         ULONG remainder = newMethodSize % mod;
@@ -97,74 +184,111 @@ ULONG ILWriter::GetOffset()
     }
 }
 
-void* ILWriter::GetNewILHeader()
+HRESULT ILWriter::DefineInjectedMethod(ICorProfilerInfo* profilerInfo, ModuleID moduleID, mdMemberRef* methodToken)
 {
-    ModuleID moduleId = functionInfo->GetModuleID();
-    IMethodMalloc* allocator = NULL;
-    HRESULT hr = profilerInfo->GetILFunctionBodyAllocator(moduleId, &allocator);
-    if (FAILED(hr) || allocator == NULL)
-    {
-        return NULL;
-    }
-
     IMetaDataEmit* iMetaDataEmit = NULL;
     DWORD OpenFlags = ofRead | ofWrite;
-    hr = profilerInfo->GetModuleMetaData(moduleId, OpenFlags, IID_IMetaDataEmit, (IUnknown**)&iMetaDataEmit);
+    HRESULT hr = profilerInfo->GetModuleMetaData(moduleID, OpenFlags, IID_IMetaDataEmit, (IUnknown**)&iMetaDataEmit);
     if (FAILED(hr) || iMetaDataEmit == NULL)
     {
-        return NULL;
-    }
-
-    ULONG newMethodTotalSize = GetNewMethodTotalSize();
-    BYTE* codeBuffer = (BYTE*)allocator->Alloc(newMethodTotalSize);
-    if (codeBuffer == NULL)
-    {
-        return NULL;
+        Journal::WriteFailure(JournalSiteGetModuleMetaData, hr);
+        return FAILED(hr) ? hr : E_FAIL;
     }
 
-    allocator->Release();
-
     IMetaDataAssemblyEmit* iMetaDataAssemblyEmit = NULL;
     hr = iMetaDataEmit->QueryInterface(IID_IMetaDataAssemblyEmit, (void**)&iMetaDataAssemblyEmit);
     if (FAILED(hr) || iMetaDataAssemblyEmit == NULL)
     {
-        return NULL;
+        Journal::WriteFailure(JournalSiteQueryAssemblyEmit, hr);
+        return FAILED(hr) ? hr : E_FAIL;
     }
 
     const BYTE publicKey[] = { 0xd4, 0x27, 0x00, 0x1f, 0x96, 0xb0, 0xd0, 0xb6 }; // d427001f96b0d0b6
-    LPCWSTR autoInstrumentationAssemblyName = L"AWSXRayRecorder.AutoInstrumentation";
     ASSEMBLYMETADATA autoInstrumentationAssemblyMetaData = {0};
     mdModuleRef autoInstrumentationAssemblyToken;
-    hr = iMetaDataAssemblyEmit->DefineAssemblyRef(publicKey, sizeof(publicKey), autoInstrumentationAssemblyName, &autoInstrumentationAssemblyMetaData, NULL, 0, 0, &autoInstrumentationAssemblyToken);
+    hr = iMetaDataAssemblyEmit->DefineAssemblyRef(publicKey, sizeof(publicKey), AutoInstrumentationAssemblyName, &autoInstrumentationAssemblyMetaData, NULL, 0, 0, &autoInstrumentationAssemblyToken);
+    Recorder::RecordDefinition(moduleID, RecordingDefineAssemblyRef, mdTokenNil, hr, autoInstrumentationAssemblyToken, AutoInstrumentationAssemblyName, publicKey, sizeof(publicKey));
     if (FAILED(hr))
     {
-        return NULL;
+        Journal::WriteFailure(JournalSiteDefineAssemblyRef, hr);
+        return hr;
     }
     
     iMetaDataAssemblyEmit->Release();
 
-    LPCWSTR autoInstrumentationClassName = L"Amazon.XRay.Recorder.AutoInstrumentation.Initialize";
     mdTypeRef autoInstrumentationClassToken;
-    hr = iMetaDataEmit->DefineTypeRefByName(autoInstrumentationAssemblyToken, autoInstrumentationClassName, &autoInstrumentationClassToken);
+    hr = iMetaDataEmit->DefineTypeRefByName(autoInstrumentationAssemblyToken, AutoInstrumentationClassName, &autoInstrumentationClassToken);
+    Recorder::RecordDefinition(moduleID, RecordingDefineTypeRef, autoInstrumentationAssemblyToken, hr, autoInstrumentationClassToken, AutoInstrumentationClassName, NULL, 0);
     if (FAILED(hr))
     {
-        return NULL;
+        Journal::WriteFailure(JournalSiteDefineTypeRefByName, hr);
+        return hr;
     }
 
-    LPCWSTR autoInstrumentationMethodName = L"AddXRay";
+    // The deferred stub has the same signature, it only queues AddXRay to a pool thread and returns. A cached
+    // rewrite embeds nothing but the token, which then refers to the method of the current mode.
+    LPCWSTR autoInstrumentationMethodName = Environment::IsEnabled(DeferredBootstrapVariable) ? AutoInstrumentationDeferredMethodName : AutoInstrumentationMethodName;
+
     const BYTE autoInstrumentationMethodSignature[] = { IMAGE_CEE_CS_CALLCONV_DEFAULT, 0, ELEMENT_TYPE_VOID }; //0 arg, void
-    mdMemberRef autoInstrumentationMethodToken;
-    hr = iMetaDataEmit->DefineMemberRef(autoInstrumentationClassToken, autoInstrumentationMethodName, autoInstrumentationMethodSignature, sizeof(autoInstrumentationMethodSignature), &autoInstrumentationMethodToken);
+    hr = iMetaDataEmit->DefineMemberRef(autoInstrumentationClassToken, autoInstrumentationMethodName, autoInstrumentationMethodSignature, sizeof(autoInstrumentationMethodSignature), methodToken);
+    Recorder::RecordDefinition(moduleID, RecordingDefineMemberRef, autoInstrumentationClassToken, hr, *methodToken, autoInstrumentationMethodName, autoInstrumentationMethodSignature, sizeof(autoInstrumentationMethodSignature));
     if (FAILED(hr))
     {
-        return NULL;
+        Journal::WriteFailure(JournalSiteDefineMemberRef, hr);
+        return hr;
     }
 
     iMetaDataEmit->Release();
 
-    InjectedCode* injectedCode = new InjectedCode();
-    injectedCode->nop = 0x00;
-    injectedCode->call = 0x28;
+    return S_OK;
+}
+
+void* ILWriter::GetNewILHeader()
+{
+    ModuleID moduleId = functionInfo->GetModuleID();
+    IMethodMalloc* allocator = NULL;
+    HRESULT hr = profilerInfo->GetILFunctionBodyAllocator(moduleId, &allocator);
+    if (FAILED(hr) || allocator == NULL)
+    {
+        Journal::WriteFailure(JournalSiteGetILFunctionBodyAllocator, hr);
+        return NULL;
+    }
+
+    ULONG newMethodTotalSize = GetNewMethodTotalSize();
+    BYTE* codeBuffer = (BYTE*)allocator->Alloc(newMethodTotalSize);
+    if (codeBuffer == NULL)
+    {
+        Journal::WriteFailure(JournalSiteAllocILFunctionBody, E_OUTOFMEMORY);
+        return NULL;
+    }
+
+    allocator->Release();
+
+    if (injectsAddXRay)
+    {
+        mdMemberRef autoInstrumentationMethodToken;
+        hr = DefineInjectedMethod(profilerInfo, moduleId, &autoInstrumentationMethodToken);
+        if (FAILED(hr))
+        {
+            return NULL;
+        }
+
+        this->injectedMethodToken = autoInstrumentationMethodToken;
+
+        InjectedCode injectedCode;
+        injectedCode.nop = 0x00;
+        injectedCode.call = 0x28;
+        memcpy_s(
+            injectedCode.token,
+            sizeof(injectedCode.token),
+            (void*)&autoInstrumentationMethodToken,
+            sizeof(autoInstrumentationMethodToken));
+        memcpy_s(
+            prologue,
+            MaximumPrologueSize,
+            &injectedCode,
+            InjectedCodeSize);
+    }
 
     if (identifier == FatMethod)
     {
@@ -174,56 +298,50 @@ void* ILWriter::GetNewILHeader()
             methodHeader,
             FatMethodHeader);
 
-        WORD maxStack = (WORD)((COR_ILMETHOD_FAT*)methodHeader)->MaxStack + InjectedCodeSize / 2;
+        WORD maxStack = (WORD)((COR_ILMETHOD_FAT*)methodHeader)->MaxStack + prologueMaxStack;
         memcpy_s(
             codeBuffer + sizeof(WORD),
             newMethodTotalSize - sizeof(WORD),
             &maxStack,
             sizeof(WORD));
 
-        DWORD newMethodBodySize = ((COR_ILMETHOD_FAT*)methodHeader)->GetCodeSize() + InjectedCodeSize;
+        DWORD newMethodBodySize = ((COR_ILMETHOD_FAT*)methodHeader)->GetCodeSize() + prologueSize;
         memcpy_s(
             codeBuffer + sizeof(DWORD),
             newMethodTotalSize - sizeof(DWORD),
             &newMethodBodySize,
             sizeof(DWORD));
 
-        memcpy_s(
-            injectedCode->token,
-            sizeof(injectedCode->token),
-            (void*)&autoInstrumentationMethodToken,
-            sizeof(autoInstrumentationMethodToken));
-
         memcpy_s(
             codeBuffer + FatMethodHeader,
             newMethodTotalSize - FatMethodHeader,
-            injectedCode,
-            InjectedCodeSize);
+            prologue,
+            prologueSize);
 
         ULONG oldMethodBodySize = ((COR_ILMETHOD_FAT*)methodHeader)->GetCodeSize();
 
         memcpy_s(
-            codeBuffer + FatMethodHeader + InjectedCodeSize,
-            newMethodTotalSize - FatMethodHeader - InjectedCodeSize,
+            codeBuffer + FatMethodHeader + prologueSize,
+            newMethodTotalSize - FatMethodHeader - prologueSize,
             (BYTE*)methodHeader + FatMethodHeader,
             oldMethodBodySize);
 
         ULONG oldMethodSize = FatMethodHeader + ((COR_ILMETHOD_FAT*)methodHeader)->GetCodeSize();
         ULONG extraSectionSize = methodSize - oldMethodSize;
         memcpy_s(
-            codeBuffer + FatMethodHeader + InjectedCodeSize + oldMethodBodySize,
-            newMethodTotalSize - FatMethodHeader - InjectedCodeSize - oldMethodBodySize + GetOffset(),
+            codeBuffer + FatMethodHeader + prologueSize + oldMethodBodySize,
+            newMethodTotalSize - FatMethodHeader - prologueSize - oldMethodBodySize + GetOffset(),
             (BYTE*)methodHeader + (methodSize - extraSectionSize - GetOffset()),
             extraSectionSize);
 
         if (((COR_ILMETHOD_FAT*)methodHeader)->GetFlags() & CorILMethod_MoreSects)
         {
-            FixSEHSections(codeBuffer, InjectedCodeSize);
+            FixSEHSections(codeBuffer, prologueSize);
         }
     }
     else if (identifier == TinyMethod)
     {
-        ULONG newMethodBodySize = ((COR_ILMETHOD_TINY*)methodHeader)->GetCodeSize() + InjectedCodeSize;
+        ULONG newMethodBodySize = ((COR_ILMETHOD_TINY*)methodHeader)->GetCodeSize() + prologueSize;
 
         BYTE newBodySize = (BYTE)(CorILMethod_TinyFormat | (newMethodBodySize << 2));
         memcpy_s(
@@ -231,28 +349,26 @@ void* ILWriter::GetNewILHeader()
             newMethodTotalSize,
             &newBodySize,
             TinyMethodHeader);
-        memcpy_s(
-            injectedCode->token,
-            sizeof(injectedCode->token),
-            (void*)&autoInstrumentationMethodToken,
-            sizeof(autoInstrumentationMethodToken));
         memcpy_s(
             codeBuffer + TinyMethodHeader,
             newMethodTotalSize - TinyMethodHeader,
-            injectedCode,
-            InjectedCodeSize);
+            prologue,
+            prologueSize);
 
         ULONG oldMethodBodySize = ((COR_ILMETHOD_TINY*)methodHeader)->GetCodeSize();
 
         memcpy_s(
-            codeBuffer + TinyMethodHeader + InjectedCodeSize,
-            newMethodTotalSize - TinyMethodHeader - InjectedCodeSize,
+            codeBuffer + TinyMethodHeader + prologueSize,
+            newMethodTotalSize - TinyMethodHeader - prologueSize,
             (BYTE*)methodHeader + TinyMethodHeader,
             oldMethodBodySize);
 
     }
     else if (identifier == OtherMethod)
     {
+        // Tiny headers carry no local signature token, so clear the whole fat header before filling it in
+        memset(codeBuffer, 0, FatMethodHeader);
+
         BYTE flags[] = { 0x03, 0x30, };
         memcpy_s(
             codeBuffer,
@@ -260,35 +376,30 @@ void* ILWriter::GetNewILHeader()
             &flags,
             sizeof(WORD));
 
-        WORD maxStack = 1 + (InjectedCodeSize / 2);
+        WORD maxStack = TinyMethodMaxStack + prologueMaxStack;
         memcpy_s(
             codeBuffer + sizeof(WORD),
             newMethodTotalSize - sizeof(WORD),
             &maxStack,
             sizeof(WORD));
 
-        DWORD newMethodBodySize = ((COR_ILMETHOD_TINY*)methodHeader)->GetCodeSize() + InjectedCodeSize;
+        DWORD newMethodBodySize = ((COR_ILMETHOD_TINY*)methodHeader)->GetCodeSize() + prologueSize;
         memcpy_s(
             codeBuffer + sizeof(DWORD),
             newMethodTotalSize - sizeof(DWORD),
             &newMethodBodySize,
             sizeof(DWORD));
-        memcpy_s(
-            injectedCode->token,
-            sizeof(injectedCode->token),
-            (void*)&autoInstrumentationMethodToken,
-            sizeof(autoInstrumentationMethodToken));
         memcpy_s(
             codeBuffer + FatMethodHeader,
             newMethodTotalSize - FatMethodHeader,
-            injectedCode,
-            InjectedCodeSize);
+            prologue,
+            prologueSize);
 
         ULONG oldMethodBodySize = ((COR_ILMETHOD_TINY*)methodHeader)->GetCodeSize();
 
         memcpy_s(
-            codeBuffer + FatMethodHeader + InjectedCodeSize,
-            newMethodTotalSize - FatMethodHeader - InjectedCodeSize,
+            codeBuffer + FatMethodHeader + prologueSize,
+            newMethodTotalSize - FatMethodHeader - prologueSize,
             (BYTE*)methodHeader + TinyMethodHeader,
             oldMethodBodySize);
     }
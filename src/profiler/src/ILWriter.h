@@ -8,11 +8,19 @@
 #define TinyMethod 2
 #define OtherMethod 3
 #define MaximumSize 64
+#define MaximumPrologueSize 32
+#define TinyMethodMaxStack 8
 
 #define FatMethodHeader sizeof(WORD) + sizeof(WORD) + sizeof(DWORD) + sizeof(DWORD) // 12 bytes 
 #define TinyMethodHeader sizeof(BYTE) 
 #define InjectedCodeSize sizeof(InjectedCode)
 
+#define AutoInstrumentationAssemblyName L"AWSXRayRecorder.AutoInstrumentation"
+#define AutoInstrumentationClassName L"Amazon.XRay.Recorder.AutoInstrumentation.Initialize"
+#define AutoInstrumentationMethodName L"AddXRay"
+#define AutoInstrumentationDeferredMethodName L"AddXRayDeferred"
+#define DeferredBootstrapVariable L"AWS_XRAY_PROFILER_DEFERRED_BOOTSTRAP"
+
 typedef struct
 {
     BYTE nop;
@@ -25,6 +33,7 @@ class ILWriter
 {
 public:    
     ILWriter(ICorProfilerInfo* profilerInfo, FunctionInfo* functionInfo);
+    ILWriter(ICorProfilerInfo* profilerInfo, FunctionInfo* functionInfo, LPCBYTE prologue, ULONG prologueSize, WORD prologueMaxStack);
     
     ~ILWriter();
 
@@ -32,15 +41,27 @@ public:
 
     BOOL Write();
     void* GetNewILHeader();
+    LPCBYTE GetWrittenILHeader();
+    mdMemberRef GetInjectedMethodToken();
+
+    static HRESULT DefineInjectedMethod(ICorProfilerInfo* profilerInfo, ModuleID moduleID, mdMemberRef* methodToken);
+    static BOOL WriteILHeader(ICorProfilerInfo* profilerInfo, ModuleID moduleID, mdToken functionToken, LPCBYTE ilHeader, ULONG ilSize);
 
     ULONG GetOffset();
     void FixSEHSections(BYTE* methodBytes, ULONG newILSize);
 
 private:
+    void Load(ICorProfilerInfo* profilerInfo, FunctionInfo* functionInfo);
 
     ULONG identifier = 0;
     ICorProfilerInfo* profilerInfo = NULL;
     FunctionInfo* functionInfo = NULL;
     LPCBYTE methodHeader = NULL;
     ULONG methodSize = 0;
+    LPCBYTE newILHeader = NULL;
+    mdMemberRef injectedMethodToken = mdTokenNil;
+    BYTE prologue[MaximumPrologueSize] = { 0 };
+    ULONG prologueSize = InjectedCodeSize;
+    WORD prologueMaxStack = InjectedCodeSize / 2;
+    BOOL injectsAddXRay = TRUE;
 };
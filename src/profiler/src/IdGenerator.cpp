@@ -0,0 +1,129 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#define _CRT_RAND_S
+#include <stdlib.h>
+#include "stdafx.h"
+#include "Clock.h"
+#include "IdGenerator.h"
+
+static const WCHAR HexDigits[] = L"0123456789abcdef";
+
+static thread_local ULONG64 randomState[4] = { 0 };
+
+static inline ULONG64 RotateLeft(ULONG64 value, int count)
+{
+    return (value << count) | (value >> (64 - count));
+}
+
+static inline ULONG64 SplitMix(ULONG64* seed)
+{
+    ULONG64 z = (*seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void IdGenerator::Seed(ULONG64* state)
+{
+    bool seeded = true;
+    for (int i = 0; i < 8; i++)
+    {
+        unsigned int value = 0;
+        if (rand_s(&value) != 0)
+        {
+            seeded = false;
+            break;
+        }
+
+        ((unsigned int*)state)[i] = value;
+    }
+
+    // rand_s only fails when the system RNG is unavailable; the ids must still differ between
+    // threads and processes, so mix the counter, thread and process into a SplitMix stream instead.
+    if (!seeded || (state[0] | state[1] | state[2] | state[3]) == 0)
+    {
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+
+        ULONG64 seed = (ULONG64)counter.QuadPart ^ ((ULONG64)GetCurrentThreadId() << 32) ^ GetCurrentProcessId();
+        for (int i = 0; i < 4; i++)
+        {
+            state[i] = SplitMix(&seed);
+        }
+    }
+}
+
+ULONG64 IdGenerator::NextRandom()
+{
+    ULONG64* state = randomState;
+
+    if ((state[0] | state[1] | state[2] | state[3]) == 0)
+    {
+        Seed(state);
+    }
+
+    ULONG64 result = RotateLeft(state[1] * 5, 7) * 9;
+    ULONG64 shifted = state[1] << 17;
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= shifted;
+    state[3] = RotateLeft(state[3], 45);
+
+    return result;
+}
+
+void IdGenerator::WriteHex(WCHAR* buffer, ULONG64 value, int digits)
+{
+    for (int i = digits - 1; i >= 0; i--)
+    {
+        buffer[i] = HexDigits[value & 0xF];
+        value >>= 4;
+    }
+}
+
+HRESULT IdGenerator::WriteTraceId(WCHAR* buffer, ULONG bufferLength)
+{
+    if (buffer == NULL || bufferLength < TraceIdLength)
+    {
+        return E_INVALIDARG;
+    }
+
+    ULONG64 epochSeconds = (ULONG64)(Clock::GetEpochMicroseconds() / MicrosecondsPerSecond);
+    ULONG64 high = NextRandom();
+    ULONG64 low = NextRandom();
+
+    buffer[0] = TraceIdVersion;
+    buffer[1] = TraceIdDelimiter;
+    WriteHex(buffer + 2, epochSeconds, 8);
+    buffer[10] = TraceIdDelimiter;
+    WriteHex(buffer + 11, high >> 32, 8);
+    WriteHex(buffer + 19, low, 16);
+
+    return S_OK;
+}
+
+HRESULT IdGenerator::WriteSegmentId(WCHAR* buffer, ULONG bufferLength)
+{
+    if (buffer == NULL || bufferLength < SegmentIdLength)
+    {
+        return E_INVALIDARG;
+    }
+
+    WriteHex(buffer, NextRandom(), SegmentIdLength);
+
+    return S_OK;
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE GenerateXRayTraceId(WCHAR* buffer, ULONG bufferLength)
+{
+    return IdGenerator::WriteTraceId(buffer, bufferLength);
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE GenerateXRaySegmentId(WCHAR* buffer, ULONG bufferLength)
+{
+    return IdGenerator::WriteSegmentId(buffer, bufferLength);
+}
@@ -0,0 +1,29 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "cor.h"
+
+#define TraceIdLength 35 // 1-xxxxxxxx-xxxxxxxxxxxxxxxxxxxxxxxx
+#define SegmentIdLength 16
+#define TraceIdVersion L'1'
+#define TraceIdDelimiter L'-'
+
+// Generates X-Ray trace and segment ids without allocating.
+// Each thread owns a xoshiro256** state seeded from the OS cryptographic generator,
+// so no lock or shared cache line is touched on the hot path.
+class IdGenerator
+{
+public:
+    static ULONG64 NextRandom();
+    static HRESULT WriteTraceId(WCHAR* buffer, ULONG bufferLength);
+    static HRESULT WriteSegmentId(WCHAR* buffer, ULONG bufferLength);
+    static void WriteHex(WCHAR* buffer, ULONG64 value, int digits);
+
+private:
+    static void Seed(ULONG64* state);
+};
+
+extern "C" HRESULT STDMETHODCALLTYPE GenerateXRayTraceId(WCHAR* buffer, ULONG bufferLength);
+extern "C" HRESULT STDMETHODCALLTYPE GenerateXRaySegmentId(WCHAR* buffer, ULONG bufferLength);
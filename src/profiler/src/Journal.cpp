@@ -0,0 +1,186 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <mutex>
+#include <vector>
+#include "stdafx.h"
+#include "Environment.h"
+#include "Journal.h"
+
+JournalRecord* Journal::records = NULL;
+ULONG Journal::capacity = 0;
+std::atomic<ULONG64> Journal::writeIndex(0);
+std::atomic<bool> Journal::shuttingDown(false);
+WCHAR Journal::path[MAX_PATH] = { 0 };
+HANDLE Journal::dumpEvent = NULL;
+
+static std::mutex dumpLock;
+
+void Journal::Initialize()
+{
+    if (records != NULL || !Environment::GetValue(JournalPathVariable, path, MAX_PATH))
+    {
+        return;
+    }
+
+    ULONG requested = Environment::GetULong(JournalRecordsVariable, JournalDefaultRecords);
+    if (requested == 0 || requested > JournalMaximumRecords)
+    {
+        requested = JournalDefaultRecords;
+    }
+
+    // Round up to a power of two so the slot is a mask of the write index
+    ULONG size = 1;
+    while (size < requested)
+    {
+        size <<= 1;
+    }
+
+    JournalRecord* buffer = new JournalRecord[size];
+    memset(buffer, 0, size * sizeof(JournalRecord));
+
+    capacity = size;
+    records = buffer;
+
+    WCHAR eventName[MAX_PATH];
+    if (swprintf_s(eventName, MAX_PATH, JournalDumpEventFormat, GetCurrentProcessId()) > 0)
+    {
+        dumpEvent = CreateEventW(NULL, FALSE, FALSE, eventName);
+    }
+
+    if (dumpEvent != NULL)
+    {
+        HANDLE thread = CreateThread(NULL, 0, DumpThread, NULL, 0, NULL);
+        if (thread != NULL)
+        {
+            CloseHandle(thread);
+        }
+    }
+}
+
+void Journal::Append(uint16_t eventType, uint16_t site, uint64_t value)
+{
+    ULONG64 index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+    JournalRecord* record = &records[index & (capacity - 1)];
+
+    // Claim the slot first so a dump racing with this write sees it as torn, not as stale data.
+    // A writer the ring lapped while it was preempted leaves the slot to the newer record.
+    std::atomic<uint64_t>* sequence = (std::atomic<uint64_t>*)&record->sequence;
+    uint64_t previous = sequence->load(std::memory_order_relaxed);
+    if (previous == JournalSequenceBusy || previous > index || !sequence->compare_exchange_strong(previous, JournalSequenceBusy, std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    std::atomic_thread_fence(std::memory_order_release);
+
+    record->counter = Clock::GetCounter();
+    record->value = value;
+    record->threadId = GetCurrentThreadId();
+    record->eventType = eventType;
+    record->site = site;
+
+    sequence->store(index + 1, std::memory_order_release);
+}
+
+void Journal::CopyRecord(const JournalRecord* source, JournalRecord* target)
+{
+    // A writer marks the sequence busy before its stores and sets it after them, so an unchanged
+    // complete sequence on both sides of the copy means the fields in between are one record.
+    uint64_t before = ((const std::atomic<uint64_t>*)&source->sequence)->load(std::memory_order_acquire);
+
+    target->counter = source->counter;
+    target->value = source->value;
+    target->threadId = source->threadId;
+    target->eventType = source->eventType;
+    target->site = source->site;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = ((const std::atomic<uint64_t>*)&source->sequence)->load(std::memory_order_relaxed);
+
+    if (before == 0 || before == JournalSequenceBusy || before != after)
+    {
+        memset(target, 0, sizeof(JournalRecord));
+        return;
+    }
+
+    target->sequence = before;
+}
+
+DWORD WINAPI Journal::DumpThread(LPVOID parameter)
+{
+    while (WaitForSingleObject(dumpEvent, INFINITE) == WAIT_OBJECT_0)
+    {
+        if (shuttingDown.load(std::memory_order_acquire))
+        {
+            break;
+        }
+
+        Dump();
+    }
+
+    return 0;
+}
+
+bool Journal::Dump()
+{
+    if (records == NULL)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(dumpLock);
+
+    JournalHeader header = { 0 };
+    header.magic = JournalMagic;
+    header.formatVersion = JournalFormatVersion;
+    header.recordSize = sizeof(JournalRecord);
+    header.capacity = capacity;
+    header.writeIndex = writeIndex.load(std::memory_order_acquire);
+    header.counterFrequency = Clock::GetFrequency();
+    header.dumpCounter = Clock::GetCounter();
+    header.dumpEpochMicroseconds = Clock::GetEpochMicroseconds();
+    header.processId = GetCurrentProcessId();
+
+    HANDLE output = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (output == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    // Records are written through a staging copy, never straight from the ring that threads keep appending to
+    std::vector<JournalRecord> staging(capacity < JournalStagingRecords ? capacity : JournalStagingRecords);
+
+    DWORD written = 0;
+    BOOL result = WriteFile(output, &header, sizeof(header), &written, NULL);
+
+    for (ULONG start = 0; result && start < capacity; start += (ULONG)staging.size())
+    {
+        for (SIZE_T i = 0; i < staging.size(); i++)
+        {
+            CopyRecord(&records[start + i], &staging[i]);
+        }
+
+        result = WriteFile(output, staging.data(), (DWORD)(staging.size() * sizeof(JournalRecord)), &written, NULL);
+    }
+
+    CloseHandle(output);
+
+    return result == TRUE;
+}
+
+void Journal::Shutdown()
+{
+    if (records == NULL)
+    {
+        return;
+    }
+
+    Dump();
+
+    shuttingDown.store(true, std::memory_order_release);
+    if (dumpEvent != NULL)
+    {
+        SetEvent(dumpEvent);
+    }
+}
@@ -0,0 +1,59 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include "cor.h"
+#include "Clock.h"
+#include "JournalFormat.h"
+
+#define JournalPathVariable L"AWS_XRAY_PROFILER_JOURNAL_PATH"
+#define JournalRecordsVariable L"AWS_XRAY_PROFILER_JOURNAL_RECORDS"
+#define JournalDefaultRecords 65536
+#define JournalMaximumRecords 16777216
+#define JournalStagingRecords 4096
+#define JournalSequenceBusy UINT64_MAX
+#define JournalDumpEventFormat L"Local\\AWSXRayProfilerJournal-%lu"
+
+// Fixed-size in-memory ring of profiler decisions, dumped to AWS_XRAY_PROFILER_JOURNAL_PATH
+// on Shutdown or whenever the named dump event is signaled. A disabled journal costs one
+// predictable branch; an enabled one costs an interlocked increment, a compare-exchange claiming
+// the slot and a 32-byte store.
+class Journal
+{
+public:
+    static void Initialize();
+    static void Shutdown();
+    static bool Dump();
+
+    static inline bool IsEnabled()
+    {
+        return records != NULL;
+    }
+
+    static inline void Write(uint16_t eventType, uint16_t site, uint64_t value)
+    {
+        if (records != NULL)
+        {
+            Append(eventType, site, value);
+        }
+    }
+
+    static inline void WriteFailure(uint16_t site, HRESULT hr)
+    {
+        Write(JournalCallFailed, site, (uint32_t)hr);
+    }
+
+private:
+    static void Append(uint16_t eventType, uint16_t site, uint64_t value);
+    static void CopyRecord(const JournalRecord* source, JournalRecord* target);
+    static DWORD WINAPI DumpThread(LPVOID parameter);
+
+    static JournalRecord* records;
+    static ULONG capacity;
+    static std::atomic<ULONG64> writeIndex;
+    static std::atomic<bool> shuttingDown;
+    static WCHAR path[MAX_PATH];
+    static HANDLE dumpEvent;
+};
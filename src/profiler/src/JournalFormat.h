@@ -0,0 +1,74 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <stdint.h>
+
+// On-disk layout of the profiler journal, shared with the JournalDecoder tool.
+// Only fixed-width types are used so the decoder does not depend on the CLR headers.
+
+#define JournalMagic 0x4C4A5258 // XRJL
+#define JournalFormatVersion 1
+
+#define JournalMethodConsidered 1
+#define JournalRewriteStarted 2
+#define JournalRewriteFinished 3
+#define JournalRewriteFailed 4
+#define JournalCallFailed 5
+#define JournalEventMaskChanged 6
+#define JournalProbeShed 7
+#define JournalProbeRestored 8
+#define JournalCallSitesRedirected 9
+#define JournalStartupCompleted 10
+#define JournalStarvationStarted 11
+#define JournalStarvationEnded 12
+#define JournalStarvationSegment 13
+#define JournalGCSegment 14
+
+#define JournalSiteNone 0
+#define JournalSiteSetEventMask 1
+#define JournalSiteGetFunctionInfo 2
+#define JournalSiteGetModuleInfo 3
+#define JournalSiteGetAssemblyInfo 4
+#define JournalSiteGetTokenAndMetaDataFromFunction 5
+#define JournalSiteGetMethodProps 6
+#define JournalSiteGetTypeDefProps 7
+#define JournalSiteGetILFunctionBody 8
+#define JournalSiteGetILFunctionBodyAllocator 9
+#define JournalSiteAllocILFunctionBody 10
+#define JournalSiteGetModuleMetaData 11
+#define JournalSiteQueryAssemblyEmit 12
+#define JournalSiteDefineAssemblyRef 13
+#define JournalSiteDefineTypeRefByName 14
+#define JournalSiteDefineMemberRef 15
+#define JournalSiteSetILFunctionBody 16
+#define JournalSiteGetGenerationBounds 17
+
+#pragma pack(push, 8)
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t formatVersion;
+    uint32_t recordSize;
+    uint32_t capacity;
+    uint64_t writeIndex;
+    int64_t counterFrequency;
+    int64_t dumpCounter;
+    int64_t dumpEpochMicroseconds;
+    uint32_t processId;
+    uint32_t reserved;
+} JournalHeader;
+
+typedef struct
+{
+    uint64_t sequence; // write index + 1, stored last; the dump writes 0 for a record torn while it was copied
+    int64_t counter;
+    uint64_t value;
+    uint32_t threadId;
+    uint16_t eventType;
+    uint16_t site;
+} JournalRecord;
+
+#pragma pack(pop)
@@ -0,0 +1,453 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "MetadataReader.h"
+
+// PE and CLI header offsets (ECMA-335 II.25), read from raw bytes so no Windows image structures are needed
+#define DosNewHeaderOffset 0x3C
+#define PeSignature 0x00004550 // PE\0\0
+#define FileHeaderSize 20
+#define FileHeaderSectionCountOffset 2
+#define FileHeaderOptionalSizeOffset 16
+#define OptionalHeaderMagic32 0x10B
+#define OptionalHeaderMagic64 0x20B
+#define OptionalHeaderDirectories32 96
+#define OptionalHeaderDirectories64 112
+#define ComDescriptorDirectory 14
+#define SectionHeaderSize 40
+#define CliHeaderMetadataOffset 8
+
+#define HeapStringsWide 0x01
+#define HeapGuidWide 0x02
+#define HeapBlobWide 0x04
+#define HeapExtraData 0x40
+
+static inline USHORT ReadUShort(LPCBYTE pointer)
+{
+    USHORT value;
+    memcpy(&value, pointer, sizeof(value));
+    return value;
+}
+
+static inline ULONG ReadULong(LPCBYTE pointer)
+{
+    ULONG value;
+    memcpy(&value, pointer, sizeof(value));
+    return value;
+}
+
+static inline ULONG64 ReadULong64(LPCBYTE pointer)
+{
+    ULONG64 value;
+    memcpy(&value, pointer, sizeof(value));
+    return value;
+}
+
+MetadataReader::MetadataReader() : image(NULL), flatLayout(false), sections(NULL), sectionCount(0), strings(NULL), stringsSize(0),
+    blobs(NULL), blobsSize(0), stringIndexSize(2), guidIndexSize(2), blobIndexSize(2)
+{
+    memset(rowCounts, 0, sizeof(rowCounts));
+    memset(rowSizes, 0, sizeof(rowSizes));
+    memset(tables, 0, sizeof(tables));
+}
+
+LPCBYTE MetadataReader::GetPointer(ULONG rva, ULONG size)
+{
+    if (!flatLayout)
+    {
+        return image + rva;
+    }
+
+    for (ULONG i = 0; i < sectionCount; i++)
+    {
+        LPCBYTE section = sections + i * SectionHeaderSize;
+        ULONG virtualSize = ReadULong(section + 8);
+        ULONG virtualAddress = ReadULong(section + 12);
+        ULONG rawSize = ReadULong(section + 16);
+        ULONG rawPointer = ReadULong(section + 20);
+
+        if (rva >= virtualAddress && (ULONG64)rva + size <= (ULONG64)virtualAddress + (rawSize < virtualSize || virtualSize == 0 ? rawSize : virtualSize))
+        {
+            return image + rawPointer + (rva - virtualAddress);
+        }
+    }
+
+    return NULL;
+}
+
+bool MetadataReader::Open(LPCBYTE image, bool flatLayout)
+{
+    if (image == NULL || ReadUShort(image) != 0x5A4D) // MZ
+    {
+        return false;
+    }
+
+    this->image = image;
+    this->flatLayout = flatLayout;
+
+    LPCBYTE ntHeaders = image + ReadULong(image + DosNewHeaderOffset);
+    if (ReadULong(ntHeaders) != PeSignature)
+    {
+        return false;
+    }
+
+    LPCBYTE fileHeader = ntHeaders + sizeof(ULONG);
+    LPCBYTE optionalHeader = fileHeader + FileHeaderSize;
+    sectionCount = ReadUShort(fileHeader + FileHeaderSectionCountOffset);
+    sections = optionalHeader + ReadUShort(fileHeader + FileHeaderOptionalSizeOffset);
+
+    USHORT magic = ReadUShort(optionalHeader);
+    if (magic != OptionalHeaderMagic32 && magic != OptionalHeaderMagic64)
+    {
+        return false;
+    }
+
+    LPCBYTE directories = optionalHeader + (magic == OptionalHeaderMagic32 ? OptionalHeaderDirectories32 : OptionalHeaderDirectories64);
+    ULONG cliHeaderRva = ReadULong(directories + ComDescriptorDirectory * 8);
+    LPCBYTE cliHeader = cliHeaderRva == 0 ? NULL : GetPointer(cliHeaderRva, CliHeaderMetadataOffset + 8);
+    if (cliHeader == NULL)
+    {
+        return false;
+    }
+
+    ULONG metadataSize = ReadULong(cliHeader + CliHeaderMetadataOffset + 4);
+    LPCBYTE metadata = GetPointer(ReadULong(cliHeader + CliHeaderMetadataOffset), metadataSize);
+    if (metadata == NULL || metadataSize < 16 || ReadULong(metadata) != MetadataSignature)
+    {
+        return false;
+    }
+
+    ULONG versionLength = ReadULong(metadata + 12);
+    if (16 + versionLength + 4 > metadataSize)
+    {
+        return false;
+    }
+
+    LPCBYTE streamHeader = metadata + 16 + versionLength + 2;
+    USHORT streamCount = ReadUShort(streamHeader);
+    streamHeader += sizeof(USHORT);
+
+    LPCBYTE tableStream = NULL;
+    ULONG tableStreamSize = 0;
+
+    for (USHORT i = 0; i < streamCount; i++)
+    {
+        if (streamHeader + 8 > metadata + metadataSize)
+        {
+            return false;
+        }
+
+        ULONG offset = ReadULong(streamHeader);
+        ULONG size = ReadULong(streamHeader + 4);
+        LPCSTR name = (LPCSTR)(streamHeader + 8);
+        size_t nameLength = strnlen(name, 32);
+
+        if ((ULONG64)offset + size > metadataSize)
+        {
+            return false;
+        }
+
+        if (strcmp(name, "#~") == 0)
+        {
+            tableStream = metadata + offset;
+            tableStreamSize = size;
+        }
+        else if (strcmp(name, "#Strings") == 0)
+        {
+            strings = metadata + offset;
+            stringsSize = size;
+        }
+        else if (strcmp(name, "#Blob") == 0)
+        {
+            blobs = metadata + offset;
+            blobsSize = size;
+        }
+
+        // Names are null terminated and padded to a multiple of four bytes
+        streamHeader += 8 + ((nameLength + 4) & ~3);
+    }
+
+    if (tableStream == NULL || strings == NULL || tableStreamSize < 24)
+    {
+        return false;
+    }
+
+    BYTE heapSizes = tableStream[6];
+    ULONG64 valid = ReadULong64(tableStream + 8);
+    LPCBYTE cursor = tableStream + 24;
+
+    stringIndexSize = heapSizes & HeapStringsWide ? 4 : 2;
+    guidIndexSize = heapSizes & HeapGuidWide ? 4 : 2;
+    blobIndexSize = heapSizes & HeapBlobWide ? 4 : 2;
+
+    for (ULONG i = 0; i < MetadataTableCount; i++)
+    {
+        if (valid & (1ULL << i))
+        {
+            if (cursor + sizeof(ULONG) > tableStream + tableStreamSize)
+            {
+                return false;
+            }
+
+            rowCounts[i] = ReadULong(cursor);
+            cursor += sizeof(ULONG);
+        }
+    }
+
+    if (heapSizes & HeapExtraData)
+    {
+        cursor += sizeof(ULONG);
+    }
+
+    // Tables that would need the indirection tables are left to IMetaDataImport
+    if (rowCounts[MetadataTableFieldPtr] != 0 || rowCounts[MetadataTableMethodPtr] != 0 || rowCounts[MetadataTableParamPtr] != 0)
+    {
+        return false;
+    }
+
+    const ULONG resolutionScope[] = { MetadataTableModule, MetadataTableModuleRef, MetadataTableAssemblyRef, MetadataTableTypeRef };
+    const ULONG typeDefOrRef[] = { MetadataTableTypeDef, MetadataTableTypeRef, MetadataTableTypeSpec };
+    const ULONG memberRefParent[] = { MetadataTableTypeDef, MetadataTableTypeRef, MetadataTableModuleRef, MetadataTableMethodDef, MetadataTableTypeSpec };
+
+    // Only the tables up to MemberRef are read, so only their rows have to be sized
+    rowSizes[MetadataTableModule] = 2 + stringIndexSize + 3 * guidIndexSize;
+    rowSizes[MetadataTableTypeRef] = GetCodedIndexSize(resolutionScope, 4, 2) + 2 * stringIndexSize;
+    rowSizes[MetadataTableTypeDef] = 4 + 2 * stringIndexSize + GetCodedIndexSize(typeDefOrRef, 3, 2) + GetIndexSize(MetadataTableField) + GetIndexSize(MetadataTableMethodDef);
+    rowSizes[MetadataTableFieldPtr] = GetIndexSize(MetadataTableField);
+    rowSizes[MetadataTableField] = 2 + stringIndexSize + blobIndexSize;
+    rowSizes[MetadataTableMethodPtr] = GetIndexSize(MetadataTableMethodDef);
+    rowSizes[MetadataTableMethodDef] = 4 + 2 + 2 + stringIndexSize + blobIndexSize + GetIndexSize(MetadataTableParam);
+    rowSizes[MetadataTableParamPtr] = GetIndexSize(MetadataTableParam);
+    rowSizes[MetadataTableParam] = 2 + 2 + stringIndexSize;
+    rowSizes[MetadataTableInterfaceImpl] = GetIndexSize(MetadataTableTypeDef) + GetCodedIndexSize(typeDefOrRef, 3, 2);
+    rowSizes[MetadataTableMemberRef] = GetCodedIndexSize(memberRefParent, 5, 3) + stringIndexSize + blobIndexSize;
+
+    for (ULONG i = MetadataTableModule; i <= MetadataTableMemberRef; i++)
+    {
+        tables[i] = cursor;
+        cursor += (ULONG64)rowCounts[i] * rowSizes[i];
+    }
+
+    return cursor <= tableStream + tableStreamSize;
+}
+
+ULONG MetadataReader::GetIndexSize(ULONG table)
+{
+    return rowCounts[table] < 0x10000 ? 2 : 4;
+}
+
+ULONG MetadataReader::GetCodedIndexSize(const ULONG* tables, ULONG tableCount, ULONG tagBits)
+{
+    ULONG largest = 0;
+    for (ULONG i = 0; i < tableCount; i++)
+    {
+        largest = rowCounts[tables[i]] > largest ? rowCounts[tables[i]] : largest;
+    }
+
+    return largest < (1UL << (16 - tagBits)) ? 2 : 4;
+}
+
+ULONG MetadataReader::ReadColumn(LPCBYTE* cursor, ULONG size)
+{
+    ULONG value = size == 2 ? ReadUShort(*cursor) : ReadULong(*cursor);
+    *cursor += size;
+    return value;
+}
+
+LPCBYTE MetadataReader::GetRow(ULONG table, ULONG rid)
+{
+    if (rid == 0 || rid > rowCounts[table] || tables[table] == NULL)
+    {
+        return NULL;
+    }
+
+    return tables[table] + (ULONG64)(rid - 1) * rowSizes[table];
+}
+
+LPCSTR MetadataReader::GetString(ULONG index)
+{
+    return index < stringsSize ? (LPCSTR)(strings + index) : "";
+}
+
+PCCOR_SIGNATURE MetadataReader::GetBlob(ULONG index, ULONG* length)
+{
+    *length = 0;
+    if (blobs == NULL || index >= blobsSize)
+    {
+        return NULL;
+    }
+
+    // Compressed length prefix (II.24.2.4)
+    LPCBYTE blob = blobs + index;
+    ULONG prefix = 1;
+    ULONG size = blob[0];
+
+    if ((blob[0] & 0x80) == 0)
+    {
+        size = blob[0];
+    }
+    else if ((blob[0] & 0xC0) == 0x80 && index + 2 <= blobsSize)
+    {
+        size = ((blob[0] & 0x3F) << 8) | blob[1];
+        prefix = 2;
+    }
+    else if ((blob[0] & 0xE0) == 0xC0 && index + 4 <= blobsSize)
+    {
+        size = ((blob[0] & 0x1F) << 24) | (blob[1] << 16) | (blob[2] << 8) | blob[3];
+        prefix = 4;
+    }
+    else
+    {
+        return NULL;
+    }
+
+    if ((ULONG64)index + prefix + size > blobsSize)
+    {
+        return NULL;
+    }
+
+    *length = size;
+    return blob + prefix;
+}
+
+ULONG MetadataReader::GetRowCount(ULONG table)
+{
+    return table < MetadataTableCount ? rowCounts[table] : 0;
+}
+
+bool MetadataReader::GetTypeRef(mdTypeRef token, MetadataTypeRef* typeRef)
+{
+    LPCBYTE cursor = TypeFromToken(token) == mdtTypeRef ? GetRow(MetadataTableTypeRef, RidFromToken(token)) : NULL;
+    if (cursor == NULL)
+    {
+        return false;
+    }
+
+    const mdToken scopeTypes[] = { mdtModule, mdtModuleRef, mdtAssemblyRef, mdtTypeRef };
+    ULONG scopeSize = rowSizes[MetadataTableTypeRef] - 2 * stringIndexSize;
+
+    ULONG scope = ReadColumn(&cursor, scopeSize);
+    typeRef->resolutionScope = TokenFromRid(scope >> 2, scopeTypes[scope & 3]);
+    typeRef->name = GetString(ReadColumn(&cursor, stringIndexSize));
+    typeRef->nameSpace = GetString(ReadColumn(&cursor, stringIndexSize));
+
+    return true;
+}
+
+bool MetadataReader::GetTypeDef(mdTypeDef token, MetadataTypeDef* typeDef)
+{
+    LPCBYTE cursor = TypeFromToken(token) == mdtTypeDef ? GetRow(MetadataTableTypeDef, RidFromToken(token)) : NULL;
+    if (cursor == NULL)
+    {
+        return false;
+    }
+
+    const mdToken extendsTypes[] = { mdtTypeDef, mdtTypeRef, mdtTypeSpec, 0 };
+    ULONG extendsSize = rowSizes[MetadataTableTypeDef] - 4 - 2 * stringIndexSize - GetIndexSize(MetadataTableField) - GetIndexSize(MetadataTableMethodDef);
+
+    typeDef->flags = ReadColumn(&cursor, 4);
+    typeDef->name = GetString(ReadColumn(&cursor, stringIndexSize));
+    typeDef->nameSpace = GetString(ReadColumn(&cursor, stringIndexSize));
+    ULONG extends = ReadColumn(&cursor, extendsSize);
+    typeDef->extends = (extends >> 2) == 0 ? mdTokenNil : TokenFromRid(extends >> 2, extendsTypes[extends & 3]);
+    ReadColumn(&cursor, GetIndexSize(MetadataTableField));
+    typeDef->methodList = ReadColumn(&cursor, GetIndexSize(MetadataTableMethodDef));
+
+    return true;
+}
+
+bool MetadataReader::GetMethodDef(mdMethodDef token, MetadataMethodDef* methodDef)
+{
+    LPCBYTE cursor = TypeFromToken(token) == mdtMethodDef ? GetRow(MetadataTableMethodDef, RidFromToken(token)) : NULL;
+    if (cursor == NULL)
+    {
+        return false;
+    }
+
+    methodDef->rva = ReadColumn(&cursor, 4);
+    methodDef->implFlags = (USHORT)ReadColumn(&cursor, 2);
+    methodDef->flags = (USHORT)ReadColumn(&cursor, 2);
+    methodDef->name = GetString(ReadColumn(&cursor, stringIndexSize));
+    methodDef->signature = GetBlob(ReadColumn(&cursor, blobIndexSize), &methodDef->signatureLength);
+
+    return true;
+}
+
+bool MetadataReader::GetMemberRef(mdMemberRef token, MetadataMemberRef* memberRef)
+{
+    LPCBYTE cursor = TypeFromToken(token) == mdtMemberRef ? GetRow(MetadataTableMemberRef, RidFromToken(token)) : NULL;
+    if (cursor == NULL)
+    {
+        return false;
+    }
+
+    const mdToken parentTypes[] = { mdtTypeDef, mdtTypeRef, mdtModuleRef, mdtMethodDef, mdtTypeSpec, 0, 0, 0 };
+    ULONG parentSize = rowSizes[MetadataTableMemberRef] - stringIndexSize - blobIndexSize;
+
+    ULONG parent = ReadColumn(&cursor, parentSize);
+    memberRef->parent = TokenFromRid(parent >> 3, parentTypes[parent & 7]);
+    memberRef->name = GetString(ReadColumn(&cursor, stringIndexSize));
+    memberRef->signature = GetBlob(ReadColumn(&cursor, blobIndexSize), &memberRef->signatureLength);
+
+    return true;
+}
+
+mdTypeDef MetadataReader::GetMethodOwner(mdMethodDef token)
+{
+    ULONG rid = RidFromToken(token);
+    ULONG methodListSize = GetIndexSize(MetadataTableMethodDef);
+    ULONG methodListOffset = rowSizes[MetadataTableTypeDef] - methodListSize;
+
+    // Method lists are ascending, the owner is the last type whose list starts at or before the method
+    ULONG low = 1;
+    ULONG high = rowCounts[MetadataTableTypeDef];
+    ULONG owner = 0;
+
+    while (low <= high)
+    {
+        ULONG middle = low + (high - low) / 2;
+        LPCBYTE cursor = GetRow(MetadataTableTypeDef, middle) + methodListOffset;
+
+        if (ReadColumn(&cursor, methodListSize) <= rid)
+        {
+            owner = middle;
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+
+    return owner == 0 ? mdTypeDefNil : TokenFromRid(owner, mdtTypeDef);
+}
+
+LPCBYTE MetadataReader::GetMethodBody(const MetadataMethodDef& methodDef)
+{
+    // Abstract, runtime and P/Invoke methods have no body; the header is at most 12 bytes and sized by its caller
+    return methodDef.rva == 0 ? NULL : GetPointer(methodDef.rva, 1);
+}
+
+bool MetadataReader::GetName(LPCSTR name, WCHAR* buffer, ULONG length)
+{
+    return MultiByteToWideChar(CP_UTF8, 0, name, -1, buffer, length) > 0;
+}
+
+bool MetadataReader::GetTypeName(LPCSTR nameSpace, LPCSTR name, WCHAR* buffer, ULONG length)
+{
+    // Same shape as IMetaDataImport::GetTypeDefProps: Namespace.Name, or the bare name without a namespace
+    if (nameSpace[0] == '\0')
+    {
+        return GetName(name, buffer, length);
+    }
+
+    int written = MultiByteToWideChar(CP_UTF8, 0, nameSpace, -1, buffer, length);
+    if (written <= 0 || (ULONG)written >= length)
+    {
+        return false;
+    }
+
+    buffer[written - 1] = L'.';
+    return GetName(name, buffer + written, length - written);
+}
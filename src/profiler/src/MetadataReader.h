@@ -0,0 +1,109 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "cor.h"
+
+#define MetadataSignature 0x424A5342 // BSJB
+#define MetadataTableCount 64
+#define MetadataNameLength 1024
+
+#define MetadataTableModule 0x00
+#define MetadataTableTypeRef 0x01
+#define MetadataTableTypeDef 0x02
+#define MetadataTableFieldPtr 0x03
+#define MetadataTableField 0x04
+#define MetadataTableMethodPtr 0x05
+#define MetadataTableMethodDef 0x06
+#define MetadataTableParamPtr 0x07
+#define MetadataTableParam 0x08
+#define MetadataTableInterfaceImpl 0x09
+#define MetadataTableMemberRef 0x0A
+#define MetadataTableModuleRef 0x1A
+#define MetadataTableTypeSpec 0x1B
+#define MetadataTableAssemblyRef 0x23
+
+typedef struct
+{
+    DWORD flags;
+    LPCSTR name;
+    LPCSTR nameSpace;
+    mdToken extends;
+    ULONG methodList;
+} MetadataTypeDef;
+
+typedef struct
+{
+    mdToken resolutionScope;
+    LPCSTR name;
+    LPCSTR nameSpace;
+} MetadataTypeRef;
+
+typedef struct
+{
+    ULONG rva;
+    USHORT implFlags;
+    USHORT flags;
+    LPCSTR name;
+    PCCOR_SIGNATURE signature;
+    ULONG signatureLength;
+} MetadataMethodDef;
+
+typedef struct
+{
+    mdToken parent;
+    LPCSTR name;
+    PCCOR_SIGNATURE signature;
+    ULONG signatureLength;
+} MetadataMemberRef;
+
+// Read-only view of the ECMA-335 tables of a module image (#~, #Strings, #Blob; TypeRef, TypeDef,
+// MethodDef and MemberRef rows). Nothing is copied: names point into the #Strings heap as UTF-8 and signatures into
+// the #Blob heap, so they live as long as the image. Open accepts the mapped layout the loader uses
+// as well as the flat file layout. Images it cannot read (uncompressed #- tables, MethodPtr
+// indirection, dynamic modules) are rejected, and callers fall back to IMetaDataImport.
+class MetadataReader
+{
+public:
+    MetadataReader();
+
+    bool Open(LPCBYTE image, bool flatLayout);
+
+    ULONG GetRowCount(ULONG table);
+    bool GetTypeRef(mdTypeRef token, MetadataTypeRef* typeRef);
+    bool GetTypeDef(mdTypeDef token, MetadataTypeDef* typeDef);
+    bool GetMethodDef(mdMethodDef token, MetadataMethodDef* methodDef);
+    bool GetMemberRef(mdMemberRef token, MetadataMemberRef* memberRef);
+    mdTypeDef GetMethodOwner(mdMethodDef token);
+    LPCBYTE GetMethodBody(const MetadataMethodDef& methodDef);
+
+    static bool GetName(LPCSTR name, WCHAR* buffer, ULONG length);
+    static bool GetTypeName(LPCSTR nameSpace, LPCSTR name, WCHAR* buffer, ULONG length);
+
+private:
+    LPCBYTE GetPointer(ULONG rva, ULONG size);
+    ULONG GetIndexSize(ULONG table);
+    ULONG GetCodedIndexSize(const ULONG* tables, ULONG tableCount, ULONG tagBits);
+    ULONG ReadColumn(LPCBYTE* cursor, ULONG size);
+    LPCBYTE GetRow(ULONG table, ULONG rid);
+    LPCSTR GetString(ULONG index);
+    PCCOR_SIGNATURE GetBlob(ULONG index, ULONG* length);
+
+    LPCBYTE image;
+    bool flatLayout;
+    LPCBYTE sections;
+    ULONG sectionCount;
+
+    LPCBYTE strings;
+    ULONG stringsSize;
+    LPCBYTE blobs;
+    ULONG blobsSize;
+
+    ULONG stringIndexSize;
+    ULONG guidIndexSize;
+    ULONG blobIndexSize;
+    ULONG rowCounts[MetadataTableCount];
+    ULONG rowSizes[MetadataTableCount];
+    LPCBYTE tables[MetadataTableCount];
+};
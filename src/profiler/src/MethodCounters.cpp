@@ -0,0 +1,226 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <mutex>
+#include <set>
+#include <utility>
+#include "stdafx.h"
+#include "Environment.h"
+#include "Journal.h"
+#include "MethodCounters.h"
+#include "Recorder.h"
+
+MethodCounterSlot MethodCounters::slots[MethodCountersMaximumSlots];
+WCHAR MethodCounters::classNames[MethodCountersMaximumSlots][MethodCounterNameLength] = { 0 };
+WCHAR MethodCounters::methodNames[MethodCountersMaximumSlots][MethodCounterNameLength] = { 0 };
+ULONG MethodCounters::slotCount = 0;
+
+static std::mutex claimLock;
+static std::set<std::pair<ModuleID, mdToken>> claimed;
+
+void MethodCounters::Initialize()
+{
+    WCHAR* value = new WCHAR[MethodCountersValueLength];
+
+    if (slotCount == 0 && Environment::GetValue(MethodCountersVariable, value, MethodCountersValueLength))
+    {
+        WCHAR* context = NULL;
+        for (WCHAR* name = wcstok_s(value, L";", &context); name != NULL; name = wcstok_s(NULL, L";", &context))
+        {
+            AddSlot(name);
+        }
+    }
+
+    delete[] value;
+}
+
+void MethodCounters::AddSlot(LPCWSTR name)
+{
+    // The method name follows the last '.', everything before it is the namespace qualified type
+    LPCWSTR separator = wcsrchr(name, L'.');
+    if (separator == NULL || separator == name || separator[1] == L'\0' || slotCount >= MethodCountersMaximumSlots)
+    {
+        return;
+    }
+
+    size_t classNameLength = separator - name;
+    if (classNameLength >= MethodCounterNameLength || wcslen(separator + 1) >= MethodCounterNameLength)
+    {
+        return;
+    }
+
+    wcsncpy_s(classNames[slotCount], MethodCounterNameLength, name, classNameLength);
+    wcscpy_s(methodNames[slotCount], MethodCounterNameLength, separator + 1);
+
+    slots[slotCount].count.store(0, std::memory_order_relaxed);
+    slots[slotCount].enabled.store(1, std::memory_order_relaxed);
+    slotCount++;
+}
+
+bool MethodCounters::IsCountedName(LPCWSTR methodName)
+{
+    for (ULONG i = 0; i < slotCount; i++)
+    {
+        if (wcscmp(methodNames[i], methodName) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+LONG MethodCounters::FindSlot(LPCWSTR className, LPCWSTR methodName)
+{
+    for (ULONG i = 0; i < slotCount; i++)
+    {
+        if (wcscmp(methodNames[i], methodName) == 0 && wcscmp(classNames[i], className) == 0)
+        {
+            return (LONG)i;
+        }
+    }
+
+    return -1;
+}
+
+bool MethodCounters::Claim(ModuleID moduleID, mdToken token)
+{
+    // Tiered compilation reports the same method again, and its body already carries the counter
+    std::lock_guard<std::mutex> guard(claimLock);
+
+    return claimed.insert(std::make_pair(moduleID, token)).second;
+}
+
+HRESULT MethodCounters::DefineInterlockedAdd(ICorProfilerInfo* profilerInfo, ModuleID moduleID, mdMemberRef* methodToken)
+{
+    IMetaDataEmit* iMetaDataEmit = NULL;
+    HRESULT hr = profilerInfo->GetModuleMetaData(moduleID, ofRead | ofWrite, IID_IMetaDataEmit, (IUnknown**)&iMetaDataEmit);
+    if (FAILED(hr) || iMetaDataEmit == NULL)
+    {
+        Journal::WriteFailure(JournalSiteGetModuleMetaData, hr);
+        return FAILED(hr) ? hr : E_FAIL;
+    }
+
+    IMetaDataAssemblyEmit* iMetaDataAssemblyEmit = NULL;
+    hr = iMetaDataEmit->QueryInterface(IID_IMetaDataAssemblyEmit, (void**)&iMetaDataAssemblyEmit);
+    if (FAILED(hr) || iMetaDataAssemblyEmit == NULL)
+    {
+        Journal::WriteFailure(JournalSiteQueryAssemblyEmit, hr);
+        iMetaDataEmit->Release();
+        return FAILED(hr) ? hr : E_FAIL;
+    }
+
+    // mscorlib resolves to the core library on both .NET Framework and .NET Core, through its facade on the latter
+    const BYTE publicKeyToken[] = { 0xb7, 0x7a, 0x5c, 0x56, 0x19, 0x34, 0xe0, 0x89 }; // b77a5c561934e089
+    ASSEMBLYMETADATA mscorlibMetaData = { 0 };
+    mscorlibMetaData.usMajorVersion = 4;
+    mdAssemblyRef mscorlibToken;
+    hr = iMetaDataAssemblyEmit->DefineAssemblyRef(publicKeyToken, sizeof(publicKeyToken), L"mscorlib", &mscorlibMetaData, NULL, 0, 0, &mscorlibToken);
+    Recorder::RecordDefinition(moduleID, RecordingDefineAssemblyRef, mdTokenNil, hr, mscorlibToken, L"mscorlib", publicKeyToken, sizeof(publicKeyToken));
+    iMetaDataAssemblyEmit->Release();
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteDefineAssemblyRef, hr);
+        iMetaDataEmit->Release();
+        return hr;
+    }
+
+    mdTypeRef interlockedToken;
+    hr = iMetaDataEmit->DefineTypeRefByName(mscorlibToken, L"System.Threading.Interlocked", &interlockedToken);
+    Recorder::RecordDefinition(moduleID, RecordingDefineTypeRef, mscorlibToken, hr, interlockedToken, L"System.Threading.Interlocked", NULL, 0);
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteDefineTypeRefByName, hr);
+        iMetaDataEmit->Release();
+        return hr;
+    }
+
+    const BYTE addSignature[] = { IMAGE_CEE_CS_CALLCONV_DEFAULT, 2, ELEMENT_TYPE_I8, ELEMENT_TYPE_BYREF, ELEMENT_TYPE_I8, ELEMENT_TYPE_I8 }; // int64 (ref int64, int64)
+    hr = iMetaDataEmit->DefineMemberRef(interlockedToken, L"Add", addSignature, sizeof(addSignature), methodToken);
+    Recorder::RecordDefinition(moduleID, RecordingDefineMemberRef, interlockedToken, hr, *methodToken, L"Add", addSignature, sizeof(addSignature));
+    iMetaDataEmit->Release();
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteDefineMemberRef, hr);
+        return hr;
+    }
+
+    return S_OK;
+}
+
+HRESULT MethodCounters::BuildPrologue(ICorProfilerInfo* profilerInfo, FunctionInfo* functionInfo, ULONG slot, BYTE* prologue, ULONG prologueLength)
+{
+    if (slot >= slotCount || prologueLength < MethodCounterPrologueSize)
+    {
+        return E_INVALIDARG;
+    }
+
+    mdMemberRef addToken;
+    HRESULT hr = DefineInterlockedAdd(profilerInfo, functionInfo->GetModuleID(), &addToken);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // The slot never moves, so its addresses are embedded as constants
+    LONG64 enabledAddress = (LONG64)(INT_PTR)&slots[slot].enabled;
+    LONG64 countAddress = (LONG64)(INT_PTR)&slots[slot].count;
+
+    prologue[0] = 0x21; // ldc.i8
+    memcpy_s(prologue + 1, prologueLength - 1, &enabledAddress, sizeof(enabledAddress));
+    prologue[9] = 0xD3; // conv.i
+    prologue[10] = 0x4A; // ldind.i4
+    prologue[11] = 0x2C; // brfalse.s
+    prologue[12] = (BYTE)(MethodCounterPrologueSize - 13); // to the original method body
+    prologue[13] = 0x21; // ldc.i8
+    memcpy_s(prologue + 14, prologueLength - 14, &countAddress, sizeof(countAddress));
+    prologue[22] = 0xD3; // conv.i
+    prologue[23] = 0x17; // ldc.i4.1
+    prologue[24] = 0x6A; // conv.i8
+    prologue[25] = 0x28; // call
+    memcpy_s(prologue + 26, prologueLength - 26, &addToken, sizeof(addToken));
+    prologue[30] = 0x26; // pop
+
+    return S_OK;
+}
+
+ULONG MethodCounters::Snapshot(ULONG64* counts, ULONG length)
+{
+    if (counts != NULL)
+    {
+        for (ULONG i = 0; i < slotCount && i < length; i++)
+        {
+            counts[i] = (ULONG64)slots[i].count.load(std::memory_order_relaxed);
+        }
+    }
+
+    return slotCount;
+}
+
+HRESULT MethodCounters::GetName(ULONG slot, WCHAR* buffer, ULONG length)
+{
+    if (slot >= slotCount || buffer == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Checked up front, the secure CRT functions would raise the invalid parameter handler instead of failing
+    if (wcslen(classNames[slot]) + wcslen(methodNames[slot]) + 2 > length)
+    {
+        return E_NOT_SUFFICIENT_BUFFER;
+    }
+
+    swprintf_s(buffer, length, L"%s.%s", classNames[slot], methodNames[slot]);
+
+    return S_OK;
+}
+
+extern "C" ULONG STDMETHODCALLTYPE GetXRayMethodCounters(ULONG64* counts, ULONG length)
+{
+    return MethodCounters::Snapshot(counts, length);
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayMethodCounterName(ULONG slot, WCHAR* buffer, ULONG length)
+{
+    return MethodCounters::GetName(slot, buffer, length);
+}
@@ -0,0 +1,80 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include "cor.h"
+#include "corprof.h"
+#include "FunctionInfo.h"
+
+#define MethodCountersVariable L"AWS_XRAY_PROFILER_COUNTED_METHODS"
+#define MethodCountersValueLength 8192
+#define MethodCountersMaximumSlots 256
+#define MethodCounterNameLength 256
+#define MethodCounterCacheLine 64
+#define MethodCounterPrologueSize 31
+#define MethodCounterPrologueMaxStack 2
+
+// Each slot owns a full cache line, so methods counted from different threads never share one
+typedef struct alignas(MethodCounterCacheLine)
+{
+    std::atomic<LONG64> count;
+    std::atomic<LONG> enabled;
+} MethodCounterSlot;
+
+// Call counters for the methods listed in AWS_XRAY_PROFILER_COUNTED_METHODS ("Namespace.Type.Method;...").
+// The prologue injected into each counted method is
+//     ldc.i8 <enabled address>; conv.i; ldind.i4; brfalse.s <method body>;
+//     ldc.i8 <count address>; conv.i; ldc.i4.1; conv.i8; call Interlocked::Add(int64&, int64); pop
+// so a call costs one locked add on a line no other counter touches, and reading the counters never
+// stops the application. Clearing the enabled flag sheds the add without touching the method body.
+class MethodCounters
+{
+public:
+    static void Initialize();
+
+    static inline bool IsEnabled()
+    {
+        return slotCount > 0;
+    }
+
+    static bool IsCountedName(LPCWSTR methodName);
+    static LONG FindSlot(LPCWSTR className, LPCWSTR methodName);
+    static bool Claim(ModuleID moduleID, mdToken token);
+    static HRESULT BuildPrologue(ICorProfilerInfo* profilerInfo, FunctionInfo* functionInfo, ULONG slot, BYTE* prologue, ULONG prologueLength);
+    static ULONG Snapshot(ULONG64* counts, ULONG length);
+
+    static inline ULONG GetSlotCount()
+    {
+        return slotCount;
+    }
+
+    static inline ULONG64 GetCount(ULONG slot)
+    {
+        return (ULONG64)slots[slot].count.load(std::memory_order_relaxed);
+    }
+
+    static inline bool IsSlotEnabled(ULONG slot)
+    {
+        return slots[slot].enabled.load(std::memory_order_relaxed) != 0;
+    }
+
+    static inline void SetSlotEnabled(ULONG slot, bool enabled)
+    {
+        slots[slot].enabled.store(enabled ? 1 : 0, std::memory_order_relaxed);
+    }
+    static HRESULT GetName(ULONG slot, WCHAR* buffer, ULONG length);
+
+private:
+    static HRESULT DefineInterlockedAdd(ICorProfilerInfo* profilerInfo, ModuleID moduleID, mdMemberRef* methodToken);
+    static void AddSlot(LPCWSTR name);
+
+    static MethodCounterSlot slots[MethodCountersMaximumSlots];
+    static WCHAR classNames[MethodCountersMaximumSlots][MethodCounterNameLength];
+    static WCHAR methodNames[MethodCountersMaximumSlots][MethodCounterNameLength];
+    static ULONG slotCount;
+};
+
+extern "C" ULONG STDMETHODCALLTYPE GetXRayMethodCounters(ULONG64* counts, ULONG length);
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayMethodCounterName(ULONG slot, WCHAR* buffer, ULONG length);
@@ -0,0 +1,326 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include "stdafx.h"
+#include "Epoch.h"
+#include "MethodTable.h"
+
+std::atomic<MethodTable::Table*> MethodTable::table(nullptr);
+std::mutex MethodTable::writeLock;
+ULONG MethodTable::used = 0;
+std::vector<MethodTable::Entry*> MethodTable::freeEntries;
+
+std::mutex MethodTable::nameLock;
+std::unordered_map<std::wstring, ULONG> MethodTable::nameIds;
+std::atomic<LPCWSTR*> MethodTable::nameChunks[MethodTableNameChunkCount];
+ULONG MethodTable::nameCount = 1;
+
+ULONG MethodTable::GetIndex(FunctionID functionId, ULONG capacity)
+{
+    // FunctionIDs are aligned pointers, so mix the bits before masking
+    ULONG64 hash = (ULONG64)functionId * 0x9E3779B97F4A7C15ULL;
+    return (ULONG)(hash >> 32) & (capacity - 1);
+}
+
+bool MethodTable::Find(FunctionID functionId, MethodDescriptor* descriptor)
+{
+    EpochGuard guard;
+
+    Table* current = table.load(std::memory_order_acquire);
+    if (current == nullptr || functionId <= MethodTableDeletedKey)
+    {
+        return false;
+    }
+
+    for (ULONG probe = 0, index = GetIndex(functionId, current->capacity); probe < current->capacity; probe++, index = (index + 1) & (current->capacity - 1))
+    {
+        FunctionID key = current->keys[index].load(std::memory_order_acquire);
+        if (key == MethodTableEmptyKey)
+        {
+            return false;
+        }
+
+        if (key != functionId)
+        {
+            continue;
+        }
+
+        Entry* entry = current->entries[index].load(std::memory_order_acquire);
+        if (entry == nullptr)
+        {
+            return false;
+        }
+
+        ULONG before = entry->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            return false;
+        }
+
+        memcpy(descriptor, &entry->descriptor, sizeof(MethodDescriptor));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // The entry was recycled or rewritten while it was copied
+        return entry->sequence.load(std::memory_order_relaxed) == before && descriptor->functionId == functionId;
+    }
+
+    return false;
+}
+
+MethodTable::Table* MethodTable::CreateTable(ULONG capacity)
+{
+    Table* created = new Table();
+    created->capacity = capacity;
+    created->keys = new std::atomic<FunctionID>[capacity];
+    created->entries = new std::atomic<Entry*>[capacity];
+
+    for (ULONG i = 0; i < capacity; i++)
+    {
+        created->keys[i].store(MethodTableEmptyKey, std::memory_order_relaxed);
+        created->entries[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    return created;
+}
+
+void MethodTable::FreeTable(void* retired)
+{
+    Table* table = (Table*)retired;
+
+    delete[] table->keys;
+    delete[] table->entries;
+    delete table;
+}
+
+void MethodTable::Grow()
+{
+    Table* current = table.load(std::memory_order_relaxed);
+    ULONG live = 0;
+
+    for (ULONG i = 0; current != nullptr && i < current->capacity; i++)
+    {
+        if (current->entries[i].load(std::memory_order_relaxed) != nullptr)
+        {
+            live++;
+        }
+    }
+
+    // Rebuilding at the same size is enough when most of the used slots are tombstones
+    ULONG capacity = current == nullptr ? MethodTableInitialCapacity : current->capacity;
+    while (live * 2 >= capacity)
+    {
+        capacity *= 2;
+    }
+
+    Table* created = CreateTable(capacity);
+
+    for (ULONG i = 0; current != nullptr && i < current->capacity; i++)
+    {
+        Entry* entry = current->entries[i].load(std::memory_order_relaxed);
+        if (entry == nullptr)
+        {
+            continue;
+        }
+
+        FunctionID key = current->keys[i].load(std::memory_order_relaxed);
+        ULONG index = GetIndex(key, capacity);
+        while (created->keys[index].load(std::memory_order_relaxed) != MethodTableEmptyKey)
+        {
+            index = (index + 1) & (capacity - 1);
+        }
+
+        created->keys[index].store(key, std::memory_order_relaxed);
+        created->entries[index].store(entry, std::memory_order_relaxed);
+    }
+
+    used = live;
+    table.store(created, std::memory_order_release);
+
+    // Readers may still be probing the old arrays, so they are retired rather than freed
+    if (current != nullptr)
+    {
+        Epoch::Retire(current, FreeTable);
+    }
+}
+
+MethodTable::Entry* MethodTable::AllocateEntry()
+{
+    if (freeEntries.empty())
+    {
+        Entry* slab = new Entry[MethodTableSlabSize];
+        for (ULONG i = 0; i < MethodTableSlabSize; i++)
+        {
+            slab[i].sequence.store(0, std::memory_order_relaxed);
+            freeEntries.push_back(&slab[MethodTableSlabSize - 1 - i]);
+        }
+    }
+
+    Entry* entry = freeEntries.back();
+    freeEntries.pop_back();
+
+    return entry;
+}
+
+void MethodTable::Insert(const MethodDescriptor& descriptor)
+{
+    if (descriptor.functionId <= MethodTableDeletedKey)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(writeLock);
+
+    Table* current = table.load(std::memory_order_relaxed);
+    if (current == nullptr || (used + 1) * 4 > current->capacity * 3)
+    {
+        Grow();
+        current = table.load(std::memory_order_relaxed);
+    }
+
+    ULONG target = current->capacity;
+    ULONG index = GetIndex(descriptor.functionId, current->capacity);
+
+    for (ULONG probe = 0; probe < current->capacity; probe++, index = (index + 1) & (current->capacity - 1))
+    {
+        FunctionID key = current->keys[index].load(std::memory_order_relaxed);
+        if (key == descriptor.functionId)
+        {
+            target = index;
+            break;
+        }
+
+        if (key == MethodTableDeletedKey && target == current->capacity)
+        {
+            target = index;
+        }
+        else if (key == MethodTableEmptyKey)
+        {
+            if (target == current->capacity)
+            {
+                target = index;
+            }
+            break;
+        }
+    }
+
+    Entry* entry = current->entries[target].load(std::memory_order_relaxed);
+    if (entry == nullptr)
+    {
+        entry = AllocateEntry();
+    }
+
+    ULONG sequence = entry->sequence.load(std::memory_order_relaxed);
+    entry->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry->descriptor = descriptor;
+    entry->sequence.store(sequence + 2, std::memory_order_release);
+
+    if (current->keys[target].load(std::memory_order_relaxed) == MethodTableEmptyKey)
+    {
+        used++;
+    }
+
+    current->entries[target].store(entry, std::memory_order_release);
+    current->keys[target].store(descriptor.functionId, std::memory_order_release);
+}
+
+void MethodTable::ReleaseEntry(Table* current, ULONG index)
+{
+    Entry* entry = current->entries[index].load(std::memory_order_relaxed);
+
+    current->keys[index].store(MethodTableDeletedKey, std::memory_order_release);
+    current->entries[index].store(nullptr, std::memory_order_release);
+
+    // Bumping the sequence invalidates copies taken by readers that already hold the entry
+    entry->sequence.fetch_add(2, std::memory_order_release);
+    freeEntries.push_back(entry);
+}
+
+void MethodTable::Remove(FunctionID functionId)
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+
+    Table* current = table.load(std::memory_order_relaxed);
+    if (current == nullptr || functionId <= MethodTableDeletedKey)
+    {
+        return;
+    }
+
+    for (ULONG probe = 0, index = GetIndex(functionId, current->capacity); probe < current->capacity; probe++, index = (index + 1) & (current->capacity - 1))
+    {
+        FunctionID key = current->keys[index].load(std::memory_order_relaxed);
+        if (key == MethodTableEmptyKey)
+        {
+            return;
+        }
+
+        if (key == functionId)
+        {
+            ReleaseEntry(current, index);
+            return;
+        }
+    }
+}
+
+void MethodTable::RemoveModule(ModuleID moduleId)
+{
+    std::lock_guard<std::mutex> guard(writeLock);
+
+    Table* current = table.load(std::memory_order_relaxed);
+    for (ULONG i = 0; current != nullptr && i < current->capacity; i++)
+    {
+        Entry* entry = current->entries[i].load(std::memory_order_relaxed);
+        if (entry != nullptr && entry->descriptor.moduleId == moduleId)
+        {
+            ReleaseEntry(current, i);
+        }
+    }
+}
+
+ULONG MethodTable::InternName(LPCWSTR name)
+{
+    if (name == NULL || name[0] == L'\0')
+    {
+        return MethodNoName;
+    }
+
+    std::lock_guard<std::mutex> guard(nameLock);
+
+    auto found = nameIds.find(name);
+    if (found != nameIds.end())
+    {
+        return found->second;
+    }
+
+    ULONG chunk = nameCount / MethodTableNameChunkSize;
+    if (chunk >= MethodTableNameChunkCount)
+    {
+        return MethodNoName;
+    }
+
+    LPCWSTR* names = nameChunks[chunk].load(std::memory_order_relaxed);
+    if (names == nullptr)
+    {
+        names = new LPCWSTR[MethodTableNameChunkSize]();
+        nameChunks[chunk].store(names, std::memory_order_release);
+    }
+
+    ULONG nameId = nameCount++;
+    names[nameId % MethodTableNameChunkSize] = _wcsdup(name);
+    nameIds.emplace(name, nameId);
+
+    return nameId;
+}
+
+LPCWSTR MethodTable::GetName(ULONG nameId)
+{
+    // Ids are only handed out after their name is stored, and names are never freed
+    LPCWSTR* names = nameId / MethodTableNameChunkSize < MethodTableNameChunkCount ? nameChunks[nameId / MethodTableNameChunkSize].load(std::memory_order_acquire) : nullptr;
+    if (nameId == MethodNoName || names == nullptr)
+    {
+        return L"";
+    }
+
+    return names[nameId % MethodTableNameChunkSize];
+}
@@ -0,0 +1,89 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "cor.h"
+#include "corprof.h"
+
+#define MethodTableInitialCapacity 1024
+#define MethodTableSlabSize 256
+#define MethodTableNameChunkSize 1024
+#define MethodTableNameChunkCount 1024
+
+#define MethodTableEmptyKey 0
+#define MethodTableDeletedKey 1
+
+#define MethodFlagEntryPoint 0x01
+#define MethodFlagCounted 0x02
+#define MethodFlagRewritten 0x04
+#define MethodFlagRedirected 0x08
+
+#define MethodNoName 0
+
+typedef struct
+{
+    FunctionID functionId;
+    ModuleID moduleId;
+    mdToken token;
+    ULONG assemblyNameId;
+    ULONG classNameId;
+    ULONG methodNameId;
+    ULONG flags : 8;
+    ULONG counterSlot : 24;
+} MethodDescriptor;
+
+// FunctionID to MethodDescriptor map shared by the callbacks.
+// Lookups never lock: the table is open addressed with linear probing and replaced as a whole when
+// it grows, and every descriptor carries a sequence number that readers check around their copy.
+// Writers serialize on one mutex. A replaced table is retired to Epoch and freed once no lookup still
+// probes it. Descriptors are carved out of slabs that are recycled but never freed, so a reader
+// racing with an eviction sees a changed sequence, never freed memory.
+// Names are interned once and referenced by id; id 0 is the empty name.
+class MethodTable
+{
+public:
+    static bool Find(FunctionID functionId, MethodDescriptor* descriptor);
+    static void Insert(const MethodDescriptor& descriptor);
+    static void Remove(FunctionID functionId);
+    static void RemoveModule(ModuleID moduleId);
+
+    static ULONG InternName(LPCWSTR name);
+    static LPCWSTR GetName(ULONG nameId);
+
+private:
+    struct Entry
+    {
+        std::atomic<ULONG> sequence;
+        MethodDescriptor descriptor;
+    };
+
+    struct Table
+    {
+        ULONG capacity;
+        std::atomic<FunctionID>* keys;
+        std::atomic<Entry*>* entries;
+    };
+
+    static Table* CreateTable(ULONG capacity);
+    static void FreeTable(void* table);
+    static void Grow();
+    static Entry* AllocateEntry();
+    static void ReleaseEntry(Table* table, ULONG index);
+    static ULONG GetIndex(FunctionID functionId, ULONG capacity);
+
+    static std::atomic<Table*> table;
+    static std::mutex writeLock;
+    static ULONG used;
+    static std::vector<Entry*> freeEntries;
+
+    static std::mutex nameLock;
+    static std::unordered_map<std::wstring, ULONG> nameIds;
+    static std::atomic<LPCWSTR*> nameChunks[MethodTableNameChunkCount];
+    static ULONG nameCount;
+};
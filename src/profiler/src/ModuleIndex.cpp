@@ -0,0 +1,515 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "CallSites.h"
+#include "Environment.h"
+#include "Epoch.h"
+#include "MethodCounters.h"
+#include "ModuleIndex.h"
+#include "Recorder.h"
+
+ICorProfilerInfo3* ModuleIndex::profilerInfo = NULL;
+std::mutex ModuleIndex::queueLock;
+std::condition_variable ModuleIndex::queueReady;
+std::deque<std::pair<ModuleID, ModuleIndex::ModuleBitmap*>> ModuleIndex::queue;
+std::mutex ModuleIndex::tableLock;
+std::atomic<ModuleIndex::Table*> ModuleIndex::table(nullptr);
+std::atomic<bool> ModuleIndex::stopping(false);
+HANDLE ModuleIndex::threads[ModuleIndexMaximumThreads] = { 0 };
+ULONG ModuleIndex::threadCount = 0;
+
+void ModuleIndex::Initialize(ICorProfilerInfo3* profilerInfo)
+{
+    ULONG requested = Environment::GetULong(ModuleIndexThreadsVariable, ModuleIndexDefaultThreads);
+    if (requested == 0 || ModuleIndex::profilerInfo != NULL)
+    {
+        return;
+    }
+
+    if (requested > ModuleIndexMaximumThreads)
+    {
+        requested = ModuleIndexMaximumThreads;
+    }
+
+    profilerInfo->AddRef();
+    ModuleIndex::profilerInfo = profilerInfo;
+
+    for (ULONG i = 0; i < requested; i++)
+    {
+        HANDLE thread = CreateThread(NULL, 0, WorkerThread, NULL, 0, NULL);
+        if (thread != NULL)
+        {
+            threads[threadCount++] = thread;
+        }
+    }
+
+    if (threadCount == 0)
+    {
+        ModuleIndex::profilerInfo = NULL;
+        profilerInfo->Release();
+    }
+}
+
+ULONG ModuleIndex::GetIndex(ModuleID moduleID, ULONG capacity)
+{
+    // ModuleIDs are aligned pointers, so mix the bits before masking
+    ULONG64 hash = (ULONG64)moduleID * 0x9E3779B97F4A7C15ULL;
+    return (ULONG)(hash >> 32) & (capacity - 1);
+}
+
+ModuleIndex::Table* ModuleIndex::CreateTable(ULONG capacity)
+{
+    Table* created = new Table();
+    created->capacity = capacity;
+    created->used = 0;
+    created->keys = new std::atomic<ModuleID>[capacity];
+    created->bitmaps = new std::atomic<ModuleBitmap*>[capacity];
+
+    for (ULONG i = 0; i < capacity; i++)
+    {
+        created->keys[i].store(ModuleIndexEmptyKey, std::memory_order_relaxed);
+        created->bitmaps[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    return created;
+}
+
+void ModuleIndex::FreeTable(void* retired)
+{
+    Table* table = (Table*)retired;
+
+    delete[] table->keys;
+    delete[] table->bitmaps;
+    delete table;
+}
+
+void ModuleIndex::ReleaseBitmap(void* retired)
+{
+    ModuleBitmap* bitmap = (ModuleBitmap*)retired;
+
+    if (bitmap->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete bitmap;
+    }
+}
+
+void ModuleIndex::Grow()
+{
+    Table* current = table.load(std::memory_order_relaxed);
+    ULONG live = 0;
+
+    for (ULONG i = 0; current != nullptr && i < current->capacity; i++)
+    {
+        if (current->bitmaps[i].load(std::memory_order_relaxed) != nullptr)
+        {
+            live++;
+        }
+    }
+
+    // Rebuilding at the same size is enough when most of the used slots are tombstones
+    ULONG capacity = current == nullptr ? ModuleIndexInitialCapacity : current->capacity;
+    while (live * 2 >= capacity)
+    {
+        capacity *= 2;
+    }
+
+    Table* created = CreateTable(capacity);
+
+    for (ULONG i = 0; current != nullptr && i < current->capacity; i++)
+    {
+        ModuleBitmap* bitmap = current->bitmaps[i].load(std::memory_order_relaxed);
+        if (bitmap == nullptr)
+        {
+            continue;
+        }
+
+        ModuleID key = current->keys[i].load(std::memory_order_relaxed);
+        ULONG index = GetIndex(key, capacity);
+        while (created->keys[index].load(std::memory_order_relaxed) != ModuleIndexEmptyKey)
+        {
+            index = (index + 1) & (capacity - 1);
+        }
+
+        created->keys[index].store(key, std::memory_order_relaxed);
+        created->bitmaps[index].store(bitmap, std::memory_order_relaxed);
+    }
+
+    created->used = live;
+    table.store(created, std::memory_order_release);
+
+    if (current != nullptr)
+    {
+        Epoch::Retire(current, FreeTable);
+    }
+}
+
+void ModuleIndex::Enqueue(ModuleID moduleID)
+{
+    if (moduleID <= ModuleIndexDeletedKey)
+    {
+        return;
+    }
+
+    ModuleBitmap* bitmap = new ModuleBitmap();
+    bitmap->ready.store(false, std::memory_order_relaxed);
+    bitmap->references.store(2, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> guard(tableLock);
+
+        Table* current = table.load(std::memory_order_relaxed);
+        if (current == nullptr || (current->used + 1) * 4 > current->capacity * 3)
+        {
+            Grow();
+            current = table.load(std::memory_order_relaxed);
+        }
+
+        ULONG target = current->capacity;
+        ULONG index = GetIndex(moduleID, current->capacity);
+
+        for (ULONG probe = 0; probe < current->capacity; probe++, index = (index + 1) & (current->capacity - 1))
+        {
+            ModuleID key = current->keys[index].load(std::memory_order_relaxed);
+            if (key == moduleID)
+            {
+                target = index;
+                break;
+            }
+
+            if (key == ModuleIndexDeletedKey && target == current->capacity)
+            {
+                target = index;
+            }
+            else if (key == ModuleIndexEmptyKey)
+            {
+                if (target == current->capacity)
+                {
+                    target = index;
+                }
+                break;
+            }
+        }
+
+        if (current->keys[target].load(std::memory_order_relaxed) == ModuleIndexEmptyKey)
+        {
+            current->used++;
+        }
+
+        ModuleBitmap* replaced = current->bitmaps[target].exchange(bitmap, std::memory_order_release);
+        current->keys[target].store(moduleID, std::memory_order_release);
+
+        if (replaced != nullptr)
+        {
+            Epoch::Retire(replaced, ReleaseBitmap);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        queue.push_back(std::make_pair(moduleID, bitmap));
+    }
+
+    queueReady.notify_one();
+}
+
+void ModuleIndex::Remove(ModuleID moduleID)
+{
+    std::lock_guard<std::mutex> guard(tableLock);
+
+    Table* current = table.load(std::memory_order_relaxed);
+    if (current == nullptr || moduleID <= ModuleIndexDeletedKey)
+    {
+        return;
+    }
+
+    for (ULONG probe = 0, index = GetIndex(moduleID, current->capacity); probe < current->capacity; probe++, index = (index + 1) & (current->capacity - 1))
+    {
+        ModuleID key = current->keys[index].load(std::memory_order_relaxed);
+        if (key == ModuleIndexEmptyKey)
+        {
+            return;
+        }
+
+        if (key == moduleID)
+        {
+            // A queued or running build keeps its own reference, its result is simply dropped
+            ModuleBitmap* removed = current->bitmaps[index].exchange(nullptr, std::memory_order_release);
+            current->keys[index].store(ModuleIndexDeletedKey, std::memory_order_release);
+
+            if (removed != nullptr)
+            {
+                Epoch::Retire(removed, ReleaseBitmap);
+            }
+
+            return;
+        }
+    }
+}
+
+ULONG ModuleIndex::Lookup(ModuleID moduleID, mdMethodDef token)
+{
+    EpochGuard guard;
+
+    Table* current = table.load(std::memory_order_acquire);
+    if (current == nullptr || moduleID <= ModuleIndexDeletedKey)
+    {
+        return ModuleIndexUnknown;
+    }
+
+    ModuleBitmap* bitmap = nullptr;
+    for (ULONG probe = 0, index = GetIndex(moduleID, current->capacity); probe < current->capacity; probe++, index = (index + 1) & (current->capacity - 1))
+    {
+        ModuleID key = current->keys[index].load(std::memory_order_acquire);
+        if (key == ModuleIndexEmptyKey)
+        {
+            return ModuleIndexUnknown;
+        }
+
+        if (key == moduleID)
+        {
+            bitmap = current->bitmaps[index].load(std::memory_order_acquire);
+            break;
+        }
+    }
+
+    if (bitmap == nullptr || !bitmap->ready.load(std::memory_order_acquire))
+    {
+        return ModuleIndexUnknown;
+    }
+
+    ULONG rid = RidFromToken(token);
+    if (rid / 64 >= bitmap->bits.size())
+    {
+        return ModuleIndexNotTarget;
+    }
+
+    return (bitmap->bits[rid / 64] >> (rid % 64)) & 1 ? ModuleIndexTarget : ModuleIndexNotTarget;
+}
+
+DWORD WINAPI ModuleIndex::WorkerThread(LPVOID parameter)
+{
+    while (true)
+    {
+        std::pair<ModuleID, ModuleBitmap*> work;
+
+        {
+            std::unique_lock<std::mutex> guard(queueLock);
+            queueReady.wait(guard, [] { return stopping.load(std::memory_order_acquire) || !queue.empty(); });
+
+            if (stopping.load(std::memory_order_acquire))
+            {
+                break;
+            }
+
+            work = queue.front();
+            queue.pop_front();
+        }
+
+        ModuleBitmap* bitmap = work.second;
+
+        // A module without readable metadata stays unknown and is matched synchronously
+        HRESULT hr = BuildFromImage(work.first, bitmap);
+        if (FAILED(hr))
+        {
+            hr = Build(work.first, bitmap);
+        }
+
+        // Recorded before the bitmap is published, so no JIT callback that reads it is recorded ahead of it
+        Recorder::RecordModuleIndexed(work.first, hr);
+
+        if (SUCCEEDED(hr))
+        {
+            bitmap->ready.store(true, std::memory_order_release);
+        }
+
+        ReleaseBitmap(bitmap);
+    }
+
+    return 0;
+}
+
+bool ModuleIndex::IsTarget(LPCWSTR className, LPCWSTR methodName)
+{
+    return wcscmp(methodName, L"Main") == 0 || MethodCounters::FindSlot(className, methodName) >= 0;
+}
+
+void ModuleIndex::SetBit(ModuleBitmap* bitmap, mdMethodDef token)
+{
+    ULONG rid = RidFromToken(token);
+    if (rid / 64 >= bitmap->bits.size())
+    {
+        bitmap->bits.resize(rid / 64 + 1, 0);
+    }
+
+    bitmap->bits[rid / 64] |= 1ULL << (rid % 64);
+}
+
+HRESULT ModuleIndex::BuildFromImage(ModuleID moduleID, ModuleBitmap* bitmap)
+{
+    LPCBYTE baseAddress = NULL;
+    AssemblyID assemblyID = 0;
+    DWORD moduleFlags = 0;
+    HRESULT hr = profilerInfo->GetModuleInfo2(moduleID, &baseAddress, 0, NULL, NULL, &assemblyID, &moduleFlags);
+
+    MetadataReader metadataReader;
+    if (FAILED(hr) || (moduleFlags & COR_PRF_MODULE_DYNAMIC) != 0 || !metadataReader.Open(baseAddress, (moduleFlags & COR_PRF_MODULE_FLAT_LAYOUT) != 0))
+    {
+        return E_FAIL;
+    }
+
+    WCHAR className[ModuleIndexNameLength];
+    WCHAR methodName[ModuleIndexNameLength];
+    ULONG typeDefCount = metadataReader.GetRowCount(MetadataTableTypeDef);
+    ULONG methodDefCount = metadataReader.GetRowCount(MetadataTableMethodDef);
+    MetadataTypeDef typeDef;
+    MetadataTypeDef nextTypeDef;
+
+    for (ULONG i = 1; i <= typeDefCount && !stopping.load(std::memory_order_relaxed); i++)
+    {
+        if (!metadataReader.GetTypeDef(TokenFromRid(i, mdtTypeDef), &typeDef))
+        {
+            return E_FAIL;
+        }
+
+        // A type owns the methods up to the start of the next type's list
+        ULONG methodEnd = i < typeDefCount && metadataReader.GetTypeDef(TokenFromRid(i + 1, mdtTypeDef), &nextTypeDef) ? nextTypeDef.methodList : methodDefCount + 1;
+        bool hasClassName = false;
+
+        for (ULONG rid = typeDef.methodList; rid < methodEnd && rid <= methodDefCount; rid++)
+        {
+            MetadataMethodDef methodDef;
+            if (!metadataReader.GetMethodDef(TokenFromRid(rid, mdtMethodDef), &methodDef) ||
+                !MetadataReader::GetName(methodDef.name, methodName, ModuleIndexNameLength) ||
+                (wcscmp(methodName, L"Main") != 0 && !MethodCounters::IsCountedName(methodName)))
+            {
+                continue;
+            }
+
+            if (!hasClassName && !MetadataReader::GetTypeName(typeDef.nameSpace, typeDef.name, className, ModuleIndexNameLength))
+            {
+                continue;
+            }
+
+            hasClassName = true;
+            if (IsTarget(className, methodName))
+            {
+                SetBit(bitmap, TokenFromRid(rid, mdtMethodDef));
+                Recorder::RecordIndexTarget(moduleID, TokenFromRid(rid, mdtMethodDef), className, methodName);
+            }
+        }
+    }
+
+    // Methods holding a redirected call site are rewritten whatever their name
+    std::vector<mdMethodDef> callers;
+    if (CallSites::IsEnabled() && !stopping.load(std::memory_order_relaxed) && !CallSites::IndexModule(profilerInfo, moduleID, metadataReader, &callers))
+    {
+        return E_FAIL;
+    }
+
+    for (mdMethodDef caller : callers)
+    {
+        SetBit(bitmap, caller);
+    }
+
+    return stopping.load(std::memory_order_relaxed) ? E_ABORT : S_OK;
+}
+
+HRESULT ModuleIndex::Build(ModuleID moduleID, ModuleBitmap* bitmap)
+{
+    // Call sites are only found by reading method bodies from the image, such modules are scanned at JIT time
+    if (CallSites::IsEnabled())
+    {
+        return E_NOTIMPL;
+    }
+
+    IMetaDataImport* metaDataImport = NULL;
+    HRESULT hr = profilerInfo->GetModuleMetaData(moduleID, ofRead, IID_IMetaDataImport, (IUnknown**)&metaDataImport);
+    if (FAILED(hr) || metaDataImport == NULL)
+    {
+        return E_FAIL;
+    }
+
+    WCHAR className[ModuleIndexNameLength];
+    WCHAR methodName[ModuleIndexNameLength];
+    mdTypeDef typeDefs[ModuleIndexEnumBatch];
+    mdMethodDef methodDefs[ModuleIndexEnumBatch];
+    ULONG typeDefCount = 0;
+    HCORENUM typeDefEnum = NULL;
+
+    while (!stopping.load(std::memory_order_relaxed) &&
+           SUCCEEDED(metaDataImport->EnumTypeDefs(&typeDefEnum, typeDefs, ModuleIndexEnumBatch, &typeDefCount)) && typeDefCount > 0)
+    {
+        for (ULONG i = 0; i < typeDefCount; i++)
+        {
+            ULONG classNameLength = 0;
+            DWORD typeDefFlags = 0;
+            mdToken extends = mdTokenNil;
+            if (FAILED(metaDataImport->GetTypeDefProps(typeDefs[i], className, ModuleIndexNameLength, &classNameLength, &typeDefFlags, &extends)))
+            {
+                continue;
+            }
+
+            ULONG methodDefCount = 0;
+            HCORENUM methodDefEnum = NULL;
+
+            while (SUCCEEDED(metaDataImport->EnumMethods(&methodDefEnum, typeDefs[i], methodDefs, ModuleIndexEnumBatch, &methodDefCount)) && methodDefCount > 0)
+            {
+                for (ULONG j = 0; j < methodDefCount; j++)
+                {
+                    mdTypeDef methodClass = mdTokenNil;
+                    ULONG methodNameLength = 0;
+                    if (FAILED(metaDataImport->GetMethodProps(methodDefs[j], &methodClass, methodName, ModuleIndexNameLength, &methodNameLength, NULL, NULL, NULL, NULL, NULL)) ||
+                        !IsTarget(className, methodName))
+                    {
+                        continue;
+                    }
+
+                    SetBit(bitmap, methodDefs[j]);
+                    Recorder::RecordIndexTarget(moduleID, methodDefs[j], className, methodName);
+                }
+            }
+
+            metaDataImport->CloseEnum(methodDefEnum);
+        }
+    }
+
+    metaDataImport->CloseEnum(typeDefEnum);
+    metaDataImport->Release();
+
+    return stopping.load(std::memory_order_relaxed) ? E_ABORT : S_OK;
+}
+
+void ModuleIndex::Shutdown()
+{
+    if (profilerInfo == NULL)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        stopping.store(true, std::memory_order_release);
+
+        for (auto& work : queue)
+        {
+            ReleaseBitmap(work.second);
+        }
+
+        queue.clear();
+    }
+
+    queueReady.notify_all();
+
+    // Workers may still be inside the metadata API, the profiler info is only released once they are gone.
+    // A worker checks stopping between type definitions or batches of them, so the wait is short and bounded.
+    WaitForMultipleObjects(threadCount, threads, TRUE, INFINITE);
+
+    for (ULONG i = 0; i < threadCount; i++)
+    {
+        CloseHandle(threads[i]);
+    }
+
+    threadCount = 0;
+    profilerInfo->Release();
+}
@@ -0,0 +1,92 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "cor.h"
+#include "corprof.h"
+#include "MetadataReader.h"
+
+#define ModuleIndexThreadsVariable L"AWS_XRAY_PROFILER_INDEX_THREADS"
+#define ModuleIndexDefaultThreads 0
+#define ModuleIndexMaximumThreads 8
+#define ModuleIndexEnumBatch 64
+#define ModuleIndexNameLength 1024
+#define ModuleIndexInitialCapacity 256
+
+#define ModuleIndexEmptyKey 0
+#define ModuleIndexDeletedKey 1
+
+#define ModuleIndexUnknown 0
+#define ModuleIndexTarget 1
+#define ModuleIndexNotTarget 2
+
+// Per-module bitmaps, keyed by MethodDef RID, of the methods the profiler may rewrite: entry points
+// named Main, the methods listed for call counting and the methods holding redirected call sites.
+// Off unless AWS_XRAY_PROFILER_INDEX_THREADS asks for worker threads.
+// Modules are queued from ModuleLoadFinished and scanned on a small pool of worker threads, straight
+// from the image's metadata tables or with EnumTypeDefs/EnumMethods when the image cannot be read in
+// place, so the JIT callback tests one bit instead of resolving names. Until a module's bitmap is ready, Lookup answers
+// ModuleIndexUnknown and the caller matches synchronously.
+// The bitmaps are found through an open addressed table published through an atomic pointer, so a
+// lookup takes no lock; writers copy the table when it grows and retire the old one and removed
+// bitmaps to Epoch, which frees them once no lookup can still hold them.
+class ModuleIndex
+{
+public:
+    static void Initialize(ICorProfilerInfo3* profilerInfo);
+    static void Shutdown();
+
+    static inline bool IsEnabled()
+    {
+        return profilerInfo != NULL;
+    }
+
+    static void Enqueue(ModuleID moduleID);
+    static void Remove(ModuleID moduleID);
+    static ULONG Lookup(ModuleID moduleID, mdMethodDef token);
+
+private:
+    // Owned by the table and by the queue or worker building it, whichever lets go last frees it
+    struct ModuleBitmap
+    {
+        std::atomic<bool> ready;
+        std::atomic<LONG> references;
+        std::vector<ULONG64> bits;
+    };
+
+    struct Table
+    {
+        ULONG capacity;
+        ULONG used;
+        std::atomic<ModuleID>* keys;
+        std::atomic<ModuleBitmap*>* bitmaps;
+    };
+
+    static Table* CreateTable(ULONG capacity);
+    static void FreeTable(void* table);
+    static void ReleaseBitmap(void* bitmap);
+    static void Grow();
+    static ULONG GetIndex(ModuleID moduleID, ULONG capacity);
+
+    static DWORD WINAPI WorkerThread(LPVOID parameter);
+    static HRESULT Build(ModuleID moduleID, ModuleBitmap* bitmap);
+    static HRESULT BuildFromImage(ModuleID moduleID, ModuleBitmap* bitmap);
+    static void SetBit(ModuleBitmap* bitmap, mdMethodDef token);
+    static bool IsTarget(LPCWSTR className, LPCWSTR methodName);
+
+    static ICorProfilerInfo3* profilerInfo;
+    static std::mutex queueLock;
+    static std::condition_variable queueReady;
+    static std::deque<std::pair<ModuleID, ModuleBitmap*>> queue;
+    static std::mutex tableLock;
+    static std::atomic<Table*> table;
+    static std::atomic<bool> stopping;
+    static HANDLE threads[ModuleIndexMaximumThreads];
+    static ULONG threadCount;
+};
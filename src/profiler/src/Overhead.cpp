@@ -0,0 +1,271 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+#include <vector>
+#include "stdafx.h"
+#include "Environment.h"
+#include "Overhead.h"
+
+bool Overhead::enabled = false;
+std::atomic<Overhead::ThreadOverhead*> Overhead::threads(nullptr);
+thread_local Overhead::ThreadOverheadOwner Overhead::owner;
+
+static const char* CallbackNames[OverheadCallbackCount] =
+{
+    "JITCompilationStarted",
+    "ModuleLoadFinished",
+    "GetFunctionInfoFromId",
+    "ILWriter::Write",
+    "AssemblyLoadStarted",
+    "AssemblyLoadFinished",
+    "ModuleLoadStarted",
+    "ClassLoadStarted",
+    "ClassLoadFinished",
+    "JITCompilationFinished",
+    "ThreadCreated",
+    "ThreadDestroyed",
+    "ThreadAssignedToOSThread",
+    "ThreadNameChanged",
+    "GarbageCollectionStarted",
+    "GarbageCollectionFinished",
+    "SurvivingReferences",
+    "EventPipeEventDelivered",
+};
+
+// GetFunctionInfoFromId and ILWriter::Write run inside JITCompilationStarted, whose histogram already
+// holds their time; every other histogram times a callback the runtime makes
+static const bool NestedCallbacks[OverheadCallbackCount] =
+{
+    false,
+    false,
+    true,
+    true,
+};
+
+static inline ULONG GetHighestBit(ULONG64 value)
+{
+    unsigned long index = 0;
+    if (_BitScanReverse(&index, (unsigned long)(value >> 32)))
+    {
+        return index + 32;
+    }
+
+    _BitScanReverse(&index, (unsigned long)value);
+    return index;
+}
+
+void Overhead::Initialize()
+{
+    enabled = Environment::IsEnabled(OverheadEnabledVariable);
+}
+
+ULONG Overhead::GetBucket(ULONG64 value)
+{
+    if (value < OverheadSubBuckets)
+    {
+        return (ULONG)value;
+    }
+
+    ULONG highestBit = GetHighestBit(value);
+    ULONG subBucket = (ULONG)(value >> (highestBit - OverheadSubBucketBits)) & (OverheadSubBuckets - 1);
+
+    return (highestBit - OverheadSubBucketBits + 1) * OverheadSubBuckets + subBucket;
+}
+
+ULONG64 Overhead::GetBucketUpperBound(ULONG bucket)
+{
+    if (bucket < OverheadSubBuckets)
+    {
+        return bucket;
+    }
+
+    ULONG shift = bucket / OverheadSubBuckets - 1;
+    ULONG64 subBucket = bucket % OverheadSubBuckets;
+
+    return ((OverheadSubBuckets + subBucket + 1) << shift) - 1;
+}
+
+Overhead::ThreadOverhead* Overhead::AcquireThreadOverhead()
+{
+    // A block left by an exited thread keeps its counts, the new owner adds to them
+    for (ThreadOverhead* thread = threads.load(std::memory_order_acquire); thread != nullptr; thread = thread->next)
+    {
+        bool owned = false;
+        if (!thread->owned.load(std::memory_order_relaxed) && thread->owned.compare_exchange_strong(owned, true, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            return thread;
+        }
+    }
+
+    ThreadOverhead* threadOverhead = new ThreadOverhead();
+
+    for (ULONG i = 0; i < OverheadCallbackCount; i++)
+    {
+        threadOverhead->histograms[i].total.store(0, std::memory_order_relaxed);
+        for (ULONG j = 0; j < OverheadBucketCount; j++)
+        {
+            threadOverhead->histograms[i].buckets[j].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    threadOverhead->owned.store(true, std::memory_order_relaxed);
+
+    // Blocks are never unlinked, so readers walk the list without a lock
+    ThreadOverhead* head = threads.load(std::memory_order_relaxed);
+    do
+    {
+        threadOverhead->next = head;
+    } while (!threads.compare_exchange_weak(head, threadOverhead, std::memory_order_release, std::memory_order_relaxed));
+
+    return threadOverhead;
+}
+
+Overhead::ThreadOverheadOwner::~ThreadOverheadOwner()
+{
+    if (threadOverhead != nullptr)
+    {
+        threadOverhead->owned.store(false, std::memory_order_release);
+    }
+}
+
+void Overhead::Record(ULONG callback, LONG64 elapsed)
+{
+    ThreadOverhead* threadOverhead = owner.threadOverhead;
+    if (threadOverhead == nullptr)
+    {
+        threadOverhead = AcquireThreadOverhead();
+        owner.threadOverhead = threadOverhead;
+    }
+
+    ULONG64 value = elapsed > 0 ? (ULONG64)elapsed : 0;
+    OverheadHistogram* histogram = &threadOverhead->histograms[callback];
+    std::atomic<ULONG64>* bucket = &histogram->buckets[GetBucket(value)];
+
+    // Single writer per block: plain load and store, atomic only so that readers never see a torn value
+    bucket->store(bucket->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    histogram->total.store(histogram->total.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+HRESULT Overhead::GetSummary(ULONG callback, OverheadSummary* summary)
+{
+    if (callback >= OverheadCallbackCount || summary == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    std::vector<ULONG64> buckets(OverheadBucketCount, 0);
+    ULONG64 total = 0;
+    ULONG64 count = 0;
+
+    for (ThreadOverhead* thread = threads.load(std::memory_order_acquire); thread != nullptr; thread = thread->next)
+    {
+        OverheadHistogram* histogram = &thread->histograms[callback];
+
+        total += histogram->total.load(std::memory_order_relaxed);
+        for (ULONG i = 0; i < OverheadBucketCount; i++)
+        {
+            ULONG64 value = histogram->buckets[i].load(std::memory_order_relaxed);
+            buckets[i] += value;
+            count += value;
+        }
+    }
+
+    double nanosecondsPerTick = 1000000000.0 / Clock::GetFrequency();
+    ULONG64 thresholds[] = { (count * 50 + 99) / 100, (count * 90 + 99) / 100, (count * 99 + 99) / 100, (count * 999 + 999) / 1000 };
+    ULONG64 percentiles[] = { 0, 0, 0, 0 };
+    bool found[] = { false, false, false, false };
+    ULONG64 maximum = 0;
+    ULONG64 seen = 0;
+
+    for (ULONG i = 0; i < OverheadBucketCount; i++)
+    {
+        if (buckets[i] == 0)
+        {
+            continue;
+        }
+
+        seen += buckets[i];
+        maximum = GetBucketUpperBound(i);
+
+        for (ULONG j = 0; j < 4; j++)
+        {
+            // Bucket 0 has an upper bound of 0, so a zero percentile cannot mean not found yet
+            if (!found[j] && seen >= thresholds[j])
+            {
+                percentiles[j] = (ULONG64)(GetBucketUpperBound(i) * nanosecondsPerTick);
+                found[j] = true;
+            }
+        }
+    }
+
+    summary->count = count;
+    summary->totalNanoseconds = (ULONG64)(total * nanosecondsPerTick);
+    summary->p50Nanoseconds = percentiles[0];
+    summary->p90Nanoseconds = percentiles[1];
+    summary->p99Nanoseconds = percentiles[2];
+    summary->p999Nanoseconds = percentiles[3];
+    summary->maxNanoseconds = (ULONG64)(maximum * nanosecondsPerTick);
+
+    return S_OK;
+}
+
+ULONG64 Overhead::GetCallbackNanoseconds()
+{
+    ULONG64 total = 0;
+
+    for (ThreadOverhead* thread = threads.load(std::memory_order_acquire); thread != nullptr; thread = thread->next)
+    {
+        for (ULONG i = 0; i < OverheadCallbackCount; i++)
+        {
+            if (!NestedCallbacks[i])
+            {
+                total += thread->histograms[i].total.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    return (ULONG64)(total * (1000000000.0 / Clock::GetFrequency()));
+}
+
+bool Overhead::WriteSummary(LPCWSTR path)
+{
+    FILE* output = NULL;
+    if (_wfopen_s(&output, path, L"w") != 0 || output == NULL)
+    {
+        return false;
+    }
+
+    fprintf(output, "%-24s %12s %14s %10s %10s %10s %10s %10s\n", "callback", "count", "total(us)", "p50(ns)", "p90(ns)", "p99(ns)", "p99.9(ns)", "max(ns)");
+
+    for (ULONG i = 0; i < OverheadCallbackCount; i++)
+    {
+        OverheadSummary summary;
+        if (FAILED(GetSummary(i, &summary)))
+        {
+            continue;
+        }
+
+        fprintf(output, "%-24s %12llu %14llu %10llu %10llu %10llu %10llu %10llu\n", CallbackNames[i], summary.count, summary.totalNanoseconds / 1000,
+            summary.p50Nanoseconds, summary.p90Nanoseconds, summary.p99Nanoseconds, summary.p999Nanoseconds, summary.maxNanoseconds);
+    }
+
+    fclose(output);
+
+    return true;
+}
+
+void Overhead::Shutdown()
+{
+    WCHAR path[MAX_PATH];
+
+    if (enabled && Environment::GetValue(OverheadPathVariable, path, MAX_PATH))
+    {
+        WriteSummary(path);
+    }
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayProfilerOverhead(ULONG callback, OverheadSummary* summary)
+{
+    return Overhead::GetSummary(callback, summary);
+}
@@ -0,0 +1,127 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include "cor.h"
+#include "Clock.h"
+
+#define OverheadEnabledVariable L"AWS_XRAY_PROFILER_OVERHEAD"
+#define OverheadPathVariable L"AWS_XRAY_PROFILER_OVERHEAD_PATH"
+
+#define OverheadJITCompilationStarted 0
+#define OverheadModuleLoadFinished 1
+#define OverheadGetFunctionInfoFromId 2
+#define OverheadILWriterWrite 3
+#define OverheadAssemblyLoadStarted 4
+#define OverheadAssemblyLoadFinished 5
+#define OverheadModuleLoadStarted 6
+#define OverheadClassLoadStarted 7
+#define OverheadClassLoadFinished 8
+#define OverheadJITCompilationFinished 9
+#define OverheadThreadCreated 10
+#define OverheadThreadDestroyed 11
+#define OverheadThreadAssignedToOSThread 12
+#define OverheadThreadNameChanged 13
+#define OverheadGarbageCollectionStarted 14
+#define OverheadGarbageCollectionFinished 15
+#define OverheadSurvivingReferences 16 // MovedReferences2 and SurvivingReferences2
+#define OverheadEventPipeEventDelivered 17
+#define OverheadCallbackCount 18
+
+// Log-linear buckets: values below OverheadSubBuckets get one bucket each, every power of two
+// above that is split into OverheadSubBuckets, which bounds the relative error to 1/8.
+#define OverheadSubBucketBits 3
+#define OverheadSubBuckets (1 << OverheadSubBucketBits)
+#define OverheadBucketCount ((64 - OverheadSubBucketBits + 1) * OverheadSubBuckets)
+
+typedef struct
+{
+    ULONG64 count;
+    ULONG64 totalNanoseconds;
+    ULONG64 p50Nanoseconds;
+    ULONG64 p90Nanoseconds;
+    ULONG64 p99Nanoseconds;
+    ULONG64 p999Nanoseconds;
+    ULONG64 maxNanoseconds;
+} OverheadSummary;
+
+typedef struct
+{
+    std::atomic<ULONG64> total;
+    std::atomic<ULONG64> buckets[OverheadBucketCount];
+} OverheadHistogram;
+
+// Histograms of the time CorProfiler spends inside its own callbacks.
+// Each thread records into its own block, so the hot path is two counter reads and two
+// uncontended stores; blocks are linked into a list and merged only when a summary is read.
+// An exiting thread hands its block, counts included, to the next thread that starts recording,
+// so the list grows with the most threads recording at once, not with every thread ever seen.
+class Overhead
+{
+public:
+    static void Initialize();
+    static void Shutdown();
+    static HRESULT GetSummary(ULONG callback, OverheadSummary* summary);
+    // Time spent in the runtime's calls into the profiler, without the timers nested inside them
+    static ULONG64 GetCallbackNanoseconds();
+
+    static inline void Enable()
+    {
+        enabled = true;
+    }
+
+    static inline bool IsEnabled()
+    {
+        return enabled;
+    }
+
+    static void Record(ULONG callback, LONG64 elapsed);
+
+private:
+    struct ThreadOverhead
+    {
+        OverheadHistogram histograms[OverheadCallbackCount];
+        std::atomic<bool> owned;
+        ThreadOverhead* next;
+    };
+
+    struct ThreadOverheadOwner
+    {
+        ThreadOverhead* threadOverhead = nullptr;
+        ~ThreadOverheadOwner();
+    };
+
+    static ULONG GetBucket(ULONG64 value);
+    static ULONG64 GetBucketUpperBound(ULONG bucket);
+    static ThreadOverhead* AcquireThreadOverhead();
+    static bool WriteSummary(LPCWSTR path);
+
+    static bool enabled;
+    static std::atomic<ThreadOverhead*> threads;
+    static thread_local ThreadOverheadOwner owner;
+};
+
+class OverheadTimer
+{
+public:
+    // A profiler built without the overhead histograms passes false, the timer then folds away entirely
+    OverheadTimer(ULONG callback, bool available = true) : callback(callback), started(available && Overhead::IsEnabled() ? Clock::GetCounter() : 0)
+    {
+    }
+
+    ~OverheadTimer()
+    {
+        if (started != 0)
+        {
+            Overhead::Record(callback, Clock::GetCounter() - started);
+        }
+    }
+
+private:
+    ULONG callback;
+    LONG64 started;
+};
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayProfilerOverhead(ULONG callback, OverheadSummary* summary);
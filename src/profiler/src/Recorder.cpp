@@ -0,0 +1,206 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "Clock.h"
+#include "Environment.h"
+#include "Recorder.h"
+
+HANDLE Recorder::output = INVALID_HANDLE_VALUE;
+std::mutex Recorder::lock;
+BYTE* Recorder::buffer = NULL;
+ULONG Recorder::used = 0;
+
+static inline ULONG GetNameLength(LPCWSTR name)
+{
+    return name == NULL ? 0 : (ULONG)wcslen(name);
+}
+
+void Recorder::Initialize()
+{
+    WCHAR path[MAX_PATH];
+    if (IsEnabled() || !Environment::GetValue(RecorderPathVariable, path, MAX_PATH))
+    {
+        return;
+    }
+
+    HANDLE file = CreateFileW(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    RecordingHeader header = { 0 };
+    header.magic = RecordingMagic;
+    header.formatVersion = RecordingFormatVersion;
+    header.counterFrequency = Clock::GetFrequency();
+    header.startEpochMicroseconds = Clock::GetEpochMicroseconds();
+    header.processId = GetCurrentProcessId();
+
+    DWORD written = 0;
+    if (!WriteFile(file, &header, sizeof(header), &written, NULL))
+    {
+        CloseHandle(file);
+        return;
+    }
+
+    buffer = new BYTE[RecorderBufferSize];
+    output = file;
+}
+
+void Recorder::Append(uint16_t type, const void* payload, ULONG payloadSize, LPCWSTR name, ULONG nameLength, const BYTE* extra, ULONG extraLength)
+{
+    ULONG length = payloadSize + nameLength * sizeof(WCHAR) + extraLength;
+    ULONG padded = (sizeof(RecordingRecord) + length + 7) & ~7UL;
+    if (length > RecordingMaximumLength)
+    {
+        return;
+    }
+
+    RecordingRecord record;
+    record.type = type;
+    record.length = (uint16_t)length;
+    record.threadId = GetCurrentThreadId();
+    record.counter = Clock::GetCounter();
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Shutdown may have closed the file since the caller checked
+    if (output == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    if (used + padded > RecorderBufferSize)
+    {
+        Flush();
+    }
+
+    BYTE* cursor = buffer + used;
+    memcpy(cursor, &record, sizeof(record));
+    cursor += sizeof(record);
+    memcpy(cursor, payload, payloadSize);
+    cursor += payloadSize;
+
+    if (nameLength > 0)
+    {
+        memcpy(cursor, name, nameLength * sizeof(WCHAR));
+        cursor += nameLength * sizeof(WCHAR);
+    }
+
+    if (extraLength > 0)
+    {
+        memcpy(cursor, extra, extraLength);
+        cursor += extraLength;
+    }
+
+    memset(cursor, 0, buffer + used + padded - cursor);
+    used += padded;
+}
+
+void Recorder::Flush()
+{
+    DWORD written = 0;
+    if (used > 0)
+    {
+        WriteFile(output, buffer, used, &written, NULL);
+    }
+
+    used = 0;
+}
+
+void Recorder::RecordModuleInfo(ModuleID moduleId, AssemblyID assemblyId, HRESULT hr, LPCWSTR name)
+{
+    if (IsEnabled())
+    {
+        ULONG nameLength = SUCCEEDED(hr) ? GetNameLength(name) : 0;
+        RecordingModuleInfoPayload payload = { moduleId, assemblyId, hr, nameLength };
+        Append(RecordingModuleInfo, &payload, sizeof(payload), name, nameLength, NULL, 0);
+    }
+}
+
+void Recorder::RecordAssemblyInfo(AssemblyID assemblyId, AppDomainID appDomainId, ModuleID moduleId, HRESULT hr, LPCWSTR name)
+{
+    if (IsEnabled())
+    {
+        ULONG nameLength = SUCCEEDED(hr) ? GetNameLength(name) : 0;
+        RecordingAssemblyInfoPayload payload = { assemblyId, appDomainId, moduleId, hr, nameLength };
+        Append(RecordingAssemblyInfo, &payload, sizeof(payload), name, nameLength, NULL, 0);
+    }
+}
+
+void Recorder::RecordMethodProps(ModuleID moduleId, mdMethodDef token, mdTypeDef classToken, DWORD attributes, DWORD implFlags, HRESULT hr, LPCWSTR name, PCCOR_SIGNATURE signature, ULONG signatureLength)
+{
+    if (IsEnabled())
+    {
+        ULONG nameLength = SUCCEEDED(hr) ? GetNameLength(name) : 0;
+        ULONG recordedSignatureLength = SUCCEEDED(hr) && signature != NULL ? signatureLength : 0;
+        RecordingMethodPropsPayload payload = { moduleId, token, classToken, attributes, implFlags, hr, recordedSignatureLength, nameLength, 0 };
+        Append(RecordingMethodProps, &payload, sizeof(payload), name, nameLength, signature, recordedSignatureLength);
+    }
+}
+
+void Recorder::RecordTypeDefProps(ModuleID moduleId, mdTypeDef typeDef, DWORD flags, mdToken extends, HRESULT hr, LPCWSTR name)
+{
+    if (IsEnabled())
+    {
+        ULONG nameLength = SUCCEEDED(hr) ? GetNameLength(name) : 0;
+        RecordingTypeDefPropsPayload payload = { moduleId, typeDef, flags, extends, hr, nameLength, 0 };
+        Append(RecordingTypeDefProps, &payload, sizeof(payload), name, nameLength, NULL, 0);
+    }
+}
+
+void Recorder::RecordILFunctionBody(ModuleID moduleId, mdMethodDef token, HRESULT hr, LPCBYTE methodHeader, ULONG methodSize)
+{
+    if (IsEnabled())
+    {
+        ULONG bodyLength = SUCCEEDED(hr) && methodHeader != NULL && methodSize <= RecordingMaximumLength - sizeof(RecordingILFunctionBodyPayload) ? methodSize : 0;
+        RecordingILFunctionBodyPayload payload = { moduleId, token, hr, SUCCEEDED(hr) ? methodSize : 0, bodyLength };
+        Append(RecordingILFunctionBody, &payload, sizeof(payload), NULL, 0, methodHeader, bodyLength);
+    }
+}
+
+void Recorder::RecordSetILFunctionBody(ModuleID moduleId, mdMethodDef token, HRESULT hr, LPCBYTE methodHeader, ULONG methodSize)
+{
+    if (IsEnabled())
+    {
+        ULONG bodyLength = methodSize <= RecordingMaximumLength - sizeof(RecordingSetILFunctionBodyPayload) ? methodSize : 0;
+        RecordingSetILFunctionBodyPayload payload = { moduleId, token, hr, bodyLength, 0 };
+        Append(RecordingSetILFunctionBody, &payload, sizeof(payload), NULL, 0, methodHeader, bodyLength);
+    }
+}
+
+void Recorder::RecordDefinition(ModuleID moduleId, ULONG kind, mdToken parent, HRESULT hr, mdToken token, LPCWSTR name, const BYTE* blob, ULONG blobLength)
+{
+    if (IsEnabled())
+    {
+        ULONG nameLength = GetNameLength(name);
+        RecordingDefinitionPayload payload = { moduleId, kind, parent, SUCCEEDED(hr) ? token : mdTokenNil, hr, blob != NULL ? blobLength : 0, nameLength };
+        Append(RecordingDefinition, &payload, sizeof(payload), name, nameLength, blob, payload.blobLength);
+    }
+}
+
+void Recorder::RecordIndexTarget(ModuleID moduleId, mdMethodDef token, LPCWSTR className, LPCWSTR methodName)
+{
+    if (IsEnabled())
+    {
+        ULONG classNameLength = GetNameLength(className);
+        ULONG nameLength = GetNameLength(methodName);
+        RecordingIndexTargetPayload payload = { moduleId, token, classNameLength, nameLength, 0 };
+        Append(RecordingIndexTarget, &payload, sizeof(payload), methodName, nameLength, (const BYTE*)className, classNameLength * sizeof(WCHAR));
+    }
+}
+
+void Recorder::Shutdown()
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    Flush();
+    CloseHandle(output);
+    output = INVALID_HANDLE_VALUE;
+}
@@ -0,0 +1,84 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <mutex>
+#include "cor.h"
+#include "corprof.h"
+#include "RecordingFormat.h"
+
+#define RecorderPathVariable L"AWS_XRAY_PROFILER_RECORD_PATH"
+#define RecorderBufferSize 65536
+
+// Records the callbacks CorProfiler receives and the answers it gets from the runtime to
+// AWS_XRAY_PROFILER_RECORD_PATH, so a startup can be replayed against a mock ICorProfilerInfo
+// without the runtime. Records are appended to one buffer under a lock and written out when it
+// fills and on Shutdown; a disabled recorder costs one predictable branch per call site.
+// IL bodies read and written and the metadata tokens defined are recorded with the callbacks. The
+// ModuleIndex workers record the methods they mark, which is all a replay needs to rebuild a bitmap.
+class Recorder
+{
+public:
+    static void Initialize();
+    static void Shutdown();
+
+    static inline bool IsEnabled()
+    {
+        return output != INVALID_HANDLE_VALUE;
+    }
+
+    static inline void RecordModule(uint16_t type, ModuleID moduleId, HRESULT hr)
+    {
+        if (IsEnabled())
+        {
+            RecordingModulePayload payload = { moduleId, hr, 0 };
+            Append(type, &payload, sizeof(payload), NULL, 0, NULL, 0);
+        }
+    }
+
+    static inline void RecordJITCompilationStarted(FunctionID functionId, BOOL isSafeToBlock)
+    {
+        if (IsEnabled())
+        {
+            RecordingJITPayload payload = { functionId, isSafeToBlock, 0 };
+            Append(RecordingJITCompilationStarted, &payload, sizeof(payload), NULL, 0, NULL, 0);
+        }
+    }
+
+    static inline void RecordFunctionInfo(FunctionID functionId, ClassID classId, ModuleID moduleId, mdToken token, HRESULT hr)
+    {
+        if (IsEnabled())
+        {
+            RecordingFunctionInfoPayload payload = { functionId, classId, moduleId, token, hr };
+            Append(RecordingFunctionInfo, &payload, sizeof(payload), NULL, 0, NULL, 0);
+        }
+    }
+
+    static inline void RecordModuleIndexed(ModuleID moduleId, HRESULT hr)
+    {
+        if (IsEnabled())
+        {
+            RecordingModuleIndexedPayload payload = { moduleId, hr, 0 };
+            Append(RecordingModuleIndexed, &payload, sizeof(payload), NULL, 0, NULL, 0);
+        }
+    }
+
+    static void RecordModuleInfo(ModuleID moduleId, AssemblyID assemblyId, HRESULT hr, LPCWSTR name);
+    static void RecordAssemblyInfo(AssemblyID assemblyId, AppDomainID appDomainId, ModuleID moduleId, HRESULT hr, LPCWSTR name);
+    static void RecordMethodProps(ModuleID moduleId, mdMethodDef token, mdTypeDef classToken, DWORD attributes, DWORD implFlags, HRESULT hr, LPCWSTR name, PCCOR_SIGNATURE signature, ULONG signatureLength);
+    static void RecordTypeDefProps(ModuleID moduleId, mdTypeDef typeDef, DWORD flags, mdToken extends, HRESULT hr, LPCWSTR name);
+    static void RecordILFunctionBody(ModuleID moduleId, mdMethodDef token, HRESULT hr, LPCBYTE methodHeader, ULONG methodSize);
+    static void RecordSetILFunctionBody(ModuleID moduleId, mdMethodDef token, HRESULT hr, LPCBYTE methodHeader, ULONG methodSize);
+    static void RecordDefinition(ModuleID moduleId, ULONG kind, mdToken parent, HRESULT hr, mdToken token, LPCWSTR name, const BYTE* blob, ULONG blobLength);
+    static void RecordIndexTarget(ModuleID moduleId, mdMethodDef token, LPCWSTR className, LPCWSTR methodName);
+
+private:
+    static void Append(uint16_t type, const void* payload, ULONG payloadSize, LPCWSTR name, ULONG nameLength, const BYTE* extra, ULONG extraLength);
+    static void Flush();
+
+    static HANDLE output;
+    static std::mutex lock;
+    static BYTE* buffer;
+    static ULONG used;
+};
@@ -0,0 +1,167 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <stdint.h>
+
+// On-disk layout of a callback recording, read back by replay tooling without the CLR headers.
+// The file is a RecordingHeader followed by records. Each record is a RecordingRecord, its fixed
+// payload, the nameLength UTF-16 code units of payloads that carry a name, then the bytes counted by
+// the payload's other length (a signature, an IL body, a blob, or the class name of an index target),
+// padded with zeros to a multiple of 8 bytes. RecordingRecord.length counts the payload and its data
+// without the padding, so a record never holds more than RecordingMaximumLength bytes; IL bodies
+// longer than that are recorded without their bytes.
+
+#define RecordingMagic 0x43525258 // XRRC
+#define RecordingFormatVersion 2
+#define RecordingMaximumLength 65520
+
+#define RecordingModuleLoadFinished 1
+#define RecordingModuleUnloadStarted 2
+#define RecordingJITCompilationStarted 3
+#define RecordingFunctionInfo 4
+#define RecordingModuleInfo 5
+#define RecordingAssemblyInfo 6
+#define RecordingMethodProps 7
+#define RecordingTypeDefProps 8
+#define RecordingILFunctionBody 9
+#define RecordingSetILFunctionBody 10
+#define RecordingDefinition 11
+#define RecordingIndexTarget 12
+#define RecordingModuleIndexed 13
+
+#define RecordingDefineAssemblyRef 1
+#define RecordingDefineTypeRef 2
+#define RecordingDefineMemberRef 3
+
+#pragma pack(push, 8)
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t formatVersion;
+    int64_t counterFrequency;
+    int64_t startEpochMicroseconds;
+    uint32_t processId;
+    uint32_t reserved;
+} RecordingHeader;
+
+typedef struct
+{
+    uint16_t type;
+    uint16_t length;
+    uint32_t threadId;
+    int64_t counter;
+} RecordingRecord;
+
+typedef struct
+{
+    uint64_t moduleId;
+    int32_t hr;
+    uint32_t reserved;
+} RecordingModulePayload;
+
+typedef struct
+{
+    uint64_t functionId;
+    int32_t isSafeToBlock;
+    uint32_t reserved;
+} RecordingJITPayload;
+
+typedef struct
+{
+    uint64_t functionId;
+    uint64_t classId;
+    uint64_t moduleId;
+    uint32_t token;
+    int32_t hr;
+} RecordingFunctionInfoPayload;
+
+typedef struct
+{
+    uint64_t moduleId;
+    uint64_t assemblyId;
+    int32_t hr;
+    uint32_t nameLength;
+} RecordingModuleInfoPayload;
+
+typedef struct
+{
+    uint64_t assemblyId;
+    uint64_t appDomainId;
+    uint64_t moduleId;
+    int32_t hr;
+    uint32_t nameLength;
+} RecordingAssemblyInfoPayload;
+
+typedef struct
+{
+    uint64_t moduleId;
+    uint32_t token;
+    uint32_t classToken;
+    uint32_t attributes;
+    uint32_t implFlags;
+    int32_t hr;
+    uint32_t signatureLength;
+    uint32_t nameLength;
+    uint32_t reserved;
+} RecordingMethodPropsPayload;
+
+typedef struct
+{
+    uint64_t moduleId;
+    uint32_t typeDef;
+    uint32_t flags;
+    uint32_t extends;
+    int32_t hr;
+    uint32_t nameLength;
+    uint32_t reserved;
+} RecordingTypeDefPropsPayload;
+
+typedef struct
+{
+    uint64_t moduleId;
+    uint32_t token;
+    int32_t hr;
+    uint32_t methodSize;
+    uint32_t bodyLength; // methodSize, or 0 when the body was not recorded
+} RecordingILFunctionBodyPayload;
+
+typedef struct
+{
+    uint64_t moduleId;
+    uint32_t token;
+    int32_t hr;
+    uint32_t bodyLength;
+    uint32_t reserved;
+} RecordingSetILFunctionBodyPayload;
+
+typedef struct
+{
+    uint64_t moduleId;
+    uint32_t kind;
+    uint32_t parent;
+    uint32_t token;
+    int32_t hr;
+    uint32_t blobLength; // public key token of an assembly reference, signature of a member reference
+    uint32_t nameLength;
+} RecordingDefinitionPayload;
+
+typedef struct
+{
+    uint64_t moduleId;
+    uint32_t token;
+    uint32_t classNameLength;
+    uint32_t nameLength;
+    uint32_t reserved;
+} RecordingIndexTargetPayload;
+
+typedef struct
+{
+    uint64_t moduleId;
+    int32_t hr;
+    uint32_t reserved;
+} RecordingModuleIndexedPayload;
+
+#pragma pack(pop)
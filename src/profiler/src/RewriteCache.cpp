@@ -0,0 +1,283 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "ILWriter.h"
+#include "RewriteCache.h"
+
+#define FnvOffsetBasis 0xCBF29CE484222325ULL
+#define FnvPrime 0x100000001B3ULL
+
+RewriteCache::RewriteCache(LPCWSTR path)
+{
+    wcsncpy_s(this->path, MAX_PATH, path, _TRUNCATE);
+}
+
+RewriteCache::~RewriteCache()
+{
+    Flush();
+    Unload();
+}
+
+ULONG64 RewriteCache::GetChecksum(LPCBYTE data, SIZE_T size)
+{
+    ULONG64 hash = FnvOffsetBasis;
+
+    for (SIZE_T i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= FnvPrime;
+    }
+
+    return hash;
+}
+
+DWORD RewriteCache::GetManifestVersion()
+{
+    // The stored bodies are only valid for the call that ILWriter injects today,
+    // so any change to the injected target or prologue invalidates every entry.
+    LPCWSTR names[] = { AutoInstrumentationAssemblyName, AutoInstrumentationClassName, AutoInstrumentationMethodName };
+    ULONG64 hash = FnvOffsetBasis ^ InjectedCodeSize;
+
+    for (LPCWSTR name : names)
+    {
+        hash ^= GetChecksum((LPCBYTE)name, wcslen(name) * sizeof(WCHAR));
+        hash *= FnvPrime;
+    }
+
+    return (DWORD)(hash ^ (hash >> 32));
+}
+
+bool RewriteCache::Load()
+{
+    file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(RewriteCacheHeader) || fileSize.QuadPart > RewriteCacheMaxEntries * (LONGLONG)RewriteCacheMaxILSize)
+    {
+        Unload();
+        return false;
+    }
+
+    mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        Unload();
+        return false;
+    }
+
+    view = (LPCBYTE)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL)
+    {
+        Unload();
+        return false;
+    }
+
+    viewSize = (SIZE_T)fileSize.QuadPart;
+    const RewriteCacheHeader* candidate = (const RewriteCacheHeader*)view;
+    SIZE_T entriesSize = (SIZE_T)candidate->entryCount * sizeof(RewriteCacheEntry);
+
+    if (candidate->magic != RewriteCacheMagic ||
+        candidate->formatVersion != RewriteCacheFormatVersion ||
+        candidate->manifestVersion != GetManifestVersion() ||
+        candidate->entryCount > RewriteCacheMaxEntries ||
+        sizeof(RewriteCacheHeader) + entriesSize > viewSize ||
+        candidate->checksum != GetChecksum(view + sizeof(RewriteCacheHeader), viewSize - sizeof(RewriteCacheHeader)))
+    {
+        Unload();
+        return false;
+    }
+
+    const RewriteCacheEntry* candidateEntries = (const RewriteCacheEntry*)(view + sizeof(RewriteCacheHeader));
+    for (DWORD i = 0; i < candidate->entryCount; i++)
+    {
+        const RewriteCacheEntry* entry = &candidateEntries[i];
+
+        if (entry->ilSize == 0 ||
+            entry->ilSize > RewriteCacheMaxILSize ||
+            entry->ilOffset < sizeof(RewriteCacheHeader) + entriesSize ||
+            (SIZE_T)entry->ilOffset + entry->ilSize > viewSize)
+        {
+            Unload();
+            return false;
+        }
+    }
+
+    header = candidate;
+    entries = candidateEntries;
+
+    return true;
+}
+
+void RewriteCache::Unload()
+{
+    if (view != NULL)
+    {
+        UnmapViewOfFile(view);
+        view = NULL;
+    }
+
+    if (mapping != NULL)
+    {
+        CloseHandle(mapping);
+        mapping = NULL;
+    }
+
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+    }
+
+    viewSize = 0;
+    header = NULL;
+    entries = NULL;
+}
+
+bool RewriteCache::IsEmpty()
+{
+    return header == NULL || header->entryCount == 0;
+}
+
+const RewriteCacheEntry* RewriteCache::Find(const GUID& moduleVersionId)
+{
+    if (header == NULL)
+    {
+        return NULL;
+    }
+
+    for (DWORD i = 0; i < header->entryCount; i++)
+    {
+        if (IsEqualGUID(entries[i].moduleVersionId, moduleVersionId))
+        {
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+LPCBYTE RewriteCache::GetILHeader(const RewriteCacheEntry* entry)
+{
+    return view + entry->ilOffset;
+}
+
+bool RewriteCache::Save(const GUID& moduleVersionId, mdMethodDef entryPointToken, mdMemberRef injectedMethodToken, LPCBYTE ilHeader, ULONG ilSize)
+{
+    if (ilSize == 0 || ilSize > RewriteCacheMaxILSize)
+    {
+        return false;
+    }
+
+    // Keep the entries of other applications sharing the file, replacing any stale one for this module.
+    std::vector<RewriteCacheEntry> newEntries;
+    std::vector<BYTE> ilData;
+
+    if (header != NULL)
+    {
+        for (DWORD i = 0; i < header->entryCount && newEntries.size() < RewriteCacheMaxEntries - 1; i++)
+        {
+            if (IsEqualGUID(entries[i].moduleVersionId, moduleVersionId))
+            {
+                continue;
+            }
+
+            RewriteCacheEntry entry = entries[i];
+            entry.ilOffset = (ULONG)ilData.size();
+            ilData.insert(ilData.end(), view + entries[i].ilOffset, view + entries[i].ilOffset + entries[i].ilSize);
+            newEntries.push_back(entry);
+        }
+    }
+
+    RewriteCacheEntry entry = { moduleVersionId, entryPointToken, injectedMethodToken, (ULONG)ilData.size(), ilSize };
+    ilData.insert(ilData.end(), ilHeader, ilHeader + ilSize);
+    newEntries.push_back(entry);
+
+    ULONG dataOffset = (ULONG)(sizeof(RewriteCacheHeader) + newEntries.size() * sizeof(RewriteCacheEntry));
+    for (RewriteCacheEntry& newEntry : newEntries)
+    {
+        newEntry.ilOffset += dataOffset;
+    }
+
+    PendingWrite* pending = new PendingWrite();
+    wcsncpy_s(pending->path, MAX_PATH, path, _TRUNCATE);
+
+    SIZE_T entriesSize = newEntries.size() * sizeof(RewriteCacheEntry);
+    pending->contents.resize(sizeof(RewriteCacheHeader) + entriesSize + ilData.size());
+    BYTE* payload = pending->contents.data() + sizeof(RewriteCacheHeader);
+    SIZE_T payloadSize = entriesSize + ilData.size();
+    memcpy_s(payload, payloadSize, newEntries.data(), entriesSize);
+    memcpy_s(payload + entriesSize, ilData.size(), ilData.data(), ilData.size());
+
+    RewriteCacheHeader newHeader = { RewriteCacheMagic, RewriteCacheFormatVersion, GetManifestVersion(), (DWORD)newEntries.size(), GetChecksum(payload, payloadSize) };
+    memcpy_s(pending->contents.data(), sizeof(RewriteCacheHeader), &newHeader, sizeof(newHeader));
+
+    // The mapped view pins the file, so release it before replacing the file.
+    Unload();
+
+    // One write at a time, so a later save is never overtaken by an earlier one
+    Flush();
+
+    writer = CreateThread(NULL, 0, WriterThread, pending, 0, NULL);
+    if (writer == NULL)
+    {
+        bool written = Write(pending);
+        delete pending;
+        return written;
+    }
+
+    return true;
+}
+
+void RewriteCache::Flush()
+{
+    if (writer == NULL)
+    {
+        return;
+    }
+
+    // A writer stuck on the disk past the timeout finishes or dies with the process
+    WaitForSingleObject(writer, RewriteCacheFlushTimeoutMilliseconds);
+    CloseHandle(writer);
+    writer = NULL;
+}
+
+DWORD WINAPI RewriteCache::WriterThread(LPVOID parameter)
+{
+    PendingWrite* pending = (PendingWrite*)parameter;
+    Write(pending);
+    delete pending;
+
+    return 0;
+}
+
+bool RewriteCache::Write(const PendingWrite* pending)
+{
+    WCHAR temporaryPath[MAX_PATH];
+    if (swprintf_s(temporaryPath, MAX_PATH, L"%s.%lu.tmp", pending->path, GetCurrentProcessId()) < 0)
+    {
+        return false;
+    }
+
+    HANDLE output = CreateFileW(temporaryPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (output == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    DWORD written = 0;
+    BOOL result = WriteFile(output, pending->contents.data(), (DWORD)pending->contents.size(), &written, NULL);
+    CloseHandle(output);
+
+    if (!result || !MoveFileExW(temporaryPath, pending->path, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileW(temporaryPath);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,75 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <vector>
+#include "cor.h"
+
+#define RewriteCachePathVariable L"AWS_XRAY_PROFILER_CACHE_PATH"
+#define RewriteCacheMagic 0x43525058 // XPRC
+#define RewriteCacheFormatVersion 1
+#define RewriteCacheMaxEntries 256
+#define RewriteCacheMaxILSize 0x100000
+#define RewriteCacheFlushTimeoutMilliseconds 5000
+
+typedef struct
+{
+    DWORD magic;
+    DWORD formatVersion;
+    DWORD manifestVersion;
+    DWORD entryCount;
+    ULONG64 checksum;
+} RewriteCacheHeader;
+
+typedef struct
+{
+    GUID moduleVersionId;
+    mdMethodDef entryPointToken;
+    mdMemberRef injectedMethodToken;
+    ULONG ilOffset;
+    ULONG ilSize;
+} RewriteCacheEntry;
+
+// Optional file cache of the rewrite decision, keyed by module MVID.
+// A warm start maps the file, finds the entry module as it loads and replays the stored IL body,
+// so no method names are resolved and no rewrite is built. Any mismatch in the header, the checksum
+// or the bounds of an entry discards the whole file and the profiler takes the normal path.
+// Saving builds the new file on the JIT thread and leaves the disk writes to a writer thread.
+class RewriteCache
+{
+public:
+    RewriteCache(LPCWSTR path);
+    ~RewriteCache();
+
+    bool Load();
+    bool IsEmpty();
+    const RewriteCacheEntry* Find(const GUID& moduleVersionId);
+    LPCBYTE GetILHeader(const RewriteCacheEntry* entry);
+    bool Save(const GUID& moduleVersionId, mdMethodDef entryPointToken, mdMemberRef injectedMethodToken, LPCBYTE ilHeader, ULONG ilSize);
+    void Flush();
+
+    static DWORD GetManifestVersion();
+
+private:
+    // Owned by the writer thread, so a writer outliving Flush touches nothing of the cache
+    typedef struct
+    {
+        WCHAR path[MAX_PATH];
+        std::vector<BYTE> contents;
+    } PendingWrite;
+
+    void Unload();
+    static ULONG64 GetChecksum(LPCBYTE data, SIZE_T size);
+    static bool Write(const PendingWrite* pending);
+    static DWORD WINAPI WriterThread(LPVOID parameter);
+
+    WCHAR path[MAX_PATH];
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+    LPCBYTE view = NULL;
+    SIZE_T viewSize = 0;
+    const RewriteCacheHeader* header = NULL;
+    const RewriteCacheEntry* entries = NULL;
+    HANDLE writer = NULL;
+};
@@ -0,0 +1,238 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "Clock.h"
+#include "Environment.h"
+#include "Journal.h"
+#include "RuntimeEvents.h"
+#include "TraceContext.h"
+
+ICorProfilerInfo12* RuntimeEvents::profilerInfo = NULL;
+EVENTPIPE_SESSION RuntimeEvents::session = 0;
+std::atomic<RuntimeEvents::ThreadCounters*> RuntimeEvents::threads(nullptr);
+std::atomic<LONG64> RuntimeEvents::suspendStarted(0);
+std::atomic<ULONG64> RuntimeEvents::suspendSegment(0);
+std::atomic<ULONG64> RuntimeEvents::threadPoolWorkers(0);
+
+static thread_local void* currentThreadCounters = nullptr;
+static thread_local LONG64 contentionStarted = 0;
+
+DWORD RuntimeEvents::Initialize(IUnknown* profilerInfoUnknown)
+{
+    if (!Environment::IsEnabled(RuntimeEventsVariable) || profilerInfo != NULL)
+    {
+        return 0;
+    }
+
+    // Runtimes before .NET 5 do not offer ICorProfilerInfo12, the events are then simply not collected
+    if (FAILED(profilerInfoUnknown->QueryInterface(__uuidof(ICorProfilerInfo12), reinterpret_cast<void**>(&profilerInfo))))
+    {
+        profilerInfo = NULL;
+        return 0;
+    }
+
+    COR_PRF_EVENTPIPE_PROVIDER_CONFIG providers[] =
+    {
+        { RuntimeEventsProvider, RuntimeEventsKeywords, RuntimeEventsLevel, NULL },
+    };
+
+    HRESULT hr = profilerInfo->EventPipeStartSession(sizeof(providers) / sizeof(providers[0]), providers, FALSE, &session);
+
+    if (FAILED(hr))
+    {
+        session = 0;
+        profilerInfo->Release();
+        profilerInfo = NULL;
+        return 0;
+    }
+
+    return COR_PRF_HIGH_MONITOR_EVENT_PIPE;
+}
+
+void RuntimeEvents::Shutdown()
+{
+    if (session != 0)
+    {
+        profilerInfo->EventPipeStopSession(session);
+        session = 0;
+    }
+
+    if (profilerInfo != NULL)
+    {
+        profilerInfo->Release();
+        profilerInfo = NULL;
+    }
+}
+
+RuntimeEvents::ThreadCounters* RuntimeEvents::GetThreadCounters()
+{
+    ThreadCounters* threadCounters = (ThreadCounters*)currentThreadCounters;
+    if (threadCounters != nullptr)
+    {
+        return threadCounters;
+    }
+
+    threadCounters = new ThreadCounters();
+
+    for (ULONG i = 0; i < RuntimeCounterCount; i++)
+    {
+        threadCounters->values[i].store(0, std::memory_order_relaxed);
+    }
+
+    // Blocks are never unlinked, so the counts of exited threads stay in the totals
+    ThreadCounters* head = threads.load(std::memory_order_relaxed);
+    do
+    {
+        threadCounters->next = head;
+    } while (!threads.compare_exchange_weak(head, threadCounters, std::memory_order_release, std::memory_order_relaxed));
+
+    currentThreadCounters = threadCounters;
+
+    return threadCounters;
+}
+
+void RuntimeEvents::Add(ThreadCounters* threadCounters, ULONG counter, ULONG64 value)
+{
+    // Single writer per block: plain load and store, atomic only so that readers never see a torn value
+    std::atomic<ULONG64>* target = &threadCounters->values[counter];
+    target->store(target->load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+bool RuntimeEvents::ReadULong(ULONG eventDataLength, LPCBYTE eventData, ULONG offset, ULONG* value)
+{
+    if (eventData == NULL || eventDataLength < offset + sizeof(ULONG))
+    {
+        return false;
+    }
+
+    memcpy(value, eventData + offset, sizeof(ULONG));
+
+    return true;
+}
+
+void RuntimeEvents::Deliver(DWORD eventId, ULONG eventDataLength, LPCBYTE eventData, ThreadID eventThread)
+{
+    ThreadCounters* threadCounters = GetThreadCounters();
+    ULONG value = 0;
+
+    Add(threadCounters, RuntimeCounterEvents, 1);
+
+    switch (eventId)
+    {
+    case RuntimeEventContentionStart:
+        contentionStarted = Clock::GetCounter();
+        Add(threadCounters, RuntimeCounterContentions, 1);
+        break;
+
+    case RuntimeEventContentionStop:
+        if (contentionStarted != 0)
+        {
+            Add(threadCounters, RuntimeCounterContentionNanoseconds, (ULONG64)((Clock::GetCounter() - contentionStarted) * 1000000000.0 / Clock::GetFrequency()));
+            contentionStarted = 0;
+        }
+        break;
+
+    case RuntimeEventGCStart:
+        Add(threadCounters, RuntimeCounterGCs, 1);
+
+        // Count, then the generation collected
+        if (ReadULong(eventDataLength, eventData, 4, &value) && value == 2)
+        {
+            Add(threadCounters, RuntimeCounterGen2GCs, 1);
+        }
+        break;
+
+    case RuntimeEventGCSuspendEEBegin:
+        // Suspensions for other reasons, such as the debugger, are not GC pauses
+        if (ReadULong(eventDataLength, eventData, 0, &value) && (value == RuntimeSuspendForGC || value == RuntimeSuspendForGCPrep))
+        {
+            TraceContextIds ids;
+            suspendSegment.store(eventThread != 0 && TraceContext::Find(eventThread, &ids) ? ids.words[2] : 0, std::memory_order_relaxed);
+            suspendStarted.store(Clock::GetCounter(), std::memory_order_relaxed);
+        }
+        break;
+
+    case RuntimeEventGCRestartEEEnd:
+    {
+        LONG64 started = suspendStarted.exchange(0, std::memory_order_relaxed);
+        if (started != 0)
+        {
+            Add(threadCounters, RuntimeCounterGCPauseNanoseconds, (ULONG64)((Clock::GetCounter() - started) * 1000000000.0 / Clock::GetFrequency()));
+
+            ULONG64 segment = suspendSegment.exchange(0, std::memory_order_relaxed);
+            if (segment != 0)
+            {
+                Journal::Write(JournalGCSegment, JournalSiteNone, segment);
+            }
+        }
+        break;
+    }
+
+    case RuntimeEventThreadPoolWorkerStart:
+        Add(threadCounters, RuntimeCounterThreadPoolWorkerStarts, 1);
+        break;
+
+    case RuntimeEventThreadPoolWorkerStop:
+        Add(threadCounters, RuntimeCounterThreadPoolWorkerStops, 1);
+        break;
+
+    case RuntimeEventThreadPoolAdjustment:
+        Add(threadCounters, RuntimeCounterThreadPoolAdjustments, 1);
+
+        // AverageThroughput, NewWorkerThreadCount, Reason
+        if (ReadULong(eventDataLength, eventData, 8, &value))
+        {
+            threadPoolWorkers.store(value, std::memory_order_relaxed);
+        }
+
+        if (ReadULong(eventDataLength, eventData, 12, &value) && value == RuntimeAdjustmentStarvation)
+        {
+            Add(threadCounters, RuntimeCounterThreadPoolStarvationAdjustments, 1);
+        }
+        break;
+    }
+}
+
+HRESULT RuntimeEvents::GetCounters(BOOL currentThread, RuntimeEventCounters* counters)
+{
+    if (counters == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    memset(counters, 0, sizeof(RuntimeEventCounters));
+
+    if (session == 0)
+    {
+        return S_FALSE;
+    }
+
+    counters->threadPoolWorkers = threadPoolWorkers.load(std::memory_order_relaxed);
+
+    if (currentThread)
+    {
+        ThreadCounters* threadCounters = GetThreadCounters();
+        for (ULONG i = 0; i < RuntimeCounterCount; i++)
+        {
+            counters->values[i] = threadCounters->values[i].load(std::memory_order_relaxed);
+        }
+
+        return S_OK;
+    }
+
+    for (ThreadCounters* thread = threads.load(std::memory_order_acquire); thread != nullptr; thread = thread->next)
+    {
+        for (ULONG i = 0; i < RuntimeCounterCount; i++)
+        {
+            counters->values[i] += thread->values[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    return S_OK;
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayRuntimeEventCounters(BOOL currentThread, RuntimeEventCounters* counters)
+{
+    return RuntimeEvents::GetCounters(currentThread, counters);
+}
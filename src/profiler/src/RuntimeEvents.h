@@ -0,0 +1,86 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include "cor.h"
+#include "corprof.h"
+
+#define RuntimeEventsVariable L"AWS_XRAY_PROFILER_RUNTIME_EVENTS"
+#define RuntimeEventsProvider L"Microsoft-Windows-DotNETRuntime"
+#define RuntimeEventsKeywords 0x14001ULL // GC | Contention | Threading
+#define RuntimeEventsLevel 4 // Informational
+
+#define RuntimeEventGCStart 1
+#define RuntimeEventGCRestartEEEnd 3
+#define RuntimeEventGCSuspendEEBegin 9
+#define RuntimeEventThreadPoolWorkerStart 50
+#define RuntimeEventThreadPoolWorkerStop 51
+#define RuntimeEventThreadPoolAdjustment 55
+#define RuntimeEventContentionStart 81
+#define RuntimeEventContentionStop 91
+
+#define RuntimeSuspendForGC 1
+#define RuntimeSuspendForGCPrep 6
+#define RuntimeAdjustmentStarvation 6
+
+#define RuntimeCounterEvents 0
+#define RuntimeCounterContentions 1
+#define RuntimeCounterContentionNanoseconds 2
+#define RuntimeCounterGCs 3
+#define RuntimeCounterGen2GCs 4
+#define RuntimeCounterGCPauseNanoseconds 5
+#define RuntimeCounterThreadPoolAdjustments 6
+#define RuntimeCounterThreadPoolStarvationAdjustments 7
+#define RuntimeCounterThreadPoolWorkerStarts 8
+#define RuntimeCounterThreadPoolWorkerStops 9
+#define RuntimeCounterCount 10
+
+typedef struct
+{
+    ULONG64 values[RuntimeCounterCount];
+    ULONG64 threadPoolWorkers;
+} RuntimeEventCounters;
+
+// In-process EventPipe session on the runtime provider, enabled by AWS_XRAY_PROFILER_RUNTIME_EVENTS
+// where the runtime offers ICorProfilerInfo12. Contention, thread pool adjustment and GC suspension
+// events are delivered synchronously on the thread that raised them and folded into counters owned
+// by that thread, the same scheme as the overhead histograms, so nothing is allocated or shared per
+// event. Totals are summed when read, the process-wide totals or those of the current thread. The
+// thread that suspends the runtime for a GC is looked up in the trace context table, and each pause
+// it caused while working on a segment is journaled with that segment's id.
+class RuntimeEvents
+{
+public:
+    static DWORD Initialize(IUnknown* profilerInfoUnknown);
+    static void Shutdown();
+
+    static inline bool IsEnabled()
+    {
+        return session != 0;
+    }
+
+    static void Deliver(DWORD eventId, ULONG eventDataLength, LPCBYTE eventData, ThreadID eventThread);
+    static HRESULT GetCounters(BOOL currentThread, RuntimeEventCounters* counters);
+
+private:
+    struct ThreadCounters
+    {
+        std::atomic<ULONG64> values[RuntimeCounterCount];
+        ThreadCounters* next;
+    };
+
+    static ThreadCounters* GetThreadCounters();
+    static void Add(ThreadCounters* threadCounters, ULONG counter, ULONG64 value);
+    static bool ReadULong(ULONG eventDataLength, LPCBYTE eventData, ULONG offset, ULONG* value);
+
+    static ICorProfilerInfo12* profilerInfo;
+    static EVENTPIPE_SESSION session;
+    static std::atomic<ThreadCounters*> threads;
+    static std::atomic<LONG64> suspendStarted;
+    static std::atomic<ULONG64> suspendSegment;
+    static std::atomic<ULONG64> threadPoolWorkers;
+};
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayRuntimeEventCounters(BOOL currentThread, RuntimeEventCounters* counters);
@@ -0,0 +1,589 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include "stdafx.h"
+#include "Clock.h"
+#include "Environment.h"
+#include "Epoch.h"
+#include "IdGenerator.h"
+#include "Sampler.h"
+
+#define SamplerMaximumDepth 32
+#define SamplerKeyLength 64
+
+std::atomic<Sampler::RuleSet*> Sampler::ruleSet(nullptr);
+
+static inline WCHAR FoldCase(WCHAR c)
+{
+    return c >= L'A' && c <= L'Z' ? (WCHAR)(c + (L'a' - L'A')) : c;
+}
+
+void Sampler::Initialize()
+{
+    WCHAR path[MAX_PATH];
+    if (ruleSet.load(std::memory_order_relaxed) == nullptr && Environment::GetValue(SamplerRulesVariable, path, MAX_PATH))
+    {
+        Load(path);
+    }
+}
+
+HRESULT Sampler::Load(LPCWSTR path)
+{
+    if (path == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart > SamplerMaximumFileSize)
+    {
+        CloseHandle(file);
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    char* json = new char[(size_t)fileSize.QuadPart + 1];
+    DWORD read = 0;
+    BOOL succeeded = ReadFile(file, json, (DWORD)fileSize.QuadPart, &read, NULL);
+    CloseHandle(file);
+
+    if (!succeeded || read != (DWORD)fileSize.QuadPart)
+    {
+        delete[] json;
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    // Numbers are read with strtod, which stops at the terminator at the latest
+    json[read] = '\0';
+
+    RuleSet* parsed = new RuleSet();
+    HRESULT hr = Parse(json, read, parsed);
+    delete[] json;
+
+    if (FAILED(hr))
+    {
+        delete parsed;
+        return hr;
+    }
+
+    for (ULONG i = 0; i <= SamplerMaximumRules; i++)
+    {
+        parsed->reservoirs[i].state.store(0, std::memory_order_relaxed);
+    }
+
+    // Decisions still reading the replaced set hold an epoch, it is freed once they are done
+    RuleSet* replaced = ruleSet.exchange(parsed, std::memory_order_acq_rel);
+    if (replaced != nullptr)
+    {
+        Epoch::Retire(replaced, FreeRuleSet);
+    }
+
+    return S_OK;
+}
+
+void Sampler::FreeRuleSet(void* retired)
+{
+    delete (RuleSet*)retired;
+}
+
+HRESULT Sampler::Decide(LPCWSTR host, LPCWSTR method, LPCWSTR path, SamplingDecision* decision)
+{
+    if (decision == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    decision->sampled = FALSE;
+    decision->ruleIndex = SamplerDefaultRule;
+    decision->fromReservoir = FALSE;
+
+    EpochGuard guard;
+    RuleSet* rules = ruleSet.load(std::memory_order_acquire);
+    if (rules == nullptr)
+    {
+        return S_FALSE;
+    }
+
+    ULONG index = 0;
+    while (index < rules->ruleCount && !Matches(&rules->rules[index], host, method, path))
+    {
+        index++;
+    }
+
+    // The default rule and its reservoir sit in the last slot
+    if (index == rules->ruleCount)
+    {
+        index = SamplerMaximumRules;
+    }
+
+    const SamplingRule* rule = &rules->rules[index];
+    decision->ruleIndex = index < SamplerMaximumRules ? index : SamplerDefaultRule;
+
+    if (TakeReservoir(&rules->reservoirs[index], rule->fixedTarget))
+    {
+        decision->sampled = TRUE;
+        decision->fromReservoir = TRUE;
+    }
+    else if (rule->rate > 0)
+    {
+        // The top 53 bits of the draw give a uniform double in [0, 1)
+        decision->sampled = (IdGenerator::NextRandom() >> 11) * (1.0 / 9007199254740992.0) < rule->rate ? TRUE : FALSE;
+    }
+
+    return S_OK;
+}
+
+bool Sampler::Matches(const SamplingRule* rule, LPCWSTR host, LPCWSTR method, LPCWSTR path)
+{
+    return (rule->anyHost || MatchGlob(rule->host, host != NULL ? host : L"")) &&
+           (rule->anyMethod || MatchGlob(rule->method, method != NULL ? method : L"")) &&
+           (rule->anyPath || MatchGlob(rule->path, path != NULL ? path : L""));
+}
+
+bool Sampler::MatchGlob(LPCWSTR pattern, LPCWSTR text)
+{
+    // Greedy match that backs up to the last '*' on a mismatch, linear for patterns with one '*'
+    LPCWSTR star = NULL;
+    LPCWSTR resume = NULL;
+
+    while (*text != L'\0')
+    {
+        if (*pattern == L'*')
+        {
+            star = pattern++;
+            resume = text;
+        }
+        else if (*pattern == L'?' || (*pattern != L'\0' && *pattern == FoldCase(*text)))
+        {
+            pattern++;
+            text++;
+        }
+        else if (star != NULL)
+        {
+            pattern = star + 1;
+            text = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (*pattern == L'*')
+    {
+        pattern++;
+    }
+
+    return *pattern == L'\0';
+}
+
+bool Sampler::TakeReservoir(SamplingReservoir* reservoir, ULONG fixedTarget)
+{
+    if (fixedTarget == 0)
+    {
+        return false;
+    }
+
+    ULONG64 second = (ULONG64)(Clock::GetCounter() / Clock::GetFrequency()) & 0xFFFFFFFF;
+    ULONG64 state = reservoir->state.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+        ULONG64 next;
+
+        // A thread that read the clock just before the second turned counts against the newer second
+        if ((state >> 32) < second)
+        {
+            next = (second << 32) | 1;
+        }
+        else if ((state & 0xFFFFFFFF) < fixedTarget)
+        {
+            next = state + 1;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (reservoir->state.compare_exchange_weak(state, next, std::memory_order_relaxed))
+        {
+            return true;
+        }
+    }
+}
+
+void Sampler::SetPattern(WCHAR* pattern, bool* any)
+{
+    for (WCHAR* c = pattern; *c != L'\0'; c++)
+    {
+        *c = FoldCase(*c);
+    }
+
+    *any = pattern[0] == L'*' && pattern[1] == L'\0';
+}
+
+HRESULT Sampler::Parse(const char* json, ULONG length, RuleSet* ruleSet)
+{
+    JsonCursor cursor = { json, json + length };
+    double version = 0;
+    bool hasDefault = false;
+
+    // A UTF-8 byte order mark is tolerated
+    if (length >= 3 && (BYTE)json[0] == 0xEF && (BYTE)json[1] == 0xBB && (BYTE)json[2] == 0xBF)
+    {
+        cursor.position += 3;
+    }
+
+    ruleSet->ruleCount = 0;
+
+    if (!Consume(&cursor, '{'))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    bool more = !Consume(&cursor, '}');
+    while (more)
+    {
+        WCHAR key[SamplerKeyLength];
+        if (!ParseString(&cursor, key, SamplerKeyLength) || !Consume(&cursor, ':'))
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+
+        bool parsed;
+        if (wcscmp(key, L"version") == 0)
+        {
+            parsed = ParseNumber(&cursor, &version);
+        }
+        else if (wcscmp(key, L"default") == 0)
+        {
+            parsed = ParseRule(&cursor, &ruleSet->rules[SamplerMaximumRules]);
+            hasDefault = true;
+        }
+        else if (wcscmp(key, L"rules") == 0)
+        {
+            parsed = Consume(&cursor, '[');
+
+            bool moreRules = parsed && !Consume(&cursor, ']');
+            while (parsed && moreRules)
+            {
+                if (ruleSet->ruleCount >= SamplerMaximumRules)
+                {
+                    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                }
+
+                parsed = ParseRule(&cursor, &ruleSet->rules[ruleSet->ruleCount++]);
+                moreRules = parsed && Consume(&cursor, ',');
+                parsed = parsed && (moreRules || Consume(&cursor, ']'));
+            }
+        }
+        else
+        {
+            parsed = SkipValue(&cursor, 0);
+        }
+
+        if (!parsed)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+
+        more = Consume(&cursor, ',');
+        if (!more && !Consume(&cursor, '}'))
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+
+    if ((version != 1 && version != 2) || !hasDefault)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    return S_OK;
+}
+
+bool Sampler::ParseRule(JsonCursor* cursor, SamplingRule* rule)
+{
+    memset(rule, 0, sizeof(SamplingRule));
+    rule->anyHost = rule->anyMethod = rule->anyPath = true;
+
+    if (!Consume(cursor, '{'))
+    {
+        return false;
+    }
+
+    bool more = !Consume(cursor, '}');
+    while (more)
+    {
+        WCHAR key[SamplerKeyLength];
+        double number = 0;
+        bool parsed;
+
+        if (!ParseString(cursor, key, SamplerKeyLength) || !Consume(cursor, ':'))
+        {
+            return false;
+        }
+
+        // Version 1 files name the host service_name
+        if (wcscmp(key, L"host") == 0 || wcscmp(key, L"service_name") == 0)
+        {
+            parsed = ParseString(cursor, rule->host, SamplerPatternLength);
+            SetPattern(rule->host, &rule->anyHost);
+        }
+        else if (wcscmp(key, L"http_method") == 0)
+        {
+            parsed = ParseString(cursor, rule->method, SamplerPatternLength);
+            SetPattern(rule->method, &rule->anyMethod);
+        }
+        else if (wcscmp(key, L"url_path") == 0)
+        {
+            parsed = ParseString(cursor, rule->path, SamplerPathPatternLength);
+            SetPattern(rule->path, &rule->anyPath);
+        }
+        else if (wcscmp(key, L"fixed_target") == 0)
+        {
+            parsed = ParseNumber(cursor, &number) && number >= 0 && number <= 0xFFFFFFFF && number == (ULONG)number;
+            rule->fixedTarget = (ULONG)number;
+        }
+        else if (wcscmp(key, L"rate") == 0)
+        {
+            parsed = ParseNumber(cursor, &number) && number >= 0 && number <= 1;
+            rule->rate = number;
+        }
+        else
+        {
+            parsed = SkipValue(cursor, 0);
+        }
+
+        if (!parsed)
+        {
+            return false;
+        }
+
+        more = Consume(cursor, ',');
+        if (!more && !Consume(cursor, '}'))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+char Sampler::Peek(JsonCursor* cursor)
+{
+    while (cursor->position < cursor->end && (*cursor->position == ' ' || *cursor->position == '\t' || *cursor->position == '\r' || *cursor->position == '\n'))
+    {
+        cursor->position++;
+    }
+
+    return cursor->position < cursor->end ? *cursor->position : '\0';
+}
+
+bool Sampler::Consume(JsonCursor* cursor, char expected)
+{
+    if (Peek(cursor) != expected)
+    {
+        return false;
+    }
+
+    cursor->position++;
+
+    return true;
+}
+
+bool Sampler::ParseString(JsonCursor* cursor, WCHAR* buffer, ULONG bufferLength)
+{
+    if (!Consume(cursor, '"'))
+    {
+        return false;
+    }
+
+    // Values that do not fit are refused rather than cut, a cut pattern would match other requests
+    ULONG length = 0;
+    const char* end = cursor->end;
+
+    while (cursor->position < end && *cursor->position != '"')
+    {
+        BYTE c = (BYTE)*cursor->position++;
+        ULONG codePoint = c;
+
+        if (c == '\\')
+        {
+            if (cursor->position >= end)
+            {
+                return false;
+            }
+
+            char escape = *cursor->position++;
+            switch (escape)
+            {
+            case '"': codePoint = '"'; break;
+            case '\\': codePoint = '\\'; break;
+            case '/': codePoint = '/'; break;
+            case 'b': codePoint = '\b'; break;
+            case 'f': codePoint = '\f'; break;
+            case 'n': codePoint = '\n'; break;
+            case 'r': codePoint = '\r'; break;
+            case 't': codePoint = '\t'; break;
+            case 'u':
+                codePoint = 0;
+                for (int i = 0; i < 4; i++)
+                {
+                    char digit = cursor->position < end ? *cursor->position++ : '\0';
+                    if (digit >= '0' && digit <= '9') codePoint = (codePoint << 4) | (digit - '0');
+                    else if (digit >= 'a' && digit <= 'f') codePoint = (codePoint << 4) | (digit - 'a' + 10);
+                    else if (digit >= 'A' && digit <= 'F') codePoint = (codePoint << 4) | (digit - 'A' + 10);
+                    else return false;
+                }
+                break;
+            default:
+                return false;
+            }
+        }
+        else if (c >= 0x80)
+        {
+            // UTF-8 sequences of two to four bytes
+            int continuation = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : -1;
+            if (continuation < 0 || end - cursor->position < continuation)
+            {
+                return false;
+            }
+
+            codePoint = c & (0x3F >> continuation);
+            for (int i = 0; i < continuation; i++)
+            {
+                codePoint = (codePoint << 6) | ((BYTE)*cursor->position++ & 0x3F);
+            }
+        }
+
+        if (codePoint >= 0x10000)
+        {
+            if (buffer != NULL && length + 2 < bufferLength)
+            {
+                codePoint -= 0x10000;
+                buffer[length++] = (WCHAR)(0xD800 | (codePoint >> 10));
+                buffer[length++] = (WCHAR)(0xDC00 | (codePoint & 0x3FF));
+                continue;
+            }
+        }
+        else if (buffer != NULL && length + 1 < bufferLength)
+        {
+            buffer[length++] = (WCHAR)codePoint;
+            continue;
+        }
+
+        if (buffer != NULL)
+        {
+            return false;
+        }
+    }
+
+    if (cursor->position >= end)
+    {
+        return false;
+    }
+
+    cursor->position++;
+
+    if (buffer != NULL)
+    {
+        buffer[length] = L'\0';
+    }
+
+    return true;
+}
+
+bool Sampler::ParseNumber(JsonCursor* cursor, double* value)
+{
+    Peek(cursor);
+
+    char* numberEnd = NULL;
+    *value = strtod(cursor->position, &numberEnd);
+
+    if (numberEnd == cursor->position || numberEnd > cursor->end)
+    {
+        return false;
+    }
+
+    cursor->position = numberEnd;
+
+    return true;
+}
+
+bool Sampler::SkipValue(JsonCursor* cursor, ULONG depth)
+{
+    if (depth > SamplerMaximumDepth)
+    {
+        return false;
+    }
+
+    char first = Peek(cursor);
+
+    if (first == '"')
+    {
+        return ParseString(cursor, NULL, 0);
+    }
+
+    if (first == '{' || first == '[')
+    {
+        char close = first == '{' ? '}' : ']';
+        cursor->position++;
+
+        if (Consume(cursor, close))
+        {
+            return true;
+        }
+
+        do
+        {
+            if (close == '}' && (!ParseString(cursor, NULL, 0) || !Consume(cursor, ':')))
+            {
+                return false;
+            }
+
+            if (!SkipValue(cursor, depth + 1))
+            {
+                return false;
+            }
+        } while (Consume(cursor, ','));
+
+        return Consume(cursor, close);
+    }
+
+    double number;
+    if (ParseNumber(cursor, &number))
+    {
+        return true;
+    }
+
+    // true, false and null
+    const char* words[] = { "true", "false", "null" };
+    for (const char* word : words)
+    {
+        size_t wordLength = strlen(word);
+        if ((size_t)(cursor->end - cursor->position) >= wordLength && strncmp(cursor->position, word, wordLength) == 0)
+        {
+            cursor->position += wordLength;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE LoadXRaySamplingRules(LPCWSTR path)
+{
+    return Sampler::Load(path);
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE MakeXRaySamplingDecision(LPCWSTR host, LPCWSTR method, LPCWSTR path, SamplingDecision* decision)
+{
+    return Sampler::Decide(host, method, path, decision);
+}
@@ -0,0 +1,91 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include "cor.h"
+#include "corprof.h"
+
+#define SamplerRulesVariable L"AWS_XRAY_PROFILER_SAMPLING_RULES"
+#define SamplerMaximumRules 64
+#define SamplerMaximumFileSize 65536
+#define SamplerPatternLength 128
+#define SamplerPathPatternLength 256
+#define SamplerCacheLine 64
+#define SamplerDefaultRule 0xFFFFFFFF
+
+typedef struct
+{
+    ULONG sampled;
+    ULONG ruleIndex;
+    ULONG fromReservoir;
+} SamplingDecision;
+
+// Every reservoir owns a full cache line, so decisions on different rules never share one
+typedef struct alignas(SamplerCacheLine)
+{
+    std::atomic<ULONG64> state; // second << 32 | requests taken in that second
+} SamplingReservoir;
+
+// Local sampling rules, version 1 or 2 of the X-Ray rules file, loaded from the file named by
+// AWS_XRAY_PROFILER_SAMPLING_RULES or through LoadXRaySamplingRules. Rules are matched in file order on
+// host, HTTP method and URL path globs ('*' and '?', ignoring case), falling back to the default rule.
+// A matching rule samples its fixed target of requests each second from a reservoir, then the given
+// rate of the rest. The reservoir is one word, the second and the count taken, updated with a single
+// compare-exchange, so the target holds exactly under any number of threads without a lock; the rate
+// draws from the per-thread generator of IdGenerator. Patterns are lower-cased once at load and a bare
+// '*' is not matched at all. Loading publishes a new rule set in one exchange; decisions read the set
+// under an epoch, and the replaced set is retired and freed once none of them can still hold it.
+class Sampler
+{
+public:
+    static void Initialize();
+    static HRESULT Load(LPCWSTR path);
+    static HRESULT Decide(LPCWSTR host, LPCWSTR method, LPCWSTR path, SamplingDecision* decision);
+
+private:
+    struct SamplingRule
+    {
+        ULONG fixedTarget;
+        double rate;
+        bool anyHost;
+        bool anyMethod;
+        bool anyPath;
+        WCHAR host[SamplerPatternLength];
+        WCHAR method[SamplerPatternLength];
+        WCHAR path[SamplerPathPatternLength];
+    };
+
+    struct RuleSet
+    {
+        ULONG ruleCount;
+        SamplingRule rules[SamplerMaximumRules + 1]; // the default rule is the last slot
+        SamplingReservoir reservoirs[SamplerMaximumRules + 1];
+    };
+
+    struct JsonCursor
+    {
+        const char* position;
+        const char* end;
+    };
+
+    static bool Matches(const SamplingRule* rule, LPCWSTR host, LPCWSTR method, LPCWSTR path);
+    static bool MatchGlob(LPCWSTR pattern, LPCWSTR text);
+    static bool TakeReservoir(SamplingReservoir* reservoir, ULONG fixedTarget);
+    static void FreeRuleSet(void* retired);
+
+    static HRESULT Parse(const char* json, ULONG length, RuleSet* ruleSet);
+    static bool ParseRule(JsonCursor* cursor, SamplingRule* rule);
+    static bool ParseString(JsonCursor* cursor, WCHAR* buffer, ULONG bufferLength);
+    static bool ParseNumber(JsonCursor* cursor, double* value);
+    static bool SkipValue(JsonCursor* cursor, ULONG depth);
+    static char Peek(JsonCursor* cursor);
+    static bool Consume(JsonCursor* cursor, char expected);
+    static void SetPattern(WCHAR* pattern, bool* any);
+
+    static std::atomic<RuleSet*> ruleSet;
+};
+
+extern "C" HRESULT STDMETHODCALLTYPE LoadXRaySamplingRules(LPCWSTR path);
+extern "C" HRESULT STDMETHODCALLTYPE MakeXRaySamplingDecision(LPCWSTR host, LPCWSTR method, LPCWSTR path, SamplingDecision* decision);
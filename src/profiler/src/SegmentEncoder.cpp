@@ -0,0 +1,442 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <charconv>
+#include <math.h>
+#include "stdafx.h"
+#include "SegmentEncoder.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#define SegmentNumberLength 32
+
+// Decimal exponents .NET writes a double in fixed notation for, 1E-05 and 1E+15 being the first outside
+#define SegmentFixedExponentMin -4
+#define SegmentFixedExponentMax 15
+
+static const char HexDigits[] = "0123456789ABCDEF";
+
+void SegmentEncoder::Append(Output* output, const char* text, ULONG length)
+{
+    // Once the buffer is full only the length keeps counting, so the caller learns the size it needs
+    if ((ULONG)(output->end - output->cursor) >= length)
+    {
+        memcpy(output->cursor, text, length);
+        output->cursor += length;
+    }
+    else
+    {
+        output->cursor = output->end;
+    }
+
+    output->length += length;
+}
+
+void SegmentEncoder::AppendName(Output* output, const char* name, bool* first)
+{
+    if (!*first)
+    {
+        Append(output, ",", 1);
+    }
+
+    *first = false;
+    Append(output, "\"", 1);
+    Append(output, name, (ULONG)strlen(name));
+    Append(output, "\":", 2);
+}
+
+void SegmentEncoder::AppendEscaped(Output* output, WCHAR value)
+{
+    char escaped[6] = { '\\', 'u', '0', '0', '0', '0' };
+
+    switch (value)
+    {
+    case L'"': Append(output, "\\\"", 2); return;
+    case L'\\': Append(output, "\\\\", 2); return;
+    case L'\n': Append(output, "\\n", 2); return;
+    case L'\r': Append(output, "\\r", 2); return;
+    case L'\t': Append(output, "\\t", 2); return;
+    case L'\b': Append(output, "\\b", 2); return;
+    case L'\f': Append(output, "\\f", 2); return;
+    }
+
+    if (value >= 0x20 && value <= 0x7E)
+    {
+        char character = (char)value;
+        Append(output, &character, 1);
+        return;
+    }
+
+    // Non-ASCII text is escaped one UTF-16 unit at a time, surrogate pairs included
+    escaped[2] = HexDigits[(value >> 12) & 0xF];
+    escaped[3] = HexDigits[(value >> 8) & 0xF];
+    escaped[4] = HexDigits[(value >> 4) & 0xF];
+    escaped[5] = HexDigits[value & 0xF];
+    Append(output, escaped, sizeof(escaped));
+}
+
+void SegmentEncoder::AppendString(Output* output, LPCWSTR value)
+{
+    Append(output, "\"", 1);
+
+#if defined(_M_IX86) || defined(_M_X64)
+    // Aligned loads never cross a page, so reading a block past the terminator is safe
+    while (((UINT_PTR)value & 15) != 0 && *value != L'\0')
+    {
+        AppendEscaped(output, *value++);
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lowest = _mm_set1_epi16(0x20);
+    const __m128i highest = _mm_set1_epi16(0x7E);
+    const __m128i quote = _mm_set1_epi16(L'"');
+    const __m128i backslash = _mm_set1_epi16(L'\\');
+
+    while (((UINT_PTR)value & 15) == 0)
+    {
+        __m128i units = _mm_load_si128((const __m128i*)value);
+
+        // Saturating subtractions stay zero only inside 0x20..0x7E, which also catches the terminator
+        __m128i outside = _mm_or_si128(_mm_subs_epu16(lowest, units), _mm_subs_epu16(units, highest));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi16(units, quote), _mm_cmpeq_epi16(units, backslash));
+        __m128i plain = _mm_andnot_si128(special, _mm_cmpeq_epi16(outside, zero));
+
+        if (_mm_movemask_epi8(plain) != 0xFFFF)
+        {
+            break;
+        }
+
+        BYTE packed[16];
+        _mm_storeu_si128((__m128i*)packed, _mm_packus_epi16(units, units));
+        Append(output, (const char*)packed, 8);
+        value += 8;
+    }
+#endif
+
+    for (; *value != L'\0'; value++)
+    {
+        AppendEscaped(output, *value);
+    }
+
+    Append(output, "\"", 1);
+}
+
+void SegmentEncoder::AppendDouble(Output* output, double value)
+{
+    // The shortest round-trip digits, laid out the way .NET formats them for the SDK's LitJson writer:
+    // fixed notation from 0.0001 up to 15 integral digits, E+XX or E-XX outside it, and ".0" kept on
+    // fixed integral values
+    char digits[SegmentNumberLength];
+    std::to_chars_result result = std::to_chars(digits, digits + SegmentNumberLength, value, std::chars_format::scientific);
+
+    // Scientific form is [-]d[.ddd]e(+|-)xx
+    const char* mantissa = digits;
+    bool negative = *mantissa == '-';
+    if (negative)
+    {
+        mantissa++;
+    }
+
+    char significant[SegmentNumberLength];
+    int significantLength = 0;
+    const char* cursor = mantissa;
+    for (; cursor < result.ptr && *cursor != 'e'; cursor++)
+    {
+        if (*cursor != '.')
+        {
+            significant[significantLength++] = *cursor;
+        }
+    }
+
+    // to_chars does not terminate the text, so the exponent is read up to the end it returned
+    int exponent = 0;
+    if (cursor < result.ptr)
+    {
+        bool negativeExponent = cursor[1] == '-';
+        for (cursor += 2; cursor < result.ptr; cursor++)
+        {
+            exponent = exponent * 10 + (*cursor - '0');
+        }
+
+        exponent = negativeExponent ? -exponent : exponent;
+    }
+
+    char number[SegmentNumberLength];
+    int length = 0;
+    if (negative)
+    {
+        number[length++] = '-';
+    }
+
+    if (exponent >= SegmentFixedExponentMin && exponent < SegmentFixedExponentMax)
+    {
+        if (exponent < 0)
+        {
+            number[length++] = '0';
+            number[length++] = '.';
+            for (int i = -1; i > exponent; i--)
+            {
+                number[length++] = '0';
+            }
+
+            memcpy(number + length, significant, significantLength);
+            length += significantLength;
+        }
+        else
+        {
+            int integral = exponent + 1;
+            for (int i = 0; i < integral; i++)
+            {
+                number[length++] = i < significantLength ? significant[i] : '0';
+            }
+
+            number[length++] = '.';
+            if (significantLength > integral)
+            {
+                memcpy(number + length, significant + integral, significantLength - integral);
+                length += significantLength - integral;
+            }
+            else
+            {
+                number[length++] = '0';
+            }
+        }
+    }
+    else
+    {
+        number[length++] = significant[0];
+        if (significantLength > 1)
+        {
+            number[length++] = '.';
+            memcpy(number + length, significant + 1, significantLength - 1);
+            length += significantLength - 1;
+        }
+
+        number[length++] = 'E';
+        number[length++] = exponent < 0 ? '-' : '+';
+
+        // At least two exponent digits, as in 1E-05
+        int magnitude = exponent < 0 ? -exponent : exponent;
+        if (magnitude >= 100)
+        {
+            number[length++] = (char)('0' + magnitude / 100);
+        }
+
+        number[length++] = (char)('0' + magnitude / 10 % 10);
+        number[length++] = (char)('0' + magnitude % 10);
+    }
+
+    Append(output, number, (ULONG)length);
+}
+
+void SegmentEncoder::AppendInteger(Output* output, LONG64 value)
+{
+    char number[SegmentNumberLength];
+    std::to_chars_result result = std::to_chars(number, number + SegmentNumberLength, value);
+
+    Append(output, number, (ULONG)(result.ptr - number));
+}
+
+void SegmentEncoder::AppendStringField(Output* output, const char* name, LPCWSTR value, bool* first)
+{
+    if (value != NULL)
+    {
+        AppendName(output, name, first);
+        AppendString(output, value);
+    }
+}
+
+HRESULT SegmentEncoder::Encode(const SegmentDocument* segment, BYTE* buffer, ULONG capacity, ULONG* written)
+{
+    if (segment == NULL || written == NULL || (buffer == NULL && capacity != 0) ||
+        segment->name == NULL || segment->id == NULL || segment->traceId == NULL || !isfinite(segment->startTime) ||
+        (segment->kind == SegmentKindSubsegment && segment->parentId == NULL) ||
+        (segment->annotationCount != 0 && segment->annotations == NULL))
+    {
+        return E_INVALIDARG;
+    }
+
+    Output output = { buffer, buffer + capacity, 0 };
+    bool first = true;
+
+    Append(&output, SegmentProtocolHeader, sizeof(SegmentProtocolHeader) - 1);
+    Append(&output, "{", 1);
+
+    AppendStringField(&output, "name", segment->name, &first);
+    AppendStringField(&output, "id", segment->id, &first);
+    AppendName(&output, "start_time", &first);
+    AppendDouble(&output, segment->startTime);
+
+    if ((segment->flags & SegmentFlagInProgress) != 0 || !isfinite(segment->endTime))
+    {
+        AppendName(&output, "in_progress", &first);
+        Append(&output, "true", 4);
+    }
+    else
+    {
+        AppendName(&output, "end_time", &first);
+        AppendDouble(&output, segment->endTime);
+    }
+
+    AppendStringField(&output, "trace_id", segment->traceId, &first);
+    AppendStringField(&output, "parent_id", segment->parentId, &first);
+
+    if (segment->kind == SegmentKindSubsegment)
+    {
+        AppendName(&output, "type", &first);
+        Append(&output, "\"subsegment\"", 12);
+    }
+
+    AppendStringField(&output, "namespace", segment->nameSpace, &first);
+    AppendStringField(&output, "origin", segment->origin, &first);
+
+    const struct { ULONG flag; const char* name; } flagFields[] =
+    {
+        { SegmentFlagError, "error" },
+        { SegmentFlagFault, "fault" },
+        { SegmentFlagThrottle, "throttle" },
+    };
+
+    for (const auto& flagField : flagFields)
+    {
+        if ((segment->flags & flagField.flag) != 0)
+        {
+            AppendName(&output, flagField.name, &first);
+            Append(&output, "true", 4);
+        }
+    }
+
+    bool hasRequest = segment->httpMethod != NULL || segment->httpUrl != NULL || segment->httpUserAgent != NULL || segment->httpClientIp != NULL;
+    bool hasResponse = segment->httpStatus != SegmentNoHttpStatus || segment->httpContentLength != SegmentNoContentLength;
+
+    if (hasRequest || hasResponse)
+    {
+        bool firstHttp = true;
+        AppendName(&output, "http", &first);
+        Append(&output, "{", 1);
+
+        if (hasRequest)
+        {
+            bool firstRequest = true;
+            AppendName(&output, "request", &firstHttp);
+            Append(&output, "{", 1);
+            AppendStringField(&output, "method", segment->httpMethod, &firstRequest);
+            AppendStringField(&output, "url", segment->httpUrl, &firstRequest);
+            AppendStringField(&output, "user_agent", segment->httpUserAgent, &firstRequest);
+            AppendStringField(&output, "client_ip", segment->httpClientIp, &firstRequest);
+            Append(&output, "}", 1);
+        }
+
+        if (hasResponse)
+        {
+            bool firstResponse = true;
+            AppendName(&output, "response", &firstHttp);
+            Append(&output, "{", 1);
+
+            if (segment->httpStatus != SegmentNoHttpStatus)
+            {
+                AppendName(&output, "status", &firstResponse);
+                AppendInteger(&output, segment->httpStatus);
+            }
+
+            if (segment->httpContentLength != SegmentNoContentLength)
+            {
+                AppendName(&output, "content_length", &firstResponse);
+                AppendInteger(&output, segment->httpContentLength);
+            }
+
+            Append(&output, "}", 1);
+        }
+
+        Append(&output, "}", 1);
+    }
+
+    const struct { const char* name; LPCWSTR value; } sqlFields[] =
+    {
+        { "url", segment->sqlUrl },
+        { "preparation", segment->sqlPreparation },
+        { "database_type", segment->sqlDatabaseType },
+        { "database_version", segment->sqlDatabaseVersion },
+        { "driver_version", segment->sqlDriverVersion },
+        { "user", segment->sqlUser },
+        { "sanitized_query", segment->sqlSanitizedQuery },
+    };
+
+    bool firstSql = true;
+    for (const auto& sqlField : sqlFields)
+    {
+        if (sqlField.value == NULL)
+        {
+            continue;
+        }
+
+        if (firstSql)
+        {
+            AppendName(&output, "sql", &first);
+            Append(&output, "{", 1);
+        }
+
+        AppendStringField(&output, sqlField.name, sqlField.value, &firstSql);
+    }
+
+    if (!firstSql)
+    {
+        Append(&output, "}", 1);
+    }
+
+    if (segment->annotationCount > 0)
+    {
+        AppendName(&output, "annotations", &first);
+        Append(&output, "{", 1);
+
+        for (ULONG i = 0; i < segment->annotationCount; i++)
+        {
+            const SegmentAnnotation* annotation = &segment->annotations[i];
+            if (annotation->key == NULL || (annotation->type == SegmentAnnotationString && annotation->stringValue == NULL))
+            {
+                return E_INVALIDARG;
+            }
+
+            if (i > 0)
+            {
+                Append(&output, ",", 1);
+            }
+
+            AppendString(&output, annotation->key);
+            Append(&output, ":", 1);
+
+            switch (annotation->type)
+            {
+            case SegmentAnnotationString:
+                AppendString(&output, annotation->stringValue);
+                break;
+            case SegmentAnnotationNumber:
+                AppendDouble(&output, annotation->numberValue);
+                break;
+            case SegmentAnnotationInteger:
+                AppendInteger(&output, annotation->integerValue);
+                break;
+            case SegmentAnnotationBoolean:
+                Append(&output, annotation->booleanValue ? "true" : "false", annotation->booleanValue ? 4 : 5);
+                break;
+            default:
+                return E_INVALIDARG;
+            }
+        }
+
+        Append(&output, "}", 1);
+    }
+
+    Append(&output, "}", 1);
+
+    *written = output.length;
+
+    return output.length <= capacity ? S_OK : E_NOT_SUFFICIENT_BUFFER;
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE EncodeXRaySegment(const SegmentDocument* segment, BYTE* buffer, ULONG capacity, ULONG* written)
+{
+    return SegmentEncoder::Encode(segment, buffer, capacity, written);
+}
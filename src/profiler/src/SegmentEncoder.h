@@ -0,0 +1,96 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "cor.h"
+
+#define SegmentProtocolHeader "{\"format\":\"json\",\"version\":1}\n"
+
+#define SegmentKindSegment 0
+#define SegmentKindSubsegment 1
+
+#define SegmentFlagInProgress 0x01
+#define SegmentFlagError 0x02
+#define SegmentFlagFault 0x04
+#define SegmentFlagThrottle 0x08
+
+#define SegmentAnnotationString 0
+#define SegmentAnnotationNumber 1
+#define SegmentAnnotationInteger 2
+#define SegmentAnnotationBoolean 3
+
+#define SegmentNoHttpStatus 0
+#define SegmentNoContentLength -1
+
+typedef struct
+{
+    LPCWSTR key;
+    ULONG type;
+    BOOL booleanValue;
+    LPCWSTR stringValue;
+    double numberValue;
+    LONG64 integerValue;
+} SegmentAnnotation;
+
+// Flat description of one segment or independently sent subsegment. Strings are NUL terminated UTF-16
+// pinned by the caller; a NULL string leaves its field out of the document.
+typedef struct
+{
+    ULONG kind;
+    ULONG flags;
+    LPCWSTR name;
+    LPCWSTR id;
+    LPCWSTR traceId;
+    LPCWSTR parentId;
+    LPCWSTR nameSpace;
+    LPCWSTR origin;
+    double startTime;
+    double endTime;
+
+    LPCWSTR httpMethod;
+    LPCWSTR httpUrl;
+    LPCWSTR httpUserAgent;
+    LPCWSTR httpClientIp;
+    ULONG httpStatus;
+    LONG64 httpContentLength;
+
+    LPCWSTR sqlUrl;
+    LPCWSTR sqlPreparation;
+    LPCWSTR sqlDatabaseType;
+    LPCWSTR sqlDatabaseVersion;
+    LPCWSTR sqlDriverVersion;
+    LPCWSTR sqlUser;
+    LPCWSTR sqlSanitizedQuery;
+
+    const SegmentAnnotation* annotations;
+    ULONG annotationCount;
+} SegmentDocument;
+
+// Writes a segment as the daemon's UDP payload, the protocol header followed by the JSON document,
+// straight into a buffer owned by the caller. Nothing is allocated. The output is ASCII: characters
+// outside the printable range are written as \uXXXX escapes the way the SDK's JSON writer does, and
+// strings are checked eight UTF-16 units at a time so plain text is copied without a per-character branch.
+class SegmentEncoder
+{
+public:
+    static HRESULT Encode(const SegmentDocument* segment, BYTE* buffer, ULONG capacity, ULONG* written);
+
+private:
+    struct Output
+    {
+        BYTE* cursor;
+        BYTE* end;
+        ULONG length;
+    };
+
+    static void Append(Output* output, const char* text, ULONG length);
+    static void AppendName(Output* output, const char* name, bool* first);
+    static void AppendString(Output* output, LPCWSTR value);
+    static void AppendEscaped(Output* output, WCHAR value);
+    static void AppendDouble(Output* output, double value);
+    static void AppendInteger(Output* output, LONG64 value);
+    static void AppendStringField(Output* output, const char* name, LPCWSTR value, bool* first);
+};
+
+extern "C" HRESULT STDMETHODCALLTYPE EncodeXRaySegment(const SegmentDocument* segment, BYTE* buffer, ULONG capacity, ULONG* written);
@@ -0,0 +1,118 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "Clock.h"
+#include "SqlCommands.h"
+
+std::atomic<bool> SqlCommands::enabled(false);
+std::atomic<ULONG64> SqlCommands::freeRecords(0);
+std::atomic<ULONG> SqlCommands::nextFree[SqlCommandRecordCount];
+std::atomic<bool> SqlCommands::inFlight[SqlCommandRecordCount];
+SqlCommandRecord SqlCommands::records[SqlCommandRecordCount] = { 0 };
+
+void SqlCommands::Enable()
+{
+    if (enabled.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    // Records are numbered from 1 so that 0 ends the stack and tells a hook its command is untraced
+    for (ULONG record = 1; record <= SqlCommandRecordCount; record++)
+    {
+        nextFree[record - 1].store(record < SqlCommandRecordCount ? record + 1 : 0, std::memory_order_relaxed);
+        inFlight[record - 1].store(false, std::memory_order_relaxed);
+    }
+
+    freeRecords.store(1, std::memory_order_relaxed);
+    enabled.store(true, std::memory_order_release);
+}
+
+ULONG SqlCommands::Pop()
+{
+    ULONG64 head = freeRecords.load(std::memory_order_acquire);
+
+    for (;;)
+    {
+        ULONG record = (ULONG)head;
+        if (record == 0)
+        {
+            return 0;
+        }
+
+        // A record taken and returned in between bumps the tag, so a stale next never gets in
+        ULONG64 replacement = (((head >> 32) + 1) << 32) | nextFree[record - 1].load(std::memory_order_relaxed);
+        if (freeRecords.compare_exchange_weak(head, replacement, std::memory_order_acquire, std::memory_order_acquire))
+        {
+            return record;
+        }
+    }
+}
+
+void SqlCommands::Push(ULONG record)
+{
+    ULONG64 head = freeRecords.load(std::memory_order_relaxed);
+    ULONG64 replacement;
+
+    do
+    {
+        nextFree[record - 1].store((ULONG)head, std::memory_order_relaxed);
+        replacement = (((head >> 32) + 1) << 32) | record;
+    } while (!freeRecords.compare_exchange_weak(head, replacement, std::memory_order_release, std::memory_order_relaxed));
+}
+
+ULONG SqlCommands::Begin()
+{
+    if (!enabled.load(std::memory_order_acquire))
+    {
+        return 0;
+    }
+
+    ULONG record = Pop();
+    if (record == 0)
+    {
+        return 0;
+    }
+
+    records[record - 1].startMicroseconds = Clock::GetEpochMicroseconds();
+    inFlight[record - 1].store(true, std::memory_order_relaxed);
+
+    return record;
+}
+
+HRESULT SqlCommands::End(ULONG record, BOOL failed, SqlCommandRecord* copy)
+{
+    // Stamped first, so that checking the record is not part of the command
+    LONG64 endMicroseconds = Clock::GetEpochMicroseconds();
+
+    if (record == 0 || record > SqlCommandRecordCount || copy == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Only the hook that began the command hands it back, a second end finds it free
+    if (!inFlight[record - 1].exchange(false, std::memory_order_relaxed))
+    {
+        return E_INVALIDARG;
+    }
+
+    SqlCommandRecord* entry = &records[record - 1];
+    entry->endMicroseconds = endMicroseconds;
+    entry->failed = failed;
+    *copy = *entry;
+
+    Push(record);
+
+    return S_OK;
+}
+
+extern "C" ULONG STDMETHODCALLTYPE BeginXRaySqlCommand()
+{
+    return SqlCommands::Begin();
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE EndXRaySqlCommand(ULONG record, BOOL failed, SqlCommandRecord* copy)
+{
+    return SqlCommands::End(record, failed, copy);
+}
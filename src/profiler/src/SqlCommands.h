@@ -0,0 +1,45 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include "cor.h"
+#include "corprof.h"
+
+#define SqlCommandRecordCount 4096 // commands in flight at once, the ones past it go untraced
+
+typedef struct
+{
+    LONG64 startMicroseconds;
+    LONG64 endMicroseconds;
+    BOOL failed;
+} SqlCommandRecord;
+
+// Timing of the SqlCommand calls that AWS_XRAY_PROFILER_SQL_COMMANDS redirects to the agent's
+// SqlCommandHooks. A hook takes a record from a fixed pool when the call starts, which stamps the start
+// on the clock of the segments, and hands it back when the call returns or throws, which stamps the end
+// and whether it failed and copies the record out. The hook writes the subsegment from the copy once the
+// command is done, so nothing is opened on the caller's trace context while it runs. Free records sit on
+// a lock-free stack whose head carries a tag against ABA; with every record in flight, Begin returns 0.
+class SqlCommands
+{
+public:
+    static void Enable();
+
+    static ULONG Begin();
+    static HRESULT End(ULONG record, BOOL failed, SqlCommandRecord* copy);
+
+private:
+    static ULONG Pop();
+    static void Push(ULONG record);
+
+    static std::atomic<bool> enabled;
+    static std::atomic<ULONG64> freeRecords; // tag in the high half, the top record in the low half
+    static std::atomic<ULONG> nextFree[SqlCommandRecordCount];
+    static std::atomic<bool> inFlight[SqlCommandRecordCount];
+    static SqlCommandRecord records[SqlCommandRecordCount];
+};
+
+extern "C" ULONG STDMETHODCALLTYPE BeginXRaySqlCommand();
+extern "C" HRESULT STDMETHODCALLTYPE EndXRaySqlCommand(ULONG record, BOOL failed, SqlCommandRecord* copy);
@@ -0,0 +1,463 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <new>
+#include "stdafx.h"
+#include "Environment.h"
+#include "IdGenerator.h"
+#include "Journal.h"
+#include "SegmentEncoder.h"
+#include "StartupTimeline.h"
+
+#define StartupAnnotationCount (10 + 2 * StartupSlowestAssemblies)
+
+ICorProfilerInfo5* StartupTimeline::profilerInfo = NULL;
+DWORD StartupTimeline::addedEventMask = 0;
+std::atomic<bool> StartupTimeline::active(false);
+double StartupTimeline::processStartTime = 0;
+LONG64 StartupTimeline::startCounter = 0;
+LONG64 StartupTimeline::startEpochMicroseconds = 0;
+std::atomic<LONG64> StartupTimeline::endCounter(0);
+std::atomic<StartupTimeline::ThreadTimeline*> StartupTimeline::threads(nullptr);
+std::mutex StartupTimeline::assembliesLock;
+StartupTimeline::StartupAssembly* StartupTimeline::assemblies = NULL;
+ULONG StartupTimeline::assemblyCount = 0;
+thread_local StartupTimeline::ThreadTimeline* StartupTimeline::threadTimeline = nullptr;
+
+static LPCWSTR const SlowestAssemblyKeys[StartupSlowestAssemblies] = { L"slowest_assembly_1", L"slowest_assembly_2", L"slowest_assembly_3" };
+static LPCWSTR const SlowestAssemblyTimeKeys[StartupSlowestAssemblies] = { L"slowest_assembly_1_ms", L"slowest_assembly_2_ms", L"slowest_assembly_3_ms" };
+
+DWORD StartupTimeline::Initialize(ICorProfilerInfo5* profilerInfo, DWORD eventMask)
+{
+    if (!Environment::IsEnabled(StartupTimelineVariable) || assemblies != NULL)
+    {
+        return 0;
+    }
+
+    assemblies = new (std::nothrow) StartupAssembly[StartupMaximumAssemblies];
+    if (assemblies == NULL)
+    {
+        return 0;
+    }
+
+    startCounter = Clock::GetCounter();
+    startEpochMicroseconds = Clock::GetEpochMicroseconds();
+    processStartTime = (double)startEpochMicroseconds / MicrosecondsPerSecond;
+
+    // The runtime was already loaded and running its own startup before the profiler was attached
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+    {
+        ULONG64 ticks = ((ULONG64)creationTime.dwHighDateTime << 32) | creationTime.dwLowDateTime;
+        if (ticks > FileTimeUnixEpochOffset)
+        {
+            processStartTime = (double)((ticks - FileTimeUnixEpochOffset) / FileTimeTicksPerMicrosecond) / MicrosecondsPerSecond;
+        }
+    }
+
+    profilerInfo->AddRef();
+    StartupTimeline::profilerInfo = profilerInfo;
+
+    // Only the bits the rest of the profiler did not ask for are dropped again at completion
+    addedEventMask = (COR_PRF_MONITOR_ASSEMBLY_LOADS | COR_PRF_MONITOR_MODULE_LOADS | COR_PRF_MONITOR_CLASS_LOADS | COR_PRF_MONITOR_JIT_COMPILATION) & ~eventMask;
+    active.store(true, std::memory_order_relaxed);
+
+    return addedEventMask;
+}
+
+void StartupTimeline::Complete()
+{
+    std::lock_guard<std::mutex> guard(assembliesLock);
+
+    bool expected = true;
+    if (!active.compare_exchange_strong(expected, false))
+    {
+        return;
+    }
+
+    LONG64 completed = Clock::GetCounter();
+    endCounter.store(completed, std::memory_order_relaxed);
+    Journal::Write(JournalStartupCompleted, JournalSiteNone, ToMicroseconds(completed - startCounter));
+
+    if (addedEventMask == 0 || profilerInfo == NULL)
+    {
+        return;
+    }
+
+    // The high half is carried over, SetEventMask alone would not say what becomes of it
+    DWORD eventMask = 0;
+    DWORD highEventMask = 0;
+    HRESULT hr = profilerInfo->GetEventMask2(&eventMask, &highEventMask);
+
+    if (SUCCEEDED(hr))
+    {
+        eventMask &= ~addedEventMask;
+        hr = profilerInfo->SetEventMask2(eventMask, highEventMask);
+    }
+
+    if (FAILED(hr))
+    {
+        Journal::WriteFailure(JournalSiteSetEventMask, hr);
+    }
+    else
+    {
+        Journal::Write(JournalEventMaskChanged, JournalSiteSetEventMask, ((ULONG64)highEventMask << 32) | eventMask);
+    }
+}
+
+void StartupTimeline::Shutdown()
+{
+    std::lock_guard<std::mutex> guard(assembliesLock);
+
+    // A process that never served a request still keeps the timeline it got to
+    if (active.exchange(false))
+    {
+        endCounter.store(Clock::GetCounter(), std::memory_order_relaxed);
+    }
+
+    if (profilerInfo != NULL)
+    {
+        profilerInfo->Release();
+        profilerInfo = NULL;
+    }
+}
+
+StartupTimeline::ThreadTimeline* StartupTimeline::GetThreadTimeline()
+{
+    ThreadTimeline* timeline = threadTimeline;
+    if (timeline != nullptr)
+    {
+        return timeline;
+    }
+
+    timeline = new ThreadTimeline();
+
+    for (ULONG phase = 0; phase < StartupPhaseCount; phase++)
+    {
+        timeline->phases[phase].depth = 0;
+        timeline->phases[phase].started = 0;
+        timeline->counts[phase].store(0, std::memory_order_relaxed);
+        timeline->elapsed[phase].store(0, std::memory_order_relaxed);
+    }
+
+    timeline->profilerElapsed.store(0, std::memory_order_relaxed);
+
+    // Blocks are never unlinked, so the counts of exited threads stay in the totals
+    ThreadTimeline* head = threads.load(std::memory_order_relaxed);
+    do
+    {
+        timeline->next = head;
+    } while (!threads.compare_exchange_weak(head, timeline, std::memory_order_release, std::memory_order_relaxed));
+
+    threadTimeline = timeline;
+    return timeline;
+}
+
+void StartupTimeline::Begin(ULONG phase)
+{
+    ThreadPhase& threadPhase = GetThreadTimeline()->phases[phase];
+
+    if (threadPhase.depth++ == 0)
+    {
+        threadPhase.started = Clock::GetCounter();
+    }
+}
+
+void StartupTimeline::End(ULONG phase)
+{
+    ThreadTimeline* timeline = GetThreadTimeline();
+    ThreadPhase& threadPhase = timeline->phases[phase];
+
+    // A finished callback can arrive without its start when the timeline began in between
+    if (threadPhase.depth == 0)
+    {
+        return;
+    }
+
+    // Single writer per block: plain load and store, atomic only so that readers never see a torn value
+    std::atomic<ULONG64>* count = &timeline->counts[phase];
+    count->store(count->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    if (--threadPhase.depth == 0)
+    {
+        std::atomic<LONG64>* elapsed = &timeline->elapsed[phase];
+        elapsed->store(elapsed->load(std::memory_order_relaxed) + Clock::GetCounter() - threadPhase.started, std::memory_order_relaxed);
+    }
+}
+
+void StartupTimeline::AssemblyStarted(AssemblyID assemblyId)
+{
+    LONG64 started = Clock::GetCounter();
+    std::lock_guard<std::mutex> guard(assembliesLock);
+
+    if (assemblyCount < StartupMaximumAssemblies)
+    {
+        StartupAssembly* assembly = &assemblies[assemblyCount++];
+        assembly->assemblyId = assemblyId;
+        assembly->started = started;
+        assembly->elapsed = 0;
+        assembly->name[0] = L'\0';
+    }
+}
+
+void StartupTimeline::AssemblyFinished(AssemblyID assemblyId)
+{
+    LONG64 finished = Clock::GetCounter();
+
+    WCHAR name[StartupAssemblyNameLength];
+    ULONG nameLength = 0;
+    AppDomainID appDomainId;
+    ModuleID moduleId;
+
+    if (profilerInfo == NULL || FAILED(profilerInfo->GetAssemblyInfo(assemblyId, StartupAssemblyNameLength, &nameLength, name, &appDomainId, &moduleId)))
+    {
+        name[0] = L'\0';
+    }
+
+    std::lock_guard<std::mutex> guard(assembliesLock);
+
+    // The assembly that finishes is almost always the one that started last
+    for (ULONG i = assemblyCount; i > 0; i--)
+    {
+        StartupAssembly* assembly = &assemblies[i - 1];
+        if (assembly->assemblyId == assemblyId && assembly->elapsed == 0)
+        {
+            assembly->elapsed = finished - assembly->started;
+            wcsncpy_s(assembly->name, StartupAssemblyNameLength, name, _TRUNCATE);
+            break;
+        }
+    }
+}
+
+void StartupTimeline::AddProfilerTime(LONG64 elapsed)
+{
+    std::atomic<LONG64>* profilerElapsed = &GetThreadTimeline()->profilerElapsed;
+    profilerElapsed->store(profilerElapsed->load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+}
+
+double StartupTimeline::ToEpochSeconds(LONG64 counter)
+{
+    return (startEpochMicroseconds + (double)(counter - startCounter) * MicrosecondsPerSecond / Clock::GetFrequency()) / MicrosecondsPerSecond;
+}
+
+ULONG64 StartupTimeline::ToMicroseconds(LONG64 elapsed)
+{
+    return elapsed <= 0 ? 0 : (ULONG64)(elapsed * (double)MicrosecondsPerSecond / Clock::GetFrequency());
+}
+
+HRESULT StartupTimeline::GetSummary(StartupSummary* summary)
+{
+    if (summary == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    memset(summary, 0, sizeof(StartupSummary));
+
+    if (assemblies == NULL)
+    {
+        return S_FALSE;
+    }
+
+    LONG64 completed = endCounter.load(std::memory_order_relaxed);
+
+    summary->processStartTime = processStartTime;
+    summary->profilerStartTime = ToEpochSeconds(startCounter);
+    summary->endTime = completed != 0 ? ToEpochSeconds(completed) : 0;
+    summary->completed = completed != 0 ? TRUE : FALSE;
+
+    LONG64 profilerElapsed = 0;
+    LONG64 elapsed[StartupPhaseCount] = { 0 };
+
+    for (ThreadTimeline* thread = threads.load(std::memory_order_acquire); thread != nullptr; thread = thread->next)
+    {
+        profilerElapsed += thread->profilerElapsed.load(std::memory_order_relaxed);
+
+        for (ULONG phase = 0; phase < StartupPhaseCount; phase++)
+        {
+            summary->counts[phase] += thread->counts[phase].load(std::memory_order_relaxed);
+            elapsed[phase] += thread->elapsed[phase].load(std::memory_order_relaxed);
+        }
+    }
+
+    summary->profilerMicroseconds = ToMicroseconds(profilerElapsed);
+
+    for (ULONG phase = 0; phase < StartupPhaseCount; phase++)
+    {
+        summary->microseconds[phase] = ToMicroseconds(elapsed[phase]);
+    }
+
+    std::lock_guard<std::mutex> guard(assembliesLock);
+    summary->assemblyCount = assemblyCount;
+
+    return S_OK;
+}
+
+HRESULT StartupTimeline::GetAssembly(ULONG index, StartupAssemblyTiming* timing)
+{
+    if (timing == NULL || assemblies == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    std::lock_guard<std::mutex> guard(assembliesLock);
+
+    if (index >= assemblyCount)
+    {
+        return E_INVALIDARG;
+    }
+
+    const StartupAssembly* assembly = &assemblies[index];
+    timing->startOffsetMicroseconds = ToMicroseconds(assembly->started - startCounter);
+    timing->loadMicroseconds = ToMicroseconds(assembly->elapsed);
+    wcsncpy_s(timing->name, StartupAssemblyNameLength, assembly->name, _TRUNCATE);
+
+    return S_OK;
+}
+
+HRESULT StartupTimeline::Encode(LPCWSTR traceId, LPCWSTR parentId, BYTE* buffer, ULONG capacity, ULONG* written)
+{
+    if (written == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    *written = 0;
+
+    StartupSummary summary;
+    HRESULT hr = GetSummary(&summary);
+    if (hr != S_OK)
+    {
+        return hr;
+    }
+
+    WCHAR id[SegmentIdLength + 1];
+    hr = IdGenerator::WriteSegmentId(id, SegmentIdLength + 1);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    id[SegmentIdLength] = L'\0';
+
+    // Names are copied out so the annotations stay valid once the table is unlocked
+    WCHAR slowestNames[StartupSlowestAssemblies][StartupAssemblyNameLength];
+    LONG64 slowestElapsed[StartupSlowestAssemblies] = { 0 };
+    ULONG slowestCount = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(assembliesLock);
+
+        for (ULONG i = 0; i < assemblyCount; i++)
+        {
+            const StartupAssembly* assembly = &assemblies[i];
+            if (assembly->elapsed == 0)
+            {
+                continue;
+            }
+
+            ULONG position = slowestCount;
+
+            while (position > 0 && slowestElapsed[position - 1] < assembly->elapsed)
+            {
+                position--;
+            }
+
+            if (position >= StartupSlowestAssemblies)
+            {
+                continue;
+            }
+
+            ULONG last = slowestCount < StartupSlowestAssemblies ? slowestCount++ : StartupSlowestAssemblies - 1;
+            for (ULONG j = last; j > position; j--)
+            {
+                slowestElapsed[j] = slowestElapsed[j - 1];
+                wcscpy_s(slowestNames[j], StartupAssemblyNameLength, slowestNames[j - 1]);
+            }
+
+            slowestElapsed[position] = assembly->elapsed;
+            wcscpy_s(slowestNames[position], StartupAssemblyNameLength, assembly->name);
+        }
+    }
+
+    const struct { LPCWSTR key; ULONG phase; LPCWSTR timeKey; } phases[] =
+    {
+        { L"assemblies", StartupPhaseAssembly, L"assembly_load_ms" },
+        { L"modules", StartupPhaseModule, L"module_load_ms" },
+        { L"classes", StartupPhaseClass, L"class_load_ms" },
+        { L"jit_methods", StartupPhaseJit, L"jit_ms" },
+    };
+
+    SegmentAnnotation annotations[StartupAnnotationCount] = { 0 };
+    ULONG annotationCount = 0;
+
+    for (const auto& phase : phases)
+    {
+        annotations[annotationCount].key = phase.key;
+        annotations[annotationCount].type = SegmentAnnotationInteger;
+        annotations[annotationCount++].integerValue = (LONG64)summary.counts[phase.phase];
+        annotations[annotationCount].key = phase.timeKey;
+        annotations[annotationCount].type = SegmentAnnotationNumber;
+        annotations[annotationCount++].numberValue = summary.microseconds[phase.phase] / 1000.0;
+    }
+
+    annotations[annotationCount].key = L"profiler_ms";
+    annotations[annotationCount].type = SegmentAnnotationNumber;
+    annotations[annotationCount++].numberValue = summary.profilerMicroseconds / 1000.0;
+    annotations[annotationCount].key = L"runtime_ms";
+    annotations[annotationCount].type = SegmentAnnotationNumber;
+    annotations[annotationCount++].numberValue = (summary.profilerStartTime - summary.processStartTime) * 1000.0;
+
+    for (ULONG i = 0; i < slowestCount; i++)
+    {
+        annotations[annotationCount].key = SlowestAssemblyKeys[i];
+        annotations[annotationCount].type = SegmentAnnotationString;
+        annotations[annotationCount++].stringValue = slowestNames[i];
+        annotations[annotationCount].key = SlowestAssemblyTimeKeys[i];
+        annotations[annotationCount].type = SegmentAnnotationNumber;
+        annotations[annotationCount++].numberValue = ToMicroseconds(slowestElapsed[i]) / 1000.0;
+    }
+
+    SegmentDocument document = { 0 };
+    document.kind = SegmentKindSubsegment;
+    document.flags = summary.completed ? 0 : SegmentFlagInProgress;
+    document.name = StartupSubsegmentName;
+    document.id = id;
+    document.traceId = traceId;
+    document.parentId = parentId;
+    document.startTime = summary.processStartTime;
+    document.endTime = summary.endTime;
+    document.httpStatus = SegmentNoHttpStatus;
+    document.httpContentLength = SegmentNoContentLength;
+    document.annotations = annotations;
+    document.annotationCount = annotationCount;
+
+    return SegmentEncoder::Encode(&document, buffer, capacity, written);
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE CompleteXRayStartup()
+{
+    if (!StartupTimeline::IsActive())
+    {
+        return S_FALSE;
+    }
+
+    StartupTimeline::Complete();
+
+    return S_OK;
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayStartupSummary(StartupSummary* summary)
+{
+    return StartupTimeline::GetSummary(summary);
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayStartupAssembly(ULONG index, StartupAssemblyTiming* timing)
+{
+    return StartupTimeline::GetAssembly(index, timing);
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE EncodeXRayStartupSubsegment(LPCWSTR traceId, LPCWSTR parentId, BYTE* buffer, ULONG capacity, ULONG* written)
+{
+    return StartupTimeline::Encode(traceId, parentId, buffer, capacity, written);
+}
@@ -0,0 +1,140 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include "cor.h"
+#include "corprof.h"
+#include "Clock.h"
+
+#define StartupTimelineVariable L"AWS_XRAY_PROFILER_STARTUP_TIMELINE"
+#define StartupMaximumAssemblies 512
+#define StartupAssemblyNameLength 128
+#define StartupSlowestAssemblies 3
+#define StartupSubsegmentName L"startup"
+#define StartupCacheLine 64
+
+#define StartupPhaseAssembly 0
+#define StartupPhaseModule 1
+#define StartupPhaseClass 2
+#define StartupPhaseJit 3
+#define StartupPhaseCount 4
+
+typedef struct
+{
+    double processStartTime;
+    double profilerStartTime;
+    double endTime;
+    ULONG assemblyCount;
+    ULONG completed;
+    ULONG64 counts[StartupPhaseCount];
+    ULONG64 microseconds[StartupPhaseCount];
+    ULONG64 profilerMicroseconds;
+} StartupSummary;
+
+typedef struct
+{
+    ULONG64 startOffsetMicroseconds;
+    ULONG64 loadMicroseconds;
+    WCHAR name[StartupAssemblyNameLength];
+} StartupAssemblyTiming;
+
+// Opt-in timeline of the runtime's startup, enabled by AWS_XRAY_PROFILER_STARTUP_TIMELINE.
+// The started/finished callbacks of assembly, module and class loads and of JIT compilation are
+// paired per thread; a phase is timed from its outermost callback, so a class load inside a JIT
+// compilation counts once for each phase. Assemblies are also timed one by one, and the time spent
+// in the profiler's own callbacks is kept apart. Each thread counts into its own block, so a storm of
+// JIT callbacks on many cores never writes a shared cache line; blocks are linked into a list and
+// summed when the summary is read. CompleteXRayStartup, called by the SDK once the first request is
+// served, freezes the timeline and drops the event mask bits only it asked for.
+class StartupTimeline
+{
+public:
+    static DWORD Initialize(ICorProfilerInfo5* profilerInfo, DWORD eventMask);
+    static void Shutdown();
+    static void Complete();
+
+    static inline bool IsActive()
+    {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    static void Begin(ULONG phase);
+    static void End(ULONG phase);
+    static void AssemblyStarted(AssemblyID assemblyId);
+    static void AssemblyFinished(AssemblyID assemblyId);
+    static void AddProfilerTime(LONG64 elapsed);
+
+    static HRESULT GetSummary(StartupSummary* summary);
+    static HRESULT GetAssembly(ULONG index, StartupAssemblyTiming* timing);
+    static HRESULT Encode(LPCWSTR traceId, LPCWSTR parentId, BYTE* buffer, ULONG capacity, ULONG* written);
+
+private:
+    struct StartupAssembly
+    {
+        AssemblyID assemblyId;
+        LONG64 started;
+        LONG64 elapsed;
+        WCHAR name[StartupAssemblyNameLength];
+    };
+
+    struct ThreadPhase
+    {
+        ULONG depth;
+        LONG64 started;
+    };
+
+    // Aligned so that blocks of different threads never share a line
+    struct alignas(StartupCacheLine) ThreadTimeline
+    {
+        ThreadPhase phases[StartupPhaseCount];
+        std::atomic<ULONG64> counts[StartupPhaseCount];
+        std::atomic<LONG64> elapsed[StartupPhaseCount];
+        std::atomic<LONG64> profilerElapsed;
+        ThreadTimeline* next;
+    };
+
+    static ThreadTimeline* GetThreadTimeline();
+    static double ToEpochSeconds(LONG64 counter);
+    static ULONG64 ToMicroseconds(LONG64 elapsed);
+
+    static ICorProfilerInfo5* profilerInfo;
+    static DWORD addedEventMask;
+    static std::atomic<bool> active;
+    static double processStartTime;
+    static LONG64 startCounter;
+    static LONG64 startEpochMicroseconds;
+    static std::atomic<LONG64> endCounter;
+    static std::atomic<ThreadTimeline*> threads;
+    static std::mutex assembliesLock;
+    static StartupAssembly* assemblies;
+    static ULONG assemblyCount;
+    static thread_local ThreadTimeline* threadTimeline;
+};
+
+// Times one profiler callback while the timeline is running
+class StartupTimer
+{
+public:
+    StartupTimer(bool available = true) : started(available && StartupTimeline::IsActive() ? Clock::GetCounter() : 0)
+    {
+    }
+
+    ~StartupTimer()
+    {
+        if (started != 0)
+        {
+            StartupTimeline::AddProfilerTime(Clock::GetCounter() - started);
+        }
+    }
+
+private:
+    LONG64 started;
+};
+
+extern "C" HRESULT STDMETHODCALLTYPE CompleteXRayStartup();
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayStartupSummary(StartupSummary* summary);
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayStartupAssembly(ULONG index, StartupAssemblyTiming* timing);
+extern "C" HRESULT STDMETHODCALLTYPE EncodeXRayStartupSubsegment(LPCWSTR traceId, LPCWSTR parentId, BYTE* buffer, ULONG capacity, ULONG* written);
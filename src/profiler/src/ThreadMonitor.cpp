@@ -0,0 +1,305 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "Clock.h"
+#include "Environment.h"
+#include "Journal.h"
+#include "ThreadMonitor.h"
+#include "TraceContext.h"
+
+#define ThreadMonitorNameLength 256
+
+ULONG ThreadMonitor::threshold = 0;
+ULONG ThreadMonitor::windowSamples = 1;
+HANDLE ThreadMonitor::stopEvent = NULL;
+HANDLE ThreadMonitor::watchdog = NULL;
+std::mutex ThreadMonitor::threadsLock;
+std::unordered_map<ThreadID, ThreadMonitor::MonitoredThread> ThreadMonitor::threads;
+bool ThreadMonitor::poolWorkersNamed = false;
+std::atomic<ULONG64> ThreadMonitor::created(0);
+std::atomic<ULONG64> ThreadMonitor::destroyed(0);
+ULONG64 ThreadMonitor::createdSamples[ThreadMonitorMaximumWindowSamples] = { 0 };
+ULONG ThreadMonitor::sampleIndex = 0;
+std::atomic<bool> ThreadMonitor::starving(false);
+std::atomic<ULONG> ThreadMonitor::poolThreads(0);
+std::atomic<ULONG> ThreadMonitor::blockedThreads(0);
+std::atomic<ULONG64> ThreadMonitor::longestBlocked(0);
+std::atomic<ULONG64> ThreadMonitor::longestBlockedSegment(0);
+std::atomic<ULONG64> ThreadMonitor::injectedInWindow(0);
+std::atomic<ULONG64> ThreadMonitor::episodes(0);
+std::atomic<LONG64> ThreadMonitor::starvingSince(0);
+
+DWORD ThreadMonitor::Initialize()
+{
+    if (stopEvent != NULL)
+    {
+        return 0;
+    }
+
+    threshold = Environment::GetULong(ThreadMonitorThresholdVariable, 0);
+    if (threshold == 0)
+    {
+        return 0;
+    }
+
+    // Injection is looked for over the last threshold worth of samples
+    windowSamples = threshold / ThreadMonitorSampleIntervalMilliseconds;
+    if (windowSamples == 0)
+    {
+        windowSamples = 1;
+    }
+    else if (windowSamples > ThreadMonitorMaximumWindowSamples)
+    {
+        windowSamples = ThreadMonitorMaximumWindowSamples;
+    }
+
+    stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (stopEvent == NULL)
+    {
+        threshold = 0;
+        return 0;
+    }
+
+    watchdog = CreateThread(NULL, 0, WatchdogThread, NULL, 0, NULL);
+    if (watchdog == NULL)
+    {
+        threshold = 0;
+        return 0;
+    }
+
+    return COR_PRF_MONITOR_THREADS;
+}
+
+void ThreadMonitor::Shutdown()
+{
+    if (watchdog == NULL)
+    {
+        return;
+    }
+
+    // The watchdog samples the thread handles, so they are only closed once it has exited
+    SetEvent(stopEvent);
+    WaitForSingleObject(watchdog, INFINITE);
+    CloseHandle(watchdog);
+    watchdog = NULL;
+
+    std::lock_guard<std::mutex> guard(threadsLock);
+
+    threshold = 0;
+    for (auto& entry : threads)
+    {
+        CloseThread(&entry.second);
+    }
+
+    threads.clear();
+}
+
+void ThreadMonitor::Add(ThreadID threadId)
+{
+    std::lock_guard<std::mutex> guard(threadsLock);
+
+    MonitoredThread& thread = threads[threadId];
+    thread.progressed = Clock::GetCounter();
+    created.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ThreadMonitor::Remove(ThreadID threadId)
+{
+    std::lock_guard<std::mutex> guard(threadsLock);
+
+    auto entry = threads.find(threadId);
+    if (entry != threads.end())
+    {
+        CloseThread(&entry->second);
+        threads.erase(entry);
+        destroyed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void ThreadMonitor::Assign(ThreadID threadId, DWORD osThreadId)
+{
+    std::lock_guard<std::mutex> guard(threadsLock);
+
+    MonitoredThread& thread = threads[threadId];
+    CloseThread(&thread);
+
+    // A handle that cannot be opened leaves the thread out of the samples rather than always blocked
+    thread.osThread = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE, osThreadId);
+    thread.cycles = 0;
+    thread.progressed = Clock::GetCounter();
+}
+
+void ThreadMonitor::SetName(ThreadID threadId, ULONG nameLength, const WCHAR* name)
+{
+    if (name == NULL)
+    {
+        return;
+    }
+
+    // The runtime passes the name without a terminator
+    WCHAR threadName[ThreadMonitorNameLength];
+    ULONG length = nameLength < ThreadMonitorNameLength - 1 ? nameLength : ThreadMonitorNameLength - 1;
+    memcpy(threadName, name, length * sizeof(WCHAR));
+    threadName[length] = L'\0';
+
+    bool poolWorker = wcsstr(threadName, ThreadMonitorPoolWorkerName) != NULL;
+    std::lock_guard<std::mutex> guard(threadsLock);
+
+    auto entry = threads.find(threadId);
+    if (entry != threads.end())
+    {
+        entry->second.poolWorker = poolWorker;
+        poolWorkersNamed |= poolWorker;
+    }
+}
+
+void ThreadMonitor::CloseThread(MonitoredThread* thread)
+{
+    if (thread->osThread != NULL)
+    {
+        CloseHandle(thread->osThread);
+        thread->osThread = NULL;
+    }
+}
+
+DWORD WINAPI ThreadMonitor::WatchdogThread(LPVOID parameter)
+{
+    while (WaitForSingleObject(stopEvent, ThreadMonitorSampleIntervalMilliseconds) == WAIT_TIMEOUT)
+    {
+        Sample();
+    }
+
+    return 0;
+}
+
+void ThreadMonitor::Sample()
+{
+    LONG64 now = Clock::GetCounter();
+    LONG64 blockedAfter = Clock::GetFrequency() * ThreadMonitorSampleIntervalMilliseconds / 1000;
+    LONG64 thresholdTicks = Clock::GetFrequency() * threshold / 1000;
+    ULONG pool = 0;
+    ULONG blocked = 0;
+    LONG64 longest = 0;
+    ThreadID longestThread = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(threadsLock);
+
+        for (auto& entry : threads)
+        {
+            MonitoredThread& thread = entry.second;
+            if (thread.osThread == NULL || (poolWorkersNamed && !thread.poolWorker))
+            {
+                continue;
+            }
+
+            ULONG64 cycles = 0;
+            if (!QueryThreadCycleTime(thread.osThread, &cycles))
+            {
+                continue;
+            }
+
+            if (cycles - thread.cycles >= ThreadMonitorProgressCycles)
+            {
+                thread.progressed = now;
+            }
+
+            thread.cycles = cycles;
+            pool++;
+
+            LONG64 stalled = now - thread.progressed;
+            if (stalled >= blockedAfter)
+            {
+                blocked++;
+                if (stalled > longest)
+                {
+                    longest = stalled;
+                    longestThread = entry.first;
+                }
+            }
+        }
+    }
+
+    // A thread that exited since is simply not found
+    TraceContextIds ids;
+    ULONG64 segment = longestThread != 0 && TraceContext::Find(longestThread, &ids) ? ids.words[2] : 0;
+
+    // The slot about to be overwritten holds the count from one window ago
+    ULONG64 createdNow = created.load(std::memory_order_relaxed);
+    ULONG slot = sampleIndex++ % windowSamples;
+    ULONG64 injected = createdNow - createdSamples[slot];
+    createdSamples[slot] = createdNow;
+
+    poolThreads.store(pool, std::memory_order_relaxed);
+    blockedThreads.store(blocked, std::memory_order_relaxed);
+    longestBlocked.store((ULONG64)(longest * 1000 / Clock::GetFrequency()), std::memory_order_relaxed);
+    longestBlockedSegment.store(segment, std::memory_order_relaxed);
+    injectedInWindow.store(injected, std::memory_order_relaxed);
+
+    bool mostlyBlocked = pool > 0 && (ULONG64)blocked * 100 >= (ULONG64)pool * ThreadMonitorBlockedPercent;
+
+    if (!starving.load(std::memory_order_relaxed) && mostlyBlocked && injected > 0 && longest >= thresholdTicks)
+    {
+        starvingSince.store(Clock::GetEpochMicroseconds(), std::memory_order_relaxed);
+        episodes.fetch_add(1, std::memory_order_relaxed);
+        starving.store(true, std::memory_order_relaxed);
+        Journal::Write(JournalStarvationStarted, JournalSiteNone, ((ULONG64)blocked << 32) | pool);
+
+        if (segment != 0)
+        {
+            Journal::Write(JournalStarvationSegment, JournalSiteNone, segment);
+        }
+    }
+    else if (starving.load(std::memory_order_relaxed) && !mostlyBlocked)
+    {
+        starving.store(false, std::memory_order_relaxed);
+        Journal::Write(JournalStarvationEnded, JournalSiteNone, Clock::GetEpochMicroseconds() - starvingSince.load(std::memory_order_relaxed));
+        starvingSince.store(0, std::memory_order_relaxed);
+    }
+}
+
+HRESULT ThreadMonitor::GetStatus(ThreadPoolStatus* status)
+{
+    if (status == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    memset(status, 0, sizeof(ThreadPoolStatus));
+
+    if (threshold == 0)
+    {
+        return S_FALSE;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(threadsLock);
+        status->liveThreads = (ULONG)threads.size();
+    }
+
+    LONG64 since = starvingSince.load(std::memory_order_relaxed);
+
+    status->poolThreads = poolThreads.load(std::memory_order_relaxed);
+    status->blockedThreads = blockedThreads.load(std::memory_order_relaxed);
+    status->starving = IsStarving() ? TRUE : FALSE;
+    status->createdThreads = created.load(std::memory_order_relaxed);
+    status->destroyedThreads = destroyed.load(std::memory_order_relaxed);
+    status->injectionRate = injectedInWindow.load(std::memory_order_relaxed) * 1000.0 / (windowSamples * ThreadMonitorSampleIntervalMilliseconds);
+    status->longestBlockedMilliseconds = longestBlocked.load(std::memory_order_relaxed);
+    status->longestBlockedSegment = longestBlockedSegment.load(std::memory_order_relaxed);
+    status->starvationEpisodes = episodes.load(std::memory_order_relaxed);
+    status->starvingSince = since != 0 ? (double)since / MicrosecondsPerSecond : 0;
+
+    return S_OK;
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayThreadPoolStatus(ThreadPoolStatus* status)
+{
+    return ThreadMonitor::GetStatus(status);
+}
+
+extern "C" BOOL STDMETHODCALLTYPE IsXRayThreadPoolStarving()
+{
+    return ThreadMonitor::IsStarving() ? TRUE : FALSE;
+}
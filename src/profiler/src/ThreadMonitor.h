@@ -0,0 +1,100 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include "cor.h"
+#include "corprof.h"
+
+#define ThreadMonitorThresholdVariable L"AWS_XRAY_PROFILER_STARVATION_THRESHOLD"
+#define ThreadMonitorSampleIntervalMilliseconds 100
+#define ThreadMonitorMaximumWindowSamples 64
+#define ThreadMonitorBlockedPercent 90
+#define ThreadMonitorProgressCycles 100000
+#define ThreadMonitorPoolWorkerName L"ThreadPool Worker"
+
+typedef struct
+{
+    ULONG liveThreads;
+    ULONG poolThreads;
+    ULONG blockedThreads;
+    ULONG starving;
+    ULONG64 createdThreads;
+    ULONG64 destroyedThreads;
+    double injectionRate;
+    ULONG64 longestBlockedMilliseconds;
+    ULONG64 starvationEpisodes;
+    double starvingSince;
+    ULONG64 longestBlockedSegment;
+} ThreadPoolStatus;
+
+// Thread-pool starvation detector, enabled by AWS_XRAY_PROFILER_STARVATION_THRESHOLD (milliseconds).
+// The thread callbacks keep the set of live managed threads and their OS threads. A watchdog reads
+// every thread's cycle counter each sample interval, a thread whose counter stood still is blocked.
+// An idle pool looks the same, so starvation is only raised while the runtime keeps injecting
+// threads into a pool that is almost entirely blocked, one of them for longer than the threshold,
+// and cleared once enough of the pool makes progress again. Pool workers are told apart by name
+// where the runtime names them, otherwise every managed thread counts. Transitions are journaled.
+// The longest-blocked thread is looked up in the trace context table, so the status and the journal
+// name the segment it was working on, zero when it had none.
+class ThreadMonitor
+{
+public:
+    static DWORD Initialize();
+    static void Shutdown();
+
+    static inline bool IsEnabled()
+    {
+        return threshold != 0;
+    }
+
+    static inline bool IsStarving()
+    {
+        return starving.load(std::memory_order_relaxed);
+    }
+
+    static void Add(ThreadID threadId);
+    static void Remove(ThreadID threadId);
+    static void Assign(ThreadID threadId, DWORD osThreadId);
+    static void SetName(ThreadID threadId, ULONG nameLength, const WCHAR* name);
+    static HRESULT GetStatus(ThreadPoolStatus* status);
+
+private:
+    struct MonitoredThread
+    {
+        HANDLE osThread;
+        bool poolWorker;
+        ULONG64 cycles;
+        LONG64 progressed;
+    };
+
+    static DWORD WINAPI WatchdogThread(LPVOID parameter);
+    static void Sample();
+    static void CloseThread(MonitoredThread* thread);
+
+    static ULONG threshold;
+    static ULONG windowSamples;
+    static HANDLE stopEvent;
+    static HANDLE watchdog;
+    static std::mutex threadsLock;
+    static std::unordered_map<ThreadID, MonitoredThread> threads;
+    static bool poolWorkersNamed;
+    static std::atomic<ULONG64> created;
+    static std::atomic<ULONG64> destroyed;
+    static ULONG64 createdSamples[ThreadMonitorMaximumWindowSamples];
+    static ULONG sampleIndex;
+    static std::atomic<bool> starving;
+    static std::atomic<ULONG> poolThreads;
+    static std::atomic<ULONG> blockedThreads;
+    static std::atomic<ULONG64> longestBlocked;
+    static std::atomic<ULONG64> longestBlockedSegment;
+    static std::atomic<ULONG64> injectedInWindow;
+    static std::atomic<ULONG64> episodes;
+    static std::atomic<LONG64> starvingSince;
+};
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayThreadPoolStatus(ThreadPoolStatus* status);
+extern "C" BOOL STDMETHODCALLTYPE IsXRayThreadPoolStarving();
@@ -0,0 +1,512 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "Clock.h"
+#include "CpuTime.h"
+#include "Epoch.h"
+#include "TraceContext.h"
+
+ICorProfilerInfo* TraceContext::profilerInfo = NULL;
+bool TraceContext::indexThreads = false;
+thread_local TraceContext::ThreadSlot TraceContext::threadSlot = { nullptr, false };
+std::atomic<ThreadID> TraceContext::tableKeys[TraceContextTableSize];
+std::atomic<TraceContext::ContextSlot*> TraceContext::tableSlots[TraceContextTableSize];
+std::atomic<ULONG64> TraceContext::cpuKeys[TraceContextCpuTableSize];
+std::atomic<ULONG64> TraceContext::cpuTotals[TraceContextCpuTableSize];
+std::atomic<ULONG64> TraceContext::cpuTouched[TraceContextCpuTableSize];
+
+TraceContext::ThreadSlot::~ThreadSlot()
+{
+    // No other thread can reach a slot that was never indexed
+    if (slot != nullptr && !indexed)
+    {
+        delete slot;
+    }
+}
+
+void TraceContext::Initialize(ICorProfilerInfo* profilerInfo, bool indexThreads)
+{
+    if (TraceContext::profilerInfo != NULL)
+    {
+        return;
+    }
+
+    profilerInfo->AddRef();
+    TraceContext::profilerInfo = profilerInfo;
+
+    // Without ThreadDestroyed an indexed entry could never be removed
+    TraceContext::indexThreads = indexThreads;
+}
+
+void TraceContext::Shutdown()
+{
+    if (profilerInfo != NULL)
+    {
+        profilerInfo->Release();
+        profilerInfo = NULL;
+    }
+}
+
+TraceContext::ContextSlot* TraceContext::GetThreadSlot()
+{
+    ContextSlot* slot = threadSlot.slot;
+    if (slot != nullptr)
+    {
+        return slot;
+    }
+
+    slot = new ContextSlot();
+    slot->sequence.store(0, std::memory_order_relaxed);
+    slot->generation.store(0, std::memory_order_relaxed);
+    slot->cpuStarted = 0;
+
+    for (ULONG i = 0; i < TraceContextWords; i++)
+    {
+        slot->words[i].store(0, std::memory_order_relaxed);
+    }
+
+    // The SDK calls in on managed threads, so the runtime knows the caller
+    ThreadID threadId = 0;
+    bool indexed = indexThreads && profilerInfo != NULL && SUCCEEDED(profilerInfo->GetCurrentThreadID(&threadId)) &&
+                   threadId != 0 && Bind(threadId, slot);
+
+    threadSlot.slot = slot;
+    threadSlot.indexed = indexed;
+
+    return slot;
+}
+
+ULONG TraceContext::GetThreadHome(ThreadID threadId)
+{
+    return (ULONG)(((ULONG64)threadId * 0x9E3779B97F4A7C15ULL) >> (64 - TraceContextTableBits));
+}
+
+bool TraceContext::Bind(ThreadID threadId, ContextSlot* slot)
+{
+    ULONG start = GetThreadHome(threadId);
+    ULONG empty = TraceContextMaximumProbes;
+
+    for (ULONG i = 0; i < TraceContextMaximumProbes; i++)
+    {
+        ULONG index = (start + i) & (TraceContextTableSize - 1);
+        ThreadID key = tableKeys[index].load(std::memory_order_acquire);
+
+        // An entry ThreadDestroyed was not called for belongs to a thread that is gone
+        if (key == threadId)
+        {
+            ContextSlot* replaced = tableSlots[index].exchange(slot, std::memory_order_acq_rel);
+            if (replaced != nullptr)
+            {
+                Epoch::Retire(replaced, ReleaseSlot);
+            }
+
+            return true;
+        }
+
+        if (key == 0 && empty == TraceContextMaximumProbes)
+        {
+            empty = i;
+        }
+    }
+
+    // Only the thread itself binds its ThreadID, so an entry lost to another thread is simply passed
+    for (ULONG i = empty; i < TraceContextMaximumProbes; i++)
+    {
+        ULONG index = (start + i) & (TraceContextTableSize - 1);
+        ThreadID expected = 0;
+
+        if (tableKeys[index].compare_exchange_strong(expected, threadId, std::memory_order_acq_rel))
+        {
+            tableSlots[index].store(slot, std::memory_order_release);
+            return true;
+        }
+    }
+
+    // A full window leaves the thread out of cross-thread lookups, its own context still works
+    return false;
+}
+
+void TraceContext::Unbind(ThreadID threadId)
+{
+    if (!indexThreads)
+    {
+        return;
+    }
+
+    ULONG start = GetThreadHome(threadId);
+
+    for (ULONG i = 0; i < TraceContextMaximumProbes; i++)
+    {
+        ULONG index = (start + i) & (TraceContextTableSize - 1);
+        if (tableKeys[index].load(std::memory_order_acquire) != threadId)
+        {
+            continue;
+        }
+
+        // Readers that found the entry before it is unlinked hold an epoch, the slot outlives them. The
+        // slot goes first, so the entry is empty again before another thread can take it over
+        ContextSlot* slot = tableSlots[index].exchange(nullptr, std::memory_order_acq_rel);
+        tableKeys[index].store(0, std::memory_order_release);
+
+        if (slot != nullptr)
+        {
+            // The runtime usually reports a thread's end on the thread itself
+            if (threadSlot.slot == slot)
+            {
+                threadSlot.slot = nullptr;
+                threadSlot.indexed = false;
+            }
+
+            Epoch::Retire(slot, ReleaseSlot);
+        }
+
+        return;
+    }
+}
+
+void TraceContext::ReleaseSlot(void* slot)
+{
+    delete (ContextSlot*)slot;
+}
+
+TraceContext::ContextSlot* TraceContext::Lookup(ThreadID threadId)
+{
+    ULONG start = GetThreadHome(threadId);
+
+    // Entries are emptied in place, so the probe covers the whole window instead of stopping at a gap
+    for (ULONG i = 0; i < TraceContextMaximumProbes; i++)
+    {
+        ULONG index = (start + i) & (TraceContextTableSize - 1);
+        if (tableKeys[index].load(std::memory_order_acquire) != threadId)
+        {
+            continue;
+        }
+
+        // The entry may have been taken over by another thread between the two loads
+        ContextSlot* slot = tableSlots[index].load(std::memory_order_acquire);
+
+        return tableKeys[index].load(std::memory_order_acquire) == threadId ? slot : nullptr;
+    }
+
+    return nullptr;
+}
+
+void TraceContext::Write(ContextSlot* slot, const ULONG64* words)
+{
+    // Single writer per slot: an odd sequence marks the words as being changed
+    ULONG sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (ULONG i = 0; i < TraceContextWords; i++)
+    {
+        slot->words[i].store(words[i], std::memory_order_relaxed);
+    }
+
+    if (words[0] != 0)
+    {
+        slot->generation.store(slot->generation.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool TraceContext::Read(ContextSlot* slot, TraceContextIds* ids)
+{
+    // The owner may be suspended halfway through a write, for a GC for instance, so readers give up
+    // after a few attempts instead of spinning
+    for (ULONG attempt = 0; attempt < TraceContextReadAttempts; attempt++)
+    {
+        ULONG sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence & 1)
+        {
+            continue;
+        }
+
+        for (ULONG i = 0; i < TraceContextWords; i++)
+        {
+            ids->words[i] = slot->words[i].load(std::memory_order_relaxed);
+        }
+
+        ids->generation = slot->generation.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->sequence.load(std::memory_order_relaxed) == sequence)
+        {
+            // Trace ids never carry a zero epoch, so zero words are a cleared context
+            return ids->words[0] != 0;
+        }
+    }
+
+    return false;
+}
+
+bool TraceContext::ParseHex(LPCWSTR text, int digits, ULONG64* value)
+{
+    ULONG64 result = 0;
+
+    for (int i = 0; i < digits; i++)
+    {
+        WCHAR c = text[i];
+        ULONG64 digit;
+
+        if (c >= L'0' && c <= L'9')
+        {
+            digit = c - L'0';
+        }
+        else if (c >= L'a' && c <= L'f')
+        {
+            digit = c - L'a' + 10;
+        }
+        else if (c >= L'A' && c <= L'F')
+        {
+            digit = c - L'A' + 10;
+        }
+        else
+        {
+            return false;
+        }
+
+        result = (result << 4) | digit;
+    }
+
+    *value = result;
+
+    return true;
+}
+
+HRESULT TraceContext::Set(LPCWSTR traceId, LPCWSTR segmentId)
+{
+    if (traceId == NULL || segmentId == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    // The parser stops at the first character that is not a hex digit, terminator included
+    ULONG64 epoch = 0;
+    ULONG64 high = 0;
+    ULONG64 low = 0;
+    ULONG64 segment = 0;
+
+    if (traceId[0] != TraceIdVersion || traceId[1] != TraceIdDelimiter ||
+        !ParseHex(traceId + 2, 8, &epoch) || traceId[10] != TraceIdDelimiter ||
+        !ParseHex(traceId + 11, 8, &high) || !ParseHex(traceId + 19, 16, &low) || traceId[TraceIdLength] != L'\0' ||
+        !ParseHex(segmentId, SegmentIdLength, &segment) || segmentId[SegmentIdLength] != L'\0' ||
+        epoch == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    ULONG64 words[TraceContextWords] = { (epoch << 32) | high, low, segment };
+    ContextSlot* slot = GetThreadSlot();
+
+    Write(slot, words);
+    slot->cpuStarted = CpuTime::GetThreadCounter();
+
+    return S_OK;
+}
+
+HRESULT TraceContext::Clear()
+{
+    ContextSlot* slot = threadSlot.slot;
+    if (slot == nullptr)
+    {
+        return S_FALSE;
+    }
+
+    ULONG64 words[TraceContextWords] = { 0 };
+    Write(slot, words);
+
+    return S_OK;
+}
+
+HRESULT TraceContext::Leave(ULONG64* cpuNanoseconds)
+{
+    return LeaveSegment(false, cpuNanoseconds);
+}
+
+HRESULT TraceContext::End(ULONG64* cpuNanoseconds)
+{
+    return LeaveSegment(true, cpuNanoseconds);
+}
+
+HRESULT TraceContext::LeaveSegment(bool end, ULONG64* cpuNanoseconds)
+{
+    if (cpuNanoseconds == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    *cpuNanoseconds = 0;
+
+    ContextSlot* slot = threadSlot.slot;
+    if (slot == nullptr || slot->words[0].load(std::memory_order_relaxed) == 0)
+    {
+        return S_FALSE;
+    }
+
+    ULONG64 now = CpuTime::GetThreadCounter();
+    ULONG64 spent = CpuTime::ToNanoseconds(now > slot->cpuStarted ? now - slot->cpuStarted : 0);
+
+    *cpuNanoseconds = AddCpuTime(slot->words[2].load(std::memory_order_relaxed), spent, end);
+
+    ULONG64 words[TraceContextWords] = { 0 };
+    Write(slot, words);
+
+    return S_OK;
+}
+
+ULONG64 TraceContext::AddCpuTime(ULONG64 segment, ULONG64 nanoseconds, bool end)
+{
+    if (segment == 0)
+    {
+        return nanoseconds;
+    }
+
+    // Segment ids are random, their low bits spread well enough
+    ULONG start = (ULONG)segment & (TraceContextCpuTableSize - 1);
+    ULONG64 now = (ULONG64)(Clock::GetCounter() / Clock::GetFrequency());
+    ULONG empty = TraceContextMaximumProbes;
+    ULONG abandoned = TraceContextMaximumProbes;
+    ULONG64 abandonedKey = 0;
+    ULONG64 oldest = now;
+
+    for (ULONG i = 0; i < TraceContextMaximumProbes; i++)
+    {
+        ULONG index = (start + i) & (TraceContextCpuTableSize - 1);
+        ULONG64 key = cpuKeys[index].load(std::memory_order_acquire);
+
+        if (key == segment)
+        {
+            cpuTouched[index].store(now, std::memory_order_relaxed);
+            ULONG64 total = cpuTotals[index].fetch_add(nanoseconds, std::memory_order_relaxed) + nanoseconds;
+
+            // Every piece was added by the time the segment ends; the entry is emptied for the next one
+            if (end)
+            {
+                total = cpuTotals[index].exchange(0, std::memory_order_relaxed);
+                cpuKeys[index].store(0, std::memory_order_release);
+            }
+
+            return total;
+        }
+
+        if (key == 0)
+        {
+            empty = empty == TraceContextMaximumProbes ? i : empty;
+            continue;
+        }
+
+        // A segment that left and never ended stops being touched
+        ULONG64 touched = cpuTouched[index].load(std::memory_order_relaxed);
+        if (touched + TraceContextCpuAbandonSeconds <= now && touched < oldest)
+        {
+            abandoned = i;
+            abandonedKey = key;
+            oldest = touched;
+        }
+    }
+
+    // A segment that ends with its first piece has nothing to keep
+    if (end)
+    {
+        return nanoseconds;
+    }
+
+    // Claimed entries start from zero, so continuations racing to claim the same segment all add up.
+    // Two of them can still claim two entries when one frees up ahead of the other's probe; the end
+    // then reports the first, and the second is reclaimed once abandoned
+    for (ULONG i = empty; i < TraceContextMaximumProbes; i++)
+    {
+        ULONG index = (start + i) & (TraceContextCpuTableSize - 1);
+        ULONG64 expected = 0;
+
+        if (cpuKeys[index].compare_exchange_strong(expected, segment, std::memory_order_acq_rel) || expected == segment)
+        {
+            cpuTouched[index].store(now, std::memory_order_relaxed);
+            return cpuTotals[index].fetch_add(nanoseconds, std::memory_order_relaxed) + nanoseconds;
+        }
+    }
+
+    // A full window takes over the entry left the longest, whatever it still held is dropped
+    if (abandoned != TraceContextMaximumProbes)
+    {
+        ULONG index = (start + abandoned) & (TraceContextCpuTableSize - 1);
+
+        if (cpuKeys[index].compare_exchange_strong(abandonedKey, segment, std::memory_order_acq_rel))
+        {
+            cpuTouched[index].store(now, std::memory_order_relaxed);
+            cpuTotals[index].store(nanoseconds, std::memory_order_relaxed);
+        }
+    }
+
+    return nanoseconds;
+}
+
+bool TraceContext::GetCurrent(TraceContextIds* ids)
+{
+    ContextSlot* slot = threadSlot.slot;
+
+    return slot != nullptr && Read(slot, ids);
+}
+
+bool TraceContext::Find(ThreadID threadId, TraceContextIds* ids)
+{
+    EpochGuard guard;
+    ContextSlot* slot = Lookup(threadId);
+
+    return slot != nullptr && Read(slot, ids);
+}
+
+HRESULT TraceContext::Get(ThreadID threadId, TraceContextInfo* info)
+{
+    if (info == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    memset(info, 0, sizeof(TraceContextInfo));
+
+    TraceContextIds ids;
+    if (!(threadId == 0 ? GetCurrent(&ids) : Find(threadId, &ids)))
+    {
+        return S_FALSE;
+    }
+
+    info->traceId[0] = TraceIdVersion;
+    info->traceId[1] = TraceIdDelimiter;
+    IdGenerator::WriteHex(info->traceId + 2, ids.words[0] >> 32, 8);
+    info->traceId[10] = TraceIdDelimiter;
+    IdGenerator::WriteHex(info->traceId + 11, ids.words[0] & 0xFFFFFFFF, 8);
+    IdGenerator::WriteHex(info->traceId + 19, ids.words[1], 16);
+    IdGenerator::WriteHex(info->segmentId, ids.words[2], SegmentIdLength);
+    info->generation = ids.generation;
+
+    return S_OK;
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE SetXRayTraceContext(LPCWSTR traceId, LPCWSTR segmentId)
+{
+    return TraceContext::Set(traceId, segmentId);
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE ClearXRayTraceContext()
+{
+    return TraceContext::Clear();
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE LeaveXRayTraceContext(ULONG64* cpuNanoseconds)
+{
+    return TraceContext::Leave(cpuNanoseconds);
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE EndXRayTraceContext(ULONG64* cpuNanoseconds)
+{
+    return TraceContext::End(cpuNanoseconds);
+}
+
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayTraceContext(ThreadID threadId, TraceContextInfo* info)
+{
+    return TraceContext::Get(threadId, info);
+}
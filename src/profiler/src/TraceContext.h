@@ -0,0 +1,108 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include "cor.h"
+#include "corprof.h"
+#include "IdGenerator.h"
+
+#define TraceContextTableBits 12
+#define TraceContextTableSize (1 << TraceContextTableBits)
+#define TraceContextReadAttempts 16
+#define TraceContextWords 3
+#define TraceContextMaximumProbes 32
+#define TraceContextCpuTableBits 12
+#define TraceContextCpuTableSize (1 << TraceContextCpuTableBits)
+#define TraceContextCpuAbandonSeconds 600
+
+typedef struct
+{
+    WCHAR traceId[TraceIdLength + 1];
+    WCHAR segmentId[SegmentIdLength + 1];
+    ULONG64 generation;
+} TraceContextInfo;
+
+// Trace ids in binary: the epoch and the first 32 random bits, the last 64 random bits, and the segment id
+typedef struct
+{
+    ULONG64 words[TraceContextWords];
+    ULONG64 generation;
+} TraceContextIds;
+
+// Trace and segment of the request each managed thread is working on. The SDK sets the context when
+// a segment or subsegment begins and clears it when it ends; the ids are kept in binary in a slot the
+// thread owns and finds through thread-local storage, so setting them writes four words and never
+// locks. When the runtime reports thread lifetimes, slots are also indexed by the profiler's ThreadID
+// in a fixed open-addressing table, so that callbacks and collectors running on another thread can
+// attribute what they see to the segment of the thread it concerns. Readers on other threads go
+// through a sequence count and never see half a context, and hold an epoch while they do:
+// ThreadDestroyed empties the thread's entry and retires its slot. A slot that was never indexed is
+// freed when its thread exits. Setting a context also notes the thread's CPU time counter. The SDK
+// leaves the context whenever a segment's work moves off a thread, at an await for instance, and sets
+// it again where the continuation runs; each leave converts the counter difference to nanoseconds and
+// adds it to the segment's total, kept in a second open-addressing table keyed by the segment id, so
+// continuations on any thread add up. Ending the context hands back the total and empties the entry.
+// Both tables probe a fixed window and empty entries in place rather than leave tombstones, so a probe
+// never costs more than the window however the tables churn. A segment that left and was never ended
+// gives up its entry to a new segment once untouched for TraceContextCpuAbandonSeconds; a segment that
+// finds its window full of live ones reports the CPU time of the last piece only.
+class TraceContext
+{
+public:
+    static void Initialize(ICorProfilerInfo* profilerInfo, bool indexThreads);
+    static void Shutdown();
+    static void Unbind(ThreadID threadId);
+
+    static HRESULT Set(LPCWSTR traceId, LPCWSTR segmentId);
+    static HRESULT Clear();
+    static HRESULT Leave(ULONG64* cpuNanoseconds);
+    static HRESULT End(ULONG64* cpuNanoseconds);
+    static bool GetCurrent(TraceContextIds* ids);
+    static bool Find(ThreadID threadId, TraceContextIds* ids);
+    static HRESULT Get(ThreadID threadId, TraceContextInfo* info);
+
+private:
+    struct ContextSlot
+    {
+        std::atomic<ULONG> sequence;
+        std::atomic<ULONG64> words[TraceContextWords];
+        std::atomic<ULONG64> generation;
+        ULONG64 cpuStarted; // owner only, in CpuTime counter units
+    };
+
+    // Frees the thread's slot when the thread exits, unless it is indexed and left to ThreadDestroyed
+    struct ThreadSlot
+    {
+        ContextSlot* slot;
+        bool indexed;
+        ~ThreadSlot();
+    };
+
+    static ContextSlot* GetThreadSlot();
+    static ULONG GetThreadHome(ThreadID threadId);
+    static bool Bind(ThreadID threadId, ContextSlot* slot);
+    static ContextSlot* Lookup(ThreadID threadId);
+    static HRESULT LeaveSegment(bool end, ULONG64* cpuNanoseconds);
+    static ULONG64 AddCpuTime(ULONG64 segment, ULONG64 nanoseconds, bool end);
+    static void ReleaseSlot(void* slot);
+    static void Write(ContextSlot* slot, const ULONG64* words);
+    static bool Read(ContextSlot* slot, TraceContextIds* ids);
+    static bool ParseHex(LPCWSTR text, int digits, ULONG64* value);
+
+    static ICorProfilerInfo* profilerInfo;
+    static bool indexThreads;
+    static thread_local ThreadSlot threadSlot;
+    static std::atomic<ThreadID> tableKeys[TraceContextTableSize];
+    static std::atomic<ContextSlot*> tableSlots[TraceContextTableSize];
+    static std::atomic<ULONG64> cpuKeys[TraceContextCpuTableSize];
+    static std::atomic<ULONG64> cpuTotals[TraceContextCpuTableSize];
+    static std::atomic<ULONG64> cpuTouched[TraceContextCpuTableSize]; // seconds of the Clock counter
+};
+
+extern "C" HRESULT STDMETHODCALLTYPE SetXRayTraceContext(LPCWSTR traceId, LPCWSTR segmentId);
+extern "C" HRESULT STDMETHODCALLTYPE ClearXRayTraceContext();
+extern "C" HRESULT STDMETHODCALLTYPE LeaveXRayTraceContext(ULONG64* cpuNanoseconds);
+extern "C" HRESULT STDMETHODCALLTYPE EndXRayTraceContext(ULONG64* cpuNanoseconds);
+extern "C" HRESULT STDMETHODCALLTYPE GetXRayTraceContext(ThreadID threadId, TraceContextInfo* info);
@@ -0,0 +1,202 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <vector>
+#include "CppUnitTest.h"
+#include "stdafx.h"
+#include "CallSites.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TestTarget 0x0A000005
+#define TestOtherTarget 0x0A000107
+#define TestParent 0x01000002 // compressed as 0x09
+
+namespace ClrProfilerTests
+{
+    static CallSiteReference CreateReference(mdMemberRef token, BYTE opcode)
+    {
+        CallSiteReference reference = { 0 };
+        reference.token = token;
+        reference.opcode = opcode;
+        reference.parent = TestParent;
+        reference.hook = mdTokenNil;
+
+        return reference;
+    }
+
+    // Appends opcode and token, little endian as in a method body
+    static void AppendInstruction(std::vector<BYTE>* code, BYTE opcode, ULONG token)
+    {
+        code->push_back(opcode);
+        for (int i = 0; i < 4; i++)
+        {
+            code->push_back((BYTE)(token >> (i * 8)));
+        }
+    }
+
+    static std::vector<BYTE> BuildHookSignature(const std::vector<BYTE>& signature, BYTE opcode, HRESULT expected)
+    {
+        BYTE hookSignature[CallSiteSignatureLength];
+        ULONG hookSignatureLength = 0;
+
+        Assert::AreEqual(expected, CallSites::BuildHookSignature(signature.data(), (ULONG)signature.size(), opcode, TestParent, hookSignature, &hookSignatureLength));
+
+        return SUCCEEDED(expected) ? std::vector<BYTE>(hookSignature, hookSignature + hookSignatureLength) : std::vector<BYTE>();
+    }
+
+    TEST_CLASS(CallSitesTest)
+    {
+    public:
+        TEST_METHOD(TestFindsSitesOnInstructionBoundaries)
+        {
+            std::vector<CallSiteReference> references = { CreateReference(TestTarget, CallSiteOpcodeCallvirt), CreateReference(TestOtherTarget, CallSiteOpcodeNewobj) };
+            std::vector<BYTE> code = { 0x02 };                   // ldarg.0
+            AppendInstruction(&code, CallSiteOpcodeCallvirt, TestTarget);
+            code.push_back(0x26);                                // pop
+            AppendInstruction(&code, CallSiteOpcodeNewobj, TestOtherTarget);
+            code.push_back(0x2A);                                // ret
+
+            std::vector<CallSite> sites;
+            Assert::AreEqual(2UL, (unsigned long)CallSites::Find(code.data(), (ULONG)code.size(), references, &sites));
+            Assert::AreEqual(2UL, (unsigned long)sites.size());
+            Assert::AreEqual(1UL, (unsigned long)sites[0].offset);
+            Assert::AreEqual(0UL, (unsigned long)sites[0].reference);
+            Assert::AreEqual(7UL, (unsigned long)sites[1].offset);
+            Assert::AreEqual(1UL, (unsigned long)sites[1].reference);
+        }
+
+        TEST_METHOD(TestFindsSitesAcrossScanBlocks)
+        {
+            // Sites in the first 16-byte block, straddling the next one and in the scalar tail
+            std::vector<CallSiteReference> references = { CreateReference(TestTarget, CallSiteOpcodeCall) };
+            std::vector<BYTE> code(3, 0x00);                     // nop
+            AppendInstruction(&code, CallSiteOpcodeCall, TestTarget);
+            code.resize(14, 0x00);
+            AppendInstruction(&code, CallSiteOpcodeCall, TestTarget);
+            code.resize(40, 0x00);
+            AppendInstruction(&code, CallSiteOpcodeCall, TestTarget);
+            code.push_back(0x2A);
+
+            std::vector<CallSite> sites;
+            Assert::AreEqual(3UL, (unsigned long)CallSites::Find(code.data(), (ULONG)code.size(), references, &sites));
+            Assert::AreEqual(3UL, (unsigned long)sites[0].offset);
+            Assert::AreEqual(14UL, (unsigned long)sites[1].offset);
+            Assert::AreEqual(40UL, (unsigned long)sites[2].offset);
+        }
+
+        TEST_METHOD(TestIgnoresOperandBytesThatLookLikeCalls)
+        {
+            std::vector<CallSiteReference> references = { CreateReference(TestTarget, CallSiteOpcodeCallvirt) };
+
+            // ldc.i4 0x0000056F; stloc.0; ret holds callvirt 0x0A000005 from its second byte on
+            std::vector<BYTE> code = { 0x20, CallSiteOpcodeCallvirt, 0x05, 0x00, 0x00, 0x0A, 0x2A };
+
+            std::vector<CallSite> sites;
+            Assert::AreEqual(0UL, (unsigned long)CallSites::Find(code.data(), (ULONG)code.size(), references, &sites));
+            Assert::IsTrue(sites.empty());
+        }
+
+        TEST_METHOD(TestMatchesOpcodeOfReference)
+        {
+            // An instance method is redirected from callvirt only, a call to it is a base call
+            std::vector<CallSiteReference> references = { CreateReference(TestTarget, CallSiteOpcodeCallvirt) };
+            std::vector<BYTE> code = { 0x02 };
+            AppendInstruction(&code, CallSiteOpcodeCall, TestTarget);
+            code.push_back(0x2A);
+
+            Assert::AreEqual(0UL, (unsigned long)CallSites::Find(code.data(), (ULONG)code.size(), references, NULL));
+        }
+
+        TEST_METHOD(TestSkipsConstrainedCallvirt)
+        {
+            std::vector<CallSiteReference> references = { CreateReference(TestTarget, CallSiteOpcodeCallvirt) };
+            std::vector<BYTE> code = { 0x03, 0xFE, 0x16, 0x09, 0x00, 0x00, 0x1B }; // ldarg.1; constrained. 0x1B000009
+            AppendInstruction(&code, CallSiteOpcodeCallvirt, TestTarget);
+            code.push_back(0x02);                                // ldarg.0
+            AppendInstruction(&code, CallSiteOpcodeCallvirt, TestTarget);
+            code.push_back(0x2A);
+
+            std::vector<CallSite> sites;
+            Assert::AreEqual(1UL, (unsigned long)CallSites::Find(code.data(), (ULONG)code.size(), references, &sites));
+            Assert::AreEqual(13UL, (unsigned long)sites[0].offset);
+        }
+
+        TEST_METHOD(TestStepsOverSwitchTargets)
+        {
+            std::vector<CallSiteReference> references = { CreateReference(TestTarget, CallSiteOpcodeCall) };
+
+            // switch (1 target) whose target bytes and the next opcode look like call 0x0A000005
+            std::vector<BYTE> code = { 0x06, 0x45, 0x01, 0x00, 0x00, 0x00, CallSiteOpcodeCall, 0x05, 0x00, 0x00, 0x0A };
+            AppendInstruction(&code, CallSiteOpcodeCall, TestTarget);
+            code.push_back(0x2A);
+
+            std::vector<CallSite> sites;
+            Assert::AreEqual(1UL, (unsigned long)CallSites::Find(code.data(), (ULONG)code.size(), references, &sites));
+            Assert::AreEqual(11UL, (unsigned long)sites[0].offset);
+        }
+
+        TEST_METHOD(TestLeavesUndecodableBodies)
+        {
+            std::vector<CallSiteReference> references = { CreateReference(TestTarget, CallSiteOpcodeCall) };
+            std::vector<CallSite> sites = { { 99, 0 } };
+
+            // An opcode the decoder does not know after a site
+            std::vector<BYTE> code;
+            AppendInstruction(&code, CallSiteOpcodeCall, TestTarget);
+            code.push_back(0xA6);
+            code.push_back(0x2A);
+            Assert::AreEqual(0UL, (unsigned long)CallSites::Find(code.data(), (ULONG)code.size(), references, &sites));
+
+            // An operand running past the end of the body
+            code.resize(5);
+            code.push_back(0x20);
+            code.push_back(0x01);
+            Assert::AreEqual(0UL, (unsigned long)CallSites::Find(code.data(), (ULONG)code.size(), references, &sites));
+
+            // Sites found before the failure are taken back, the ones already in the list are kept
+            Assert::AreEqual(1UL, (unsigned long)sites.size());
+            Assert::AreEqual(99UL, (unsigned long)sites[0].offset);
+        }
+
+        TEST_METHOD(TestKeepsStaticSignature)
+        {
+            // static int32 M(string)
+            std::vector<BYTE> signature = { 0x00, 0x01, ELEMENT_TYPE_I4, ELEMENT_TYPE_STRING };
+            Assert::IsTrue(signature == BuildHookSignature(signature, CallSiteOpcodeCall, S_OK));
+        }
+
+        TEST_METHOD(TestPassesReceiverAsFirstParameter)
+        {
+            // instance void M(int32) -> static void H(class Parent, int32)
+            std::vector<BYTE> signature = { IMAGE_CEE_CS_CALLCONV_HASTHIS, 0x01, ELEMENT_TYPE_VOID, ELEMENT_TYPE_I4 };
+            std::vector<BYTE> expected = { 0x00, 0x02, ELEMENT_TYPE_VOID, ELEMENT_TYPE_CLASS, 0x09, ELEMENT_TYPE_I4 };
+            Assert::IsTrue(expected == BuildHookSignature(signature, CallSiteOpcodeCallvirt, S_OK));
+        }
+
+        TEST_METHOD(TestCopiesComplexReturnType)
+        {
+            // instance class List`1<int32> M() -> static class List`1<int32> H(class Parent)
+            std::vector<BYTE> signature = { IMAGE_CEE_CS_CALLCONV_HASTHIS, 0x00, ELEMENT_TYPE_GENERICINST, ELEMENT_TYPE_CLASS, 0x0D, 0x01, ELEMENT_TYPE_I4 };
+            std::vector<BYTE> expected = { 0x00, 0x01, ELEMENT_TYPE_GENERICINST, ELEMENT_TYPE_CLASS, 0x0D, 0x01, ELEMENT_TYPE_I4, ELEMENT_TYPE_CLASS, 0x09 };
+            Assert::IsTrue(expected == BuildHookSignature(signature, CallSiteOpcodeCallvirt, S_OK));
+        }
+
+        TEST_METHOD(TestReturnsConstructedObject)
+        {
+            // instance void .ctor(string) -> static class Parent H(string)
+            std::vector<BYTE> signature = { IMAGE_CEE_CS_CALLCONV_HASTHIS, 0x01, ELEMENT_TYPE_VOID, ELEMENT_TYPE_STRING };
+            std::vector<BYTE> expected = { 0x00, 0x01, ELEMENT_TYPE_CLASS, 0x09, ELEMENT_TYPE_STRING };
+            Assert::IsTrue(expected == BuildHookSignature(signature, CallSiteOpcodeNewobj, S_OK));
+        }
+
+        TEST_METHOD(TestRejectsMalformedSignatures)
+        {
+            // A constructor that returns a value, a return type cut short, and a signature with no room for the receiver
+            BuildHookSignature({ IMAGE_CEE_CS_CALLCONV_HASTHIS, 0x00, ELEMENT_TYPE_I4 }, CallSiteOpcodeNewobj, META_E_BAD_SIGNATURE);
+            BuildHookSignature({ IMAGE_CEE_CS_CALLCONV_HASTHIS, 0x01, ELEMENT_TYPE_GENERICINST, ELEMENT_TYPE_CLASS }, CallSiteOpcodeCallvirt, META_E_BAD_SIGNATURE);
+            BuildHookSignature(std::vector<BYTE>(CallSiteSignatureLength, ELEMENT_TYPE_I4), CallSiteOpcodeCallvirt, E_INVALIDARG);
+            BuildHookSignature({ 0x00, 0x00 }, CallSiteOpcodeCall, E_INVALIDARG);
+        }
+    };
+}
@@ -0,0 +1,169 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <thread>
+#include <vector>
+#include "CppUnitTest.h"
+#include "stdafx.h"
+#include "Clock.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TestFrequency 10000000LL
+#define TestEpochMicroseconds 1600000000000000LL
+
+namespace ClrProfilerTests
+{
+    static LONG64 ReadWallClock()
+    {
+        FILETIME wallClock;
+        GetSystemTimePreciseAsFileTime(&wallClock);
+
+        ULONG64 fileTime = ((ULONG64)wallClock.dwHighDateTime << 32) | wallClock.dwLowDateTime;
+        return (LONG64)((fileTime - FileTimeUnixEpochOffset) / FileTimeTicksPerMicrosecond);
+    }
+
+    // Replays a wall clock that is offset from the counter's time at the next resync
+    static ClockAnchor ResyncAt(const ClockAnchor& anchor, LONG64 counter, LONG64 wallOffsetMicroseconds)
+    {
+        LONG64 wall = TestEpochMicroseconds + (counter - 1) * MicrosecondsPerSecond / TestFrequency + wallOffsetMicroseconds;
+        return Clock::Reanchor(anchor, counter, counter, wall, TestFrequency, TestFrequency);
+    }
+
+    static void AssertMonotonic(const ClockAnchor& previous, const ClockAnchor& next, LONG64 until)
+    {
+        LONG64 last = 0;
+
+        for (LONG64 counter = previous.counter; counter < until; counter += 997)
+        {
+            const ClockAnchor& anchor = counter < next.counter ? previous : next;
+            LONG64 value = Clock::ToEpochMicroseconds(anchor, counter, TestFrequency, TestFrequency);
+
+            Assert::IsTrue(value >= last);
+            last = value;
+        }
+    }
+
+    TEST_CLASS(ClockTest)
+    {
+    public:
+        TEST_METHOD(TestFirstAnchorTakesWallClock)
+        {
+            ClockAnchor none = { 0, 0, 0 };
+            ClockAnchor anchor = Clock::Reanchor(none, 1, 1, TestEpochMicroseconds, TestFrequency, TestFrequency);
+
+            Assert::AreEqual(TestEpochMicroseconds, anchor.epochMicroseconds);
+            Assert::AreEqual(0LL, anchor.slewTicks);
+            Assert::AreEqual(TestEpochMicroseconds + 1500000, Clock::ToEpochMicroseconds(anchor, 1 + TestFrequency * 3 / 2, TestFrequency, TestFrequency));
+        }
+
+        TEST_METHOD(TestSlewsStepBackOverOneInterval)
+        {
+            ClockAnchor anchor = { 1, TestEpochMicroseconds, 0 };
+            LONG64 counter = 1 + TestFrequency;
+
+            // The wall clock was set back by 5ms
+            ClockAnchor next = ResyncAt(anchor, counter, -5000);
+
+            Assert::AreEqual(Clock::ToEpochMicroseconds(anchor, counter, TestFrequency, TestFrequency), next.epochMicroseconds);
+            Assert::AreEqual(-50000LL, next.slewTicks);
+            AssertMonotonic(anchor, next, counter + TestFrequency * 2);
+
+            // One interval later the clock has caught up with the wall clock
+            Assert::AreEqual(TestEpochMicroseconds + 2000000 - 5000, Clock::ToEpochMicroseconds(next, counter + TestFrequency, TestFrequency, TestFrequency));
+        }
+
+        TEST_METHOD(TestSlewsSmallStepForward)
+        {
+            ClockAnchor anchor = { 1, TestEpochMicroseconds, 0 };
+            LONG64 counter = 1 + TestFrequency;
+
+            ClockAnchor next = ResyncAt(anchor, counter, 2000);
+
+            Assert::AreEqual(TestEpochMicroseconds + 1000000, next.epochMicroseconds);
+            Assert::AreEqual(20000LL, next.slewTicks);
+            Assert::AreEqual(TestEpochMicroseconds + 2000000 + 2000, Clock::ToEpochMicroseconds(next, counter + TestFrequency, TestFrequency, TestFrequency));
+        }
+
+        TEST_METHOD(TestStepsForwardWhenFarBehind)
+        {
+            ClockAnchor anchor = { 1, TestEpochMicroseconds, 0 };
+            LONG64 counter = 1 + TestFrequency;
+
+            ClockAnchor next = ResyncAt(anchor, counter, 3000000);
+
+            Assert::AreEqual(TestEpochMicroseconds + 4000000, next.epochMicroseconds);
+            Assert::AreEqual(0LL, next.slewTicks);
+            AssertMonotonic(anchor, next, counter + TestFrequency);
+        }
+
+        TEST_METHOD(TestLimitsSlewOfLargeStepBack)
+        {
+            ClockAnchor anchor = { 1, TestEpochMicroseconds, 0 };
+            LONG64 counter = 1 + TestFrequency;
+
+            // An hour back is corrected half an interval at a time, never by going backwards
+            for (int i = 0; i < 4; i++)
+            {
+                ClockAnchor next = ResyncAt(anchor, counter, -3600000000LL);
+
+                Assert::AreEqual(-TestFrequency / ClockMaximumSlewDivisor, next.slewTicks);
+                AssertMonotonic(anchor, next, counter + TestFrequency);
+
+                anchor = next;
+                counter += TestFrequency;
+            }
+        }
+
+        TEST_METHOD(TestTracksWallClockAcrossResyncs)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                LONG64 before = ReadWallClock();
+                LONG64 now = Clock::GetEpochMicroseconds();
+                LONG64 after = ReadWallClock();
+
+                // Drift over a resync interval stays far below a millisecond
+                Assert::IsTrue(now >= before - 1000 && now <= after + 1000);
+
+                Sleep(ClockResyncIntervalMilliseconds * 3 / 4);
+            }
+        }
+
+        TEST_METHOD(TestNeverStepsBackwardsUnderConcurrentResyncs)
+        {
+            std::vector<std::thread> threads;
+            std::vector<int> failures(4, 0);
+            LONG64 until = Clock::GetCounter() + Clock::GetFrequency() * 5 / 2;
+
+            for (size_t i = 0; i < failures.size(); i++)
+            {
+                threads.emplace_back([&failures, i, until]()
+                {
+                    LONG64 last = 0;
+
+                    while (Clock::GetCounter() < until)
+                    {
+                        LONG64 now = Clock::GetEpochMicroseconds();
+                        if (now < last)
+                        {
+                            failures[i]++;
+                        }
+
+                        last = now;
+                    }
+                });
+            }
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            for (int count : failures)
+            {
+                Assert::AreEqual(0, count);
+            }
+        }
+    };
+}
@@ -0,0 +1,178 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <thread>
+#include <vector>
+#include "CppUnitTest.h"
+#include "stdafx.h"
+#include "Epoch.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TestReaders 4
+#define TestRetires 20000
+#define TestPoison 0xDEADBEEFUL
+
+namespace ClrProfilerTests
+{
+    struct TestObject
+    {
+        std::atomic<ULONG> value;
+        std::atomic<LONG>* freed;
+    };
+
+    static void ReleaseTestObject(void* object)
+    {
+        TestObject* released = (TestObject*)object;
+
+        released->freed->fetch_add(1);
+        released->value.store(TestPoison);
+    }
+
+    static void ReleaseAndDelete(void* object)
+    {
+        TestObject* released = (TestObject*)object;
+
+        released->value.store(TestPoison);
+        released->freed->fetch_add(1);
+        delete released;
+    }
+
+    TEST_CLASS(EpochTest)
+    {
+    public:
+        TEST_METHOD(TestRetiredIsFreedWithoutReaders)
+        {
+            std::atomic<LONG> freed(0);
+            TestObject object = { { 1 }, &freed };
+
+            Epoch::Retire(&object, ReleaseTestObject);
+
+            Assert::AreEqual(1L, (long)freed.load());
+        }
+
+        TEST_METHOD(TestRetiredWaitsForReader)
+        {
+            std::atomic<LONG> freed(0);
+            TestObject object = { { 1 }, &freed };
+            std::atomic<int> step(0);
+
+            std::thread reader([&step]()
+            {
+                EpochGuard guard;
+
+                step.store(1);
+                while (step.load() != 2)
+                {
+                    std::this_thread::yield();
+                }
+            });
+
+            while (step.load() != 1)
+            {
+                std::this_thread::yield();
+            }
+
+            Epoch::Retire(&object, ReleaseTestObject);
+            Assert::AreEqual(0L, (long)freed.load());
+
+            step.store(2);
+            reader.join();
+
+            Epoch::Reclaim();
+            Assert::AreEqual(1L, (long)freed.load());
+        }
+
+        TEST_METHOD(TestReaderEnteringLaterDoesNotHoldRetired)
+        {
+            std::atomic<LONG> freed(0);
+            TestObject first = { { 1 }, &freed };
+            TestObject second = { { 2 }, &freed };
+
+            {
+                EpochGuard guard;
+                Epoch::Retire(&first, ReleaseTestObject);
+                Assert::AreEqual(0L, (long)freed.load());
+            }
+
+            {
+                // A reader that entered after the retire cannot have seen the object
+                EpochGuard guard;
+                Epoch::Reclaim();
+                Assert::AreEqual(1L, (long)freed.load());
+
+                Epoch::Retire(&second, ReleaseTestObject);
+                Assert::AreEqual(1L, (long)freed.load());
+            }
+
+            Epoch::Reclaim();
+            Assert::AreEqual(2L, (long)freed.load());
+        }
+
+        TEST_METHOD(TestNestedGuardsStayInside)
+        {
+            std::atomic<LONG> freed(0);
+            TestObject object = { { 1 }, &freed };
+
+            {
+                EpochGuard outer;
+                {
+                    EpochGuard inner;
+                }
+
+                Epoch::Retire(&object, ReleaseTestObject);
+                Assert::AreEqual(0L, (long)freed.load());
+            }
+
+            Epoch::Reclaim();
+            Assert::AreEqual(1L, (long)freed.load());
+        }
+
+        TEST_METHOD(TestReadersNeverSeeFreedObject)
+        {
+            std::atomic<LONG> freed(0);
+            std::atomic<TestObject*> published(new TestObject{ { 0 }, &freed });
+            std::atomic<bool> stopping(false);
+            std::vector<int> failures(TestReaders, 0);
+            std::vector<std::thread> readers;
+
+            for (int i = 0; i < TestReaders; i++)
+            {
+                readers.emplace_back([&, i]()
+                {
+                    while (!stopping.load(std::memory_order_relaxed))
+                    {
+                        EpochGuard guard;
+
+                        TestObject* current = published.load(std::memory_order_acquire);
+                        if (current->value.load(std::memory_order_relaxed) == TestPoison)
+                        {
+                            failures[i]++;
+                        }
+                    }
+                });
+            }
+
+            for (ULONG i = 1; i <= TestRetires; i++)
+            {
+                TestObject* replaced = published.exchange(new TestObject{ { i }, &freed }, std::memory_order_acq_rel);
+                Epoch::Retire(replaced, ReleaseAndDelete);
+            }
+
+            stopping.store(true);
+            for (std::thread& reader : readers)
+            {
+                reader.join();
+            }
+
+            Epoch::Reclaim();
+            delete published.load();
+
+            Assert::AreEqual((long)TestRetires, (long)freed.load());
+            for (int count : failures)
+            {
+                Assert::AreEqual(0, count);
+            }
+        }
+    };
+}
@@ -0,0 +1,173 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <vector>
+#include "CppUnitTest.h"
+#include "stdafx.h"
+#include "Governor.h"
+#include "Overhead.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TestBudgetMicroseconds 1000.0
+
+namespace ClrProfilerTests
+{
+    static std::vector<GovernedProbe> CreateProbes(std::initializer_list<double> microseconds)
+    {
+        std::vector<GovernedProbe> probes;
+
+        for (double cost : microseconds)
+        {
+            GovernedProbe probe = { 0 };
+            probe.microseconds = cost;
+            probe.enabled = true;
+            probes.push_back(probe);
+        }
+
+        return probes;
+    }
+
+    static ULONG CountEnabled(const std::vector<GovernedProbe>& probes)
+    {
+        ULONG enabled = 0;
+
+        for (const GovernedProbe& probe : probes)
+        {
+            enabled += probe.enabled ? 1 : 0;
+        }
+
+        return enabled;
+    }
+
+    // One governor interval: measures the enabled probes, ages the shed ones, balances, returns the transitions
+    static ULONG Interval(std::vector<GovernedProbe>& probes, double callbackMicroseconds, double lastProbeMicroseconds)
+    {
+        GovernedProbe& last = probes.back();
+        if (last.enabled)
+        {
+            last.microseconds = lastProbeMicroseconds;
+        }
+
+        for (GovernedProbe& probe : probes)
+        {
+            probe.changed = false;
+        }
+
+        Governor::Age(probes.data(), (ULONG)probes.size());
+        double current = Governor::Balance(callbackMicroseconds, probes.data(), (ULONG)probes.size(), TestBudgetMicroseconds);
+        Assert::IsTrue(current <= TestBudgetMicroseconds);
+
+        ULONG transitions = 0;
+        for (const GovernedProbe& probe : probes)
+        {
+            transitions += probe.changed ? 1 : 0;
+        }
+
+        return transitions;
+    }
+
+    TEST_CLASS(GovernorTest)
+    {
+    public:
+        TEST_METHOD(TestShedsBusiestProbesUntilWithinBudget)
+        {
+            std::vector<GovernedProbe> probes = CreateProbes({ 500, 100, 50, 300 });
+
+            double current = Governor::Balance(600, probes.data(), (ULONG)probes.size(), TestBudgetMicroseconds);
+
+            Assert::AreEqual(750.0, current);
+            Assert::IsFalse(probes[0].enabled);
+            Assert::IsTrue(probes[0].changed);
+            Assert::IsTrue(probes[1].enabled && probes[2].enabled);
+            Assert::IsFalse(probes[1].changed || probes[2].changed);
+            Assert::IsFalse(probes[3].enabled);
+            Assert::IsTrue(probes[3].changed);
+        }
+
+        TEST_METHOD(TestKeepsProbesWhenCallbacksAloneExceedBudget)
+        {
+            std::vector<GovernedProbe> probes = CreateProbes({ 500, 100, 50, 300 });
+
+            double current = Governor::Balance(1200, probes.data(), (ULONG)probes.size(), TestBudgetMicroseconds);
+
+            Assert::AreEqual(2150.0, current);
+            Assert::AreEqual(4UL, CountEnabled(probes));
+            for (const GovernedProbe& probe : probes)
+            {
+                Assert::IsFalse(probe.changed);
+            }
+        }
+
+        TEST_METHOD(TestRestoresQuietestWithinRestoreThreshold)
+        {
+            std::vector<GovernedProbe> probes = CreateProbes({ 500, 100, 50, 300 });
+            for (GovernedProbe& probe : probes)
+            {
+                probe.enabled = false;
+            }
+
+            // 100 of callbacks leaves 650 below the 75% threshold: 50, 100 and 300 fit, 500 does not
+            double current = Governor::Balance(100, probes.data(), (ULONG)probes.size(), TestBudgetMicroseconds);
+
+            Assert::AreEqual(550.0, current);
+            Assert::IsFalse(probes[0].enabled || probes[0].changed);
+            Assert::IsTrue(probes[1].enabled && probes[2].enabled && probes[3].enabled);
+        }
+
+        TEST_METHOD(TestSyntheticLoad)
+        {
+            // Callbacks stay at 400us per second while one probe's traffic bursts and calms down again
+            std::vector<GovernedProbe> probes = CreateProbes({ 20, 40, 60 });
+            double rates[] = { 20, 40, 60, 900, 900, 60, 60, 60, 60, 20 };
+            ULONG transitions = 0;
+
+            for (double rate : rates)
+            {
+                transitions += Interval(probes, 400, rate);
+            }
+
+            // The bursting probe was shed, decayed back under the restore threshold and measured quiet again
+            Assert::AreEqual(3UL, CountEnabled(probes));
+            Assert::AreEqual(2UL, transitions);
+            Assert::AreEqual(1UL, probes[2].decayIntervals);
+        }
+
+        TEST_METHOD(TestBacksOffFailedRestores)
+        {
+            // The probe never calms down, so every trial restore fails and the next one comes later
+            std::vector<GovernedProbe> probes = CreateProbes({ 20, 40, 900 });
+            ULONG restoresEarly = 0;
+            ULONG restoresLate = 0;
+
+            for (ULONG interval = 0; interval < 64; interval++)
+            {
+                Interval(probes, 400, 900);
+
+                if (probes[2].changed && probes[2].enabled)
+                {
+                    (interval < 32 ? restoresEarly : restoresLate)++;
+                }
+            }
+
+            Assert::IsTrue(restoresEarly >= 2);
+            Assert::IsTrue(restoresLate <= 1);
+            Assert::IsTrue(probes[0].enabled && probes[1].enabled);
+        }
+
+        TEST_METHOD(TestNestedTimersAreNotCallbackTime)
+        {
+            Overhead::Enable();
+            ULONG64 before = Overhead::GetCallbackNanoseconds();
+            LONG64 millisecond = Clock::GetFrequency() / 1000;
+
+            Overhead::Record(OverheadJITCompilationStarted, 3 * millisecond);
+            Overhead::Record(OverheadGetFunctionInfoFromId, millisecond);
+            Overhead::Record(OverheadILWriterWrite, millisecond);
+            Overhead::Record(OverheadThreadCreated, millisecond);
+
+            ULONG64 added = Overhead::GetCallbackNanoseconds() - before;
+            Assert::IsTrue(added >= 3999000 && added <= 4001000);
+        }
+    };
+}
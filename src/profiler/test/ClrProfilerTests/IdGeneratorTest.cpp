@@ -0,0 +1,183 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CppUnitTest.h"
+#include "stdafx.h"
+#include "Clock.h"
+#include "IdGenerator.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TestThreads 8
+#define TestIdsPerThread 250000
+#define TestDistributionSamples 100000
+#define TestChiSquareLimit 50.0 // 15 degrees of freedom, far beyond the 0.01% tail at 39.3
+
+namespace ClrProfilerTests
+{
+    static ULONG64 ParseHex(const WCHAR* text, int digits)
+    {
+        ULONG64 value = 0;
+
+        for (int i = 0; i < digits; i++)
+        {
+            WCHAR c = text[i];
+            Assert::IsTrue((c >= L'0' && c <= L'9') || (c >= L'a' && c <= L'f'));
+            value = (value << 4) | (ULONG64)(c <= L'9' ? c - L'0' : c - L'a' + 10);
+        }
+
+        return value;
+    }
+
+    static void GenerateSegmentIds(std::vector<ULONG64>* ids, size_t count)
+    {
+        WCHAR buffer[SegmentIdLength];
+        ids->reserve(count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            Assert::AreEqual(S_OK, IdGenerator::WriteSegmentId(buffer, SegmentIdLength));
+            ids->push_back(ParseHex(buffer, SegmentIdLength));
+        }
+    }
+
+    TEST_CLASS(IdGeneratorTest)
+    {
+    public:
+        TEST_METHOD(TestTraceIdFormat)
+        {
+            WCHAR buffer[TraceIdLength];
+            LONG64 before = Clock::GetEpochMicroseconds() / MicrosecondsPerSecond;
+
+            Assert::AreEqual(S_OK, IdGenerator::WriteTraceId(buffer, TraceIdLength));
+
+            LONG64 after = Clock::GetEpochMicroseconds() / MicrosecondsPerSecond;
+            Assert::AreEqual(TraceIdVersion, buffer[0]);
+            Assert::AreEqual(TraceIdDelimiter, buffer[1]);
+            Assert::AreEqual(TraceIdDelimiter, buffer[10]);
+
+            LONG64 epochSeconds = (LONG64)ParseHex(buffer + 2, 8);
+            Assert::IsTrue(epochSeconds >= before && epochSeconds <= after);
+            ParseHex(buffer + 11, 24);
+        }
+
+        TEST_METHOD(TestRejectsShortBuffers)
+        {
+            WCHAR buffer[TraceIdLength];
+
+            Assert::AreEqual(E_INVALIDARG, IdGenerator::WriteTraceId(buffer, TraceIdLength - 1));
+            Assert::AreEqual(E_INVALIDARG, IdGenerator::WriteTraceId(NULL, TraceIdLength));
+            Assert::AreEqual(E_INVALIDARG, IdGenerator::WriteSegmentId(buffer, SegmentIdLength - 1));
+            Assert::AreEqual(E_INVALIDARG, IdGenerator::WriteSegmentId(NULL, SegmentIdLength));
+        }
+
+        TEST_METHOD(TestSegmentIdsAreUniqueAcrossThreads)
+        {
+            std::vector<std::vector<ULONG64>> perThread(TestThreads);
+            std::vector<std::thread> threads;
+
+            for (size_t i = 0; i < perThread.size(); i++)
+            {
+                threads.emplace_back(GenerateSegmentIds, &perThread[i], (size_t)TestIdsPerThread);
+            }
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            std::vector<ULONG64> ids;
+            for (std::vector<ULONG64>& generated : perThread)
+            {
+                ids.insert(ids.end(), generated.begin(), generated.end());
+            }
+
+            std::sort(ids.begin(), ids.end());
+            Assert::IsTrue(std::adjacent_find(ids.begin(), ids.end()) == ids.end());
+        }
+
+        TEST_METHOD(TestTraceIdsAreUnique)
+        {
+            std::vector<std::wstring> ids;
+            WCHAR buffer[TraceIdLength];
+
+            for (int i = 0; i < TestIdsPerThread; i++)
+            {
+                IdGenerator::WriteTraceId(buffer, TraceIdLength);
+                ids.emplace_back(buffer + 11, 24);
+            }
+
+            std::sort(ids.begin(), ids.end());
+            Assert::IsTrue(std::adjacent_find(ids.begin(), ids.end()) == ids.end());
+        }
+
+        TEST_METHOD(TestThreadsAreSeededApart)
+        {
+            std::vector<ULONG64> first(TestThreads * 4);
+            std::vector<std::thread> threads;
+
+            for (size_t i = 0; i < first.size(); i++)
+            {
+                threads.emplace_back([&first, i]() { first[i] = IdGenerator::NextRandom(); });
+            }
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            std::sort(first.begin(), first.end());
+            Assert::IsTrue(std::adjacent_find(first.begin(), first.end()) == first.end());
+        }
+
+        TEST_METHOD(TestHexDigitsAreUniform)
+        {
+            std::vector<ULONG64> ids;
+            GenerateSegmentIds(&ids, TestDistributionSamples);
+
+            ULONG64 digits[16] = { 0 };
+            for (ULONG64 id : ids)
+            {
+                for (int i = 0; i < SegmentIdLength; i++)
+                {
+                    digits[(id >> (i * 4)) & 0xF]++;
+                }
+            }
+
+            double expected = (double)TestDistributionSamples * SegmentIdLength / 16;
+            double chiSquare = 0;
+            for (ULONG64 count : digits)
+            {
+                chiSquare += (count - expected) * (count - expected) / expected;
+            }
+
+            Assert::IsTrue(chiSquare < TestChiSquareLimit);
+        }
+
+        TEST_METHOD(TestBitsAreBalanced)
+        {
+            std::vector<ULONG64> ids;
+            GenerateSegmentIds(&ids, TestDistributionSamples);
+
+            // Each bit is set half the time, within six standard deviations
+            LONG64 limit = (LONG64)(6 * 0.5 * sqrt((double)TestDistributionSamples));
+
+            for (int bit = 0; bit < 64; bit++)
+            {
+                LONG64 set = 0;
+                for (ULONG64 id : ids)
+                {
+                    set += (id >> bit) & 1;
+                }
+
+                Assert::IsTrue(llabs(set - TestDistributionSamples / 2) <= limit);
+            }
+        }
+    };
+}
@@ -0,0 +1,217 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <string>
+#include "CppUnitTest.h"
+#include "stdafx.h"
+#include "MetadataReader.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace ClrProfilerTests
+{
+    // The .NET Framework's own assemblies are on every machine the tests run on
+    static std::wstring GetFrameworkPath(LPCWSTR fileName)
+    {
+        WCHAR windows[MAX_PATH];
+        GetWindowsDirectoryW(windows, MAX_PATH);
+
+#if defined(_WIN64)
+        return std::wstring(windows) + L"\\Microsoft.NET\\Framework64\\v4.0.30319\\" + fileName;
+#else
+        return std::wstring(windows) + L"\\Microsoft.NET\\Framework\\v4.0.30319\\" + fileName;
+#endif
+    }
+
+    // An assembly as it lies on disk, the flat layout the reader accepts next to the loader's
+    class FlatImage
+    {
+    public:
+        FlatImage(const std::wstring& path)
+        {
+            file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            mapping = file != INVALID_HANDLE_VALUE ? CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+            view = mapping != NULL ? (LPCBYTE)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        }
+
+        ~FlatImage()
+        {
+            if (view != NULL)
+            {
+                UnmapViewOfFile(view);
+            }
+
+            if (mapping != NULL)
+            {
+                CloseHandle(mapping);
+            }
+
+            if (file != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(file);
+            }
+        }
+
+        LPCBYTE view;
+
+    private:
+        HANDLE file;
+        HANDLE mapping;
+    };
+
+    // The same assembly mapped section by section, the layout of a module the runtime loaded
+    class MappedImage
+    {
+    public:
+        MappedImage(const std::wstring& path)
+        {
+            module = LoadLibraryExW(path.c_str(), NULL, LOAD_LIBRARY_AS_IMAGE_RESOURCE);
+
+            // The loader tags the handle of a resource mapping in its low bits
+            view = module != NULL ? (LPCBYTE)((ULONG_PTR)module & ~(ULONG_PTR)3) : NULL;
+        }
+
+        ~MappedImage()
+        {
+            if (module != NULL)
+            {
+                FreeLibrary(module);
+            }
+        }
+
+        LPCBYTE view;
+
+    private:
+        HMODULE module;
+    };
+
+    static IMetaDataImport* OpenScope(const std::wstring& path)
+    {
+        IMetaDataDispenser* dispenser = NULL;
+        IMetaDataImport* metaDataImport = NULL;
+
+        CoInitializeEx(NULL, COINIT_MULTITHREADED);
+        if (SUCCEEDED(CoCreateInstance(CLSID_CorMetaDataDispenser, NULL, CLSCTX_INPROC_SERVER, IID_IMetaDataDispenser, (void**)&dispenser)))
+        {
+            dispenser->OpenScope(path.c_str(), ofRead, IID_IMetaDataImport, (IUnknown**)&metaDataImport);
+            dispenser->Release();
+        }
+
+        return metaDataImport;
+    }
+
+    TEST_CLASS(MetadataReaderTest)
+    {
+    public:
+        TEST_METHOD(TestMatchesMetaDataImport)
+        {
+            std::wstring path = GetFrameworkPath(L"mscorlib.dll");
+            FlatImage image(path);
+            IMetaDataImport* metaDataImport = OpenScope(path);
+            MetadataReader reader;
+
+            Assert::IsNotNull(image.view);
+            Assert::IsNotNull(metaDataImport);
+            Assert::IsTrue(reader.Open(image.view, true));
+            Assert::IsTrue(reader.GetRowCount(MetadataTableMethodDef) > 10000);
+
+            // Every method of the core library, with its owner, flags, RVA and signature
+            for (ULONG rid = 1; rid <= reader.GetRowCount(MetadataTableMethodDef); rid++)
+            {
+                mdMethodDef token = TokenFromRid(rid, mdtMethodDef);
+                MetadataMethodDef methodDef;
+                WCHAR name[MetadataNameLength];
+                Assert::IsTrue(reader.GetMethodDef(token, &methodDef));
+                Assert::IsTrue(MetadataReader::GetName(methodDef.name, name, MetadataNameLength));
+
+                mdTypeDef owner = mdTypeDefNil;
+                WCHAR expectedName[MetadataNameLength];
+                ULONG expectedNameLength = 0;
+                DWORD flags = 0;
+                PCCOR_SIGNATURE signature = NULL;
+                ULONG signatureLength = 0;
+                ULONG rva = 0;
+                DWORD implFlags = 0;
+                Assert::AreEqual(S_OK, metaDataImport->GetMethodProps(token, &owner, expectedName, MetadataNameLength, &expectedNameLength,
+                                                                      &flags, &signature, &signatureLength, &rva, &implFlags));
+
+                Assert::AreEqual((LPCWSTR)expectedName, (LPCWSTR)name);
+                Assert::AreEqual((ULONG)owner, (ULONG)reader.GetMethodOwner(token));
+                Assert::AreEqual((ULONG)flags, (ULONG)methodDef.flags);
+                Assert::AreEqual((ULONG)implFlags, (ULONG)methodDef.implFlags);
+                Assert::AreEqual(rva, methodDef.rva);
+                Assert::AreEqual(signatureLength, methodDef.signatureLength);
+                Assert::AreEqual(0, memcmp(signature, methodDef.signature, signatureLength));
+            }
+
+            for (ULONG rid = 1; rid <= reader.GetRowCount(MetadataTableTypeDef); rid++)
+            {
+                mdTypeDef token = TokenFromRid(rid, mdtTypeDef);
+                MetadataTypeDef typeDef;
+                WCHAR name[MetadataNameLength];
+                Assert::IsTrue(reader.GetTypeDef(token, &typeDef));
+                Assert::IsTrue(MetadataReader::GetTypeName(typeDef.nameSpace, typeDef.name, name, MetadataNameLength));
+
+                WCHAR expectedName[MetadataNameLength];
+                ULONG expectedNameLength = 0;
+                DWORD flags = 0;
+                mdToken extends = mdTokenNil;
+                Assert::AreEqual(S_OK, metaDataImport->GetTypeDefProps(token, expectedName, MetadataNameLength, &expectedNameLength, &flags, &extends));
+
+                Assert::AreEqual((LPCWSTR)expectedName, (LPCWSTR)name);
+                Assert::AreEqual((ULONG)flags, (ULONG)typeDef.flags);
+                Assert::AreEqual((ULONG)extends, (ULONG)typeDef.extends);
+            }
+
+            metaDataImport->Release();
+        }
+
+        TEST_METHOD(TestReadsFlatAndMappedLayoutsAlike)
+        {
+            std::wstring path = GetFrameworkPath(L"System.dll");
+            FlatImage flatImage(path);
+            MappedImage mappedImage(path);
+            MetadataReader flatReader;
+            MetadataReader mappedReader;
+
+            Assert::IsNotNull(flatImage.view);
+            Assert::IsNotNull(mappedImage.view);
+            Assert::IsTrue(flatReader.Open(flatImage.view, true));
+            Assert::IsTrue(mappedReader.Open(mappedImage.view, false));
+            Assert::AreEqual(flatReader.GetRowCount(MetadataTableMethodDef), mappedReader.GetRowCount(MetadataTableMethodDef));
+
+            for (ULONG rid = 1; rid <= flatReader.GetRowCount(MetadataTableMethodDef); rid++)
+            {
+                mdMethodDef token = TokenFromRid(rid, mdtMethodDef);
+                MetadataMethodDef flatMethodDef;
+                MetadataMethodDef mappedMethodDef;
+                Assert::IsTrue(flatReader.GetMethodDef(token, &flatMethodDef));
+                Assert::IsTrue(mappedReader.GetMethodDef(token, &mappedMethodDef));
+
+                Assert::AreEqual(0, strcmp(flatMethodDef.name, mappedMethodDef.name));
+                Assert::AreEqual((ULONG)flatReader.GetMethodOwner(token), (ULONG)mappedReader.GetMethodOwner(token));
+
+                // A body sits at a different offset in each layout, but its bytes are the same
+                LPCBYTE flatBody = flatReader.GetMethodBody(flatMethodDef);
+                LPCBYTE mappedBody = mappedReader.GetMethodBody(mappedMethodDef);
+                Assert::AreEqual(flatBody == NULL, mappedBody == NULL);
+                if (flatBody != NULL)
+                {
+                    Assert::AreEqual((ULONG)flatBody[0], (ULONG)mappedBody[0]);
+                }
+            }
+        }
+
+        TEST_METHOD(TestRejectsNativeImage)
+        {
+            WCHAR system[MAX_PATH];
+            GetSystemDirectoryW(system, MAX_PATH);
+
+            FlatImage image(std::wstring(system) + L"\\kernel32.dll");
+            MetadataReader reader;
+
+            Assert::IsNotNull(image.view);
+            Assert::IsFalse(reader.Open(image.view, true));
+        }
+    };
+}
@@ -0,0 +1,105 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <thread>
+#include <vector>
+#include "CppUnitTest.h"
+#include "stdafx.h"
+#include "MethodTable.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TestFunctionStride 16
+#define TestFunctionCount 20000
+#define TestReaders 2
+#define TestRounds 4
+
+namespace ClrProfilerTests
+{
+    // FunctionIDs are aligned pointers; each test uses its own range so the shared table never mixes them
+    static FunctionID GetFunctionId(ULONG base, ULONG i)
+    {
+        return (FunctionID)(base + i) * TestFunctionStride;
+    }
+
+    static MethodDescriptor CreateDescriptor(FunctionID functionId)
+    {
+        MethodDescriptor descriptor = { 0 };
+        descriptor.functionId = functionId;
+        descriptor.moduleId = functionId % 3;
+        descriptor.token = (mdToken)(functionId / TestFunctionStride);
+
+        return descriptor;
+    }
+
+    TEST_CLASS(MethodTableTest)
+    {
+    public:
+        TEST_METHOD(TestFindsInsertedAndNotRemoved)
+        {
+            MethodDescriptor descriptor;
+
+            MethodTable::Insert(CreateDescriptor(GetFunctionId(1000000, 1)));
+            MethodTable::Insert(CreateDescriptor(GetFunctionId(1000000, 2)));
+            MethodTable::Remove(GetFunctionId(1000000, 1));
+
+            Assert::IsFalse(MethodTable::Find(GetFunctionId(1000000, 1), &descriptor));
+            Assert::IsTrue(MethodTable::Find(GetFunctionId(1000000, 2), &descriptor));
+            Assert::AreEqual((ULONG)(1000000 + 2), (ULONG)descriptor.token);
+
+            MethodTable::Remove(GetFunctionId(1000000, 2));
+        }
+
+        TEST_METHOD(TestReadersSurviveGrowth)
+        {
+            std::atomic<bool> stopping(false);
+            std::vector<int> failures(TestReaders, 0);
+            std::vector<std::thread> readers;
+
+            for (int i = 0; i < TestReaders; i++)
+            {
+                readers.emplace_back([&, i]()
+                {
+                    MethodDescriptor descriptor;
+
+                    while (!stopping.load(std::memory_order_relaxed))
+                    {
+                        for (ULONG j = 0; j < TestFunctionCount; j += 7)
+                        {
+                            FunctionID functionId = GetFunctionId(2000000, j);
+                            if (MethodTable::Find(functionId, &descriptor) && descriptor.token != (mdToken)(functionId / TestFunctionStride))
+                            {
+                                failures[i]++;
+                            }
+                        }
+                    }
+                });
+            }
+
+            // Every round grows the table past its capacity again and frees the tables it replaced
+            for (int round = 0; round < TestRounds; round++)
+            {
+                for (ULONG j = 0; j < TestFunctionCount; j++)
+                {
+                    MethodTable::Insert(CreateDescriptor(GetFunctionId(2000000, j)));
+                }
+
+                for (ULONG j = 0; j < TestFunctionCount; j++)
+                {
+                    MethodTable::Remove(GetFunctionId(2000000, j));
+                }
+            }
+
+            stopping.store(true);
+            for (std::thread& reader : readers)
+            {
+                reader.join();
+            }
+
+            for (int count : failures)
+            {
+                Assert::AreEqual(0, count);
+            }
+        }
+    };
+}
@@ -0,0 +1,120 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <thread>
+#include "CppUnitTest.h"
+#include "stdafx.h"
+#include "Overhead.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace ClrProfilerTests
+{
+    // The histograms are process-wide, so each test records into callbacks no other test uses
+    TEST_CLASS(OverheadTest)
+    {
+    public:
+        TEST_CLASS_INITIALIZE(EnableOverhead)
+        {
+            Overhead::Enable();
+        }
+
+        TEST_METHOD(TestPercentilesInZeroBucket)
+        {
+            for (int i = 0; i < 999; i++)
+            {
+                Overhead::Record(OverheadAssemblyLoadStarted, 0);
+            }
+
+            Overhead::Record(OverheadAssemblyLoadStarted, Clock::GetFrequency());
+
+            OverheadSummary summary;
+            Assert::AreEqual(S_OK, Overhead::GetSummary(OverheadAssemblyLoadStarted, &summary));
+
+            Assert::AreEqual(1000ULL, summary.count);
+            Assert::AreEqual(0ULL, summary.p50Nanoseconds);
+            Assert::AreEqual(0ULL, summary.p90Nanoseconds);
+            Assert::AreEqual(0ULL, summary.p99Nanoseconds);
+            Assert::AreEqual(0ULL, summary.p999Nanoseconds);
+            Assert::IsTrue(summary.maxNanoseconds >= 1000000000ULL && summary.maxNanoseconds <= 1125000000ULL);
+        }
+
+        TEST_METHOD(TestPercentilesWithinBucketError)
+        {
+            for (LONG64 i = 1; i <= 1000; i++)
+            {
+                Overhead::Record(OverheadClassLoadStarted, i * 100);
+            }
+
+            OverheadSummary summary;
+            Overhead::GetSummary(OverheadClassLoadStarted, &summary);
+
+            double nanosecondsPerTick = 1000000000.0 / Clock::GetFrequency();
+            ULONG64 p50 = (ULONG64)(50000 * nanosecondsPerTick);
+            ULONG64 p99 = (ULONG64)(99000 * nanosecondsPerTick);
+
+            // Upper bounds of log-linear buckets overestimate by at most one eighth
+            Assert::IsTrue(summary.p50Nanoseconds >= p50 && summary.p50Nanoseconds <= p50 + p50 / 8);
+            Assert::IsTrue(summary.p99Nanoseconds >= p99 && summary.p99Nanoseconds <= p99 + p99 / 8);
+            Assert::AreEqual((ULONG64)(50050000 * nanosecondsPerTick), summary.totalNanoseconds);
+        }
+
+        TEST_METHOD(TestMergesThreads)
+        {
+            std::thread threads[4];
+            for (std::thread& thread : threads)
+            {
+                thread = std::thread([]()
+                {
+                    for (int i = 0; i < 250; i++)
+                    {
+                        Overhead::Record(OverheadGarbageCollectionStarted, 10);
+                    }
+                });
+            }
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            OverheadSummary summary;
+            Overhead::GetSummary(OverheadGarbageCollectionStarted, &summary);
+
+            Assert::AreEqual(1000ULL, summary.count);
+        }
+
+        TEST_METHOD(TestKeepsCountsOfExitedThreads)
+        {
+            // Each thread exits before the next starts, so all but the first record into a reused block
+            for (int i = 0; i < 16; i++)
+            {
+                std::thread thread([]()
+                {
+                    for (int j = 0; j < 10; j++)
+                    {
+                        Overhead::Record(OverheadThreadNameChanged, 10);
+                    }
+                });
+
+                thread.join();
+            }
+
+            OverheadSummary summary;
+            Overhead::GetSummary(OverheadThreadNameChanged, &summary);
+
+            Assert::AreEqual(160ULL, summary.count);
+        }
+
+        TEST_METHOD(TestEmptyAndInvalidCallbacks)
+        {
+            OverheadSummary summary;
+
+            Assert::AreEqual(S_OK, Overhead::GetSummary(OverheadEventPipeEventDelivered, &summary));
+            Assert::AreEqual(0ULL, summary.count);
+            Assert::AreEqual(0ULL, summary.maxNanoseconds);
+            Assert::AreEqual(E_INVALIDARG, Overhead::GetSummary(OverheadCallbackCount, &summary));
+            Assert::AreEqual(E_INVALIDARG, Overhead::GetSummary(OverheadThreadCreated, NULL));
+        }
+    };
+}
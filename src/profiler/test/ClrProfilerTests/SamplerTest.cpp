@@ -0,0 +1,214 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CppUnitTest.h"
+#include "stdafx.h"
+#include "Clock.h"
+#include "Sampler.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TestThreads 8
+#define TestFixedTarget 20000
+#define TestSeconds 3
+#define TestRateDecisions 200000
+#define TestReloads 200
+
+namespace ClrProfilerTests
+{
+    // Rules are only read from a file, so each test writes its own next to the other temporary files
+    static HRESULT LoadRules(const char* json)
+    {
+        WCHAR path[MAX_PATH];
+        DWORD length = GetTempPathW(MAX_PATH, path);
+        Assert::IsTrue(length > 0 && length + 20 < MAX_PATH);
+        wcscat_s(path, MAX_PATH, L"SamplerTest.json");
+
+        HANDLE file = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        Assert::IsTrue(file != INVALID_HANDLE_VALUE);
+
+        DWORD written = 0;
+        Assert::IsTrue(WriteFile(file, json, (DWORD)strlen(json), &written, NULL) != FALSE);
+        CloseHandle(file);
+
+        HRESULT hr = LoadXRaySamplingRules(path);
+        DeleteFileW(path);
+
+        return hr;
+    }
+
+    static ULONG64 GetSecond()
+    {
+        return (ULONG64)(Clock::GetCounter() / Clock::GetFrequency());
+    }
+
+    TEST_CLASS(SamplerTest)
+    {
+    public:
+        TEST_METHOD(TestMatchesRulesInFileOrder)
+        {
+            Assert::AreEqual(S_OK, LoadRules(
+                "{\"version\":2,\"rules\":["
+                "{\"description\":\"health\",\"host\":\"*\",\"http_method\":\"GET\",\"url_path\":\"/health\",\"fixed_target\":0,\"rate\":0},"
+                "{\"description\":\"api\",\"host\":\"*.example.com\",\"http_method\":\"*\",\"url_path\":\"/api/*\",\"fixed_target\":1,\"rate\":1},"
+                "{\"description\":\"orders\",\"host\":\"*\",\"http_method\":\"POST\",\"url_path\":\"/api/orders\",\"fixed_target\":0,\"rate\":0}],"
+                "\"default\":{\"fixed_target\":0,\"rate\":0}}"));
+
+            SamplingDecision decision;
+            Assert::AreEqual(S_OK, MakeXRaySamplingDecision(L"web.example.com", L"GET", L"/health", &decision));
+            Assert::AreEqual(0UL, (unsigned long)decision.ruleIndex);
+            Assert::AreEqual(0UL, (unsigned long)decision.sampled);
+
+            // The earlier rule wins over the more specific one after it, and patterns ignore case
+            Assert::AreEqual(S_OK, MakeXRaySamplingDecision(L"WEB.Example.com", L"POST", L"/API/orders", &decision));
+            Assert::AreEqual(1UL, (unsigned long)decision.ruleIndex);
+            Assert::AreEqual(1UL, (unsigned long)decision.sampled);
+
+            Assert::AreEqual(S_OK, MakeXRaySamplingDecision(L"example.org", L"POST", L"/api/orders", &decision));
+            Assert::AreEqual(2UL, (unsigned long)decision.ruleIndex);
+
+            Assert::AreEqual(S_OK, MakeXRaySamplingDecision(L"example.org", L"GET", L"/health/", &decision));
+            Assert::AreEqual((unsigned long)SamplerDefaultRule, (unsigned long)decision.ruleIndex);
+            Assert::AreEqual(0UL, (unsigned long)decision.sampled);
+        }
+
+        TEST_METHOD(TestRejectsInvalidRules)
+        {
+            // No default rule, an unknown version, a rate above one and a fractional target
+            Assert::IsTrue(FAILED(LoadRules("{\"version\":2,\"rules\":[]}")));
+            Assert::IsTrue(FAILED(LoadRules("{\"version\":3,\"default\":{\"fixed_target\":1,\"rate\":0.1}}")));
+            Assert::IsTrue(FAILED(LoadRules("{\"version\":2,\"default\":{\"fixed_target\":1,\"rate\":1.5}}")));
+            Assert::IsTrue(FAILED(LoadRules("{\"version\":2,\"default\":{\"fixed_target\":1.5,\"rate\":0.1}}")));
+        }
+
+        TEST_METHOD(TestReservoirHoldsUnderContention)
+        {
+            Assert::AreEqual(S_OK, LoadRules("{\"version\":2,\"default\":{\"fixed_target\":20000,\"rate\":0}}"));
+
+            std::vector<std::thread> threads;
+            std::vector<ULONG> sampled(TestThreads, 0);
+            std::vector<ULONG> fromReservoir(TestThreads, 0);
+            std::vector<ULONG> bySecond((TestSeconds + 2) * TestThreads, 0);
+            ULONG64 first = GetSecond();
+
+            for (ULONG i = 0; i < TestThreads; i++)
+            {
+                threads.emplace_back([&, i]()
+                {
+                    SamplingDecision decision;
+                    ULONG64 before = first;
+                    while (before - first <= TestSeconds)
+                    {
+                        MakeXRaySamplingDecision(L"example.com", L"GET", L"/", &decision);
+                        ULONG64 after = GetSecond();
+
+                        // A decision that did not straddle a second is known to count against that second
+                        sampled[i] += decision.sampled;
+                        fromReservoir[i] += decision.fromReservoir;
+                        if (decision.sampled && before == after)
+                        {
+                            bySecond[(ULONG)(after - first) * TestThreads + i]++;
+                        }
+
+                        before = after;
+                    }
+                });
+            }
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            ULONG64 seconds = GetSecond() - first + 1;
+            ULONG total = 0;
+            ULONG totalFromReservoir = 0;
+            for (ULONG i = 0; i < TestThreads; i++)
+            {
+                total += sampled[i];
+                totalFromReservoir += fromReservoir[i];
+            }
+
+            // With no rate, everything sampled came out of the reservoir
+            Assert::AreEqual(total, totalFromReservoir);
+
+            for (ULONG second = 0; second < TestSeconds + 2; second++)
+            {
+                ULONG inSecond = 0;
+                for (ULONG i = 0; i < TestThreads; i++)
+                {
+                    inSecond += bySecond[second * TestThreads + i];
+                }
+
+                Assert::IsTrue(inSecond <= TestFixedTarget);
+            }
+
+            // No more than the target in any second, and the seconds the threads ran through in full got all of it
+            Assert::IsTrue(total <= TestFixedTarget * seconds);
+            Assert::IsTrue(total >= TestFixedTarget * (TestSeconds - 1));
+        }
+
+        TEST_METHOD(TestSamplesRateBeyondReservoir)
+        {
+            Assert::AreEqual(S_OK, LoadRules("{\"version\":2,\"default\":{\"fixed_target\":0,\"rate\":0.25}}"));
+
+            ULONG sampled = 0;
+            SamplingDecision decision;
+            for (ULONG i = 0; i < TestRateDecisions; i++)
+            {
+                MakeXRaySamplingDecision(L"example.com", L"GET", L"/", &decision);
+                sampled += decision.sampled;
+                Assert::AreEqual(0UL, (unsigned long)decision.fromReservoir);
+            }
+
+            // Four standard deviations either side of 50000
+            Assert::IsTrue(sampled > 49225 && sampled < 50775);
+        }
+
+        TEST_METHOD(TestReloadsWhileDeciding)
+        {
+            const char* byRule = "{\"version\":2,\"rules\":[{\"description\":\"api\",\"host\":\"*\",\"http_method\":\"*\",\"url_path\":\"/api/*\",\"fixed_target\":0,\"rate\":1}],"
+                                 "\"default\":{\"fixed_target\":0,\"rate\":0}}";
+            const char* byDefault = "{\"version\":2,\"default\":{\"fixed_target\":0,\"rate\":1}}";
+            Assert::AreEqual(S_OK, LoadRules(byRule));
+
+            // Both sets sample the request, through the rule or the default; a freed set would not
+            std::atomic<bool> stop(false);
+            std::vector<std::thread> threads;
+            std::vector<ULONG> wrong(TestThreads, 0);
+
+            for (ULONG i = 0; i < TestThreads; i++)
+            {
+                threads.emplace_back([&, i]()
+                {
+                    SamplingDecision decision;
+                    while (!stop.load())
+                    {
+                        MakeXRaySamplingDecision(L"example.com", L"GET", L"/api/orders", &decision);
+                        wrong[i] += !decision.sampled || (decision.ruleIndex != 0 && decision.ruleIndex != SamplerDefaultRule);
+                    }
+                });
+            }
+
+            for (ULONG reload = 0; reload < TestReloads; reload++)
+            {
+                Assert::AreEqual(S_OK, LoadRules(reload % 2 == 0 ? byDefault : byRule));
+            }
+
+            stop.store(true);
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            for (ULONG i = 0; i < TestThreads; i++)
+            {
+                Assert::AreEqual(0UL, (unsigned long)wrong[i]);
+            }
+        }
+    };
+}
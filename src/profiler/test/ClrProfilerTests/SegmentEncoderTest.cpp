@@ -0,0 +1,221 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <string>
+#include "CppUnitTest.h"
+#include "stdafx.h"
+#include "SegmentEncoder.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TestBufferLength 4096
+
+namespace ClrProfilerTests
+{
+    static SegmentDocument CreateDocument()
+    {
+        SegmentDocument document = { 0 };
+        document.kind = SegmentKindSegment;
+        document.name = L"web";
+        document.id = L"70de5b6f19ff9a0a";
+        document.traceId = L"1-581cf771-a006649127e371903a2de979";
+        document.startTime = 1478293361.271;
+        document.endTime = 1478293361.449;
+        document.httpStatus = SegmentNoHttpStatus;
+        document.httpContentLength = SegmentNoContentLength;
+
+        return document;
+    }
+
+    // The JSON document without the protocol header
+    static std::string Encode(const SegmentDocument& document)
+    {
+        BYTE buffer[TestBufferLength];
+        ULONG written = 0;
+
+        Assert::AreEqual(S_OK, SegmentEncoder::Encode(&document, buffer, TestBufferLength, &written));
+
+        std::string payload((const char*)buffer, written);
+        Assert::AreEqual(0, payload.compare(0, sizeof(SegmentProtocolHeader) - 1, SegmentProtocolHeader));
+
+        return payload.substr(sizeof(SegmentProtocolHeader) - 1);
+    }
+
+    static std::string EncodeNumber(double value)
+    {
+        SegmentAnnotation annotation = { L"n", SegmentAnnotationNumber };
+        annotation.numberValue = value;
+
+        SegmentDocument document = CreateDocument();
+        document.annotations = &annotation;
+        document.annotationCount = 1;
+
+        std::string json = Encode(document);
+        size_t start = json.find("{\"n\":") + 5;
+
+        return json.substr(start, json.size() - start - 2);
+    }
+
+    static std::string EncodeString(LPCWSTR value)
+    {
+        SegmentDocument document = CreateDocument();
+        document.name = value;
+
+        std::string json = Encode(document);
+        size_t start = json.find("\"name\":") + 7;
+
+        return json.substr(start, json.find(",\"id\":") - start);
+    }
+
+    TEST_CLASS(SegmentEncoderTest)
+    {
+    public:
+        TEST_METHOD(TestWritesDocumentInSdkOrder)
+        {
+            SegmentAnnotation annotations[] =
+            {
+                { L"customer", SegmentAnnotationString, FALSE, L"alice" },
+                { L"retries", SegmentAnnotationInteger },
+                { L"cached", SegmentAnnotationBoolean, TRUE },
+            };
+            annotations[1].integerValue = 3;
+
+            SegmentDocument document = CreateDocument();
+            document.kind = SegmentKindSubsegment;
+            document.flags = SegmentFlagError | SegmentFlagThrottle;
+            document.parentId = L"53995c3f42cd8ad8";
+            document.nameSpace = L"remote";
+            document.httpMethod = L"GET";
+            document.httpUrl = L"https://example.com/";
+            document.httpStatus = 429;
+            document.httpContentLength = 0;
+            document.sqlDatabaseType = L"sqlserver";
+            document.sqlSanitizedQuery = L"SELECT 1";
+            document.annotations = annotations;
+            document.annotationCount = 3;
+
+            Assert::AreEqual(std::string(
+                "{\"name\":\"web\",\"id\":\"70de5b6f19ff9a0a\",\"start_time\":1478293361.271,\"end_time\":1478293361.449,"
+                "\"trace_id\":\"1-581cf771-a006649127e371903a2de979\",\"parent_id\":\"53995c3f42cd8ad8\",\"type\":\"subsegment\","
+                "\"namespace\":\"remote\",\"error\":true,\"throttle\":true,"
+                "\"http\":{\"request\":{\"method\":\"GET\",\"url\":\"https://example.com/\"},\"response\":{\"status\":429,\"content_length\":0}},"
+                "\"sql\":{\"database_type\":\"sqlserver\",\"sanitized_query\":\"SELECT 1\"},"
+                "\"annotations\":{\"customer\":\"alice\",\"retries\":3,\"cached\":true}}"), Encode(document));
+        }
+
+        TEST_METHOD(TestWritesOpenSegmentInProgress)
+        {
+            SegmentDocument document = CreateDocument();
+            document.flags = SegmentFlagInProgress;
+
+            Assert::AreEqual(std::string(
+                "{\"name\":\"web\",\"id\":\"70de5b6f19ff9a0a\",\"start_time\":1478293361.271,\"in_progress\":true,"
+                "\"trace_id\":\"1-581cf771-a006649127e371903a2de979\"}"), Encode(document));
+        }
+
+        TEST_METHOD(TestFormatsNumbersLikeDotNet)
+        {
+            // Expected values are what double.ToString("R") prints on .NET, with the ".0" LitJson adds
+            // to a number that has neither a point nor an exponent
+            const struct { double value; const char* expected; } numbers[] =
+            {
+                { 0.0, "0.0" },
+                { 1.0, "1.0" },
+                { -1.0, "-1.0" },
+                { 100000.0, "100000.0" },
+                { 1497624316.5, "1497624316.5" },
+                { 1497624316.123, "1497624316.123" },
+                { 123.456, "123.456" },
+                { 0.1, "0.1" },
+                { 1.0 / 3, "0.3333333333333333" },
+                { 0.0001, "0.0001" },
+                { 0.00012345, "0.00012345" },
+                { 0.00001, "1E-05" },
+                { 0.000012345, "1.2345E-05" },
+                { -2.5e-7, "-2.5E-07" },
+                { 1e-100, "1E-100" },
+                { 5e-324, "5E-324" },
+                { 1e14, "100000000000000.0" },
+                { 123456789012345.0, "123456789012345.0" },
+                { 1e15, "1E+15" },
+                { 1e21, "1E+21" },
+                { 1.5e300, "1.5E+300" },
+                { 1.7976931348623157e308, "1.7976931348623157E+308" },
+            };
+
+            for (const auto& number : numbers)
+            {
+                Assert::AreEqual(std::string(number.expected), EncodeNumber(number.value));
+            }
+        }
+
+        TEST_METHOD(TestEscapesLikeLitJson)
+        {
+            Assert::AreEqual(std::string("\"a\\\"b\\\\c/d\""), EncodeString(L"a\"b\\c/d"));
+            Assert::AreEqual(std::string("\"\\n\\r\\t\\b\\f\\u0001\\u007F\""), EncodeString(L"\n\r\t\b\f\x01\x7F"));
+            Assert::AreEqual(std::string("\"caf\\u00E9 \\uD83D\\uDE00\""), EncodeString(L"caf\x00E9 \xD83D\xDE00"));
+        }
+
+        TEST_METHOD(TestEscapesInsideLongStrings)
+        {
+            // Long enough for several eight-unit blocks, with escapes at block edges and past them
+            std::wstring value;
+            std::string expected = "\"";
+            for (int i = 0; i < 64; i++)
+            {
+                if (i % 9 == 0)
+                {
+                    value += L'"';
+                    expected += "\\\"";
+                }
+                else if (i % 13 == 0)
+                {
+                    value += (WCHAR)0x00E9;
+                    expected += "\\u00E9";
+                }
+                else
+                {
+                    value += (WCHAR)(L'a' + i % 26);
+                    expected += (char)('a' + i % 26);
+                }
+            }
+            expected += "\"";
+
+            Assert::AreEqual(expected, EncodeString(value.c_str()));
+        }
+
+        TEST_METHOD(TestReportsRequiredLength)
+        {
+            SegmentDocument document = CreateDocument();
+            BYTE buffer[TestBufferLength];
+            ULONG required = 0;
+            ULONG written = 0;
+
+            Assert::AreEqual(S_OK, SegmentEncoder::Encode(&document, buffer, TestBufferLength, &required));
+            Assert::AreEqual(E_NOT_SUFFICIENT_BUFFER, SegmentEncoder::Encode(&document, buffer, required - 1, &written));
+            Assert::AreEqual(required, written);
+            Assert::AreEqual(E_NOT_SUFFICIENT_BUFFER, SegmentEncoder::Encode(&document, NULL, 0, &written));
+            Assert::AreEqual(required, written);
+        }
+
+        TEST_METHOD(TestRejectsIncompleteDocuments)
+        {
+            ULONG written = 0;
+            BYTE buffer[TestBufferLength];
+
+            SegmentDocument document = CreateDocument();
+            document.traceId = NULL;
+            Assert::AreEqual(E_INVALIDARG, SegmentEncoder::Encode(&document, buffer, TestBufferLength, &written));
+
+            document = CreateDocument();
+            document.kind = SegmentKindSubsegment;
+            Assert::AreEqual(E_INVALIDARG, SegmentEncoder::Encode(&document, buffer, TestBufferLength, &written));
+
+            SegmentAnnotation annotation = { L"key", SegmentAnnotationString };
+            document = CreateDocument();
+            document.annotations = &annotation;
+            document.annotationCount = 1;
+            Assert::AreEqual(E_INVALIDARG, SegmentEncoder::Encode(&document, buffer, TestBufferLength, &written));
+        }
+    };
+}
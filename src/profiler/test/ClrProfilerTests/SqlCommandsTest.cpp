@@ -0,0 +1,138 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "CppUnitTest.h"
+#include "stdafx.h"
+#include "Clock.h"
+#include "SqlCommands.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TestThreads 8
+#define TestCommandsPerThread 100000
+
+namespace ClrProfilerTests
+{
+    TEST_CLASS(SqlCommandsTest)
+    {
+    public:
+        TEST_METHOD_INITIALIZE(Enable)
+        {
+            SqlCommands::Enable();
+        }
+
+        TEST_METHOD(TestRecordsStartEndAndFailure)
+        {
+            LONG64 before = Clock::GetEpochMicroseconds();
+            ULONG record = BeginXRaySqlCommand();
+            Assert::AreNotEqual(0UL, (unsigned long)record);
+
+            Sleep(2);
+
+            SqlCommandRecord copy;
+            Assert::AreEqual(S_OK, EndXRaySqlCommand(record, TRUE, &copy));
+            Assert::IsTrue(copy.startMicroseconds >= before);
+            Assert::IsTrue(copy.endMicroseconds >= copy.startMicroseconds + 1000);
+            Assert::IsTrue(copy.endMicroseconds <= Clock::GetEpochMicroseconds());
+            Assert::IsTrue(copy.failed != FALSE);
+
+            // The record went back to the pool with the first end
+            Assert::AreEqual(E_INVALIDARG, EndXRaySqlCommand(record, FALSE, &copy));
+            Assert::AreEqual(E_INVALIDARG, EndXRaySqlCommand(0, FALSE, &copy));
+            Assert::AreEqual(E_INVALIDARG, EndXRaySqlCommand(SqlCommandRecordCount + 1, FALSE, &copy));
+        }
+
+        TEST_METHOD(TestLeavesCommandsUntracedOnceThePoolIsSpent)
+        {
+            std::vector<ULONG> records;
+            for (ULONG i = 0; i < SqlCommandRecordCount; i++)
+            {
+                ULONG record = BeginXRaySqlCommand();
+                Assert::AreNotEqual(0UL, (unsigned long)record);
+                records.push_back(record);
+            }
+
+            Assert::AreEqual(0UL, (unsigned long)BeginXRaySqlCommand());
+
+            SqlCommandRecord copy;
+            for (ULONG record : records)
+            {
+                Assert::AreEqual(S_OK, EndXRaySqlCommand(record, FALSE, &copy));
+            }
+
+            ULONG record = BeginXRaySqlCommand();
+            Assert::AreNotEqual(0UL, (unsigned long)record);
+            Assert::AreEqual(S_OK, EndXRaySqlCommand(record, FALSE, &copy));
+        }
+
+        // Commands end on other threads than the ones that began them, as awaited ones do, while
+        // every thread takes records from the same stack; no record may be handed out twice
+        TEST_METHOD(TestHandsEachRecordToOneCommandAtATime)
+        {
+            std::atomic<ULONG> owners[SqlCommandRecordCount];
+            for (std::atomic<ULONG>& owner : owners)
+            {
+                owner.store(0);
+            }
+
+            std::atomic<ULONG> duplicates(0);
+            std::atomic<ULONG> failures(0);
+            std::vector<std::thread> threads;
+
+            for (ULONG t = 0; t < TestThreads; t++)
+            {
+                threads.emplace_back([&, t]()
+                {
+                    ULONG held[4] = { 0 };
+
+                    for (ULONG i = 0; i < TestCommandsPerThread; i++)
+                    {
+                        ULONG slot = i % 4;
+                        if (held[slot] != 0)
+                        {
+                            owners[held[slot] - 1].store(0);
+
+                            SqlCommandRecord copy;
+                            if (EndXRaySqlCommand(held[slot], FALSE, &copy) != S_OK)
+                            {
+                                failures.fetch_add(1);
+                            }
+                        }
+
+                        held[slot] = BeginXRaySqlCommand();
+                        if (held[slot] == 0)
+                        {
+                            failures.fetch_add(1);
+                        }
+                        else if (owners[held[slot] - 1].exchange(t + 1) != 0)
+                        {
+                            duplicates.fetch_add(1);
+                        }
+                    }
+
+                    for (ULONG record : held)
+                    {
+                        if (record != 0)
+                        {
+                            owners[record - 1].store(0);
+
+                            SqlCommandRecord copy;
+                            EndXRaySqlCommand(record, FALSE, &copy);
+                        }
+                    }
+                });
+            }
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            Assert::AreEqual(0UL, (unsigned long)duplicates.load());
+            Assert::AreEqual(0UL, (unsigned long)failures.load());
+        }
+    };
+}
@@ -0,0 +1,304 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "CppUnitTest.h"
+#include "stdafx.h"
+#include "CpuTime.h"
+#include "Environment.h"
+#include "IdGenerator.h"
+#include "Journal.h"
+#include "RuntimeEvents.h"
+#include "ThreadMonitor.h"
+#include "TraceContext.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+#define TestTraceId L"1-5f84c7a5-2d4f1b1a8e5c3f0a7b6d9e21"
+#define TestSegment 0x53995c3f42cd8ad8ULL
+#define TestSegmentId L"53995c3f42cd8ad8"
+#define TestStarvationThreshold L"100"
+#define TestSampleWaitMilliseconds 5000
+#define TestJournalPath L"TraceContextTest.journal"
+#define TestBurnNanoseconds 50000000ULL
+#define TestChurnSegments 100000
+
+namespace ClrProfilerTests
+{
+    // Hands out a ThreadID per thread, the only call the trace context makes
+    class TestProfilerInfo : public ICorProfilerInfo
+    {
+    public:
+        static ThreadID GetThreadId()
+        {
+            static std::atomic<ThreadID> nextThreadId(0x1000);
+            static thread_local ThreadID threadId = 0;
+
+            if (threadId == 0)
+            {
+                threadId = nextThreadId.fetch_add(0x10);
+            }
+
+            return threadId;
+        }
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override { return E_NOINTERFACE; }
+        ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+        ULONG STDMETHODCALLTYPE Release() override { return 1; }
+
+        HRESULT STDMETHODCALLTYPE GetCurrentThreadID(ThreadID* pThreadId) override
+        {
+            *pThreadId = GetThreadId();
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE GetClassFromObject(ObjectID objectId, ClassID* pClassId) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetClassFromToken(ModuleID moduleId, mdTypeDef typeDef, ClassID* pClassId) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetCodeInfo(FunctionID functionId, LPCBYTE* pStart, ULONG* pcSize) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetEventMask(DWORD* pdwEvents) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetFunctionFromIP(LPCBYTE ip, FunctionID* pFunctionId) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetFunctionFromToken(ModuleID moduleId, mdToken token, FunctionID* pFunctionId) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetHandleFromThread(ThreadID threadId, HANDLE* phThread) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetObjectSize(ObjectID objectId, ULONG* pcSize) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE IsArrayClass(ClassID classId, CorElementType* pBaseElemType, ClassID* pBaseClassId, ULONG* pcRank) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetThreadInfo(ThreadID threadId, DWORD* pdwWin32ThreadId) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetClassIDInfo(ClassID classId, ModuleID* pModuleId, mdTypeDef* pTypeDefToken) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetFunctionInfo(FunctionID functionId, ClassID* pClassId, ModuleID* pModuleId, mdToken* pToken) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SetEventMask(DWORD dwEvents) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SetEnterLeaveFunctionHooks(FunctionEnter* pFuncEnter, FunctionLeave* pFuncLeave, FunctionTailcall* pFuncTailcall) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SetFunctionIDMapper(FunctionIDMapper* pFunc) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetTokenAndMetaDataFromFunction(FunctionID functionId, REFIID riid, IUnknown** ppImport, mdToken* pToken) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetModuleInfo(ModuleID moduleId, LPCBYTE* ppBaseLoadAddress, ULONG cchName, ULONG* pcchName, WCHAR szName[], AssemblyID* pAssemblyId) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetModuleMetaData(ModuleID moduleId, DWORD dwOpenFlags, REFIID riid, IUnknown** ppOut) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetILFunctionBody(ModuleID moduleId, mdMethodDef methodId, LPCBYTE* ppMethodHeader, ULONG* pcbMethodSize) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetILFunctionBodyAllocator(ModuleID moduleId, IMethodMalloc** ppMalloc) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SetILFunctionBody(ModuleID moduleId, mdMethodDef methodid, LPCBYTE pbNewILMethodHeader) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetAppDomainInfo(AppDomainID appDomainId, ULONG cchName, ULONG* pcchName, WCHAR szName[], ProcessID* pProcessId) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetAssemblyInfo(AssemblyID assemblyId, ULONG cchName, ULONG* pcchName, WCHAR szName[], AppDomainID* pAppDomainId, ModuleID* pModuleId) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SetFunctionReJIT(FunctionID functionId) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE ForceGC() override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE SetILInstrumentedCodeMap(FunctionID functionId, BOOL fStartJit, ULONG cILMapEntries, COR_IL_MAP rgILMapEntries[]) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetInprocInspectionInterface(IUnknown** ppicd) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetInprocInspectionIThisThread(IUnknown** ppicd) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetThreadContext(ThreadID threadId, ContextID* pContextId) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE BeginInprocDebugging(BOOL fThisThreadOnly, DWORD* pdwProfilerContext) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE EndInprocDebugging(DWORD dwProfilerContext) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE GetILToNativeMapping(FunctionID functionId, ULONG32 cMap, ULONG32* pcMap, COR_DEBUG_IL_TO_NATIVE_MAP map[]) override { return E_NOTIMPL; }
+    };
+
+    static TestProfilerInfo profilerInfo;
+
+    // Spins until the thread has used enough CPU time to show at the scheduler tick Windows counts in
+    static void BurnCpu()
+    {
+        ULONG64 started = CpuTime::GetThreadNanoseconds();
+        volatile ULONG64 spins = 0;
+
+        while (CpuTime::GetThreadNanoseconds() - started < TestBurnNanoseconds)
+        {
+            spins++;
+        }
+    }
+
+    // A thread that enters a segment, reports its ids and then blocks until released
+    class SegmentThread
+    {
+    public:
+        SegmentThread() : threadId(0), osThreadId(0), entered(false)
+        {
+            releaseEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+            thread = std::thread([this]()
+            {
+                set = TraceContext::Set(TestTraceId, TestSegmentId);
+                osThreadId = GetCurrentThreadId();
+                threadId = TestProfilerInfo::GetThreadId();
+                entered.store(true);
+
+                WaitForSingleObject(releaseEvent, INFINITE);
+                TraceContext::Clear();
+            });
+
+            while (!entered.load())
+            {
+                std::this_thread::yield();
+            }
+
+            Assert::AreEqual(S_OK, set);
+        }
+
+        ~SegmentThread()
+        {
+            SetEvent(releaseEvent);
+            thread.join();
+            CloseHandle(releaseEvent);
+        }
+
+        ThreadID threadId;
+        DWORD osThreadId;
+
+    private:
+        std::thread thread;
+        std::atomic<bool> entered;
+        HANDLE releaseEvent;
+        HRESULT set;
+    };
+
+    TEST_CLASS(TraceContextTest)
+    {
+    public:
+        TEST_CLASS_INITIALIZE(IndexThreads)
+        {
+            TraceContext::Initialize(&profilerInfo, true);
+        }
+
+        TEST_METHOD(TestFindsContextOfAnotherThread)
+        {
+            ThreadID threadId = 0;
+            TraceContextIds ids;
+
+            {
+                SegmentThread segmentThread;
+                threadId = segmentThread.threadId;
+
+                Assert::IsTrue(TraceContext::Find(threadId, &ids));
+                Assert::AreEqual(0x5f84c7a52d4f1b1aULL, (unsigned long long)ids.words[0]);
+                Assert::AreEqual(0x8e5c3f0a7b6d9e21ULL, (unsigned long long)ids.words[1]);
+                Assert::AreEqual(TestSegment, (unsigned long long)ids.words[2]);
+
+                TraceContextInfo info;
+                Assert::AreEqual(S_OK, TraceContext::Get(threadId, &info));
+                Assert::AreEqual(0, wcscmp(TestTraceId, info.traceId));
+                Assert::AreEqual(0, wcscmp(TestSegmentId, info.segmentId));
+            }
+
+            // The thread cleared its context on the way out
+            Assert::IsFalse(TraceContext::Find(threadId, &ids));
+
+            TraceContext::Unbind(threadId);
+            Assert::IsFalse(TraceContext::Find(threadId, &ids));
+        }
+
+        TEST_METHOD(TestAddsCpuTimeOfContinuations)
+        {
+            ULONG64 left = 0;
+            ULONG64 ended = 0;
+
+            // The segment starts on one thread and its continuation ends it on another
+            std::thread([&left]()
+            {
+                Assert::AreEqual(S_OK, TraceContext::Set(TestTraceId, L"0123456789abcdef"));
+                BurnCpu();
+                Assert::AreEqual(S_OK, TraceContext::Leave(&left));
+            }).join();
+
+            std::thread([&ended]()
+            {
+                Assert::AreEqual(S_OK, TraceContext::Set(TestTraceId, L"0123456789abcdef"));
+                BurnCpu();
+                Assert::AreEqual(S_OK, TraceContext::End(&ended));
+            }).join();
+
+            Assert::IsTrue(left >= TestBurnNanoseconds);
+            Assert::IsTrue(ended >= left + TestBurnNanoseconds);
+        }
+
+        TEST_METHOD(TestEndedSegmentsLeaveNothingBehind)
+        {
+            WCHAR segmentId[SegmentIdLength + 1] = { 0 };
+            ULONG64 nanoseconds = 0;
+
+            // Far more segments than entries, every one of them claims an entry and gives it back
+            for (ULONG64 i = 1; i <= TestChurnSegments; i++)
+            {
+                IdGenerator::WriteHex(segmentId, i * 0x9E3779B97F4A7C15ULL, SegmentIdLength);
+                Assert::AreEqual(S_OK, TraceContext::Set(TestTraceId, segmentId));
+                Assert::AreEqual(S_OK, TraceContext::Leave(&nanoseconds));
+                Assert::AreEqual(S_OK, TraceContext::Set(TestTraceId, segmentId));
+                Assert::AreEqual(S_OK, TraceContext::End(&nanoseconds));
+            }
+
+            // A segment still finds an entry for its pieces afterwards
+            ULONG64 left = 0;
+            Assert::AreEqual(S_OK, TraceContext::Set(TestTraceId, L"fedcba9876543210"));
+            BurnCpu();
+            Assert::AreEqual(S_OK, TraceContext::Leave(&left));
+            Assert::AreEqual(S_OK, TraceContext::Set(TestTraceId, L"fedcba9876543210"));
+            BurnCpu();
+            Assert::AreEqual(S_OK, TraceContext::End(&nanoseconds));
+
+            Assert::IsTrue(nanoseconds >= left + TestBurnNanoseconds);
+        }
+
+        TEST_METHOD(TestStarvationNamesSegmentOfBlockedThread)
+        {
+            Assert::IsTrue(SetEnvironmentVariableW(ThreadMonitorThresholdVariable, TestStarvationThreshold) != FALSE);
+            ThreadMonitor::Initialize();
+            SetEnvironmentVariableW(ThreadMonitorThresholdVariable, NULL);
+            Assert::IsTrue(ThreadMonitor::IsEnabled());
+
+            ThreadPoolStatus status = { 0 };
+
+            {
+                SegmentThread segmentThread;
+                ThreadMonitor::Add(segmentThread.threadId);
+                ThreadMonitor::Assign(segmentThread.threadId, segmentThread.osThreadId);
+
+                // The only monitored thread sleeps, so it is the longest blocked as soon as it counts as blocked
+                for (int waited = 0; waited < TestSampleWaitMilliseconds && status.longestBlockedSegment == 0; waited += 50)
+                {
+                    Sleep(50);
+                    ThreadMonitor::GetStatus(&status);
+                }
+
+                ThreadMonitor::Remove(segmentThread.threadId);
+            }
+
+            ThreadMonitor::Shutdown();
+
+            Assert::AreEqual(TestSegment, (unsigned long long)status.longestBlockedSegment);
+        }
+
+        TEST_METHOD(TestGCPauseJournalsSegmentOfSuspendingThread)
+        {
+            Assert::IsTrue(SetEnvironmentVariableW(JournalPathVariable, TestJournalPath) != FALSE);
+            Journal::Initialize();
+            SetEnvironmentVariableW(JournalPathVariable, NULL);
+            Assert::IsTrue(Journal::IsEnabled());
+
+            {
+                SegmentThread segmentThread;
+
+                // SuspendEE reason, then the restart that ends the pause on the GC's own thread
+                BYTE suspend[8] = { RuntimeSuspendForGC };
+                RuntimeEvents::Deliver(RuntimeEventGCSuspendEEBegin, sizeof(suspend), suspend, segmentThread.threadId);
+                RuntimeEvents::Deliver(RuntimeEventGCRestartEEEnd, 0, NULL, 0);
+            }
+
+            Assert::IsTrue(Journal::Dump());
+
+            HANDLE input = CreateFileW(TestJournalPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            Assert::IsTrue(input != INVALID_HANDLE_VALUE);
+
+            JournalHeader header = { 0 };
+            DWORD read = 0;
+            Assert::IsTrue(ReadFile(input, &header, sizeof(header), &read, NULL) && read == sizeof(header));
+            Assert::AreEqual((uint32_t)JournalMagic, header.magic);
+
+            std::vector<JournalRecord> records(header.capacity);
+            DWORD length = (DWORD)(records.size() * sizeof(JournalRecord));
+            Assert::IsTrue(ReadFile(input, records.data(), length, &read, NULL) && read == length);
+            CloseHandle(input);
+            DeleteFileW(TestJournalPath);
+
+            bool found = false;
+            for (const JournalRecord& record : records)
+            {
+                found |= record.sequence != 0 && record.eventType == JournalGCSegment && record.value == TestSegment;
+            }
+
+            Assert::IsTrue(found);
+        }
+    };
+}
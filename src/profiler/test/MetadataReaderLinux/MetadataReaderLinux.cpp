@@ -0,0 +1,351 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Opens every assembly of a .NET shared framework directory with MetadataReader, once as the file lies on
+// disk and once laid out section by section the way the loader maps it, and checks that both views agree
+// and that every TypeRef, TypeDef, MethodDef and MemberRef row points at rows and bodies that exist.
+// ClrProfilerTests compares the reader with IMetaDataImport on Windows; this runs the same reader on Linux.
+// Usage: MetadataReaderLinux <shared framework directory, e.g. /usr/share/dotnet/shared/Microsoft.NETCore.App/8.0.0>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "stdafx.h"
+#include "MetadataReader.h"
+
+#define PeNewHeaderOffset 0x3C
+#define PeFileHeaderSize 20
+#define PeOptionalSizeOffset 16
+#define PeSectionCountOffset 2
+#define PeSizeOfImageOffset 56
+#define PeSizeOfHeadersOffset 60
+#define PeSectionHeaderSize 40
+
+#define MethodHeaderTinyFormat 0x2
+#define MethodHeaderFatFormat 0x3
+#define MethodImplCodeTypeMask 0x3
+
+static ULONG failures = 0;
+
+static bool Check(bool condition, const std::string& assembly, const char* what, ULONG rid)
+{
+    if (!condition)
+    {
+        if (failures < 50)
+        {
+            fprintf(stderr, "%s: %s, row %lu\n", assembly.c_str(), what, (unsigned long)rid);
+        }
+
+        failures++;
+    }
+
+    return condition;
+}
+
+static bool ReadContents(const std::string& path, std::vector<BYTE>* contents)
+{
+    std::ifstream input(path, std::ios::binary);
+    if (!input)
+    {
+        return false;
+    }
+
+    contents->assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    return !contents->empty();
+}
+
+static ULONG ReadULong(const std::vector<BYTE>& image, SIZE_T offset)
+{
+    ULONG value = 0;
+    if (offset + sizeof(value) <= image.size())
+    {
+        memcpy(&value, image.data() + offset, sizeof(value));
+    }
+
+    return value;
+}
+
+static USHORT ReadUShort(const std::vector<BYTE>& image, SIZE_T offset)
+{
+    USHORT value = 0;
+    if (offset + sizeof(value) <= image.size())
+    {
+        memcpy(&value, image.data() + offset, sizeof(value));
+    }
+
+    return value;
+}
+
+// Copies the headers and every section to its virtual address, as the loader does when it maps a module
+static bool MapSections(const std::vector<BYTE>& flat, std::vector<BYTE>* mapped)
+{
+    SIZE_T ntHeaders = ReadULong(flat, PeNewHeaderOffset);
+    SIZE_T fileHeader = ntHeaders + sizeof(ULONG);
+    SIZE_T optionalHeader = fileHeader + PeFileHeaderSize;
+    SIZE_T sections = optionalHeader + ReadUShort(flat, fileHeader + PeOptionalSizeOffset);
+    ULONG sectionCount = ReadUShort(flat, fileHeader + PeSectionCountOffset);
+    ULONG sizeOfImage = ReadULong(flat, optionalHeader + PeSizeOfImageOffset);
+    ULONG sizeOfHeaders = ReadULong(flat, optionalHeader + PeSizeOfHeadersOffset);
+
+    if (sizeOfImage == 0 || sizeOfHeaders > flat.size() || sizeOfHeaders > sizeOfImage)
+    {
+        return false;
+    }
+
+    mapped->assign(sizeOfImage, 0);
+    memcpy(mapped->data(), flat.data(), sizeOfHeaders);
+
+    for (ULONG i = 0; i < sectionCount; i++)
+    {
+        SIZE_T section = sections + i * PeSectionHeaderSize;
+        ULONG virtualSize = ReadULong(flat, section + 8);
+        ULONG virtualAddress = ReadULong(flat, section + 12);
+        ULONG rawSize = ReadULong(flat, section + 16);
+        ULONG rawPointer = ReadULong(flat, section + 20);
+        ULONG size = virtualSize != 0 && virtualSize < rawSize ? virtualSize : rawSize;
+
+        if ((ULONG64)rawPointer + size > flat.size() || (ULONG64)virtualAddress + size > sizeOfImage)
+        {
+            return false;
+        }
+
+        memcpy(mapped->data() + virtualAddress, flat.data() + rawPointer, size);
+    }
+
+    return true;
+}
+
+static bool IsValidToken(MetadataReader& reader, mdToken token, const ULONG* tables, ULONG tableCount)
+{
+    ULONG table = TypeFromToken(token) >> 24;
+    ULONG rid = RidFromToken(token);
+
+    for (ULONG i = 0; i < tableCount; i++)
+    {
+        if (tables[i] == table)
+        {
+            return rid >= 1 && rid <= reader.GetRowCount(table);
+        }
+    }
+
+    return false;
+}
+
+static void CheckTypeRefs(MetadataReader& reader, const std::string& assembly)
+{
+    static const ULONG scopes[] = { MetadataTableModule, MetadataTableModuleRef, MetadataTableAssemblyRef, MetadataTableTypeRef };
+    WCHAR name[MetadataNameLength];
+
+    for (ULONG rid = 1; rid <= reader.GetRowCount(MetadataTableTypeRef); rid++)
+    {
+        MetadataTypeRef typeRef;
+        if (!Check(reader.GetTypeRef(TokenFromRid(rid, mdtTypeRef), &typeRef), assembly, "TypeRef unreadable", rid))
+        {
+            continue;
+        }
+
+        Check(MetadataReader::GetTypeName(typeRef.nameSpace, typeRef.name, name, MetadataNameLength), assembly, "TypeRef name", rid);
+        Check(IsNilToken(typeRef.resolutionScope) || IsValidToken(reader, typeRef.resolutionScope, scopes, 4), assembly, "TypeRef scope", rid);
+    }
+}
+
+static void CheckTypeDefs(MetadataReader& reader, const std::string& assembly)
+{
+    static const ULONG bases[] = { MetadataTableTypeDef, MetadataTableTypeRef, MetadataTableTypeSpec };
+    WCHAR name[MetadataNameLength];
+    ULONG methodCount = reader.GetRowCount(MetadataTableMethodDef);
+    ULONG lastMethodList = 1;
+
+    for (ULONG rid = 1; rid <= reader.GetRowCount(MetadataTableTypeDef); rid++)
+    {
+        MetadataTypeDef typeDef;
+        if (!Check(reader.GetTypeDef(TokenFromRid(rid, mdtTypeDef), &typeDef), assembly, "TypeDef unreadable", rid))
+        {
+            continue;
+        }
+
+        Check(MetadataReader::GetTypeName(typeDef.nameSpace, typeDef.name, name, MetadataNameLength), assembly, "TypeDef name", rid);
+        Check(IsNilToken(typeDef.extends) || IsValidToken(reader, typeDef.extends, bases, 3), assembly, "TypeDef extends", rid);
+        Check(typeDef.methodList >= lastMethodList && typeDef.methodList <= methodCount + 1, assembly, "TypeDef method list", rid);
+        lastMethodList = typeDef.methodList;
+    }
+}
+
+static void CheckMethodDefs(MetadataReader& flatReader, MetadataReader& mappedReader, const std::string& assembly)
+{
+    WCHAR name[MetadataNameLength];
+
+    for (ULONG rid = 1; rid <= flatReader.GetRowCount(MetadataTableMethodDef); rid++)
+    {
+        mdMethodDef token = TokenFromRid(rid, mdtMethodDef);
+        MetadataMethodDef flatMethodDef;
+        MetadataMethodDef mappedMethodDef;
+        if (!Check(flatReader.GetMethodDef(token, &flatMethodDef) && mappedReader.GetMethodDef(token, &mappedMethodDef), assembly, "MethodDef unreadable", rid))
+        {
+            continue;
+        }
+
+        Check(MetadataReader::GetName(flatMethodDef.name, name, MetadataNameLength), assembly, "MethodDef name", rid);
+        Check(strcmp(flatMethodDef.name, mappedMethodDef.name) == 0, assembly, "MethodDef name differs between layouts", rid);
+        Check(flatMethodDef.signatureLength > 0 && flatMethodDef.signatureLength == mappedMethodDef.signatureLength &&
+              memcmp(flatMethodDef.signature, mappedMethodDef.signature, flatMethodDef.signatureLength) == 0, assembly, "MethodDef signature", rid);
+
+        // The owner's method list starts at or before the method, the next type's after it
+        mdTypeDef owner = flatReader.GetMethodOwner(token);
+        MetadataTypeDef ownerDef;
+        MetadataTypeDef nextDef;
+        if (Check(!IsNilToken(owner) && owner == mappedReader.GetMethodOwner(token) && flatReader.GetTypeDef(owner, &ownerDef), assembly, "MethodDef owner", rid))
+        {
+            bool last = RidFromToken(owner) == flatReader.GetRowCount(MetadataTableTypeDef);
+            Check(ownerDef.methodList <= rid && (last || (flatReader.GetTypeDef(owner + 1, &nextDef) && nextDef.methodList > rid)), assembly, "MethodDef outside its owner's list", rid);
+        }
+
+        // An IL body starts with a tiny or fat header, with the same bytes in both layouts
+        LPCBYTE flatBody = flatReader.GetMethodBody(flatMethodDef);
+        LPCBYTE mappedBody = mappedReader.GetMethodBody(mappedMethodDef);
+        Check((flatBody == NULL) == (flatMethodDef.rva == 0) && (mappedBody == NULL) == (flatBody == NULL), assembly, "MethodDef body", rid);
+        if (flatBody != NULL && mappedBody != NULL && (flatMethodDef.implFlags & MethodImplCodeTypeMask) == 0)
+        {
+            BYTE format = flatBody[0] & 0x3;
+            Check(format == MethodHeaderTinyFormat || format == MethodHeaderFatFormat, assembly, "MethodDef body header", rid);
+            Check(memcmp(flatBody, mappedBody, format == MethodHeaderFatFormat ? 12 : 1) == 0, assembly, "MethodDef body differs between layouts", rid);
+        }
+    }
+}
+
+static void CheckMemberRefs(MetadataReader& reader, const std::string& assembly)
+{
+    static const ULONG parents[] = { MetadataTableTypeDef, MetadataTableTypeRef, MetadataTableModuleRef, MetadataTableMethodDef, MetadataTableTypeSpec };
+    WCHAR name[MetadataNameLength];
+
+    for (ULONG rid = 1; rid <= reader.GetRowCount(MetadataTableMemberRef); rid++)
+    {
+        MetadataMemberRef memberRef;
+        if (!Check(reader.GetMemberRef(TokenFromRid(rid, mdtMemberRef), &memberRef), assembly, "MemberRef unreadable", rid))
+        {
+            continue;
+        }
+
+        Check(MetadataReader::GetName(memberRef.name, name, MetadataNameLength), assembly, "MemberRef name", rid);
+        Check(IsValidToken(reader, memberRef.parent, parents, 5), assembly, "MemberRef parent", rid);
+        Check(memberRef.signatureLength > 0, assembly, "MemberRef signature", rid);
+    }
+}
+
+// The root of the type system has to be where every profiler rewrite expects it
+static void CheckCoreLibrary(MetadataReader& reader, const std::string& assembly)
+{
+    bool foundObject = false;
+
+    for (ULONG rid = 1; rid <= reader.GetRowCount(MetadataTableTypeDef) && !foundObject; rid++)
+    {
+        MetadataTypeDef typeDef;
+        if (!reader.GetTypeDef(TokenFromRid(rid, mdtTypeDef), &typeDef) || strcmp(typeDef.nameSpace, "System") != 0 || strcmp(typeDef.name, "Object") != 0)
+        {
+            continue;
+        }
+
+        foundObject = true;
+        Check(IsNilToken(typeDef.extends), assembly, "System.Object has a base type", rid);
+
+        bool foundToString = false;
+        for (ULONG method = typeDef.methodList; method <= reader.GetRowCount(MetadataTableMethodDef); method++)
+        {
+            MetadataMethodDef methodDef;
+            if (reader.GetMethodOwner(TokenFromRid(method, mdtMethodDef)) != TokenFromRid(rid, mdtTypeDef))
+            {
+                break;
+            }
+
+            foundToString |= reader.GetMethodDef(TokenFromRid(method, mdtMethodDef), &methodDef) && strcmp(methodDef.name, "ToString") == 0;
+        }
+
+        Check(foundToString, assembly, "System.Object.ToString not found", rid);
+    }
+
+    Check(foundObject, assembly, "System.Object not found", 0);
+}
+
+static bool CheckAssembly(const std::string& directory, const std::string& fileName)
+{
+    std::string path = directory + "/" + fileName;
+    std::vector<BYTE> flat;
+    std::vector<BYTE> mapped;
+    MetadataReader flatReader;
+    MetadataReader mappedReader;
+
+    if (!Check(ReadContents(path, &flat) && MapSections(flat, &mapped), fileName, "not a PE image", 0) ||
+        !Check(flatReader.Open(flat.data(), true), fileName, "flat layout rejected", 0) ||
+        !Check(mappedReader.Open(mapped.data(), false), fileName, "mapped layout rejected", 0))
+    {
+        return false;
+    }
+
+    static const ULONG tables[] = { MetadataTableTypeRef, MetadataTableTypeDef, MetadataTableMethodDef, MetadataTableMemberRef };
+    for (ULONG table : tables)
+    {
+        Check(flatReader.GetRowCount(table) == mappedReader.GetRowCount(table), fileName, "row counts differ between layouts", table);
+    }
+
+    CheckTypeRefs(flatReader, fileName);
+    CheckTypeDefs(flatReader, fileName);
+    CheckMethodDefs(flatReader, mappedReader, fileName);
+    CheckMemberRefs(flatReader, fileName);
+
+    if (fileName == "System.Private.CoreLib.dll")
+    {
+        CheckCoreLibrary(flatReader, fileName);
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: MetadataReaderLinux <shared framework directory>\n");
+        return 2;
+    }
+
+    DIR* directory = opendir(argv[1]);
+    if (directory == NULL)
+    {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 2;
+    }
+
+    std::vector<std::string> fileNames;
+    for (struct dirent* entry = readdir(directory); entry != NULL; entry = readdir(directory))
+    {
+        size_t length = strlen(entry->d_name);
+        if (length > 4 && strcmp(entry->d_name + length - 4, ".dll") == 0)
+        {
+            fileNames.push_back(entry->d_name);
+        }
+    }
+
+    closedir(directory);
+
+    ULONG opened = 0;
+    bool coreLibrary = false;
+    for (const std::string& fileName : fileNames)
+    {
+        opened += CheckAssembly(argv[1], fileName) ? 1 : 0;
+        coreLibrary |= fileName == "System.Private.CoreLib.dll";
+    }
+
+    Check(coreLibrary, argv[1], "System.Private.CoreLib.dll not found", 0);
+
+    // A native binary has no CLI header and is turned away
+    std::vector<BYTE> self;
+    MetadataReader nativeReader;
+    Check(ReadContents("/proc/self/exe", &self) && self.size() > 2 && !nativeReader.Open(self.data(), true), "/proc/self/exe", "native binary accepted", 0);
+
+    printf("%lu of %zu assemblies read, %lu failures\n", (unsigned long)opened, fileNames.size(), (unsigned long)failures);
+
+    return failures == 0 ? 0 : 1;
+}
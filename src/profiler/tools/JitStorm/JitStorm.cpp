@@ -0,0 +1,501 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Drives a JIT storm through the profiler's own sources: 1, 2, 4 ... threads compile the methods of a
+// made-up ASP.NET Core service as fast as they can, with MockProfilerInfo answering from a recording
+// built in memory, and the callback rate is printed for each thread count. Only the callbacks the
+// profiler asked for are made. The profiler reads its settings from the environment as usual.
+// Usage: JitStorm [--threads N] [--seconds S]
+//
+// Worker n is named jitstorm-n and pinned to CPU n, so perf c2c can be read per worker. Record one thread
+// count at a time, each run then holds a single sharing pattern:
+//     perf c2c record -- ./JitStorm --threads 8 --seconds 5
+//     perf c2c report --stdio
+// The mocks count their references on shared words too, lines inside MockMetaData are the harness's own.
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "stdafx.h"
+#include "Clock.h"
+#include "CorProfiler.h"
+#include "MockProfilerInfo.h"
+#include "Recording.h"
+
+#define JitStormMethods 20000
+#define JitStormDefaultSeconds 2
+#define JitStormSeed 20200415
+#define JitStormMaximumPass 0xFFFF
+#define JitStormModuleBase 0x00007F5A10000000ULL
+#define JitStormClassBase 0x00007F5B00000000ULL
+#define JitStormFunctionBase 0x00007F5C00000000ULL
+#define JitStormThreadBase 0x00007F5D00000000ULL
+#define JitStormAppDomain 0x00007F5E00001000ULL
+
+typedef struct
+{
+    const char* assembly;
+    const char* directory;
+    ULONG weight;             // percent of the methods compiled before the first request is served
+    const char* const* types; // hottest first
+} StormModule;
+
+typedef struct
+{
+    ULONG module;
+    const char* type;
+    const char* method;
+} StormNamedMethod;
+
+typedef struct
+{
+    FunctionID functionId;
+    ClassID classId;
+    bool firstOfClass;
+} StormMethod;
+
+#define NetCoreDirectory "/usr/share/dotnet/shared/Microsoft.NETCore.App/3.1.0/"
+#define AspNetCoreDirectory "/usr/share/dotnet/shared/Microsoft.AspNetCore.App/3.1.0/"
+#define AppDirectory "/app/"
+
+static const char* const CoreLibTypes[] = { "System.Collections.Generic.Dictionary`2", "System.String", "System.Collections.Generic.List`1",
+    "System.Runtime.CompilerServices.AsyncTaskMethodBuilder`1", "System.Threading.Tasks.Task`1", "System.Span`1", "System.Text.StringBuilder",
+    "System.RuntimeType", "System.Number", "System.SpanHelpers", "System.Buffers.TlsOverPerCoreLockedStacksArrayPool`1",
+    "System.Threading.ExecutionContext", "System.Globalization.CultureInfo", "System.Enum", "System.Lazy`1", "<>c", NULL };
+static const char* const LinqTypes[] = { "System.Linq.Enumerable", "SelectListIterator`2", "WhereSelectEnumerableIterator`2", "System.Linq.Buffer`1", NULL };
+static const char* const CollectionsTypes[] = { "System.Collections.Generic.Queue`1", "System.Collections.Generic.Stack`1", "System.Collections.Generic.SortedSet`1", NULL };
+static const char* const ConcurrentTypes[] = { "System.Collections.Concurrent.ConcurrentDictionary`2", "System.Collections.Concurrent.ConcurrentQueue`1", NULL };
+static const char* const JsonTypes[] = { "System.Text.Json.Utf8JsonWriter", "System.Text.Json.JsonSerializer", "System.Text.Json.Utf8JsonReader", NULL };
+static const char* const UriTypes[] = { "System.Uri", "System.UriParser", NULL };
+static const char* const HttpTypes[] = { "System.Net.Http.HttpClient", "System.Net.Http.HttpConnectionPool", "System.Net.Http.HttpRequestMessage", NULL };
+static const char* const DiagnosticsTypes[] = { "System.Diagnostics.DiagnosticListener", "System.Diagnostics.Activity", NULL };
+static const char* const InjectionTypes[] = { "Microsoft.Extensions.DependencyInjection.ServiceLookup.CallSiteFactory", "Microsoft.Extensions.DependencyInjection.ServiceProvider",
+    "Microsoft.Extensions.DependencyInjection.ServiceLookup.CallSiteRuntimeResolver", "Microsoft.Extensions.DependencyInjection.ServiceCollectionServiceExtensions", NULL };
+static const char* const ConfigurationTypes[] = { "Microsoft.Extensions.Configuration.ConfigurationRoot", "Microsoft.Extensions.Configuration.ConfigurationProvider",
+    "Microsoft.Extensions.Configuration.ConfigurationBinder", NULL };
+static const char* const LoggingTypes[] = { "Microsoft.Extensions.Logging.Logger", "Microsoft.Extensions.Logging.LoggerFactory", "Microsoft.Extensions.Logging.LoggerMessage", NULL };
+static const char* const OptionsTypes[] = { "Microsoft.Extensions.Options.OptionsFactory`1", "Microsoft.Extensions.Options.OptionsManager`1", NULL };
+static const char* const HostingTypes[] = { "Microsoft.AspNetCore.Hosting.GenericWebHostService", "Microsoft.AspNetCore.Hosting.HostingApplication",
+    "Microsoft.AspNetCore.Hosting.WebHostBuilderExtensions", NULL };
+static const char* const RoutingTypes[] = { "Microsoft.AspNetCore.Routing.Matching.DfaMatcherBuilder", "Microsoft.AspNetCore.Routing.EndpointRoutingMiddleware",
+    "Microsoft.AspNetCore.Routing.Matching.DfaMatcher", "Microsoft.AspNetCore.Routing.RouteEndpointBuilder", NULL };
+static const char* const KestrelTypes[] = { "Microsoft.AspNetCore.Server.Kestrel.Core.Internal.Http.HttpProtocol", "Microsoft.AspNetCore.Server.Kestrel.Core.Internal.Http.Http1Connection",
+    "Microsoft.AspNetCore.Server.Kestrel.Core.Internal.Http.HttpRequestHeaders", "Microsoft.AspNetCore.Server.Kestrel.Core.KestrelServer", "<ProcessRequests>d__216`1", NULL };
+static const char* const MvcTypes[] = { "Microsoft.AspNetCore.Mvc.Infrastructure.ControllerActionInvoker", "Microsoft.AspNetCore.Mvc.Infrastructure.ResourceInvoker",
+    "Microsoft.AspNetCore.Mvc.Infrastructure.ObjectResultExecutor", "Microsoft.AspNetCore.Mvc.ModelBinding.ModelBinderFactory", NULL };
+static const char* const HttpAbstractionsTypes[] = { "Microsoft.AspNetCore.Http.DefaultHttpContext", "Microsoft.AspNetCore.Http.HeaderDictionary", NULL };
+static const char* const NewtonsoftTypes[] = { "Newtonsoft.Json.Serialization.JsonSerializerInternalReader", "Newtonsoft.Json.JsonTextReader",
+    "Newtonsoft.Json.Serialization.DefaultContractResolver", NULL };
+static const char* const SqlClientTypes[] = { "System.Data.SqlClient.TdsParser", "System.Data.SqlClient.SqlDataReader", "System.Data.SqlClient.SqlConnection",
+    "System.Data.SqlClient.SqlCommand", NULL };
+static const char* const RecorderTypes[] = { "Amazon.XRay.Recorder.Core.AWSXRayRecorder", "Amazon.XRay.Recorder.Core.Internal.Entities.Segment",
+    "Amazon.XRay.Recorder.Core.Sampling.DefaultSamplingStrategy", NULL };
+static const char* const AppTypes[] = { "Orders.Web.Data.OrderRepository", "Orders.Web.Controllers.OrdersController", "Orders.Web.Startup", "Orders.Web.Program", NULL };
+
+// Roughly what a small service with MVC, SqlClient and the X-Ray SDK compiles up to its first response,
+// by assembly. The core library alone is a third of it.
+static const StormModule StormModules[] =
+{
+    { "System.Private.CoreLib", NetCoreDirectory, 34, CoreLibTypes },
+    { "System.Linq", NetCoreDirectory, 4, LinqTypes },
+    { "System.Collections", NetCoreDirectory, 2, CollectionsTypes },
+    { "System.Collections.Concurrent", NetCoreDirectory, 2, ConcurrentTypes },
+    { "System.Text.Json", NetCoreDirectory, 3, JsonTypes },
+    { "System.Private.Uri", NetCoreDirectory, 1, UriTypes },
+    { "System.Net.Http", NetCoreDirectory, 2, HttpTypes },
+    { "System.Diagnostics.DiagnosticSource", NetCoreDirectory, 1, DiagnosticsTypes },
+    { "Microsoft.Extensions.DependencyInjection", AspNetCoreDirectory, 6, InjectionTypes },
+    { "Microsoft.Extensions.Configuration", AspNetCoreDirectory, 3, ConfigurationTypes },
+    { "Microsoft.Extensions.Logging", AspNetCoreDirectory, 3, LoggingTypes },
+    { "Microsoft.Extensions.Options", AspNetCoreDirectory, 2, OptionsTypes },
+    { "Microsoft.AspNetCore.Hosting", AspNetCoreDirectory, 4, HostingTypes },
+    { "Microsoft.AspNetCore.Routing", AspNetCoreDirectory, 5, RoutingTypes },
+    { "Microsoft.AspNetCore.Server.Kestrel.Core", AspNetCoreDirectory, 7, KestrelTypes },
+    { "Microsoft.AspNetCore.Mvc.Core", AspNetCoreDirectory, 6, MvcTypes },
+    { "Microsoft.AspNetCore.Http", AspNetCoreDirectory, 2, HttpAbstractionsTypes },
+    { "Newtonsoft.Json", AppDirectory, 3, NewtonsoftTypes },
+    { "System.Data.SqlClient", AppDirectory, 3, SqlClientTypes },
+    { "AWSXRayRecorder.Core", AppDirectory, 3, RecorderTypes },
+    { "Orders.Web", AppDirectory, 4, AppTypes },
+};
+
+#define JitStormModuleCount (sizeof(StormModules) / sizeof(StormModules[0]))
+#define JitStormSqlClient 18
+#define JitStormRecorder 19
+#define JitStormApp 20
+
+// Method names by how often they are compiled, accessors and state machines well ahead of the rest
+static const char* const StormMethodNames[] = { ".ctor", "get_Item", "MoveNext", "Invoke", "get_Count", "TryGetValue", "Add", "GetEnumerator",
+    "Equals", "GetHashCode", "get_Value", "Dispose", ".cctor", "ToString", "set_Item", "Start", "SetStateMachine", "GetResult", "FindValue",
+    "AwaitUnsafeOnCompleted", "Create", "GetService", "TryInsert", "Resize", "Parse", "Write", "Read", "CompareTo", "AddRange", "ToList", "Select",
+    "Where", "Initialize", "Build", "Bind", "<.ctor>b__0_0", "<Invoke>g__Awaited|6_0", "InvokeAsync", "ExecuteAsync", "Configure" };
+
+#define JitStormMethodNameCount (sizeof(StormMethodNames) / sizeof(StormMethodNames[0]))
+
+// Methods the profiler looks for by name, compiled once each among the others
+static const StormNamedMethod StormNamedMethods[] =
+{
+    { JitStormSqlClient, "System.Data.SqlClient.SqlCommand", "ExecuteReader" },
+    { JitStormSqlClient, "System.Data.SqlClient.SqlCommand", "ExecuteNonQuery" },
+    { JitStormSqlClient, "System.Data.SqlClient.SqlCommand", "ExecuteScalar" },
+    { JitStormSqlClient, "System.Data.SqlClient.SqlCommand", "ExecuteReaderAsync" },
+    { JitStormRecorder, "Amazon.XRay.Recorder.Core.AWSXRayRecorder", "BeginSegment" },
+    { JitStormRecorder, "Amazon.XRay.Recorder.Core.AWSXRayRecorder", "EndSegment" },
+    { JitStormApp, "Orders.Web.Program", "CreateHostBuilder" },
+    { JitStormApp, "Orders.Web.Controllers.OrdersController", "Get" },
+};
+
+static RecordedName Widen(const std::string& name)
+{
+    return RecordedName(name.begin(), name.end());
+}
+
+// Every method gets a function, its method and type properties and an owning module and assembly, the
+// answers the name path of JITCompilationStarted asks for. No module is marked indexed, so each method
+// is matched by name: the storm measures the path the index exists to shorten.
+static void BuildStorm(Recording* recording, std::vector<StormMethod>* methods)
+{
+    std::mt19937 random(JitStormSeed);
+
+    std::vector<double> moduleWeights;
+    for (const StormModule& module : StormModules)
+    {
+        moduleWeights.push_back(module.weight);
+    }
+
+    std::vector<double> nameWeights;
+    for (ULONG i = 0; i < JitStormMethodNameCount; i++)
+    {
+        nameWeights.push_back(1.0 / (i + 1));
+    }
+
+    std::discrete_distribution<ULONG> moduleDistribution(moduleWeights.begin(), moduleWeights.end());
+    std::discrete_distribution<ULONG> nameDistribution(nameWeights.begin(), nameWeights.end());
+    std::vector<std::discrete_distribution<ULONG>> typeDistributions;
+    std::vector<ULONG> nextRids(JitStormModuleCount, 1);
+    std::vector<bool> loadedTypes;
+    std::vector<ULONG> typeOffsets;
+
+    for (ULONG i = 0; i < JitStormModuleCount; i++)
+    {
+        const StormModule& module = StormModules[i];
+        ModuleID moduleId = JitStormModuleBase + i * 0x10000;
+        AssemblyID assemblyId = moduleId + 0x8000;
+
+        recording->modules[moduleId] = { assemblyId, S_OK, Widen(std::string(module.directory) + module.assembly + ".dll") };
+        recording->assemblies[assemblyId] = { JitStormAppDomain, moduleId, S_OK, Widen(module.assembly) };
+
+        std::vector<double> typeWeights;
+        typeOffsets.push_back((ULONG)loadedTypes.size());
+        for (ULONG j = 0; module.types[j] != NULL; j++)
+        {
+            typeWeights.push_back(1.0 / (j + 1));
+            loadedTypes.push_back(false);
+            recording->typeDefs[{ moduleId, TokenFromRid(j + 2, mdtTypeDef) }] = { tdPublic, mdTokenNil, S_OK, Widen(module.types[j]) };
+        }
+
+        typeDistributions.emplace_back(typeWeights.begin(), typeWeights.end());
+    }
+
+    auto addMethod = [&](ULONG module, ULONG type, const char* name, bool named)
+    {
+        ModuleID moduleId = JitStormModuleBase + module * 0x10000;
+        ULONG classIndex = typeOffsets[module] + type;
+        mdMethodDef token = TokenFromRid(nextRids[module]++, mdtMethodDef);
+        bool isStatic = strcmp(name, ".cctor") == 0;
+
+        StormMethod method;
+        method.functionId = JitStormFunctionBase + methods->size() * 0x40;
+        method.classId = JitStormClassBase + classIndex * 0x100;
+        method.firstOfClass = !loadedTypes[classIndex];
+        loadedTypes[classIndex] = true;
+        methods->push_back(method);
+
+        recording->functions[method.functionId] = { method.classId, moduleId, token, S_OK };
+        recording->methods[{ moduleId, token }] = { TokenFromRid(type + 2, mdtTypeDef), (DWORD)(mdPublic | mdHideBySig | (isStatic ? mdStatic : 0)), 0, S_OK, Widen(name),
+                                                    { (BYTE)(isStatic ? IMAGE_CEE_CS_CALLCONV_DEFAULT : IMAGE_CEE_CS_CALLCONV_HASTHIS), 0x00, ELEMENT_TYPE_VOID } };
+
+        // Only methods the profiler may rewrite are asked for their body, a tiny header and ret will do
+        if (named)
+        {
+            recording->bodies[{ moduleId, token }] = { S_OK, 2, { (BYTE)((1 << 2) | CorILMethod_TinyFormat), 0x2A } };
+        }
+    };
+
+    ULONG namedSpacing = JitStormMethods / (sizeof(StormNamedMethods) / sizeof(StormNamedMethods[0]) + 1);
+    for (ULONG i = 0; i < JitStormMethods; i++)
+    {
+        const StormNamedMethod* named = i % namedSpacing == 0 && i / namedSpacing > 0 && i / namedSpacing <= sizeof(StormNamedMethods) / sizeof(StormNamedMethods[0]) ?
+                                        &StormNamedMethods[i / namedSpacing - 1] : NULL;
+
+        if (named != NULL)
+        {
+            ULONG type = 0;
+            while (strcmp(StormModules[named->module].types[type], named->type) != 0)
+            {
+                type++;
+            }
+
+            addMethod(named->module, type, named->method, true);
+            continue;
+        }
+
+        ULONG module = moduleDistribution(random);
+        addMethod(module, typeDistributions[module](random), StormMethodNames[nameDistribution(random)], false);
+    }
+}
+
+// Modules are loaded once, in the order the runtime reports them, before the first storm
+static ULONG64 LoadModules(ICorProfilerCallback10* profiler, MockProfilerInfo* info, const Recording& recording)
+{
+    ULONG64 callbacks = 0;
+    DWORD eventsLow = 0;
+    DWORD eventsHigh = 0;
+    info->GetEventMask2(&eventsLow, &eventsHigh);
+
+    for (auto& module : recording.modules)
+    {
+        AssemblyID assemblyId = module.second.assemblyId;
+
+        if (eventsLow & COR_PRF_MONITOR_ASSEMBLY_LOADS)
+        {
+            profiler->AssemblyLoadStarted(assemblyId);
+            callbacks++;
+        }
+
+        if (eventsLow & COR_PRF_MONITOR_MODULE_LOADS)
+        {
+            profiler->ModuleLoadStarted(module.first);
+            profiler->ModuleLoadFinished(module.first, S_OK);
+            profiler->ModuleAttachedToAssembly(module.first, assemblyId);
+            callbacks += 3;
+        }
+
+        if (eventsLow & COR_PRF_MONITOR_ASSEMBLY_LOADS)
+        {
+            profiler->AssemblyLoadFinished(assemblyId, S_OK);
+            callbacks++;
+        }
+    }
+
+    return callbacks;
+}
+
+static void NameWorker(ULONG index)
+{
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(index % std::thread::hardware_concurrency(), &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+    char name[16];
+    snprintf(name, sizeof(name), "jitstorm-%u", (unsigned int)index);
+    pthread_setname_np(pthread_self(), name);
+#endif
+}
+
+// Each worker compiles every threadCount-th method, so the workers never compile the same method at once.
+// A worker that gets through its share starts again under new function ids, another process starting up.
+static void RunStorm(ICorProfilerCallback10* profiler, MockProfilerInfo* info, const std::vector<StormMethod>& methods, ULONG threadCount, ULONG seconds, ULONG* firstPass)
+{
+    std::vector<std::thread> threads;
+    std::vector<ULONG64> callbacks(threadCount, 0);
+    std::vector<ULONG> laps(threadCount, 0);
+    std::atomic<bool> stop(false);
+    std::atomic<ULONG> ready(0);
+
+    for (ULONG i = 0; i < threadCount; i++)
+    {
+        threads.emplace_back([&, i]()
+        {
+            NameWorker(i);
+
+            DWORD eventsLow = 0;
+            DWORD eventsHigh = 0;
+            info->GetEventMask2(&eventsLow, &eventsHigh);
+
+            ThreadID threadId = JitStormThreadBase + ((ThreadID)*firstPass << 16) + i * 0x100;
+            if (eventsLow & COR_PRF_MONITOR_THREADS)
+            {
+                profiler->ThreadCreated(threadId);
+                profiler->ThreadAssignedToOSThread(threadId, GetCurrentThreadId());
+            }
+
+            ready.fetch_add(1);
+            while (ready.load() < threadCount)
+            {
+                std::this_thread::yield();
+            }
+
+            // Counted in locals and stored once at the end, so the harness adds no written lines of its own
+            ULONG64 count = 0;
+            ULONG lap = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                // The runtime only calls back for the events the profiler currently asks for
+                info->GetEventMask2(&eventsLow, &eventsHigh);
+                ULONG pass = (*firstPass + lap) % JitStormMaximumPass + 1;
+
+                for (size_t j = i; j < methods.size() && !stop.load(std::memory_order_relaxed); j += threadCount)
+                {
+                    const StormMethod& method = methods[j];
+
+                    if (method.firstOfClass && (eventsLow & COR_PRF_MONITOR_CLASS_LOADS))
+                    {
+                        profiler->ClassLoadStarted(method.classId);
+                        profiler->ClassLoadFinished(method.classId, S_OK);
+                        count += 2;
+                    }
+
+                    if (eventsLow & COR_PRF_MONITOR_JIT_COMPILATION)
+                    {
+                        FunctionID functionId = MockProfilerInfo::GetReplayedFunctionId(method.functionId, pass);
+                        profiler->JITCompilationStarted(functionId, TRUE);
+                        profiler->JITCompilationFinished(functionId, S_OK, TRUE);
+                        count += 2;
+                    }
+                }
+
+                lap++;
+            }
+
+            if (eventsLow & COR_PRF_MONITOR_THREADS)
+            {
+                profiler->ThreadDestroyed(threadId);
+            }
+
+            callbacks[i] = count;
+            laps[i] = lap;
+        });
+    }
+
+    while (ready.load() < threadCount)
+    {
+        std::this_thread::yield();
+    }
+
+    LONG64 started = Clock::GetCounter();
+    Sleep(seconds * 1000);
+    stop.store(true);
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    double elapsed = (double)(Clock::GetCounter() - started) / Clock::GetFrequency();
+    ULONG64 total = 0;
+    ULONG64 slowest = callbacks[0];
+    ULONG maximumLaps = 0;
+    for (ULONG i = 0; i < threadCount; i++)
+    {
+        total += callbacks[i];
+        slowest = callbacks[i] < slowest ? callbacks[i] : slowest;
+        maximumLaps = laps[i] > maximumLaps ? laps[i] : maximumLaps;
+    }
+
+    // The next storm starts past every pass this one used
+    *firstPass = (*firstPass + maximumLaps) % JitStormMaximumPass;
+
+    printf("%-40s threads=%-3lu %14.0f callbacks/s %14.0f callbacks/s/thread %14.0f slowest thread %8.1f ns/callback\n", "JITCompilationStarted storm",
+        (unsigned long)threadCount, total / elapsed, total / elapsed / threadCount, slowest / elapsed, total > 0 ? elapsed * threadCount * 1e9 / total : 0);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+    ULONG onlyThreads = 0;
+    ULONG seconds = JitStormDefaultSeconds;
+
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--threads") == 0 && atoi(argv[i + 1]) > 0)
+        {
+            onlyThreads = (ULONG)atoi(argv[i + 1]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--seconds") == 0 && atoi(argv[i + 1]) > 0)
+        {
+            seconds = (ULONG)atoi(argv[i + 1]);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: JitStorm [--threads N] [--seconds S]\n");
+            return 1;
+        }
+    }
+
+#if defined(__linux__)
+    if (PAL_Initialize(argc, argv) != 0)
+    {
+        fprintf(stderr, "Unable to initialize the PAL\n");
+        return 1;
+    }
+#endif
+
+    Recording recording;
+    std::vector<StormMethod> methods;
+    BuildStorm(&recording, &methods);
+
+    ReplayDivergence divergence = {};
+    MockProfilerInfo* info = new MockProfilerInfo(&recording, &divergence);
+    ICorProfilerCallback10* profiler = CreateCorProfiler();
+
+    HRESULT hr = profiler->Initialize(info);
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Initialize failed with 0x%08x\n", (unsigned int)hr);
+        return 1;
+    }
+
+    DWORD eventsLow = 0;
+    DWORD eventsHigh = 0;
+    info->GetEventMask2(&eventsLow, &eventsHigh);
+    ULONG64 moduleCallbacks = LoadModules(profiler, info, recording);
+
+    printf("process %u, event mask 0x%08x 0x%08x, %zu modules, %zu types, %zu methods, %llu load callbacks\n",
+           (unsigned int)GetCurrentProcessId(), (unsigned int)eventsLow, (unsigned int)eventsHigh, recording.modules.size(), recording.typeDefs.size(), methods.size(),
+           (unsigned long long)moduleCallbacks);
+    fflush(stdout);
+
+    ULONG firstPass = 0;
+    if (onlyThreads != 0)
+    {
+        RunStorm(profiler, info, methods, onlyThreads, seconds, &firstPass);
+    }
+    else
+    {
+        ULONG processors = std::thread::hardware_concurrency();
+        for (ULONG threads = 1; threads <= processors; threads *= 2)
+        {
+            RunStorm(profiler, info, methods, threads, seconds, &firstPass);
+        }
+    }
+
+    profiler->Shutdown();
+    profiler->Release();
+
+    if (divergence.unrecordedFunctions.load() != 0 || divergence.unrecordedBodies.load() != 0)
+    {
+        printf("unrecorded: %llu functions, %llu bodies\n",
+               (unsigned long long)divergence.unrecordedFunctions.load(), (unsigned long long)divergence.unrecordedBodies.load());
+    }
+
+    if (info->GetReferences() != 0)
+    {
+        printf("ICorProfilerInfo8 still holds %d references\n", (int)info->GetReferences());
+    }
+
+    delete info;
+
+    return 0;
+}
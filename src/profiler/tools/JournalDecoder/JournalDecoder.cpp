@@ -0,0 +1,170 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Turns a journal dumped by the profiler into a readable timeline.
+// Usage: JournalDecoder <journal file>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <vector>
+#include "JournalFormat.h"
+
+static const char* GetEventName(uint16_t eventType)
+{
+    switch (eventType)
+    {
+    case JournalMethodConsidered: return "MethodConsidered";
+    case JournalRewriteStarted: return "RewriteStarted";
+    case JournalRewriteFinished: return "RewriteFinished";
+    case JournalRewriteFailed: return "RewriteFailed";
+    case JournalCallFailed: return "CallFailed";
+    case JournalEventMaskChanged: return "EventMaskChanged";
+    case JournalProbeShed: return "ProbeShed";
+    case JournalProbeRestored: return "ProbeRestored";
+    case JournalCallSitesRedirected: return "CallSitesRedirected";
+    case JournalStartupCompleted: return "StartupCompleted";
+    case JournalStarvationStarted: return "StarvationStarted";
+    case JournalStarvationEnded: return "StarvationEnded";
+    case JournalStarvationSegment: return "StarvationSegment";
+    case JournalGCSegment: return "GCSegment";
+    default: return "Unknown";
+    }
+}
+
+static const char* GetSiteName(uint16_t site)
+{
+    switch (site)
+    {
+    case JournalSiteNone: return "";
+    case JournalSiteSetEventMask: return "SetEventMask";
+    case JournalSiteGetFunctionInfo: return "GetFunctionInfo";
+    case JournalSiteGetModuleInfo: return "GetModuleInfo";
+    case JournalSiteGetAssemblyInfo: return "GetAssemblyInfo";
+    case JournalSiteGetTokenAndMetaDataFromFunction: return "GetTokenAndMetaDataFromFunction";
+    case JournalSiteGetMethodProps: return "GetMethodProps";
+    case JournalSiteGetTypeDefProps: return "GetTypeDefProps";
+    case JournalSiteGetILFunctionBody: return "GetILFunctionBody";
+    case JournalSiteGetILFunctionBodyAllocator: return "GetILFunctionBodyAllocator";
+    case JournalSiteAllocILFunctionBody: return "IMethodMalloc::Alloc";
+    case JournalSiteGetModuleMetaData: return "GetModuleMetaData";
+    case JournalSiteQueryAssemblyEmit: return "QueryInterface(IMetaDataAssemblyEmit)";
+    case JournalSiteDefineAssemblyRef: return "DefineAssemblyRef";
+    case JournalSiteDefineTypeRefByName: return "DefineTypeRefByName";
+    case JournalSiteDefineMemberRef: return "DefineMemberRef";
+    case JournalSiteSetILFunctionBody: return "SetILFunctionBody";
+    case JournalSiteGetGenerationBounds: return "GetGenerationBounds";
+    default: return "Unknown";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: JournalDecoder <journal file>\n");
+        return 1;
+    }
+
+    FILE* input = fopen(argv[1], "rb");
+    if (input == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", argv[1]);
+        return 1;
+    }
+
+    JournalHeader header;
+    if (fread(&header, sizeof(header), 1, input) != 1 ||
+        header.magic != JournalMagic ||
+        header.formatVersion != JournalFormatVersion ||
+        header.recordSize != sizeof(JournalRecord) ||
+        header.counterFrequency <= 0)
+    {
+        fprintf(stderr, "%s is not a profiler journal\n", argv[1]);
+        fclose(input);
+        return 1;
+    }
+
+    std::vector<JournalRecord> records(header.capacity);
+    size_t count = fread(records.data(), sizeof(JournalRecord), header.capacity, input);
+    fclose(input);
+
+    // Drop empty slots and records that were being overwritten while the dump was taken
+    std::vector<JournalRecord> timeline;
+    for (size_t i = 0; i < count; i++)
+    {
+        const JournalRecord& record = records[i];
+
+        if (record.sequence != 0 && record.sequence <= header.writeIndex && (record.sequence - 1) % header.capacity == i)
+        {
+            timeline.push_back(record);
+        }
+    }
+
+    std::sort(timeline.begin(), timeline.end(), [](const JournalRecord& left, const JournalRecord& right)
+    {
+        return left.sequence < right.sequence;
+    });
+
+    printf("process %u, %" PRIu64 " events written, %zu retained\n", header.processId, header.writeIndex, timeline.size());
+
+    if (timeline.empty())
+    {
+        return 0;
+    }
+
+    double microsecondsPerTick = 1000000.0 / header.counterFrequency;
+    int64_t firstCounter = timeline.front().counter;
+
+    for (const JournalRecord& record : timeline)
+    {
+        double epochSeconds = (header.dumpEpochMicroseconds - (header.dumpCounter - record.counter) * microsecondsPerTick) / 1000000.0;
+        double offsetMilliseconds = (record.counter - firstCounter) * microsecondsPerTick / 1000.0;
+
+        printf("%17.6f  +%11.3fms  %6u  %-18s", epochSeconds, offsetMilliseconds, record.threadId, GetEventName(record.eventType));
+
+        switch (record.eventType)
+        {
+        case JournalMethodConsidered:
+        case JournalRewriteStarted:
+            printf("function=0x%" PRIx64, record.value);
+            break;
+        case JournalRewriteFinished:
+        case JournalRewriteFailed:
+            printf("took %.1fus", record.value * microsecondsPerTick);
+            break;
+        case JournalCallFailed:
+            printf("%s hr=0x%08" PRIx64, GetSiteName(record.site), record.value);
+            break;
+        case JournalEventMaskChanged:
+            printf("%s mask=0x%08" PRIx64, GetSiteName(record.site), record.value);
+            break;
+        case JournalProbeShed:
+        case JournalProbeRestored:
+            printf("slot=%" PRIu64 " overhead=%" PRIu64 "us/s", record.value >> 32, record.value & 0xFFFFFFFF);
+            break;
+        case JournalCallSitesRedirected:
+            printf("sites=%" PRIu64, record.value);
+            break;
+        case JournalStartupCompleted:
+        case JournalStarvationEnded:
+            printf("took %.1fms", record.value / 1000.0);
+            break;
+        case JournalStarvationStarted:
+            printf("blocked=%" PRIu64 " pool=%" PRIu64, record.value >> 32, record.value & 0xFFFFFFFF);
+            break;
+        case JournalStarvationSegment:
+        case JournalGCSegment:
+            printf("segment=%016" PRIx64, record.value);
+            break;
+        default:
+            printf("site=%u value=0x%" PRIx64, record.site, record.value);
+            break;
+        }
+
+        printf("\n");
+    }
+
+    return 0;
+}
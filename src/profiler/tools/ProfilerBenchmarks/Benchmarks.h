@@ -0,0 +1,26 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <functional>
+#include "cor.h"
+
+#define BenchmarkSeconds 2
+#define BenchmarkBatch 1024
+
+// Runs the operation in batches on each of the given number of threads for BenchmarkSeconds,
+// then prints the total and per-thread rate. The operation is called with the thread's index.
+void RunThreads(const char* name, ULONG threadCount, const std::function<void(ULONG)>& operation);
+
+// Runs RunThreads for 1, 2, 4 ... threads up to the number of logical processors
+void RunThreadScaling(const char* name, const std::function<void(ULONG)>& operation);
+
+// Prints the mean time of one call, for operations that are timed on a single thread
+void ReportCall(const char* name, ULONG64 calls, LONG64 elapsedCounter);
+
+void BenchmarkIds();
+void BenchmarkMetadata();
+void BenchmarkSampler();
+void BenchmarkSegmentEncoder();
+void BenchmarkSqlCommands();
@@ -0,0 +1,22 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "IdGenerator.h"
+#include "Benchmarks.h"
+
+// Each thread owns its generator state, so the rate should scale with the thread count
+void BenchmarkIds()
+{
+    RunThreadScaling("GenerateXRayTraceId", [](ULONG)
+    {
+        WCHAR buffer[TraceIdLength];
+        GenerateXRayTraceId(buffer, TraceIdLength);
+    });
+
+    RunThreadScaling("GenerateXRaySegmentId", [](ULONG)
+    {
+        WCHAR buffer[SegmentIdLength];
+        GenerateXRaySegmentId(buffer, SegmentIdLength);
+    });
+}
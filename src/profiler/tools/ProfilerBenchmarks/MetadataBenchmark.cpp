@@ -0,0 +1,116 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+#include <string>
+#include "stdafx.h"
+#include "Clock.h"
+#include "MetadataReader.h"
+#include "Benchmarks.h"
+
+#define MetadataBenchmarkRounds 10
+
+// What JITCompilationStarted resolves for a candidate: the method's name and the name of its type.
+// The COM side starts from an opened scope; in the profiler GetTokenAndMetaDataFromFunction comes on top.
+void BenchmarkMetadata()
+{
+    WCHAR windows[MAX_PATH];
+    GetWindowsDirectoryW(windows, MAX_PATH);
+
+#if defined(_WIN64)
+    std::wstring path = std::wstring(windows) + L"\\Microsoft.NET\\Framework64\\v4.0.30319\\mscorlib.dll";
+#else
+    std::wstring path = std::wstring(windows) + L"\\Microsoft.NET\\Framework\\v4.0.30319\\mscorlib.dll";
+#endif
+
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    HANDLE mapping = file != INVALID_HANDLE_VALUE ? CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    LPCBYTE image = mapping != NULL ? (LPCBYTE)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+
+    IMetaDataDispenser* dispenser = NULL;
+    IMetaDataImport* metaDataImport = NULL;
+    CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    if (SUCCEEDED(CoCreateInstance(CLSID_CorMetaDataDispenser, NULL, CLSCTX_INPROC_SERVER, IID_IMetaDataDispenser, (void**)&dispenser)))
+    {
+        dispenser->OpenScope(path.c_str(), ofRead, IID_IMetaDataImport, (IUnknown**)&metaDataImport);
+        dispenser->Release();
+    }
+
+    MetadataReader reader;
+    if (image == NULL || metaDataImport == NULL || !reader.Open(image, true))
+    {
+        fprintf(stderr, "Unable to open %ls\n", path.c_str());
+    }
+    else
+    {
+        ULONG methodCount = reader.GetRowCount(MetadataTableMethodDef);
+        WCHAR functionName[MetadataNameLength];
+        WCHAR className[MetadataNameLength];
+        ULONG64 found = 0;
+
+        LONG64 started = Clock::GetCounter();
+        for (ULONG round = 0; round < MetadataBenchmarkRounds; round++)
+        {
+            for (ULONG rid = 1; rid <= methodCount; rid++)
+            {
+                MetadataMethodDef methodDef;
+                MetadataTypeDef typeDef;
+                mdMethodDef token = TokenFromRid(rid, mdtMethodDef);
+
+                if (reader.GetMethodDef(token, &methodDef) && MetadataReader::GetName(methodDef.name, functionName, MetadataNameLength) &&
+                    reader.GetTypeDef(reader.GetMethodOwner(token), &typeDef) && MetadataReader::GetTypeName(typeDef.nameSpace, typeDef.name, className, MetadataNameLength))
+                {
+                    found++;
+                }
+            }
+        }
+
+        ReportCall("MetadataReader method and type name", (ULONG64)methodCount * MetadataBenchmarkRounds, Clock::GetCounter() - started);
+
+        started = Clock::GetCounter();
+        for (ULONG round = 0; round < MetadataBenchmarkRounds; round++)
+        {
+            for (ULONG rid = 1; rid <= methodCount; rid++)
+            {
+                mdTypeDef classToken = mdTypeDefNil;
+                ULONG length = 0;
+                DWORD flags = 0;
+                mdToken extends = mdTokenNil;
+
+                if (SUCCEEDED(metaDataImport->GetMethodProps(TokenFromRid(rid, mdtMethodDef), &classToken, functionName, MetadataNameLength, &length, NULL, NULL, NULL, NULL, NULL)) &&
+                    SUCCEEDED(metaDataImport->GetTypeDefProps(classToken, className, MetadataNameLength, &length, &flags, &extends)))
+                {
+                    found--;
+                }
+            }
+        }
+
+        ReportCall("IMetaDataImport method and type name", (ULONG64)methodCount * MetadataBenchmarkRounds, Clock::GetCounter() - started);
+
+        // Both sides resolve the same methods, a difference means one of them failed where the other did not
+        if (found != 0)
+        {
+            fprintf(stderr, "The reader and IMetaDataImport resolved different methods\n");
+        }
+    }
+
+    if (metaDataImport != NULL)
+    {
+        metaDataImport->Release();
+    }
+
+    if (image != NULL)
+    {
+        UnmapViewOfFile(image);
+    }
+
+    if (mapping != NULL)
+    {
+        CloseHandle(mapping);
+    }
+
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file);
+    }
+}
@@ -0,0 +1,140 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Micro-benchmarks of the profiler's hot paths, compiled against the profiler's own sources.
+// Usage: ProfilerBenchmarks [benchmark ...]
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "stdafx.h"
+#include "Clock.h"
+#include "Benchmarks.h"
+
+typedef struct
+{
+    const char* name;
+    void (*run)();
+} Benchmark;
+
+static const Benchmark Benchmarks[] =
+{
+    { "ids", BenchmarkIds },
+    { "metadata", BenchmarkMetadata },
+    { "encode", BenchmarkSegmentEncoder },
+    { "sampling", BenchmarkSampler },
+    { "sql", BenchmarkSqlCommands },
+};
+
+void RunThreads(const char* name, ULONG threadCount, const std::function<void(ULONG)>& operation)
+{
+    std::vector<std::thread> threads;
+    std::vector<ULONG64> calls(threadCount, 0);
+    std::atomic<bool> stop(false);
+    std::atomic<ULONG> ready(0);
+
+    for (ULONG i = 0; i < threadCount; i++)
+    {
+        threads.emplace_back([&, i]()
+        {
+            ULONG64 count = 0;
+
+            ready.fetch_add(1);
+            while (ready.load() < threadCount)
+            {
+                std::this_thread::yield();
+            }
+
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                for (int j = 0; j < BenchmarkBatch; j++)
+                {
+                    operation(i);
+                }
+
+                count += BenchmarkBatch;
+            }
+
+            calls[i] = count;
+        });
+    }
+
+    while (ready.load() < threadCount)
+    {
+        std::this_thread::yield();
+    }
+
+    LONG64 started = Clock::GetCounter();
+    Sleep(BenchmarkSeconds * 1000);
+    stop.store(true);
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    double seconds = (double)(Clock::GetCounter() - started) / Clock::GetFrequency();
+    ULONG64 total = 0;
+    for (ULONG64 count : calls)
+    {
+        total += count;
+    }
+
+    printf("%-40s threads=%-3lu %14.0f calls/s %14.0f calls/s/thread %8.1f ns/call\n", name, (unsigned long)threadCount,
+        total / seconds, total / seconds / threadCount, seconds * threadCount * 1e9 / total);
+}
+
+void RunThreadScaling(const char* name, const std::function<void(ULONG)>& operation)
+{
+    ULONG processors = std::thread::hardware_concurrency();
+
+    for (ULONG threads = 1; threads <= processors; threads *= 2)
+    {
+        RunThreads(name, threads, operation);
+    }
+}
+
+void ReportCall(const char* name, ULONG64 calls, LONG64 elapsedCounter)
+{
+    double nanoseconds = (double)elapsedCounter * 1e9 / Clock::GetFrequency() / calls;
+    printf("%-40s %10.1f ns/call %14.0f calls/s\n", name, nanoseconds, 1e9 / nanoseconds);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t count = sizeof(Benchmarks) / sizeof(Benchmarks[0]);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        bool selected = argc < 2;
+        for (int j = 1; j < argc && !selected; j++)
+        {
+            selected = strcmp(argv[j], Benchmarks[i].name) == 0;
+        }
+
+        if (selected)
+        {
+            printf("== %s\n", Benchmarks[i].name);
+            Benchmarks[i].run();
+        }
+    }
+
+    for (int j = 1; j < argc; j++)
+    {
+        bool known = false;
+        for (size_t i = 0; i < count; i++)
+        {
+            known = known || strcmp(argv[j], Benchmarks[i].name) == 0;
+        }
+
+        if (!known)
+        {
+            fprintf(stderr, "Unknown benchmark %s\n", argv[j]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
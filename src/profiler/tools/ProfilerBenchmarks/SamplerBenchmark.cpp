@@ -0,0 +1,76 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+#include <string.h>
+#include "stdafx.h"
+#include "Sampler.h"
+#include "Benchmarks.h"
+
+// A service's rules as the X-Ray console suggests them: a few exclusions, a few busy routes, then the default
+static const char SamplerBenchmarkRules[] =
+    "{\"version\":2,\"rules\":["
+    "{\"description\":\"health\",\"host\":\"*\",\"http_method\":\"GET\",\"url_path\":\"/health\",\"fixed_target\":0,\"rate\":0},"
+    "{\"description\":\"metrics\",\"host\":\"*\",\"http_method\":\"GET\",\"url_path\":\"/metrics*\",\"fixed_target\":0,\"rate\":0},"
+    "{\"description\":\"checkout\",\"host\":\"shop.example.com\",\"http_method\":\"POST\",\"url_path\":\"/api/checkout/*\",\"fixed_target\":10,\"rate\":0.5},"
+    "{\"description\":\"orders\",\"host\":\"*.example.com\",\"http_method\":\"*\",\"url_path\":\"/api/orders/*\",\"fixed_target\":4000000000,\"rate\":0.1},"
+    "{\"description\":\"search\",\"host\":\"*.example.com\",\"http_method\":\"GET\",\"url_path\":\"/api/search?q=*\",\"fixed_target\":2,\"rate\":0.01}],"
+    "\"default\":{\"fixed_target\":1,\"rate\":0.05}}";
+
+static bool LoadBenchmarkRules()
+{
+    WCHAR path[MAX_PATH];
+    DWORD length = GetTempPathW(MAX_PATH, path);
+    if (length == 0 || length + 24 >= MAX_PATH)
+    {
+        return false;
+    }
+
+    wcscat_s(path, MAX_PATH, L"SamplerBenchmark.json");
+
+    HANDLE file = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    DWORD written = 0;
+    BOOL succeeded = WriteFile(file, SamplerBenchmarkRules, (DWORD)strlen(SamplerBenchmarkRules), &written, NULL);
+    CloseHandle(file);
+
+    HRESULT hr = succeeded ? LoadXRaySamplingRules(path) : E_FAIL;
+    DeleteFileW(path);
+
+    return SUCCEEDED(hr);
+}
+
+// Decisions only read the rules, so what does not scale with the thread count is the reservoir word
+void BenchmarkSampler()
+{
+    if (!LoadBenchmarkRules())
+    {
+        fprintf(stderr, "Unable to load the sampling rules\n");
+        return;
+    }
+
+    // The reservoir is spent within the second, so this is the match and a draw from the rate
+    RunThreadScaling("MakeXRaySamplingDecision rate", [](ULONG)
+    {
+        SamplingDecision decision;
+        MakeXRaySamplingDecision(L"shop.example.com", L"POST", L"/api/checkout/cart/42", &decision);
+    });
+
+    // A target no thread exhausts, so every decision is a compare-exchange on one shared word
+    RunThreadScaling("MakeXRaySamplingDecision reservoir", [](ULONG)
+    {
+        SamplingDecision decision;
+        MakeXRaySamplingDecision(L"api.example.com", L"GET", L"/api/orders/1234/items", &decision);
+    });
+
+    // Every rule is tried before the default one
+    RunThreadScaling("MakeXRaySamplingDecision default", [](ULONG)
+    {
+        SamplingDecision decision;
+        MakeXRaySamplingDecision(L"www.example.org", L"GET", L"/static/css/site.css", &decision);
+    });
+}
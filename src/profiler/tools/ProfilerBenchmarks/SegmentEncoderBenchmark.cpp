@@ -0,0 +1,71 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "SegmentEncoder.h"
+#include "Benchmarks.h"
+
+#define EncodeBufferLength 2048
+
+// The subsegment an instrumented SqlCommand sends, the most common document after the request segment
+static SegmentDocument CreateSqlSubsegment(const SegmentAnnotation* annotations, ULONG annotationCount)
+{
+    SegmentDocument document = { 0 };
+    document.kind = SegmentKindSubsegment;
+    document.name = L"orders@sql.example.com";
+    document.id = L"53995c3f42cd8ad8";
+    document.traceId = L"1-581cf771-a006649127e371903a2de979";
+    document.parentId = L"70de5b6f19ff9a0a";
+    document.nameSpace = L"remote";
+    document.startTime = 1478293361.271;
+    document.endTime = 1478293361.4493;
+    document.httpStatus = SegmentNoHttpStatus;
+    document.httpContentLength = SegmentNoContentLength;
+    document.sqlUrl = L"Data Source=sql.example.com;Initial Catalog=orders";
+    document.sqlDatabaseType = L"sqlserver";
+    document.sqlDatabaseVersion = L"14.00.3049";
+    document.sqlDriverVersion = L"System.Data.SqlClient-4.6.0";
+    document.sqlSanitizedQuery = L"SELECT id, total FROM orders WHERE customer = @customer AND placed > @since";
+    document.annotations = annotations;
+    document.annotationCount = annotationCount;
+
+    return document;
+}
+
+// Each thread encodes into its own buffer, so the rate should scale with the thread count
+void BenchmarkSegmentEncoder()
+{
+    SegmentAnnotation annotations[] =
+    {
+        { L"customer", SegmentAnnotationString, FALSE, L"Zo\x00EB \"Z\" M\x00FCller" },
+        { L"latency", SegmentAnnotationNumber },
+        { L"rows", SegmentAnnotationInteger },
+        { L"cached", SegmentAnnotationBoolean, FALSE },
+    };
+    annotations[1].numberValue = 0.0001784;
+    annotations[2].integerValue = 120;
+
+    SegmentDocument plain = CreateSqlSubsegment(NULL, 0);
+    SegmentDocument annotated = CreateSqlSubsegment(annotations, sizeof(annotations) / sizeof(annotations[0]));
+
+    RunThreadScaling("EncodeXRaySegment sql", [&](ULONG)
+    {
+        BYTE buffer[EncodeBufferLength];
+        ULONG written = 0;
+        EncodeXRaySegment(&plain, buffer, EncodeBufferLength, &written);
+    });
+
+    RunThreadScaling("EncodeXRaySegment sql annotated", [&](ULONG)
+    {
+        BYTE buffer[EncodeBufferLength];
+        ULONG written = 0;
+        EncodeXRaySegment(&annotated, buffer, EncodeBufferLength, &written);
+    });
+
+    // Sizing a buffer the caller does not have yet runs the same writer with nowhere to write
+    RunThreads("EncodeXRaySegment sizing", 1, [&](ULONG)
+    {
+        ULONG written = 0;
+        EncodeXRaySegment(&annotated, NULL, 0, &written);
+    });
+}
@@ -0,0 +1,35 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+#include "SqlCommands.h"
+#include "Benchmarks.h"
+
+// The native share of a traced SqlCommand call: a record taken from the pool, two clock reads and the
+// copy handed back, with every thread pushing and popping the same stack head
+void BenchmarkSqlCommands()
+{
+    SqlCommands::Enable();
+
+    RunThreadScaling("BeginXRaySqlCommand+EndXRaySqlCommand", [](ULONG)
+    {
+        SqlCommandRecord copy;
+        EndXRaySqlCommand(BeginXRaySqlCommand(), FALSE, &copy);
+    });
+
+    // Commands that stay open while others run, as awaited calls do, keep the stack from being a single entry
+    RunThreadScaling("BeginXRaySqlCommand x8 in flight", [](ULONG)
+    {
+        ULONG records[8];
+        for (ULONG& record : records)
+        {
+            record = BeginXRaySqlCommand();
+        }
+
+        SqlCommandRecord copy;
+        for (ULONG record : records)
+        {
+            EndXRaySqlCommand(record, FALSE, &copy);
+        }
+    });
+}
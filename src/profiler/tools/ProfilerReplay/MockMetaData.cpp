@@ -0,0 +1,286 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "MockMetaData.h"
+
+MockMetaData::MockMetaData(const Recording* recording, ModuleID moduleId, ReplayDivergence* divergence) :
+    recording(recording), moduleId(moduleId), divergence(divergence), references(0), nextRid(MockSyntheticRid)
+{
+    auto found = recording->targets.find(moduleId);
+    if (found == recording->targets.end())
+    {
+        return;
+    }
+
+    // Only the marked methods were recorded, so they are grouped into one made-up type per class name
+    std::map<RecordedName, mdTypeDef> classes;
+    for (const RecordedTarget& target : found->second)
+    {
+        auto added = classes.emplace(target.className, TokenFromRid(MockSyntheticRid + (ULONG)classes.size(), mdtTypeDef));
+        mdTypeDef typeDef = added.first->second;
+
+        if (added.second)
+        {
+            syntheticTypeDefs.push_back(typeDef);
+            syntheticClassNames[typeDef] = target.className;
+        }
+
+        syntheticMethods[typeDef].push_back(target.token);
+        syntheticTargets[target.token] = std::make_pair(typeDef, &target);
+    }
+}
+
+HRESULT STDMETHODCALLTYPE MockMetaData::QueryInterface(REFIID riid, void** ppvObject)
+{
+    if (ppvObject == NULL)
+    {
+        return E_POINTER;
+    }
+
+    if (riid == IID_IUnknown || riid == IID_IMetaDataImport)
+    {
+        *ppvObject = static_cast<IMetaDataImport*>(this);
+    }
+    else if (riid == IID_IMetaDataEmit)
+    {
+        *ppvObject = static_cast<IMetaDataEmit*>(this);
+    }
+    else if (riid == IID_IMetaDataAssemblyEmit)
+    {
+        *ppvObject = static_cast<IMetaDataAssemblyEmit*>(this);
+    }
+    else
+    {
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    AddRef();
+    return S_OK;
+}
+
+ULONG STDMETHODCALLTYPE MockMetaData::AddRef()
+{
+    return references.fetch_add(1) + 1;
+}
+
+ULONG STDMETHODCALLTYPE MockMetaData::Release()
+{
+    return references.fetch_sub(1) - 1;
+}
+
+void MockMetaData::CopyName(const RecordedName& name, LPWSTR buffer, ULONG bufferLength, ULONG* length)
+{
+    if (length != NULL)
+    {
+        *length = (ULONG)name.size() + 1;
+    }
+
+    if (buffer == NULL || bufferLength == 0)
+    {
+        return;
+    }
+
+    size_t copied = name.size() < bufferLength ? name.size() : bufferLength - 1;
+    memcpy(buffer, name.data(), copied * sizeof(WCHAR));
+    buffer[copied] = 0;
+}
+
+HRESULT MockMetaData::Enumerate(HCORENUM* phEnum, const std::vector<mdToken>* tokens, mdToken rTokens[], ULONG cMax, ULONG* pcTokens)
+{
+    Enumeration* enumeration = (Enumeration*)*phEnum;
+    if (enumeration == NULL)
+    {
+        enumeration = new Enumeration();
+        enumeration->next = 0;
+        if (tokens != NULL)
+        {
+            enumeration->tokens = *tokens;
+        }
+
+        *phEnum = (HCORENUM)enumeration;
+    }
+
+    ULONG count = 0;
+    while (count < cMax && enumeration->next < enumeration->tokens.size())
+    {
+        rTokens[count++] = enumeration->tokens[enumeration->next++];
+    }
+
+    if (pcTokens != NULL)
+    {
+        *pcTokens = count;
+    }
+
+    return count > 0 ? S_OK : S_FALSE;
+}
+
+void STDMETHODCALLTYPE MockMetaData::CloseEnum(HCORENUM hEnum)
+{
+    delete (Enumeration*)hEnum;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetaData::EnumTypeDefs(HCORENUM* phEnum, mdTypeDef rTypeDefs[], ULONG cMax, ULONG* pcTypeDefs)
+{
+    return Enumerate(phEnum, &syntheticTypeDefs, rTypeDefs, cMax, pcTypeDefs);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetaData::EnumMethods(HCORENUM* phEnum, mdTypeDef cl, mdMethodDef rMethods[], ULONG cMax, ULONG* pcTokens)
+{
+    auto found = syntheticMethods.find(cl);
+    return Enumerate(phEnum, found != syntheticMethods.end() ? &found->second : NULL, rMethods, cMax, pcTokens);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetaData::GetTypeDefProps(mdTypeDef td, LPWSTR szTypeDef, ULONG cchTypeDef, ULONG* pchTypeDef, DWORD* pdwTypeDefFlags, mdToken* ptkExtends)
+{
+    auto recorded = recording->typeDefs.find({ moduleId, td });
+    if (recorded != recording->typeDefs.end())
+    {
+        const RecordedTypeDef& typeDef = recorded->second;
+        if (SUCCEEDED(typeDef.hr))
+        {
+            CopyName(typeDef.name, szTypeDef, cchTypeDef, pchTypeDef);
+            if (pdwTypeDefFlags != NULL)
+            {
+                *pdwTypeDefFlags = typeDef.flags;
+            }
+
+            if (ptkExtends != NULL)
+            {
+                *ptkExtends = typeDef.extends;
+            }
+        }
+
+        return typeDef.hr;
+    }
+
+    auto synthetic = syntheticClassNames.find(td);
+    if (synthetic == syntheticClassNames.end())
+    {
+        return E_INVALIDARG;
+    }
+
+    CopyName(synthetic->second, szTypeDef, cchTypeDef, pchTypeDef);
+    if (pdwTypeDefFlags != NULL)
+    {
+        *pdwTypeDefFlags = 0;
+    }
+
+    if (ptkExtends != NULL)
+    {
+        *ptkExtends = mdTokenNil;
+    }
+
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetaData::GetMethodProps(mdMethodDef mb, mdTypeDef* pClass, LPWSTR szMethod, ULONG cchMethod, ULONG* pchMethod, DWORD* pdwAttr, PCCOR_SIGNATURE* ppvSigBlob, ULONG* pcbSigBlob, ULONG* pulCodeRVA, DWORD* pdwImplFlags)
+{
+    mdTypeDef classToken = mdTokenNil;
+    DWORD attributes = 0;
+    DWORD implFlags = 0;
+    const RecordedName* name = NULL;
+    const std::vector<BYTE>* signature = NULL;
+
+    auto recorded = recording->methods.find({ moduleId, mb });
+    auto synthetic = syntheticTargets.find(mb);
+    if (recorded != recording->methods.end())
+    {
+        const RecordedMethod& method = recorded->second;
+        if (FAILED(method.hr))
+        {
+            return method.hr;
+        }
+
+        classToken = method.classToken;
+        attributes = method.attributes;
+        implFlags = method.implFlags;
+        name = &method.name;
+        signature = &method.signature;
+    }
+    else if (synthetic != syntheticTargets.end())
+    {
+        classToken = synthetic->second.first;
+        name = &synthetic->second.second->methodName;
+    }
+    else
+    {
+        return E_INVALIDARG;
+    }
+
+    CopyName(*name, szMethod, cchMethod, pchMethod);
+    if (pClass != NULL)
+    {
+        *pClass = classToken;
+    }
+
+    if (pdwAttr != NULL)
+    {
+        *pdwAttr = attributes;
+    }
+
+    if (ppvSigBlob != NULL)
+    {
+        *ppvSigBlob = signature != NULL && !signature->empty() ? signature->data() : NULL;
+    }
+
+    if (pcbSigBlob != NULL)
+    {
+        *pcbSigBlob = signature != NULL ? (ULONG)signature->size() : 0;
+    }
+
+    if (pulCodeRVA != NULL)
+    {
+        *pulCodeRVA = 0;
+    }
+
+    if (pdwImplFlags != NULL)
+    {
+        *pdwImplFlags = implFlags;
+    }
+
+    return S_OK;
+}
+
+HRESULT MockMetaData::Define(ULONG kind, mdToken parent, LPCWSTR name, mdToken table, mdToken* token)
+{
+    RecordedDefinitionKey key(moduleId, kind, parent, RecordedName(name));
+    std::lock_guard<std::mutex> guard(definitionsLock);
+
+    // The same reference is defined again by every method that needs it, each is answered like the recorded one
+    auto recorded = recording->definitions.find(key);
+    if (recorded != recording->definitions.end())
+    {
+        size_t made = definitionCounts[key]++;
+        const RecordedDefinition& definition = recorded->second[made < recorded->second.size() ? made : recorded->second.size() - 1];
+        *token = definition.token;
+        return definition.hr;
+    }
+
+    // A definition the recorded process never made still gets a token, the same one each time it is made again,
+    // so the rewrite it belongs to can be compared
+    divergence->unrecordedDefinitions.fetch_add(1);
+    auto unrecorded = unrecordedTokens.emplace(key, TokenFromRid(nextRid, table));
+    if (unrecorded.second)
+    {
+        nextRid++;
+    }
+
+    *token = unrecorded.first->second;
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetaData::DefineTypeRefByName(mdToken tkResolutionScope, LPCWSTR szName, mdTypeRef* ptr)
+{
+    return Define(RecordingDefineTypeRef, tkResolutionScope, szName, mdtTypeRef, ptr);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetaData::DefineMemberRef(mdToken tkImport, LPCWSTR szName, PCCOR_SIGNATURE pvSigBlob, ULONG cbSigBlob, mdMemberRef* pmr)
+{
+    return Define(RecordingDefineMemberRef, tkImport, szName, mdtMemberRef, pmr);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetaData::DefineAssemblyRef(const void* pbPublicKeyOrToken, ULONG cbPublicKeyOrToken, LPCWSTR szName, const ASSEMBLYMETADATA* pMetaData, const void* pbHashValue, ULONG cbHashValue, DWORD dwAssemblyRefFlags, mdAssemblyRef* pmdar)
+{
+    return Define(RecordingDefineAssemblyRef, mdTokenNil, szName, mdtAssemblyRef, pmdar);
+}
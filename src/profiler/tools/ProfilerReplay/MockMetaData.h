@@ -0,0 +1,184 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "cor.h"
+#include "corprof.h"
+#include "Recording.h"
+
+#define MockSyntheticRid 0xF00000 // first RID of tokens the recording does not hold
+
+// One module's metadata as the recording saw it. The import side answers the method and type
+// properties recorded by the JIT callbacks, and lists one made-up type per class holding methods the
+// module index marked, so the index rebuilds the same bitmap without the image. The emit side hands back
+// the tokens recorded for each definition, in the order they were made. Calls the profiler never makes return E_NOTIMPL.
+class MockMetaData : public IMetaDataImport, public IMetaDataEmit, public IMetaDataAssemblyEmit
+{
+public:
+    MockMetaData(const Recording* recording, ModuleID moduleId, ReplayDivergence* divergence);
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override;
+    // The replay owns every mock for the whole run, references are counted only to be checked
+    ULONG STDMETHODCALLTYPE AddRef() override;
+    ULONG STDMETHODCALLTYPE Release() override;
+
+    // IMetaDataImport
+    void STDMETHODCALLTYPE CloseEnum(HCORENUM hEnum) override;
+    HRESULT STDMETHODCALLTYPE CountEnum(HCORENUM hEnum, ULONG* pulCount) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE ResetEnum(HCORENUM hEnum, ULONG ulPos) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumTypeDefs(HCORENUM* phEnum, mdTypeDef rTypeDefs[], ULONG cMax, ULONG* pcTypeDefs) override;
+    HRESULT STDMETHODCALLTYPE EnumInterfaceImpls(HCORENUM* phEnum, mdTypeDef td, mdInterfaceImpl rImpls[], ULONG cMax, ULONG* pcImpls) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumTypeRefs(HCORENUM* phEnum, mdTypeRef rTypeRefs[], ULONG cMax, ULONG* pcTypeRefs) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE FindTypeDefByName(LPCWSTR szTypeDef, mdToken tkEnclosingClass, mdTypeDef* ptd) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetScopeProps(LPWSTR szName, ULONG cchName, ULONG* pchName, GUID* pmvid) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetModuleFromScope(mdModule* pmd) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetTypeDefProps(mdTypeDef td, LPWSTR szTypeDef, ULONG cchTypeDef, ULONG* pchTypeDef, DWORD* pdwTypeDefFlags, mdToken* ptkExtends) override;
+    HRESULT STDMETHODCALLTYPE GetInterfaceImplProps(mdInterfaceImpl iiImpl, mdTypeDef* pClass, mdToken* ptkIface) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetTypeRefProps(mdTypeRef tr, mdToken* ptkResolutionScope, LPWSTR szName, ULONG cchName, ULONG* pchName) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE ResolveTypeRef(mdTypeRef tr, REFIID riid, IUnknown** ppIScope, mdTypeDef* ptd) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumMembers(HCORENUM* phEnum, mdTypeDef cl, mdToken rMembers[], ULONG cMax, ULONG* pcTokens) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumMembersWithName(HCORENUM* phEnum, mdTypeDef cl, LPCWSTR szName, mdToken rMembers[], ULONG cMax, ULONG* pcTokens) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumMethods(HCORENUM* phEnum, mdTypeDef cl, mdMethodDef rMethods[], ULONG cMax, ULONG* pcTokens) override;
+    HRESULT STDMETHODCALLTYPE EnumMethodsWithName(HCORENUM* phEnum, mdTypeDef cl, LPCWSTR szName, mdMethodDef rMethods[], ULONG cMax, ULONG* pcTokens) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumFields(HCORENUM* phEnum, mdTypeDef cl, mdFieldDef rFields[], ULONG cMax, ULONG* pcTokens) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumFieldsWithName(HCORENUM* phEnum, mdTypeDef cl, LPCWSTR szName, mdFieldDef rFields[], ULONG cMax, ULONG* pcTokens) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumParams(HCORENUM* phEnum, mdMethodDef mb, mdParamDef rParams[], ULONG cMax, ULONG* pcTokens) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumMemberRefs(HCORENUM* phEnum, mdToken tkParent, mdMemberRef rMemberRefs[], ULONG cMax, ULONG* pcTokens) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumMethodImpls(HCORENUM* phEnum, mdTypeDef td, mdToken rMethodBody[], mdToken rMethodDecl[], ULONG cMax, ULONG* pcTokens) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumPermissionSets(HCORENUM* phEnum, mdToken tk, DWORD dwActions, mdPermission rPermission[], ULONG cMax, ULONG* pcTokens) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE FindMember(mdTypeDef td, LPCWSTR szName, PCCOR_SIGNATURE pvSigBlob, ULONG cbSigBlob, mdToken* pmb) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE FindMethod(mdTypeDef td, LPCWSTR szName, PCCOR_SIGNATURE pvSigBlob, ULONG cbSigBlob, mdMethodDef* pmb) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE FindField(mdTypeDef td, LPCWSTR szName, PCCOR_SIGNATURE pvSigBlob, ULONG cbSigBlob, mdFieldDef* pmb) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE FindMemberRef(mdTypeRef td, LPCWSTR szName, PCCOR_SIGNATURE pvSigBlob, ULONG cbSigBlob, mdMemberRef* pmr) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetMethodProps(mdMethodDef mb, mdTypeDef* pClass, LPWSTR szMethod, ULONG cchMethod, ULONG* pchMethod, DWORD* pdwAttr, PCCOR_SIGNATURE* ppvSigBlob, ULONG* pcbSigBlob, ULONG* pulCodeRVA, DWORD* pdwImplFlags) override;
+    HRESULT STDMETHODCALLTYPE GetMemberRefProps(mdMemberRef mr, mdToken* ptk, LPWSTR szMember, ULONG cchMember, ULONG* pchMember, PCCOR_SIGNATURE* ppvSigBlob, ULONG* pbSig) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumProperties(HCORENUM* phEnum, mdTypeDef td, mdProperty rProperties[], ULONG cMax, ULONG* pcProperties) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumEvents(HCORENUM* phEnum, mdTypeDef td, mdEvent rEvents[], ULONG cMax, ULONG* pcEvents) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetEventProps(mdEvent ev, mdTypeDef* pClass, LPCWSTR szEvent, ULONG cchEvent, ULONG* pchEvent, DWORD* pdwEventFlags, mdToken* ptkEventType, mdMethodDef* pmdAddOn, mdMethodDef* pmdRemoveOn, mdMethodDef* pmdFire, mdMethodDef rmdOtherMethod[], ULONG cMax, ULONG* pcOtherMethod) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumMethodSemantics(HCORENUM* phEnum, mdMethodDef mb, mdToken rEventProp[], ULONG cMax, ULONG* pcEventProp) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetMethodSemantics(mdMethodDef mb, mdToken tkEventProp, DWORD* pdwSemanticsFlags) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetClassLayout(mdTypeDef td, DWORD* pdwPackSize, COR_FIELD_OFFSET rFieldOffset[], ULONG cMax, ULONG* pcFieldOffset, ULONG* pulClassSize) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetFieldMarshal(mdToken tk, PCCOR_SIGNATURE* ppvNativeType, ULONG* pcbNativeType) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetRVA(mdToken tk, ULONG* pulCodeRVA, DWORD* pdwImplFlags) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetPermissionSetProps(mdPermission pm, DWORD* pdwAction, void const** ppvPermission, ULONG* pcbPermission) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetSigFromToken(mdSignature mdSig, PCCOR_SIGNATURE* ppvSig, ULONG* pcbSig) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetModuleRefProps(mdModuleRef mur, LPWSTR szName, ULONG cchName, ULONG* pchName) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumModuleRefs(HCORENUM* phEnum, mdModuleRef rModuleRefs[], ULONG cmax, ULONG* pcModuleRefs) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetTypeSpecFromToken(mdTypeSpec typespec, PCCOR_SIGNATURE* ppvSig, ULONG* pcbSig) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetNameFromToken(mdToken tk, MDUTF8CSTR* pszUtf8NamePtr) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumUnresolvedMethods(HCORENUM* phEnum, mdToken rMethods[], ULONG cMax, ULONG* pcTokens) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetUserString(mdString stk, LPWSTR szString, ULONG cchString, ULONG* pchString) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetPinvokeMap(mdToken tk, DWORD* pdwMappingFlags, LPWSTR szImportName, ULONG cchImportName, ULONG* pchImportName, mdModuleRef* pmrImportDLL) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumSignatures(HCORENUM* phEnum, mdSignature rSignatures[], ULONG cmax, ULONG* pcSignatures) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumTypeSpecs(HCORENUM* phEnum, mdTypeSpec rTypeSpecs[], ULONG cmax, ULONG* pcTypeSpecs) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumUserStrings(HCORENUM* phEnum, mdString rStrings[], ULONG cmax, ULONG* pcStrings) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetParamForMethodIndex(mdMethodDef md, ULONG ulParamSeq, mdParamDef* ppd) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE EnumCustomAttributes(HCORENUM* phEnum, mdToken tk, mdToken tkType, mdCustomAttribute rCustomAttributes[], ULONG cMax, ULONG* pcCustomAttributes) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetCustomAttributeProps(mdCustomAttribute cv, mdToken* ptkObj, mdToken* ptkType, void const** ppBlob, ULONG* pcbSize) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE FindTypeRef(mdToken tkResolutionScope, LPCWSTR szName, mdTypeRef* ptr) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetMemberProps(mdToken mb, mdTypeDef* pClass, LPWSTR szMember, ULONG cchMember, ULONG* pchMember, DWORD* pdwAttr, PCCOR_SIGNATURE* ppvSigBlob, ULONG* pcbSigBlob, ULONG* pulCodeRVA, DWORD* pdwImplFlags, DWORD* pdwCPlusTypeFlag, UVCP_CONSTANT* ppValue, ULONG* pcchValue) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetFieldProps(mdFieldDef mb, mdTypeDef* pClass, LPWSTR szField, ULONG cchField, ULONG* pchField, DWORD* pdwAttr, PCCOR_SIGNATURE* ppvSigBlob, ULONG* pcbSigBlob, DWORD* pdwCPlusTypeFlag, UVCP_CONSTANT* ppValue, ULONG* pcchValue) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetPropertyProps(mdProperty prop, mdTypeDef* pClass, LPCWSTR szProperty, ULONG cchProperty, ULONG* pchProperty, DWORD* pdwPropFlags, PCCOR_SIGNATURE* ppvSig, ULONG* pbSig, DWORD* pdwCPlusTypeFlag, UVCP_CONSTANT* ppDefaultValue, ULONG* pcchDefaultValue, mdMethodDef* pmdSetter, mdMethodDef* pmdGetter, mdMethodDef rmdOtherMethod[], ULONG cMax, ULONG* pcOtherMethod) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetParamProps(mdParamDef tk, mdMethodDef* pmd, ULONG* pulSequence, LPWSTR szName, ULONG cchName, ULONG* pchName, DWORD* pdwAttr, DWORD* pdwCPlusTypeFlag, UVCP_CONSTANT* ppValue, ULONG* pcchValue) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetCustomAttributeByName(mdToken tkObj, LPCWSTR szName, const void** ppData, ULONG* pcbData) override { return E_NOTIMPL; }
+    BOOL STDMETHODCALLTYPE IsValidToken(mdToken tk) override { return FALSE; }
+    HRESULT STDMETHODCALLTYPE GetNestedClassProps(mdTypeDef tdNestedClass, mdTypeDef* ptdEnclosingClass) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetNativeCallConvFromSig(void const* pvSig, ULONG cbSig, ULONG* pCallConv) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE IsGlobal(mdToken pd, int* pbGlobal) override { return E_NOTIMPL; }
+
+    // IMetaDataEmit
+    HRESULT STDMETHODCALLTYPE SetModuleProps(LPCWSTR szName) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Save(LPCWSTR szFile, DWORD dwSaveFlags) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SaveToStream(IStream* pIStream, DWORD dwSaveFlags) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetSaveSize(CorSaveSize fSave, DWORD* pdwSaveSize) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineTypeDef(LPCWSTR szTypeDef, DWORD dwTypeDefFlags, mdToken tkExtends, mdToken rtkImplements[], mdTypeDef* ptd) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineNestedType(LPCWSTR szTypeDef, DWORD dwTypeDefFlags, mdToken tkExtends, mdToken rtkImplements[], mdTypeDef tdEncloser, mdTypeDef* ptd) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetHandler(IUnknown* pUnk) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineMethod(mdTypeDef td, LPCWSTR szName, DWORD dwMethodFlags, PCCOR_SIGNATURE pvSigBlob, ULONG cbSigBlob, ULONG ulCodeRVA, DWORD dwImplFlags, mdMethodDef* pmd) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineMethodImpl(mdTypeDef td, mdToken tkBody, mdToken tkDecl) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineTypeRefByName(mdToken tkResolutionScope, LPCWSTR szName, mdTypeRef* ptr) override;
+    HRESULT STDMETHODCALLTYPE DefineImportType(IMetaDataAssemblyImport* pAssemImport, const void* pbHashValue, ULONG cbHashValue, IMetaDataImport* pImport, mdTypeDef tdImport, IMetaDataAssemblyEmit* pAssemEmit, mdTypeRef* ptr) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineMemberRef(mdToken tkImport, LPCWSTR szName, PCCOR_SIGNATURE pvSigBlob, ULONG cbSigBlob, mdMemberRef* pmr) override;
+    HRESULT STDMETHODCALLTYPE DefineImportMember(IMetaDataAssemblyImport* pAssemImport, const void* pbHashValue, ULONG cbHashValue, IMetaDataImport* pImport, mdToken mbMember, IMetaDataAssemblyEmit* pAssemEmit, mdToken tkParent, mdMemberRef* pmr) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineEvent(mdTypeDef td, LPCWSTR szEvent, DWORD dwEventFlags, mdToken tkEventType, mdMethodDef mdAddOn, mdMethodDef mdRemoveOn, mdMethodDef mdFire, mdMethodDef rmdOtherMethods[], mdEvent* pmdEvent) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetClassLayout(mdTypeDef td, DWORD dwPackSize, COR_FIELD_OFFSET rFieldOffsets[], ULONG ulClassSize) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DeleteClassLayout(mdTypeDef td) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetFieldMarshal(mdToken tk, PCCOR_SIGNATURE pvNativeType, ULONG cbNativeType) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DeleteFieldMarshal(mdToken tk) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefinePermissionSet(mdToken tk, DWORD dwAction, void const* pvPermission, ULONG cbPermission, mdPermission* ppm) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetRVA(mdMethodDef md, ULONG ulRVA) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetTokenFromSig(PCCOR_SIGNATURE pvSig, ULONG cbSig, mdSignature* pmsig) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineModuleRef(LPCWSTR szName, mdModuleRef* pmur) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetParent(mdMemberRef mr, mdToken tk) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetTokenFromTypeSpec(PCCOR_SIGNATURE pvSig, ULONG cbSig, mdTypeSpec* ptypespec) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SaveToMemory(void* pbData, ULONG cbData) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineUserString(LPCWSTR szString, ULONG cchString, mdString* pstk) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DeleteToken(mdToken tkObj) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetMethodProps(mdMethodDef md, DWORD dwMethodFlags, ULONG ulCodeRVA, DWORD dwImplFlags) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetTypeDefProps(mdTypeDef td, DWORD dwTypeDefFlags, mdToken tkExtends, mdToken rtkImplements[]) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetEventProps(mdEvent ev, DWORD dwEventFlags, mdToken tkEventType, mdMethodDef mdAddOn, mdMethodDef mdRemoveOn, mdMethodDef mdFire, mdMethodDef rmdOtherMethods[]) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetPermissionSetProps(mdToken tk, DWORD dwAction, void const* pvPermission, ULONG cbPermission, mdPermission* ppm) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefinePinvokeMap(mdToken tk, DWORD dwMappingFlags, LPCWSTR szImportName, mdModuleRef mrImportDLL) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetPinvokeMap(mdToken tk, DWORD dwMappingFlags, LPCWSTR szImportName, mdModuleRef mrImportDLL) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DeletePinvokeMap(mdToken tk) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineCustomAttribute(mdToken tkOwner, mdToken tkCtor, void const* pCustomAttribute, ULONG cbCustomAttribute, mdCustomAttribute* pcv) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetCustomAttributeValue(mdCustomAttribute pcv, void const* pCustomAttribute, ULONG cbCustomAttribute) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineField(mdTypeDef td, LPCWSTR szName, DWORD dwFieldFlags, PCCOR_SIGNATURE pvSigBlob, ULONG cbSigBlob, DWORD dwCPlusTypeFlag, void const* pValue, ULONG cchValue, mdFieldDef* pmd) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineProperty(mdTypeDef td, LPCWSTR szProperty, DWORD dwPropFlags, PCCOR_SIGNATURE pvSig, ULONG cbSig, DWORD dwCPlusTypeFlag, void const* pValue, ULONG cchValue, mdMethodDef mdSetter, mdMethodDef mdGetter, mdMethodDef rmdOtherMethods[], mdProperty* pmdProp) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineParam(mdMethodDef md, ULONG ulParamSeq, LPCWSTR szName, DWORD dwParamFlags, DWORD dwCPlusTypeFlag, void const* pValue, ULONG cchValue, mdParamDef* ppd) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetFieldProps(mdFieldDef fd, DWORD dwFieldFlags, DWORD dwCPlusTypeFlag, void const* pValue, ULONG cchValue) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetPropertyProps(mdProperty pr, DWORD dwPropFlags, DWORD dwCPlusTypeFlag, void const* pValue, ULONG cchValue, mdMethodDef mdSetter, mdMethodDef mdGetter, mdMethodDef rmdOtherMethods[]) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetParamProps(mdParamDef pd, LPCWSTR szName, DWORD dwParamFlags, DWORD dwCPlusTypeFlag, void const* pValue, ULONG cchValue) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineSecurityAttributeSet(mdToken tkObj, COR_SECATTR rSecAttrs[], ULONG cSecAttrs, ULONG* pulErrorAttr) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE ApplyEditAndContinue(IUnknown* pImport) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE TranslateSigWithScope(IMetaDataAssemblyImport* pAssemImport, const void* pbHashValue, ULONG cbHashValue, IMetaDataImport* import, PCCOR_SIGNATURE pbSigBlob, ULONG cbSigBlob, IMetaDataAssemblyEmit* pAssemEmit, IMetaDataEmit* emit, PCOR_SIGNATURE pvTranslatedSig, ULONG cbTranslatedSigMax, ULONG* pcbTranslatedSig) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetMethodImplFlags(mdMethodDef md, DWORD dwImplFlags) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetFieldRVA(mdFieldDef fd, ULONG ulRVA) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Merge(IMetaDataImport* pImport, IMapToken* pHostMapToken, IUnknown* pHandler) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE MergeEnd() override { return E_NOTIMPL; }
+
+    // IMetaDataAssemblyEmit
+    HRESULT STDMETHODCALLTYPE DefineAssembly(const void* pbPublicKey, ULONG cbPublicKey, ULONG ulHashAlgId, LPCWSTR szName, const ASSEMBLYMETADATA* pMetaData, DWORD dwAssemblyFlags, mdAssembly* pma) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineAssemblyRef(const void* pbPublicKeyOrToken, ULONG cbPublicKeyOrToken, LPCWSTR szName, const ASSEMBLYMETADATA* pMetaData, const void* pbHashValue, ULONG cbHashValue, DWORD dwAssemblyRefFlags, mdAssemblyRef* pmdar) override;
+    HRESULT STDMETHODCALLTYPE DefineFile(LPCWSTR szName, const void* pbHashValue, ULONG cbHashValue, DWORD dwFileFlags, mdFile* pmdf) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineExportedType(LPCWSTR szName, mdToken tkImplementation, mdTypeDef tkTypeDef, DWORD dwExportedTypeFlags, mdExportedType* pmdct) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE DefineManifestResource(LPCWSTR szName, mdToken tkImplementation, DWORD dwOffset, DWORD dwResourceFlags, mdManifestResource* pmdmr) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetAssemblyProps(mdAssembly pma, const void* pbPublicKey, ULONG cbPublicKey, ULONG ulHashAlgId, LPCWSTR szName, const ASSEMBLYMETADATA* pMetaData, DWORD dwAssemblyFlags) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetAssemblyRefProps(mdAssemblyRef ar, const void* pbPublicKeyOrToken, ULONG cbPublicKeyOrToken, LPCWSTR szName, const ASSEMBLYMETADATA* pMetaData, const void* pbHashValue, ULONG cbHashValue, DWORD dwAssemblyRefFlags) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetFileProps(mdFile file, const void* pbHashValue, ULONG cbHashValue, DWORD dwFileFlags) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetExportedTypeProps(mdExportedType ct, mdToken tkImplementation, mdTypeDef tkTypeDef, DWORD dwExportedTypeFlags) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetManifestResourceProps(mdManifestResource mr, mdToken tkImplementation, DWORD dwOffset, DWORD dwResourceFlags) override { return E_NOTIMPL; }
+    LONG GetReferences() const
+    {
+        return references.load();
+    }
+
+private:
+    struct Enumeration
+    {
+        std::vector<mdToken> tokens;
+        size_t next;
+    };
+
+    HRESULT Enumerate(HCORENUM* phEnum, const std::vector<mdToken>* tokens, mdToken rTokens[], ULONG cMax, ULONG* pcTokens);
+    HRESULT Define(ULONG kind, mdToken parent, LPCWSTR name, mdToken table, mdToken* token);
+    static void CopyName(const RecordedName& name, LPWSTR buffer, ULONG bufferLength, ULONG* length);
+
+    const Recording* recording;
+    ModuleID moduleId;
+    ReplayDivergence* divergence;
+    std::atomic<LONG> references;
+    std::mutex definitionsLock;
+    std::map<RecordedDefinitionKey, size_t> definitionCounts;
+    std::map<RecordedDefinitionKey, mdToken> unrecordedTokens;
+    ULONG nextRid;
+    std::vector<mdToken> syntheticTypeDefs;
+    std::map<mdTypeDef, RecordedName> syntheticClassNames;
+    std::map<mdTypeDef, std::vector<mdToken>> syntheticMethods;
+    std::map<mdMethodDef, std::pair<mdTypeDef, const RecordedTarget*>> syntheticTargets;
+};
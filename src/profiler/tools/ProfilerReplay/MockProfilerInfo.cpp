@@ -0,0 +1,424 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "MockProfilerInfo.h"
+
+// The counter prologue loads the addresses of this process's counters with ldc.i8, and those move from one
+// process to the next, so the operand of an ldc.i8 found at the same offset in both bodies is not compared
+static bool IsSameBody(LPCBYTE written, const std::vector<BYTE>& expected)
+{
+    size_t i = 0;
+    while (i < expected.size())
+    {
+        if (written[i] == 0x21 && expected[i] == 0x21 && i + 9 <= expected.size())
+        {
+            i += 9;
+        }
+        else if (written[i] != expected[i])
+        {
+            return false;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    return true;
+}
+
+MockMethodMalloc::~MockMethodMalloc()
+{
+    for (auto& allocation : allocations)
+    {
+        delete[] allocation.first;
+    }
+}
+
+HRESULT STDMETHODCALLTYPE MockMethodMalloc::QueryInterface(REFIID riid, void** ppvObject)
+{
+    if (ppvObject == NULL)
+    {
+        return E_POINTER;
+    }
+
+    if (riid != IID_IUnknown)
+    {
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+
+    *ppvObject = this;
+    return S_OK;
+}
+
+ULONG STDMETHODCALLTYPE MockMethodMalloc::AddRef()
+{
+    return 1;
+}
+
+ULONG STDMETHODCALLTYPE MockMethodMalloc::Release()
+{
+    return 1;
+}
+
+PVOID STDMETHODCALLTYPE MockMethodMalloc::Alloc(ULONG cb)
+{
+    BYTE* allocation = new BYTE[cb];
+
+    std::lock_guard<std::mutex> guard(lock);
+    allocations[allocation] = cb;
+
+    return allocation;
+}
+
+ULONG MockMethodMalloc::GetSize(LPCBYTE allocation)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto found = allocations.find(allocation);
+    return found != allocations.end() ? found->second : 0;
+}
+
+MockProfilerInfo::MockProfilerInfo(const Recording* recording, ReplayDivergence* divergence) :
+    recording(recording), divergence(divergence), references(0), eventsLow(0), eventsHigh(0)
+{
+    // Every module the recording mentions gets its metadata up front, so lookups never write to the map
+    auto add = [this](ModuleID moduleId)
+    {
+        if (metaData.find(moduleId) == metaData.end())
+        {
+            metaData[moduleId] = new MockMetaData(this->recording, moduleId, this->divergence);
+        }
+    };
+
+    for (const RecordedEvent& event : recording->events)
+    {
+        if (event.type != RecordingJITCompilationStarted)
+        {
+            add(event.id);
+        }
+    }
+
+    for (auto& function : recording->functions)
+    {
+        add(function.second.moduleId);
+    }
+
+    for (auto& module : recording->modules)
+    {
+        add(module.first);
+    }
+}
+
+MockProfilerInfo::~MockProfilerInfo()
+{
+    for (auto& module : metaData)
+    {
+        delete module.second;
+    }
+}
+
+void MockProfilerInfo::CopyName(const RecordedName& name, WCHAR* buffer, ULONG bufferLength, ULONG* length)
+{
+    if (length != NULL)
+    {
+        *length = (ULONG)name.size() + 1;
+    }
+
+    if (buffer == NULL || bufferLength == 0)
+    {
+        return;
+    }
+
+    size_t copied = name.size() < bufferLength ? name.size() : bufferLength - 1;
+    memcpy(buffer, name.data(), copied * sizeof(WCHAR));
+    buffer[copied] = 0;
+}
+
+const RecordedFunction* MockProfilerInfo::FindFunction(FunctionID functionId)
+{
+    auto found = recording->functions.find(functionId & MockFunctionIdMask);
+    if (found == recording->functions.end())
+    {
+        divergence->unrecordedFunctions.fetch_add(1);
+        return NULL;
+    }
+
+    return &found->second;
+}
+
+MockMetaData* MockProfilerInfo::FindMetaData(ModuleID moduleId)
+{
+    auto found = metaData.find(moduleId);
+    return found != metaData.end() ? found->second : NULL;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::QueryInterface(REFIID riid, void** ppvObject)
+{
+    if (ppvObject == NULL)
+    {
+        return E_POINTER;
+    }
+
+    // Newer interfaces are refused, which turns off the features negotiated through them
+    if (riid == IID_IUnknown ||
+        riid == IID_ICorProfilerInfo ||
+        riid == IID_ICorProfilerInfo2 ||
+        riid == IID_ICorProfilerInfo3 ||
+        riid == IID_ICorProfilerInfo4 ||
+        riid == IID_ICorProfilerInfo5 ||
+        riid == IID_ICorProfilerInfo6 ||
+        riid == IID_ICorProfilerInfo7 ||
+        riid == IID_ICorProfilerInfo8)
+    {
+        *ppvObject = this;
+        AddRef();
+        return S_OK;
+    }
+
+    *ppvObject = NULL;
+    return E_NOINTERFACE;
+}
+
+ULONG STDMETHODCALLTYPE MockProfilerInfo::AddRef()
+{
+    return references.fetch_add(1) + 1;
+}
+
+ULONG STDMETHODCALLTYPE MockProfilerInfo::Release()
+{
+    return references.fetch_sub(1) - 1;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetEventMask(DWORD* pdwEvents)
+{
+    *pdwEvents = eventsLow;
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::SetEventMask(DWORD dwEvents)
+{
+    eventsLow = dwEvents;
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetEventMask2(DWORD* pdwEventsLow, DWORD* pdwEventsHigh)
+{
+    *pdwEventsLow = eventsLow;
+    *pdwEventsHigh = eventsHigh;
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::SetEventMask2(DWORD dwEventsLow, DWORD dwEventsHigh)
+{
+    eventsLow = dwEventsLow;
+    eventsHigh = dwEventsHigh;
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetCurrentThreadID(ThreadID* pThreadId)
+{
+    *pThreadId = (ThreadID)GetCurrentThreadId();
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetRuntimeInformation(USHORT* pClrInstanceId, COR_PRF_RUNTIME_TYPE* pRuntimeType, USHORT* pMajorVersion, USHORT* pMinorVersion, USHORT* pBuildNumber, USHORT* pQFEVersion, ULONG cchVersionString, ULONG* pcchVersionString, WCHAR szVersionString[])
+{
+    static const WCHAR Version[] = { '3', '.', '1', '.', '0', 0 };
+
+    *pClrInstanceId = 0;
+    *pRuntimeType = COR_PRF_CORE_CLR;
+    *pMajorVersion = 3;
+    *pMinorVersion = 1;
+    *pBuildNumber = 0;
+    *pQFEVersion = 0;
+    CopyName(RecordedName(Version), szVersionString, cchVersionString, pcchVersionString);
+
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetFunctionInfo(FunctionID functionId, ClassID* pClassId, ModuleID* pModuleId, mdToken* pToken)
+{
+    const RecordedFunction* function = FindFunction(functionId);
+    if (function == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    *pClassId = function->classId;
+    *pModuleId = function->moduleId;
+    *pToken = function->token;
+
+    return function->hr;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetTokenAndMetaDataFromFunction(FunctionID functionId, REFIID riid, IUnknown** ppImport, mdToken* pToken)
+{
+    const RecordedFunction* function = FindFunction(functionId);
+    MockMetaData* module = function != NULL ? FindMetaData(function->moduleId) : NULL;
+    if (module == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    *pToken = function->token;
+    return module->QueryInterface(riid, (void**)ppImport);
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetModuleInfo(ModuleID moduleId, LPCBYTE* ppBaseLoadAddress, ULONG cchName, ULONG* pcchName, WCHAR szName[], AssemblyID* pAssemblyId)
+{
+    DWORD moduleFlags = 0;
+    return GetModuleInfo2(moduleId, ppBaseLoadAddress, cchName, pcchName, szName, pAssemblyId, &moduleFlags);
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetModuleInfo2(ModuleID moduleId, LPCBYTE* ppBaseLoadAddress, ULONG cchName, ULONG* pcchName, WCHAR szName[], AssemblyID* pAssemblyId, DWORD* pdwModuleFlags)
+{
+    // Without an image the profiler falls back to IMetaDataImport, whose answers were recorded
+    if (ppBaseLoadAddress != NULL)
+    {
+        *ppBaseLoadAddress = NULL;
+    }
+
+    if (pdwModuleFlags != NULL)
+    {
+        *pdwModuleFlags = 0;
+    }
+
+    auto found = recording->modules.find(moduleId);
+    if (found == recording->modules.end())
+    {
+        // The module index asks for modules whose names were never needed while recording
+        CopyName(RecordedName(), szName, cchName, pcchName);
+        if (pAssemblyId != NULL)
+        {
+            *pAssemblyId = 0;
+        }
+
+        return S_OK;
+    }
+
+    const RecordedModule& module = found->second;
+    CopyName(module.name, szName, cchName, pcchName);
+    if (pAssemblyId != NULL)
+    {
+        *pAssemblyId = module.assemblyId;
+    }
+
+    return module.hr;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetAssemblyInfo(AssemblyID assemblyId, ULONG cchName, ULONG* pcchName, WCHAR szName[], AppDomainID* pAppDomainId, ModuleID* pModuleId)
+{
+    auto found = recording->assemblies.find(assemblyId);
+    if (found == recording->assemblies.end())
+    {
+        return E_INVALIDARG;
+    }
+
+    const RecordedAssembly& assembly = found->second;
+    CopyName(assembly.name, szName, cchName, pcchName);
+    if (pAppDomainId != NULL)
+    {
+        *pAppDomainId = assembly.appDomainId;
+    }
+
+    if (pModuleId != NULL)
+    {
+        *pModuleId = assembly.moduleId;
+    }
+
+    return assembly.hr;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetModuleMetaData(ModuleID moduleId, DWORD dwOpenFlags, REFIID riid, IUnknown** ppOut)
+{
+    MockMetaData* module = FindMetaData(moduleId);
+    if (module == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Besides the rewrite cache only the module index opens a module for reading, and a module it could not
+    // index must fail the same way again
+    if (riid == IID_IMetaDataImport)
+    {
+        auto indexed = recording->indexedModules.find(moduleId);
+        if (indexed == recording->indexedModules.end() || FAILED(indexed->second))
+        {
+            return E_FAIL;
+        }
+    }
+
+    return module->QueryInterface(riid, (void**)ppOut);
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetILFunctionBody(ModuleID moduleId, mdMethodDef methodId, LPCBYTE* ppMethodHeader, ULONG* pcbMethodSize)
+{
+    auto found = recording->bodies.find({ moduleId, methodId });
+    if (found == recording->bodies.end())
+    {
+        divergence->unrecordedBodies.fetch_add(1);
+        return E_INVALIDARG;
+    }
+
+    const RecordedBody& body = found->second;
+    if (FAILED(body.hr))
+    {
+        return body.hr;
+    }
+
+    // Bodies longer than a record were recorded without their bytes
+    if (body.body.empty())
+    {
+        divergence->unrecordedBodies.fetch_add(1);
+        return E_FAIL;
+    }
+
+    *ppMethodHeader = body.body.data();
+    *pcbMethodSize = body.methodSize;
+
+    return body.hr;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetILFunctionBodyAllocator(ModuleID moduleId, IMethodMalloc** ppMalloc)
+{
+    *ppMalloc = &methodMalloc;
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::SetILFunctionBody(ModuleID moduleId, mdMethodDef methodid, LPCBYTE pbNewILMethodHeader)
+{
+    auto found = recording->writtenBodies.find({ moduleId, methodid });
+
+    size_t write = 0;
+    {
+        std::lock_guard<std::mutex> guard(writesLock);
+        write = writes[{ moduleId, methodid }]++;
+    }
+
+    // Bodies are compared in the order each method was written, a method can be redirected and then counted
+    if (found == recording->writtenBodies.end() || write >= found->second.size())
+    {
+        divergence->unrecordedWrites.fetch_add(1);
+        return S_OK;
+    }
+
+    const RecordedBody& expected = found->second[write];
+    ULONG size = methodMalloc.GetSize(pbNewILMethodHeader);
+
+    if (expected.body.empty())
+    {
+        divergence->unrecordedBodies.fetch_add(1);
+    }
+    else if (size >= expected.body.size() && IsSameBody(pbNewILMethodHeader, expected.body))
+    {
+        divergence->bodiesMatched.fetch_add(1);
+    }
+    else
+    {
+        divergence->bodiesMismatched.fetch_add(1);
+    }
+
+    return expected.hr;
+}
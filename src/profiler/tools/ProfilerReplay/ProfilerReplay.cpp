@@ -0,0 +1,154 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Replays a recording made with AWS_XRAY_PROFILER_RECORD_PATH against the profiler's own sources, with
+// MockProfilerInfo answering in place of the runtime, and reports the callback rate and every rewritten
+// body that differs from the one recorded. The profiler reads its settings from the environment as usual.
+// Usage: ProfilerReplay <recording> [--passes N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stdafx.h"
+#include "Clock.h"
+#include "CorProfiler.h"
+#include "ModuleIndex.h"
+#include "MockProfilerInfo.h"
+#include "Recording.h"
+
+#define ReplayIndexTimeoutMilliseconds 5000
+
+// A JIT event recorded after a module was indexed has to see the bitmap, so the replay waits for the worker
+static void WaitForIndex(ModuleID moduleId)
+{
+    ULONGLONG started = GetTickCount64();
+
+    while (ModuleIndex::Lookup(moduleId, TokenFromRid(1, mdtMethodDef)) == ModuleIndexUnknown)
+    {
+        if (GetTickCount64() - started > ReplayIndexTimeoutMilliseconds)
+        {
+            fprintf(stderr, "module 0x%llx was not indexed within %ums\n", (unsigned long long)moduleId, ReplayIndexTimeoutMilliseconds);
+            return;
+        }
+
+        Sleep(1);
+    }
+}
+
+static ULONG64 ReplayPass(ICorProfilerCallback10* profiler, MockProfilerInfo* info, const Recording& recording, ULONG pass)
+{
+    ULONG64 callbacks = 0;
+
+    for (const RecordedEvent& event : recording.events)
+    {
+        // The runtime only calls back for the events the profiler currently asks for
+        DWORD eventsLow = 0;
+        DWORD eventsHigh = 0;
+        info->GetEventMask2(&eventsLow, &eventsHigh);
+
+        switch (event.type)
+        {
+        case RecordingModuleLoadFinished:
+            if (pass == 0 && (eventsLow & COR_PRF_MONITOR_MODULE_LOADS))
+            {
+                profiler->ModuleLoadStarted(event.id);
+                profiler->ModuleLoadFinished(event.id, event.value);
+                callbacks += 2;
+            }
+            break;
+        case RecordingModuleUnloadStarted:
+            if (pass == 0 && (eventsLow & COR_PRF_MONITOR_MODULE_LOADS))
+            {
+                profiler->ModuleUnloadStarted(event.id);
+                profiler->ModuleUnloadFinished(event.id, S_OK);
+                callbacks += 2;
+            }
+            break;
+        case RecordingModuleIndexed:
+            if (pass == 0 && SUCCEEDED(event.value) && ModuleIndex::IsEnabled())
+            {
+                WaitForIndex(event.id);
+            }
+            break;
+        case RecordingJITCompilationStarted:
+            if (eventsLow & COR_PRF_MONITOR_JIT_COMPILATION)
+            {
+                FunctionID functionId = MockProfilerInfo::GetReplayedFunctionId(event.id, pass);
+                profiler->JITCompilationStarted(functionId, event.value);
+                profiler->JITCompilationFinished(functionId, S_OK, event.value);
+                callbacks += 2;
+            }
+            break;
+        }
+    }
+
+    return callbacks;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2 && !(argc == 4 && strcmp(argv[2], "--passes") == 0 && atoi(argv[3]) > 0))
+    {
+        fprintf(stderr, "Usage: ProfilerReplay <recording> [--passes N]\n");
+        return 1;
+    }
+
+#if defined(__linux__)
+    if (PAL_Initialize(argc, argv) != 0)
+    {
+        fprintf(stderr, "Unable to initialize the PAL\n");
+        return 1;
+    }
+#endif
+
+    ULONG passes = argc == 4 ? (ULONG)atoi(argv[3]) : 1;
+
+    Recording recording;
+    if (!recording.Load(argv[1]))
+    {
+        return 1;
+    }
+
+    printf("process %u, %zu events, %zu functions, %zu modules indexed\n",
+           recording.header.processId, recording.events.size(), recording.functions.size(), recording.indexedModules.size());
+
+    ReplayDivergence divergence = {};
+    MockProfilerInfo* info = new MockProfilerInfo(&recording, &divergence);
+    ICorProfilerCallback10* profiler = CreateCorProfiler();
+
+    HRESULT hr = profiler->Initialize(info);
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Initialize failed with 0x%08x\n", (unsigned int)hr);
+        return 1;
+    }
+
+    // The first pass replays the recorded startup, later ones JIT the same methods again under new ids
+    for (ULONG pass = 0; pass < passes; pass++)
+    {
+        LONG64 started = Clock::GetCounter();
+        ULONG64 callbacks = ReplayPass(profiler, info, recording, pass);
+        double seconds = (double)(Clock::GetCounter() - started) / Clock::GetFrequency();
+
+        printf("pass %u: %llu callbacks in %.3fms, %.0f callbacks/s\n",
+               pass, (unsigned long long)callbacks, seconds * 1000, seconds > 0 ? callbacks / seconds : 0);
+    }
+
+    profiler->Shutdown();
+    profiler->Release();
+
+    printf("bodies: %llu matched, %llu mismatched, %llu written without a recorded write, %llu not recorded\n",
+           (unsigned long long)divergence.bodiesMatched.load(), (unsigned long long)divergence.bodiesMismatched.load(),
+           (unsigned long long)divergence.unrecordedWrites.load(), (unsigned long long)divergence.unrecordedBodies.load());
+    printf("unrecorded: %llu definitions, %llu functions\n",
+           (unsigned long long)divergence.unrecordedDefinitions.load(), (unsigned long long)divergence.unrecordedFunctions.load());
+
+    if (info->GetReferences() != 0)
+    {
+        printf("ICorProfilerInfo8 still holds %d references\n", (int)info->GetReferences());
+    }
+
+    delete info;
+
+    return divergence.bodiesMismatched.load() == 0 ? 0 : 2;
+}
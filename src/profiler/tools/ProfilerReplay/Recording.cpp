@@ -0,0 +1,215 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+#include "Recording.h"
+
+// Names are recorded as UTF-16 code units, which is what WCHAR holds on every platform the profiler builds for
+static RecordedName ReadName(const BYTE* data, ULONG length)
+{
+    RecordedName name(length, 0);
+    memcpy(&name[0], data, length * sizeof(WCHAR));
+
+    return name;
+}
+
+bool Recording::Load(const char* path)
+{
+    FILE* input = fopen(path, "rb");
+    if (input == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return false;
+    }
+
+    if (fread(&header, sizeof(header), 1, input) != 1 ||
+        header.magic != RecordingMagic ||
+        header.formatVersion != RecordingFormatVersion)
+    {
+        fprintf(stderr, "%s is not a version %d profiler recording\n", path, RecordingFormatVersion);
+        fclose(input);
+        return false;
+    }
+
+    std::vector<BYTE> data(RecordingMaximumLength + 8);
+    RecordingRecord record;
+    ULONG64 offset = sizeof(header);
+
+    while (fread(&record, sizeof(record), 1, input) == 1)
+    {
+        ULONG padded = ((sizeof(record) + record.length + 7) & ~7UL) - sizeof(record);
+        if (record.length > RecordingMaximumLength || fread(data.data(), 1, padded, input) != padded)
+        {
+            fprintf(stderr, "%s is truncated at offset %llu\n", path, (unsigned long long)offset);
+            break;
+        }
+
+        if (!Read(record, data.data()))
+        {
+            fprintf(stderr, "%s has a malformed record of type %u at offset %llu\n", path, record.type, (unsigned long long)offset);
+            break;
+        }
+
+        offset += sizeof(record) + padded;
+    }
+
+    fclose(input);
+    return true;
+}
+
+bool Recording::Read(const RecordingRecord& record, const BYTE* data)
+{
+    ULONG length = record.length;
+
+    switch (record.type)
+    {
+    case RecordingModuleLoadFinished:
+    case RecordingModuleUnloadStarted:
+    {
+        const RecordingModulePayload* payload = (const RecordingModulePayload*)data;
+        if (length < sizeof(*payload))
+        {
+            return false;
+        }
+
+        events.push_back({ record.type, record.threadId, payload->moduleId, payload->hr });
+        return true;
+    }
+    case RecordingJITCompilationStarted:
+    {
+        const RecordingJITPayload* payload = (const RecordingJITPayload*)data;
+        if (length < sizeof(*payload))
+        {
+            return false;
+        }
+
+        events.push_back({ record.type, record.threadId, payload->functionId, payload->isSafeToBlock });
+        return true;
+    }
+    case RecordingFunctionInfo:
+    {
+        const RecordingFunctionInfoPayload* payload = (const RecordingFunctionInfoPayload*)data;
+        if (length < sizeof(*payload))
+        {
+            return false;
+        }
+
+        functions[payload->functionId] = { payload->classId, payload->moduleId, payload->token, payload->hr };
+        return true;
+    }
+    case RecordingModuleInfo:
+    {
+        const RecordingModuleInfoPayload* payload = (const RecordingModuleInfoPayload*)data;
+        if (length < sizeof(*payload) + payload->nameLength * sizeof(WCHAR))
+        {
+            return false;
+        }
+
+        modules[payload->moduleId] = { payload->assemblyId, payload->hr, ReadName(data + sizeof(*payload), payload->nameLength) };
+        return true;
+    }
+    case RecordingAssemblyInfo:
+    {
+        const RecordingAssemblyInfoPayload* payload = (const RecordingAssemblyInfoPayload*)data;
+        if (length < sizeof(*payload) + payload->nameLength * sizeof(WCHAR))
+        {
+            return false;
+        }
+
+        assemblies[payload->assemblyId] = { payload->appDomainId, payload->moduleId, payload->hr, ReadName(data + sizeof(*payload), payload->nameLength) };
+        return true;
+    }
+    case RecordingMethodProps:
+    {
+        const RecordingMethodPropsPayload* payload = (const RecordingMethodPropsPayload*)data;
+        ULONG nameSize = payload->nameLength * sizeof(WCHAR);
+        if (length < sizeof(*payload) + nameSize + payload->signatureLength)
+        {
+            return false;
+        }
+
+        const BYTE* signature = data + sizeof(*payload) + nameSize;
+        methods[{ payload->moduleId, payload->token }] = { payload->classToken, payload->attributes, payload->implFlags, payload->hr,
+                                                           ReadName(data + sizeof(*payload), payload->nameLength),
+                                                           std::vector<BYTE>(signature, signature + payload->signatureLength) };
+        return true;
+    }
+    case RecordingTypeDefProps:
+    {
+        const RecordingTypeDefPropsPayload* payload = (const RecordingTypeDefPropsPayload*)data;
+        if (length < sizeof(*payload) + payload->nameLength * sizeof(WCHAR))
+        {
+            return false;
+        }
+
+        typeDefs[{ payload->moduleId, payload->typeDef }] = { payload->flags, payload->extends, payload->hr, ReadName(data + sizeof(*payload), payload->nameLength) };
+        return true;
+    }
+    case RecordingILFunctionBody:
+    {
+        const RecordingILFunctionBodyPayload* payload = (const RecordingILFunctionBodyPayload*)data;
+        if (length < sizeof(*payload) + payload->bodyLength)
+        {
+            return false;
+        }
+
+        const BYTE* body = data + sizeof(*payload);
+        bodies[{ payload->moduleId, payload->token }] = { payload->hr, payload->methodSize, std::vector<BYTE>(body, body + payload->bodyLength) };
+        return true;
+    }
+    case RecordingSetILFunctionBody:
+    {
+        const RecordingSetILFunctionBodyPayload* payload = (const RecordingSetILFunctionBodyPayload*)data;
+        if (length < sizeof(*payload) + payload->bodyLength)
+        {
+            return false;
+        }
+
+        const BYTE* body = data + sizeof(*payload);
+        writtenBodies[{ payload->moduleId, payload->token }].push_back({ payload->hr, payload->bodyLength, std::vector<BYTE>(body, body + payload->bodyLength) });
+        return true;
+    }
+    case RecordingDefinition:
+    {
+        const RecordingDefinitionPayload* payload = (const RecordingDefinitionPayload*)data;
+        if (length < sizeof(*payload) + payload->nameLength * sizeof(WCHAR) + payload->blobLength)
+        {
+            return false;
+        }
+
+        RecordedDefinitionKey key(payload->moduleId, payload->kind, payload->parent, ReadName(data + sizeof(*payload), payload->nameLength));
+        definitions[key].push_back({ payload->token, payload->hr });
+        return true;
+    }
+    case RecordingIndexTarget:
+    {
+        const RecordingIndexTargetPayload* payload = (const RecordingIndexTargetPayload*)data;
+        ULONG nameSize = payload->nameLength * sizeof(WCHAR);
+        if (length < sizeof(*payload) + nameSize + payload->classNameLength * sizeof(WCHAR))
+        {
+            return false;
+        }
+
+        targets[payload->moduleId].push_back({ payload->token,
+                                               ReadName(data + sizeof(*payload) + nameSize, payload->classNameLength),
+                                               ReadName(data + sizeof(*payload), payload->nameLength) });
+        return true;
+    }
+    case RecordingModuleIndexed:
+    {
+        const RecordingModuleIndexedPayload* payload = (const RecordingModuleIndexedPayload*)data;
+        if (length < sizeof(*payload))
+        {
+            return false;
+        }
+
+        // Replayed in order, so the JIT events recorded after it see the module indexed
+        indexedModules[payload->moduleId] = payload->hr;
+        events.push_back({ record.type, record.threadId, payload->moduleId, payload->hr });
+        return true;
+    }
+    default:
+        // Records the mocks have no use for are stepped over
+        return true;
+    }
+}
@@ -0,0 +1,123 @@
+// Copyright (c) .NET Foundation and contributors. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "cor.h"
+#include "corprof.h"
+#include "RecordingFormat.h"
+
+typedef std::basic_string<WCHAR> RecordedName;
+typedef std::pair<ModuleID, mdToken> RecordedTokenKey;
+typedef std::tuple<ModuleID, ULONG, mdToken, RecordedName> RecordedDefinitionKey; // module, kind, parent, name
+
+typedef struct
+{
+    uint16_t type;
+    uint32_t threadId;
+    uint64_t id;   // module of module events, function of JIT events
+    int32_t value; // hrStatus of module events, isSafeToBlock of JIT events
+} RecordedEvent;
+
+typedef struct
+{
+    ClassID classId;
+    ModuleID moduleId;
+    mdToken token;
+    HRESULT hr;
+} RecordedFunction;
+
+typedef struct
+{
+    AssemblyID assemblyId;
+    HRESULT hr;
+    RecordedName name;
+} RecordedModule;
+
+typedef struct
+{
+    AppDomainID appDomainId;
+    ModuleID moduleId;
+    HRESULT hr;
+    RecordedName name;
+} RecordedAssembly;
+
+typedef struct
+{
+    mdTypeDef classToken;
+    DWORD attributes;
+    DWORD implFlags;
+    HRESULT hr;
+    RecordedName name;
+    std::vector<BYTE> signature;
+} RecordedMethod;
+
+typedef struct
+{
+    DWORD flags;
+    mdToken extends;
+    HRESULT hr;
+    RecordedName name;
+} RecordedTypeDef;
+
+typedef struct
+{
+    HRESULT hr;
+    ULONG methodSize;
+    std::vector<BYTE> body; // empty when the body was too long to record
+} RecordedBody;
+
+typedef struct
+{
+    mdToken token;
+    HRESULT hr;
+} RecordedDefinition;
+
+typedef struct
+{
+    mdMethodDef token;
+    RecordedName className;
+    RecordedName methodName;
+} RecordedTarget;
+
+// Where a replay parted from the recording. The mocks count here instead of failing the call, so one
+// divergence does not hide the ones after it.
+typedef struct
+{
+    std::atomic<ULONG64> bodiesMatched;
+    std::atomic<ULONG64> bodiesMismatched;
+    std::atomic<ULONG64> unrecordedWrites;
+    std::atomic<ULONG64> unrecordedBodies;
+    std::atomic<ULONG64> unrecordedDefinitions;
+    std::atomic<ULONG64> unrecordedFunctions;
+} ReplayDivergence;
+
+// A recording written by the profiler's Recorder, split into the callbacks to replay in order and the
+// runtime's answers keyed the way the mocks are asked for them. Nothing changes after Load, so any
+// number of threads can replay against the same recording.
+class Recording
+{
+public:
+    bool Load(const char* path);
+
+    RecordingHeader header;
+    std::vector<RecordedEvent> events;
+    std::map<FunctionID, RecordedFunction> functions;
+    std::map<ModuleID, RecordedModule> modules;
+    std::map<AssemblyID, RecordedAssembly> assemblies;
+    std::map<RecordedTokenKey, RecordedMethod> methods;
+    std::map<RecordedTokenKey, RecordedTypeDef> typeDefs;
+    std::map<RecordedTokenKey, RecordedBody> bodies;
+    std::map<RecordedTokenKey, std::vector<RecordedBody>> writtenBodies; // in the order they were written
+    std::map<RecordedDefinitionKey, std::vector<RecordedDefinition>> definitions; // in the order they were made
+    std::map<ModuleID, std::vector<RecordedTarget>> targets;
+    std::map<ModuleID, HRESULT> indexedModules;
+
+private:
+    bool Read(const RecordingRecord& record, const BYTE* data);
+};
@@ -72,6 +72,11 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
 
         private void OnEventStart(object value)
         {
+            if (!Initialize.IsTracingEnabled)
+            {
+                return;
+            }
+
             var context = AgentUtil.FetchPropertyUsingReflection(value, "HttpContext");
             if (context is HttpContext httpContext)
             {
@@ -81,8 +86,9 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
 
         private void OnEventStop(object value)
         {
+            // A request that started before tracing was enabled has no segment to end
             var context = AgentUtil.FetchPropertyUsingReflection(value, "HttpContext");
-            if (context is HttpContext httpContext)
+            if (context is HttpContext httpContext && AWSXRayRecorder.Instance.TraceContext.IsEntityPresent())
             {
                 AspNetCoreRequestUtil.ProcessResponse(httpContext);
             }
@@ -92,7 +98,7 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
         {
             // The value passed in is not castable, use fetch from reflection.
             var exc = AgentUtil.FetchPropertyUsingReflection(value, "Exception"); 
-            if (exc is Exception exception)
+            if (exc is Exception exception && AWSXRayRecorder.Instance.TraceContext.IsEntityPresent())
             {
                 AspNetCoreRequestUtil.ProcessException(exception);
             }
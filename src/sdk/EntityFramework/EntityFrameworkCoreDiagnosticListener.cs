@@ -20,6 +20,7 @@ using Amazon.Runtime.Internal.Util;
 using Amazon.XRay.Recorder.AutoInstrumentation.Utils;
 using Microsoft.EntityFrameworkCore.Diagnostics;
 using System;
+using System.Collections.Concurrent;
 using System.Collections.Generic;
 using System.Data.Common;
 
@@ -34,6 +35,9 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
         
         internal override string Name => "Microsoft.EntityFrameworkCore";
 
+        // Commands that started before tracing was enabled have no subsegment to end
+        private static readonly ConcurrentDictionary<DbCommand, object> CurrentDbCommands = new ConcurrentDictionary<DbCommand, object>();
+
         protected override void OnEvent(KeyValuePair<string, object> value)
         {            
 
@@ -66,8 +70,13 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
 
         private void OnEventStart(object value)
         {
+            if (!Initialize.IsTracingEnabled)
+            {
+                return;
+            }
+
             var command = ((CommandEventData)value).Command;
-            if (command is DbCommand dbCommand)
+            if (command is DbCommand dbCommand && CurrentDbCommands.TryAdd(dbCommand, null))
             {
                 SqlRequestUtil.BeginSubsegment(dbCommand);
                 SqlRequestUtil.ProcessCommand(dbCommand);
@@ -77,7 +86,7 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
         private void OnEventStop(object value)
         {
             var command = ((CommandExecutedEventData)value).Command;
-            if (command is DbCommand dbCommand)
+            if (command is DbCommand dbCommand && CurrentDbCommands.TryRemove(dbCommand, out _))
             {
                 SqlRequestUtil.EndSubsegment();
             }
@@ -85,8 +94,9 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
 
         private void OnEventException(object value)
         {
+            var command = ((CommandErrorEventData)value).Command;
             var exc = ((CommandErrorEventData)value).Exception;
-            if (exc is Exception exception)
+            if (command is DbCommand dbCommand && exc is Exception exception && CurrentDbCommands.TryRemove(dbCommand, out _))
             {
                 SqlRequestUtil.ProcessException(exception);
                 SqlRequestUtil.EndSubsegment();
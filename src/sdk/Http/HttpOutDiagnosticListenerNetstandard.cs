@@ -68,6 +68,11 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
 
         private void OnEventStart(object value)
         {
+            if (!Initialize.IsTracingEnabled)
+            {
+                return;
+            }
+
             // The value passed in is not castable, use fetch from reflection instead.
             var request = AgentUtil.FetchPropertyUsingReflection(value, "Request");
             if (request is HttpRequestMessage httpRequestMessage)
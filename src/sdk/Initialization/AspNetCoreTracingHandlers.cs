@@ -16,6 +16,7 @@
 //-----------------------------------------------------------------------------
 
 #if !NET45
+using Amazon.XRay.Recorder.AutoInstrumentation.Utils;
 using System.Collections.Generic;
 using System.Diagnostics;
 
@@ -38,6 +39,8 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
 
             var serviceName = xrayAutoInstrumentationOptions.ServiceName;
 
+            StartupTimelineUtil.Initialize(xrayAutoInstrumentationOptions.DaemonAddress);
+
             var subscriptions = new List<DiagnosticListenerBase>();
 
             // Subscribe diagnostic listener for tracing Asp.Net Core request
@@ -61,13 +64,14 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
                 subscriptions.Add(new EntityFrameworkCoreDiagnosticListener());
             }
 
-            DiagnosticListener.AllListeners.Subscribe(new DiagnosticListenerObserver(subscriptions));
-            
             // Enable tracing for AWS request
             if (xrayAutoInstrumentationOptions.TraceAWSRequests)
             {
                 AWSSDKRequestRegister.Register();
             }
+
+            // Subscribe last, so that every listener starts receiving events at once
+            DiagnosticListener.AllListeners.Subscribe(new DiagnosticListenerObserver(subscriptions));
         }
     }
 }
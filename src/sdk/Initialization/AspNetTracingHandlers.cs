@@ -42,7 +42,15 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
 
             if (options.TraceSqlRequests)
             {
-                _ = new SqlEventListener();
+                // The profiler's redirected calls time commands without the event source's payloads
+                if (SqlCommandHooks.IsRequested())
+                {
+                    SqlCommandHooks.Enable();
+                }
+                else
+                {
+                    _ = new SqlEventListener();
+                }
             }
             
             if (options.TraceEFRequests)
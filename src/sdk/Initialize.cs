@@ -16,6 +16,10 @@
 //-----------------------------------------------------------------------------
 
 #if !NET45
+using Amazon.Runtime.Internal.Util;
+using System;
+using System.Threading;
+
 namespace Amazon.XRay.Recorder.AutoInstrumentation
 {
     /// <summary>
@@ -23,9 +27,54 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
     /// </summary>
     public static class Initialize
     {
+        private const int NotStarted = 0;
+        private const int Started = 1;
+
+        private static int _state = NotStarted;
+        private static int _tracingEnabled;
+
+        /// <summary>
+        /// True once every tracing handler and listener is registered. The listeners start tracing a request,
+        /// call or command only after this, so none is traced halfway while the deferred registration runs.
+        /// </summary>
+        internal static bool IsTracingEnabled => Volatile.Read(ref _tracingEnabled) != 0;
+
+        /// <summary>
+        /// Called by the profiler at the top of Main, registers tracing before the application starts.
+        /// </summary>
         public static void AddXRay()
         {
+            if (Interlocked.CompareExchange(ref _state, Started, NotStarted) != NotStarted)
+            {
+                return;
+            }
+
             AspNetCoreTracingHandlers.Initialize();
+            Volatile.Write(ref _tracingEnabled, 1);
+        }
+
+        /// <summary>
+        /// Called by the profiler at the top of Main in the deferred bootstrap mode. Queues the registration
+        /// and returns at once, so the dependencies of the handlers load on a pool thread instead of ahead of
+        /// the application's own startup. Requests served before the registration completes are not traced.
+        /// </summary>
+        public static void AddXRayDeferred()
+        {
+            // Nothing here may touch a type outside the core library, it would be loaded on the caller's thread
+            ThreadPool.UnsafeQueueUserWorkItem(InitializeInBackground, null);
+        }
+
+        private static void InitializeInBackground(object state)
+        {
+            try
+            {
+                AddXRay();
+            }
+            catch (Exception e)
+            {
+                // An exception escaping a pool thread would end the process
+                Logger.GetLogger(typeof(Initialize)).Error(e, "Failed to initialize X-Ray tracing in the background");
+            }
         }
     }
 }
@@ -0,0 +1,22 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="AssemblyInfo.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+using System.Runtime.CompilerServices;
+
+// The tests and benchmarks are signed with the same development key
+[assembly: InternalsVisibleTo("AWSXRayRecorder.AutoInstrumentation.Unittests, PublicKey=0024000004800000940000000602000000240000525341310004000001000100712913451f6deb158da1d2129b21119cca7d4eebeef5b310e8acd7f2d9506346071207652f1210a3bfa1545d6897a607fc3a515954e660ec6fc5797730022867514e58411e8ecd61c767a319d2c29facee20f5d4f42b5425f27518616a8f4c1e5ac0e3e2b407bd8786d1b360af6b49c2b987478fe76b124c72f4886455199df6")]
+[assembly: InternalsVisibleTo("AWSXRayRecorder.AutoInstrumentation.Benchmarks, PublicKey=0024000004800000940000000602000000240000525341310004000001000100712913451f6deb158da1d2129b21119cca7d4eebeef5b310e8acd7f2d9506346071207652f1210a3bfa1545d6897a607fc3a515954e660ec6fc5797730022867514e58411e8ecd61c767a319d2c29facee20f5d4f42b5425f27518616a8f4c1e5ac0e3e2b407bd8786d1b360af6b49c2b987478fe76b124c72f4886455199df6")]
@@ -0,0 +1,511 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="SqlCommandHooks.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#if NET45
+using Amazon.Runtime.Internal.Util;
+using Amazon.XRay.Recorder.AutoInstrumentation.Utils;
+using Amazon.XRay.Recorder.Core;
+using System;
+using System.Data;
+using System.Data.Common;
+using System.Data.SqlClient;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation
+{
+    /// <summary>
+    /// Hooks for the calls the profiler redirects when AWS_XRAY_PROFILER_SQL_COMMANDS is enabled. Every
+    /// call to an Execute method of SqlCommand, or of DbCommand on a SqlCommand, is timed by the profiler,
+    /// without the SqlEventListener's event payloads. The command comes first, the arguments follow.
+    /// A traced call takes a record from the profiler's pool as it starts and hands it back as it returns,
+    /// throws or its task completes; the profiler stamps both ends and the exception state. The subsegment
+    /// is written from the record once the command is done, so nothing is opened on the caller's trace
+    /// context while it runs, and an async call leaves the caller's context untouched.
+    /// </summary>
+    public static class SqlCommandHooks
+    {
+        private const string SqlCommandsVariable = "AWS_XRAY_PROFILER_SQL_COMMANDS";
+
+        private static readonly Logger _logger = Logger.GetLogger(typeof(SqlCommandHooks));
+
+        private const long TicksPerMicrosecond = TimeSpan.TicksPerMillisecond / 1000;
+
+        private static readonly DateTime UnixEpoch = new DateTime(1970, 1, 1, 0, 0, 0, DateTimeKind.Utc);
+
+        private static volatile bool _tracing;
+
+        /// <summary>
+        /// True when the profiler is asked to redirect SqlCommand calls to these hooks.
+        /// </summary>
+        internal static bool IsRequested()
+        {
+            var value = Environment.GetEnvironmentVariable(SqlCommandsVariable);
+            return value == "1" || string.Equals(value, "true", StringComparison.OrdinalIgnoreCase);
+        }
+
+        /// <summary>
+        /// Starts tracing redirected calls, until then they run untraced.
+        /// </summary>
+        internal static void Enable()
+        {
+            _tracing = true;
+        }
+
+        public static SqlDataReader ExecuteReader(SqlCommand command)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Return(record, command, command.ExecuteReader());
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static SqlDataReader ExecuteReader(SqlCommand command, CommandBehavior behavior)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Return(record, command, command.ExecuteReader(behavior));
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static DbDataReader ExecuteReader(DbCommand command)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Return(record, command, command.ExecuteReader());
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static DbDataReader ExecuteReader(DbCommand command, CommandBehavior behavior)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Return(record, command, command.ExecuteReader(behavior));
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static int ExecuteNonQuery(SqlCommand command)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Return(record, command, command.ExecuteNonQuery());
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static int ExecuteNonQuery(DbCommand command)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Return(record, command, command.ExecuteNonQuery());
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static object ExecuteScalar(SqlCommand command)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Return(record, command, command.ExecuteScalar());
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static object ExecuteScalar(DbCommand command)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Return(record, command, command.ExecuteScalar());
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<SqlDataReader> ExecuteReaderAsync(SqlCommand command)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteReaderAsync());
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<SqlDataReader> ExecuteReaderAsync(SqlCommand command, CancellationToken cancellationToken)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteReaderAsync(cancellationToken));
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<SqlDataReader> ExecuteReaderAsync(SqlCommand command, CommandBehavior behavior)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteReaderAsync(behavior));
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<SqlDataReader> ExecuteReaderAsync(SqlCommand command, CommandBehavior behavior, CancellationToken cancellationToken)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteReaderAsync(behavior, cancellationToken));
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<DbDataReader> ExecuteReaderAsync(DbCommand command)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteReaderAsync());
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<DbDataReader> ExecuteReaderAsync(DbCommand command, CancellationToken cancellationToken)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteReaderAsync(cancellationToken));
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<DbDataReader> ExecuteReaderAsync(DbCommand command, CommandBehavior behavior)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteReaderAsync(behavior));
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<DbDataReader> ExecuteReaderAsync(DbCommand command, CommandBehavior behavior, CancellationToken cancellationToken)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteReaderAsync(behavior, cancellationToken));
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<int> ExecuteNonQueryAsync(SqlCommand command)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteNonQueryAsync());
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<int> ExecuteNonQueryAsync(SqlCommand command, CancellationToken cancellationToken)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteNonQueryAsync(cancellationToken));
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<int> ExecuteNonQueryAsync(DbCommand command)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteNonQueryAsync());
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<int> ExecuteNonQueryAsync(DbCommand command, CancellationToken cancellationToken)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteNonQueryAsync(cancellationToken));
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<object> ExecuteScalarAsync(SqlCommand command)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteScalarAsync());
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<object> ExecuteScalarAsync(SqlCommand command, CancellationToken cancellationToken)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteScalarAsync(cancellationToken));
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<object> ExecuteScalarAsync(DbCommand command)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteScalarAsync());
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        public static Task<object> ExecuteScalarAsync(DbCommand command, CancellationToken cancellationToken)
+        {
+            uint record = Begin(command);
+            try
+            {
+                return Complete(record, command, command.ExecuteScalarAsync(cancellationToken));
+            }
+            catch (Exception e) when (Fail(record, command, e))
+            {
+                throw;
+            }
+        }
+
+        /// <summary>
+        /// Records a call that returned.
+        /// </summary>
+        private static T Return<T>(uint record, DbCommand command, T result)
+        {
+            if (record != 0)
+            {
+                End(record, command, null);
+            }
+
+            return result;
+        }
+
+        /// <summary>
+        /// Records a call that threw. Called from an exception filter, so the exception goes on unwinding
+        /// untouched.
+        /// </summary>
+        private static bool Fail(uint record, DbCommand command, Exception exception)
+        {
+            if (record != 0)
+            {
+                End(record, command, exception);
+            }
+
+            return false;
+        }
+
+        /// <summary>
+        /// Untraced calls hand back the command's own task, traced ones a task that records the call.
+        /// </summary>
+        internal static Task<T> Complete<T>(uint record, DbCommand command, Task<T> task)
+            => record == 0 ? task : CompleteAsync(record, command, task);
+
+        private static async Task<T> CompleteAsync<T>(uint record, DbCommand command, Task<T> task)
+        {
+            T result;
+
+            try
+            {
+                result = await task.ConfigureAwait(false);
+            }
+            catch (Exception e)
+            {
+                End(record, command, e);
+                throw;
+            }
+
+            End(record, command, null);
+            return result;
+        }
+
+        /// <summary>
+        /// Takes the profiler's record for a SqlCommand, 0 for other commands, when it is not traced or
+        /// when every record is in flight. Only reads the caller's trace context.
+        /// </summary>
+        private static uint Begin(DbCommand command)
+        {
+            if (!_tracing || !(command is SqlCommand) || !SqlRequestUtil.IsTraceable())
+            {
+                return 0;
+            }
+
+            try
+            {
+                return ProfilerExports.BeginXRaySqlCommand();
+            }
+            catch (Exception e) when (e is DllNotFoundException || e is EntryPointNotFoundException)
+            {
+                // Redirected calls come from the profiler, so only a direct call finds it missing
+                _tracing = false;
+                _logger.DebugFormat("The profiler is not loaded, Sql commands go untraced.");
+            }
+
+            return 0;
+        }
+
+        /// <summary>
+        /// Hands the record back to the profiler and writes the subsegment from the copy it returns.
+        /// </summary>
+        private static void End(uint record, DbCommand command, Exception exception)
+        {
+            try
+            {
+                int hr = ProfilerExports.EndXRaySqlCommand(record, exception != null, out SqlCommandRecord copy);
+                if (hr != ProfilerExports.S_OK)
+                {
+                    _logger.DebugFormat("Failed to end the record of a Sql command (0x{0:X8}).", hr);
+                    return;
+                }
+
+                Record(command, copy, exception);
+            }
+            catch (Exception e)
+            {
+                _logger.Error(e, "Failed to end the subsegment of a Sql command");
+            }
+        }
+
+        /// <summary>
+        /// Writes the subsegment of a finished command under the current entity, which is the caller's
+        /// again by then: the call returned to it, or the await resumed on the context it captured.
+        /// </summary>
+        internal static void Record(DbCommand command, SqlCommandRecord record, Exception exception)
+        {
+            SqlRequestUtil.BeginSubsegment(command, ToDateTime(record.StartMicroseconds));
+
+            try
+            {
+                if (record.Failed != 0 && exception != null)
+                {
+                    SqlRequestUtil.ProcessException(exception);
+                }
+
+                // A connection the command broke has no server version left to read
+                SqlRequestUtil.ProcessCommand(command);
+            }
+            catch (Exception e)
+            {
+                _logger.Error(e, "Failed to collect the Sql information of a command");
+            }
+            finally
+            {
+                SqlRequestUtil.EndSubsegment(ToDateTime(record.EndMicroseconds));
+            }
+        }
+
+        private static DateTime ToDateTime(long epochMicroseconds)
+            => UnixEpoch.AddTicks(epochMicroseconds * TicksPerMicrosecond);
+    }
+}
+#endif
@@ -83,6 +83,11 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation
 
         private void OnEventStart(object value)
         {
+            if (!Initialize.IsTracingEnabled)
+            {
+                return;
+            }
+
             // This class serves for tracing Sql command from both System.Data.SqlClient and Microsoft.Data.SqlClient and using fetch property works
             // fot both of these two cases 
             var command = AgentUtil.FetchPropertyUsingReflection(value, "Command");
@@ -244,6 +244,8 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation.Utils
                 _recorder.AddHttpInformation("response", responseAttributes);
             }
 
+            StartupTimelineUtil.ProcessRequestEnd(_recorder);
+
             if (AWSXRayRecorder.IsLambda())
             {
                 _recorder.EndSubsegment();
@@ -55,6 +55,7 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation.Utils
             var xrayAutoInstrumentationOptions = XRayConfiguration.Register();
 
             _recorder.SetDaemonAddress(xrayAutoInstrumentationOptions.DaemonAddress);
+            StartupTimelineUtil.Initialize(xrayAutoInstrumentationOptions.DaemonAddress);
 
             if (GetSegmentNamingStrategy() == null) // ensures only one time initialization among many HTTPApplication instances
             {
@@ -211,6 +212,8 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation.Utils
                 SetSamplingDecision(traceHeader); // extracts sampling decision from the available segment
             }
 
+            StartupTimelineUtil.ProcessRequestEnd(_recorder);
+
             _recorder.EndSegment();
             // if the sample decision is requested, add the trace header to response
             if (isSampleDecisionRequested)
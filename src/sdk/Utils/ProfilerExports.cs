@@ -0,0 +1,60 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="ProfilerExports.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+using System.Runtime.InteropServices;
+using System.Security;
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation.Utils
+{
+    /// <summary>
+    /// Exports of the profiler library the agent calls. The library is the one the runtime loaded as the
+    /// profiler, so a process started without it throws <see cref="System.DllNotFoundException"/>.
+    /// </summary>
+    [SuppressUnmanagedCodeSecurity]
+    internal static class ProfilerExports
+    {
+        private const string Library = "ClrProfiler";
+
+        internal const int S_OK = 0;
+        internal const int E_NOT_SUFFICIENT_BUFFER = unchecked((int)0x8007007A);
+
+        [DllImport(Library, CallingConvention = CallingConvention.StdCall)]
+        internal static extern int CompleteXRayStartup();
+
+        [DllImport(Library, CallingConvention = CallingConvention.StdCall)]
+        internal static extern int EncodeXRayStartupSubsegment([MarshalAs(UnmanagedType.LPWStr)] string traceId, [MarshalAs(UnmanagedType.LPWStr)] string parentId,
+                                                               byte[] buffer, uint capacity, out uint written);
+
+        [DllImport(Library, CallingConvention = CallingConvention.StdCall)]
+        internal static extern uint BeginXRaySqlCommand();
+
+        [DllImport(Library, CallingConvention = CallingConvention.StdCall)]
+        internal static extern int EndXRaySqlCommand(uint record, [MarshalAs(UnmanagedType.Bool)] bool failed, out SqlCommandRecord copy);
+    }
+
+    /// <summary>
+    /// The profiler's SqlCommandRecord, field for field: when a command started and ended, in microseconds
+    /// since the Unix epoch on the clock of the segments, and whether it threw.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct SqlCommandRecord
+    {
+        public long StartMicroseconds;
+        public long EndMicroseconds;
+        public int Failed;
+    }
+}
@@ -54,6 +54,15 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation.Utils
             AWSXRayRecorder.Instance.SetNamespace("remote");
         }
 
+        /// <summary>
+        /// Begin subsegment at the given time and add name space.
+        /// </summary>
+        internal static void BeginSubsegment(DbCommand command, DateTime timestamp)
+        {
+            AWSXRayRecorder.Instance.BeginSubsegment(BuildSubsegmentName(command), timestamp);
+            AWSXRayRecorder.Instance.SetNamespace("remote");
+        }
+
         /// <summary>
         /// Process command.
         /// </summary>                                                                                                                                                                           
@@ -109,6 +118,14 @@ namespace Amazon.XRay.Recorder.AutoInstrumentation.Utils
             AWSXRayRecorder.Instance.EndSubsegment();
         }
 
+        /// <summary>
+        /// End subsegment at the given time.
+        /// </summary>
+        internal static void EndSubsegment(DateTime timestamp)
+        {
+            AWSXRayRecorder.Instance.EndSubsegment(timestamp);
+        }
+
         /// <summary>
         /// End subsegment and emit it to Daemon.
         /// </summary>
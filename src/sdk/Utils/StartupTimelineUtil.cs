@@ -0,0 +1,111 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="StartupTimelineUtil.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+using Amazon.Runtime.Internal.Util;
+using Amazon.XRay.Recorder.Core;
+using Amazon.XRay.Recorder.Core.Internal.Entities;
+using Amazon.XRay.Recorder.Core.Internal.Utils;
+using Amazon.XRay.Recorder.Core.Sampling;
+using System;
+using System.Net.Sockets;
+using System.Threading;
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation.Utils
+{
+    /// <summary>
+    /// Ends the profiler's startup timeline when the first request ends, and sends it as a "startup"
+    /// subsegment of that request's segment when the request is sampled.
+    /// </summary>
+    public static class StartupTimelineUtil
+    {
+        private const int InitialBufferLength = 2048;
+
+        private static readonly Logger _logger = Logger.GetLogger(typeof(StartupTimelineUtil));
+
+        private static string _daemonAddress;
+
+        private static int _completed;
+
+        /// <summary>
+        /// Sets the daemon address the subsegment is sent to, the one the recorder is configured with.
+        /// </summary>
+        internal static void Initialize(string daemonAddress)
+        {
+            _daemonAddress = daemonAddress;
+        }
+
+        /// <summary>
+        /// Called by the request handlers before the segment of a request ends. Only the first call does
+        /// anything; the timeline is complete once it returns.
+        /// </summary>
+        internal static void ProcessRequestEnd(AWSXRayRecorder recorder)
+        {
+            if (Volatile.Read(ref _completed) != 0 || Interlocked.Exchange(ref _completed, 1) != 0)
+            {
+                return;
+            }
+
+            try
+            {
+                // S_FALSE when the timeline is not enabled
+                if (ProfilerExports.CompleteXRayStartup() != ProfilerExports.S_OK || !recorder.TraceContext.IsEntityPresent())
+                {
+                    return;
+                }
+
+                var entity = recorder.TraceContext.GetEntity();
+                var segment = entity as Segment ?? entity.RootSegment;
+                if (segment == null || segment.Sampled != SampleDecision.Sampled || recorder.IsTracingDisabled())
+                {
+                    return;
+                }
+
+                var buffer = new byte[InitialBufferLength];
+                int hr = ProfilerExports.EncodeXRayStartupSubsegment(segment.TraceId, segment.Id, buffer, (uint)buffer.Length, out uint written);
+                if (hr == ProfilerExports.E_NOT_SUFFICIENT_BUFFER)
+                {
+                    buffer = new byte[written];
+                    hr = ProfilerExports.EncodeXRayStartupSubsegment(segment.TraceId, segment.Id, buffer, (uint)buffer.Length, out written);
+                }
+
+                if (hr != ProfilerExports.S_OK)
+                {
+                    _logger.DebugFormat("Failed to encode the startup subsegment (0x{0:X8}).", hr);
+                    return;
+                }
+
+                // The encoded document already carries the daemon's protocol header
+                using (var client = new UdpClient())
+                {
+                    client.Send(buffer, (int)written, DaemonConfig.GetEndPoint(_daemonAddress).UDPEndpoint);
+                }
+            }
+            catch (DllNotFoundException)
+            {
+                _logger.DebugFormat("The profiler is not loaded, there is no startup timeline to complete.");
+            }
+            catch (EntryPointNotFoundException)
+            {
+                _logger.DebugFormat("The loaded profiler has no startup timeline.");
+            }
+            catch (Exception e)
+            {
+                _logger.Error(e, "Failed to complete the startup timeline.");
+            }
+        }
+    }
+}
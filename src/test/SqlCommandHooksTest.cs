@@ -0,0 +1,170 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="SqlCommandHooksTest.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#if NET45
+using Amazon.XRay.Recorder.AutoInstrumentation.Unittests.Tools;
+using Amazon.XRay.Recorder.AutoInstrumentation.Utils;
+using Amazon.XRay.Recorder.Core;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using System;
+using System.Data;
+using System.Data.SqlClient;
+using System.Threading.Tasks;
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation.Unittests
+{
+    [TestClass]
+    public class SqlCommandHooksTest : TestBase
+    {
+        // Never opened, the hooks only read the names from it
+        private const string ConnectionString = "Data Source=sql.example.com,1433;Initial Catalog=orders;User ID=app;Password=secret";
+
+        private const string SubsegmentName = "orders@sql.example.com";
+
+        private static AWSXRayRecorder _recorder;
+
+        [TestInitialize]
+        public void TestInitialize()
+        {
+            _recorder = new AWSXRayRecorder();
+            AWSXRayRecorder.InitializeInstance(recorder: _recorder);
+        }
+
+        [TestCleanup]
+        public new void TestCleanup()
+        {
+            base.TestCleanup();
+            _recorder.Dispose();
+            _recorder = null;
+        }
+
+        [TestMethod]
+        public void TestCommandOfOtherProviderRunsUntraced()
+        {
+            var command = new MockDbCommand { Result = 42 };
+
+            _recorder.BeginSegment("SqlCommandHooks", TraceId);
+            var segment = _recorder.TraceContext.GetEntity();
+
+            Assert.AreEqual(42, SqlCommandHooks.ExecuteNonQuery(command));
+            Assert.AreEqual(42, SqlCommandHooks.ExecuteScalar(command));
+            Assert.AreEqual(42, SqlCommandHooks.ExecuteNonQueryAsync(command).Result);
+            Assert.AreEqual(42, SqlCommandHooks.ExecuteScalarAsync(command).Result);
+            Assert.IsNull(SqlCommandHooks.ExecuteReader(command, CommandBehavior.SingleRow));
+
+            _recorder.EndSegment();
+
+            Assert.AreEqual(5, command.ExecutedCount);
+            Assert.IsFalse(segment.IsSubsegmentsAdded);
+        }
+
+        [TestMethod]
+        public void TestCommandExceptionReachesCaller()
+        {
+            // A command without a connection throws before it reaches a server
+            var command = new SqlCommand("SELECT 1");
+
+            _recorder.BeginSegment("SqlCommandHooks", TraceId);
+
+            Assert.ThrowsException<InvalidOperationException>(() => SqlCommandHooks.ExecuteNonQuery(command));
+            Assert.ThrowsException<InvalidOperationException>(() => SqlCommandHooks.ExecuteReader(command));
+
+            _recorder.EndSegment();
+        }
+
+        [TestMethod]
+        public void TestCommandRunsUntracedWithoutProfiler()
+        {
+            // Called directly, with no profiler to hand out records
+            var command = new SqlCommand("SELECT 1");
+            SqlCommandHooks.Enable();
+
+            _recorder.BeginSegment("SqlCommandHooks", TraceId);
+            var segment = _recorder.TraceContext.GetEntity();
+
+            Assert.ThrowsException<InvalidOperationException>(() => SqlCommandHooks.ExecuteScalar(command));
+
+            Assert.IsFalse(segment.IsSubsegmentsAdded);
+            Assert.AreSame(segment, _recorder.TraceContext.GetEntity());
+
+            _recorder.EndSegment();
+        }
+
+        [TestMethod]
+        public void TestRecordWritesSubsegmentAfterTheFact()
+        {
+            // The command failed on its closed connection, which has no server version to read either
+            var command = new SqlCommand("SELECT 1", new SqlConnection(ConnectionString));
+            var exception = new InvalidOperationException("closed");
+            var record = new SqlCommandRecord { StartMicroseconds = 1600000000000000, EndMicroseconds = 1600000000250000, Failed = 1 };
+
+            _recorder.BeginSegment("SqlCommandHooks", TraceId);
+            var segment = _recorder.TraceContext.GetEntity();
+
+            SqlCommandHooks.Record(command, record, exception);
+
+            Assert.AreEqual(1, segment.Subsegments.Count);
+            var subsegment = segment.Subsegments[0];
+            Assert.AreEqual(SubsegmentName, subsegment.Name);
+            Assert.AreEqual("remote", subsegment.Namespace);
+            Assert.AreEqual("sqlserver", subsegment.Sql["database_type"]);
+
+            // Timed by the profiler's record, not by when the subsegment was written
+            Assert.AreEqual(1600000000.0, subsegment.StartTime, 1e-6);
+            Assert.AreEqual(1600000000.25, subsegment.EndTime, 1e-6);
+            Assert.IsFalse(subsegment.IsInProgress);
+            Assert.IsTrue(subsegment.HasFault);
+            Assert.AreEqual(exception.Message, subsegment.Cause.ExceptionDescriptors[0].Message);
+            Assert.AreSame(segment, _recorder.TraceContext.GetEntity());
+
+            _recorder.EndSegment();
+        }
+
+        [TestMethod]
+        public void TestRecordAfterAwaitLeavesCallerContext()
+        {
+            var command = new SqlCommand("SELECT 1", new SqlConnection(ConnectionString));
+            var record = new SqlCommandRecord { StartMicroseconds = 1600000000000000, EndMicroseconds = 1600000000001000 };
+
+            _recorder.BeginSegment("SqlCommandHooks", TraceId);
+            var segment = _recorder.TraceContext.GetEntity();
+
+            // As a completed async command is recorded: on a pool thread, in the context the caller's call captured
+            Task.Run(async () =>
+            {
+                await Task.Yield();
+                SqlCommandHooks.Record(command, record, null);
+            }).Wait();
+
+            Assert.AreEqual(1, segment.Subsegments.Count);
+            Assert.IsFalse(segment.Subsegments[0].IsInProgress);
+            Assert.IsFalse(segment.Subsegments[0].HasFault);
+            Assert.AreSame(segment, _recorder.TraceContext.GetEntity());
+
+            _recorder.EndSegment();
+        }
+
+        [TestMethod]
+        public void TestUntracedAsyncCommandKeepsItsTask()
+        {
+            var command = new TaskCompletionSource<int>();
+
+            Assert.AreSame(command.Task, SqlCommandHooks.Complete(0, new SqlCommand(), command.Task));
+        }
+    }
+}
+#endif
@@ -0,0 +1,81 @@
+﻿//-----------------------------------------------------------------------------
+// <copyright file="MockDbCommand.cs" company="Amazon.com">
+//      Copyright 2020 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+//      Licensed under the Apache License, Version 2.0 (the "License").
+//      You may not use this file except in compliance with the License.
+//      A copy of the License is located at
+//
+//      http://aws.amazon.com/apache2.0
+//
+//      or in the "license" file accompanying this file. This file is distributed
+//      on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+//      express or implied. See the License for the specific language governing
+//      permissions and limitations under the License.
+// </copyright>
+//-----------------------------------------------------------------------------
+
+#if NET45
+using System.Data;
+using System.Data.Common;
+
+namespace Amazon.XRay.Recorder.AutoInstrumentation.Unittests.Tools
+{
+    /// <summary>
+    /// Command of a provider other than SqlClient, answering every query with the same value.
+    /// </summary>
+    public class MockDbCommand : DbCommand
+    {
+        public int Result { get; set; }
+
+        public int ExecutedCount { get; private set; }
+
+        public override string CommandText { get; set; }
+
+        public override int CommandTimeout { get; set; }
+
+        public override CommandType CommandType { get; set; }
+
+        public override bool DesignTimeVisible { get; set; }
+
+        public override UpdateRowSource UpdatedRowSource { get; set; }
+
+        protected override DbConnection DbConnection { get; set; }
+
+        protected override DbParameterCollection DbParameterCollection => null;
+
+        protected override DbTransaction DbTransaction { get; set; }
+
+        public override void Cancel()
+        {
+        }
+
+        public override int ExecuteNonQuery()
+        {
+            ExecutedCount++;
+            return Result;
+        }
+
+        public override object ExecuteScalar()
+        {
+            ExecutedCount++;
+            return Result;
+        }
+
+        public override void Prepare()
+        {
+        }
+
+        protected override DbParameter CreateDbParameter()
+        {
+            return null;
+        }
+
+        protected override DbDataReader ExecuteDbDataReader(CommandBehavior behavior)
+        {
+            ExecutedCount++;
+            return null;
+        }
+    }
+}
+#endif